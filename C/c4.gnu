@@ -70,6 +70,7 @@ CBL {
 		c4doc_selectFirstPossibleAncestorOf;
 		c4doc_selectNextPossibleAncestorOf;
 		c4doc_put;
+		c4doc_putBatch;
 		c4doc_create;
 		c4doc_update;
 		c4doc_resolveConflict;
@@ -88,6 +89,7 @@ CBL {
 		c4db_enumerateAllDocs;
 		c4db_createIndex;
 		c4db_deleteIndex;
+		c4db_getIndexBuildProgress;
 		c4db_getIndexes;
 		c4enum_next;
 		c4enum_getDocumentInfo;
@@ -115,6 +117,7 @@ CBL {
 		c4blob_openStore;
 		c4blob_deleteStore;
 		c4blob_getSize;
+		c4blob_claim;
 		c4blob_getContents;
 		c4blob_getFilePath;
 		c4blob_openReadStream;
@@ -305,6 +308,7 @@ CBL {
 		c4db_createFleeceEncoder;
 		c4db_lock;
 		c4db_unlock;
+		c4db_setMaxBackgroundReaders;
 		c4db_getRemoteDBID;
 		c4db_exists;
 		c4db_startHousekeeping;
@@ -18,6 +18,7 @@
 
 #include "c4Internal.hh"
 #include "c4BlobStore.h"
+#include "c4Private.h"
 #include "c4Database.hh"
 #include "BlobStore.hh"
 
@@ -109,6 +110,16 @@ int64_t c4blob_getSize(C4BlobStore* store, C4BlobKey key) noexcept {
 }
 
 
+bool c4blob_claim(C4BlobStore* store, C4BlobKey key) noexcept {
+    try {
+        // Protect it first, so it can't be garbage-collected between checking and protecting:
+        store->protect(asInternal(key));
+        return store->has(asInternal(key));
+    } catchExceptions()
+    return false;
+}
+
+
 C4SliceResult c4blob_getContents(C4BlobStore* store, C4BlobKey key, C4Error* outError) noexcept {
     try {
         return C4SliceResult(store->get(asInternal(key)).contents());
@@ -21,6 +21,7 @@
 #include "c4Database.h"
 #include "c4Private.h"
 
+#include "BackgroundDB.hh"
 #include "Document.hh"
 #include "SQLiteDataFile.hh"
 #include "KeyStore.hh"
@@ -256,6 +257,13 @@ void c4db_unlock(C4Database *db) C4API {
 }
 
 
+void c4db_setMaxBackgroundReaders(C4Database *db, unsigned maxReaders) C4API {
+    tryCatch(nullptr, [&]{
+        db->backgroundDatabase()->setMaxReaders(maxReaders);
+    });
+}
+
+
 bool c4db_purgeDoc(C4Database *database, C4Slice docID, C4Error *outError) noexcept {
     try {
         if (database->purgeDocument(docID))
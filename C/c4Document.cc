@@ -32,6 +32,7 @@
 #include "RevTree.hh"   // only for kDefaultRemoteID
 #include "SecureRandomize.hh"
 #include "FleeceImpl.hh"
+#include <unordered_map>
 
 using namespace fleece::impl;
 
@@ -386,7 +387,7 @@ static bool isNewDocPutRequest(C4Database *database, const C4DocPutRequest *rq)
 
 
 // Tries to fulfil a PutRequest by creating a new Record. Returns null if one already exists.
-static Document* putNewDoc(C4Database *database, const C4DocPutRequest *rq)
+static Retained<Document> putNewDoc(C4Database *database, const C4DocPutRequest *rq)
 {
     DebugAssert(rq->save, "putNewDoc optimization works only if rq->save is true");
     Record record(rq->docID);
@@ -400,7 +401,37 @@ static Document* putNewDoc(C4Database *database, const C4DocPutRequest *rq)
         ok = idoc->putNewRevision(*rq);
     if (!ok)
         idoc = nullptr;
-    return retain(idoc.get());
+    return idoc;
+}
+
+
+// Checks whether a new revision can be added to a document as a child of `parentRevID`, and
+// selects the parent revision. Returns an error code, or 0 if OK.
+static int checkDocForPut(Document *idoc,
+                          C4Slice parentRevID,
+                          bool deleting,
+                          bool allowConflict)
+{
+    int code = 0;
+    if (parentRevID.buf) {
+        // Updating an existing revision; make sure it exists and is a leaf:
+        if (!idoc->exists())
+            code = kC4ErrorNotFound;
+        else if (!idoc->selectRevision(parentRevID, false))
+            code = allowConflict ? kC4ErrorNotFound : kC4ErrorConflict;
+        else if (!allowConflict && !(idoc->selectedRev.flags & kRevLeaf))
+            code = kC4ErrorConflict;
+    } else {
+        // No parent revision given:
+        if (deleting) {
+            // Didn't specify a revision to delete: NotFound or a Conflict, depending
+            code = ((idoc->flags & kDocExists) ?kC4ErrorConflict :kC4ErrorNotFound);
+        } else if ((idoc->flags & kDocExists) && !(idoc->selectedRev.flags & kDocDeleted)) {
+            // If doc exists, current rev must be a deletion or there will be a conflict:
+            code = kC4ErrorConflict;
+        }
+    }
+    return code;
 }
 
 
@@ -423,27 +454,7 @@ C4Document* c4doc_getForPut(C4Database *database,
         }
 
         Retained<Document> idoc = database->documentFactory().newDocumentInstance(docID);
-        int code = 0;
-
-        if (parentRevID.buf) {
-            // Updating an existing revision; make sure it exists and is a leaf:
-            if (!idoc->exists())
-                code = kC4ErrorNotFound;
-            else if (!idoc->selectRevision(parentRevID, false))
-                code = allowConflict ? kC4ErrorNotFound : kC4ErrorConflict;
-            else if (!allowConflict && !(idoc->selectedRev.flags & kRevLeaf))
-                code = kC4ErrorConflict;
-        } else {
-            // No parent revision given:
-            if (deleting) {
-                // Didn't specify a revision to delete: NotFound or a Conflict, depending
-                code = ((idoc->flags & kDocExists) ?kC4ErrorConflict :kC4ErrorNotFound);
-            } else if ((idoc->flags & kDocExists) && !(idoc->selectedRev.flags & kDocDeleted)) {
-                // If doc exists, current rev must be a deletion or there will be a conflict:
-                code = kC4ErrorConflict;
-            }
-        }
-
+        int code = checkDocForPut(idoc, parentRevID, deleting, allowConflict);
         if (code)
             recordError(LiteCoreDomain, code, outError);
         else
@@ -454,75 +465,148 @@ C4Document* c4doc_getForPut(C4Database *database,
 }
 
 
-C4Document* c4doc_put(C4Database *database,
-                      const C4DocPutRequest *rq,
-                      size_t *outCommonAncestorIndex,
-                      C4Error *outError) noexcept
-{
-    if (!database->mustBeInTransaction(outError))
-        return nullptr;
+// Checks the parameters of a C4DocPutRequest.
+static bool checkPutRequest(const C4DocPutRequest *rq, C4Error *outError) noexcept {
     if (rq->docID.buf && !Document::isValidDocID(rq->docID)) {
         c4error_return(LiteCoreDomain, kC4ErrorBadDocID, C4STR("Invalid docID"), outError);
-        return nullptr;
+        return false;
     }
     if (rq->existingRevision || rq->historyCount > 0)
         if (!checkParam(rq->docID.buf, "Missing docID", outError))
-            return nullptr;
+            return false;
     if (rq->existingRevision) {
         if (!checkParam(rq->historyCount > 0, "No history", outError))
-            return nullptr;
+            return false;
     } else {
         if (!checkParam(rq->historyCount <= 1, "Too much history", outError))
-            return nullptr;
+            return false;
         if (!checkParam(rq->historyCount > 0 || !(rq->revFlags & kRevDeleted),
                         "Can't create a new already-deleted document", outError))
-            return nullptr;
+            return false;
     }
+    return true;
+}
 
-    int commonAncestorIndex = 0;
-    C4Document *doc = nullptr;
-    try {
-        if (rq->save && isNewDocPutRequest(database, rq)) {
-            // As an optimization, write the doc assuming there is no prior record in the db:
-            doc = putNewDoc(database, rq);
-            // If there's already a record, doc will be null, so we'll continue down regular path.
-        }
-        if (!doc) {
-            if (rq->existingRevision) {
-                // Insert existing revision:
-                doc = c4doc_get(database, rq->docID, false, outError);
-                if (!doc)
-                    return nullptr;
-                commonAncestorIndex = asInternal(doc)->putExistingRevision(*rq, outError);
-                if (commonAncestorIndex < 0) {
-                    c4doc_release(doc);
-                    return nullptr;
-                }
 
-            } else {
-                // Create new revision:
-                C4Slice parentRevID = kC4SliceNull;
-                if (rq->historyCount == 1)
-                    parentRevID = rq->history[0];
-                bool deletion = (rq->revFlags & kRevDeleted) != 0;
-                doc = c4doc_getForPut(database, rq->docID, parentRevID, deletion, rq->allowConflict,
-                                      outError);
-                if (!doc)
-                    return nullptr;
-                if (!asInternal(doc)->putNewRevision(*rq))
-                    commonAncestorIndex = -1;
-            }
+// The guts of c4doc_put. `idoc` is the current state of the document (possibly nonexistent) if
+// the caller already has it, else null to read it from the database. Returns the document with
+// the new revision selected, or null on error.
+static Retained<Document> putDocument(C4Database *database,
+                                      const C4DocPutRequest *rq,
+                                      Retained<Document> idoc,
+                                      int &commonAncestorIndex,
+                                      C4Error *outError)
+{
+    commonAncestorIndex = 0;
+    if (!idoc && rq->save && isNewDocPutRequest(database, rq)) {
+        // As an optimization, write the doc assuming there is no prior record in the db:
+        idoc = putNewDoc(database, rq);
+        // If there's already a record, doc will be null, so we'll continue down regular path.
+        if (idoc)
+            return idoc;
+    }
+
+    if (rq->existingRevision) {
+        // Insert existing revision:
+        if (!idoc)
+            idoc = database->documentFactory().newDocumentInstance(rq->docID);
+        commonAncestorIndex = idoc->putExistingRevision(*rq, outError);
+        if (commonAncestorIndex < 0)
+            return nullptr;
+
+    } else {
+        // Create new revision:
+        C4Slice parentRevID = kC4SliceNull;
+        if (rq->historyCount == 1)
+            parentRevID = rq->history[0];
+        bool deletion = (rq->revFlags & kRevDeleted) != 0;
+        if (!idoc) {
+            alloc_slice docID = rq->docID.buf ? alloc_slice(rq->docID) : createDocUUID();
+            idoc = database->documentFactory().newDocumentInstance(docID);
+        }
+        int code = checkDocForPut(idoc, parentRevID, deletion, rq->allowConflict);
+        if (code) {
+            recordError(LiteCoreDomain, code, outError);
+            return nullptr;
         }
+        if (!idoc->putNewRevision(*rq))
+            commonAncestorIndex = -1;
+    }
+
+    Assert(commonAncestorIndex >= 0, "Unexpected conflict in c4doc_put");
+    return idoc;
+}
+
 
-        Assert(commonAncestorIndex >= 0, "Unexpected conflict in c4doc_put");
+C4Document* c4doc_put(C4Database *database,
+                      const C4DocPutRequest *rq,
+                      size_t *outCommonAncestorIndex,
+                      C4Error *outError) noexcept
+{
+    if (!database->mustBeInTransaction(outError) || !checkPutRequest(rq, outError))
+        return nullptr;
+    try {
+        int commonAncestorIndex;
+        Retained<Document> doc = putDocument(database, rq, nullptr, commonAncestorIndex, outError);
+        if (!doc)
+            return nullptr;
         if (outCommonAncestorIndex)
             *outCommonAncestorIndex = commonAncestorIndex;
-        return doc;
+        return retain(doc.get());
+    } catchError(outError)
+    return nullptr;
+}
 
-    } catchError(outError) {
-        c4doc_release(doc);
-        return nullptr;
-    }
+
+bool c4doc_putBatch(C4Database *database,
+                    const C4DocPutRequest requests[],
+                    size_t count,
+                    C4DocPutResult results[],
+                    C4Error *outError) noexcept
+{
+    if (!database->mustBeInTransaction(outError))
+        return false;
+    return tryCatch<bool>(outError, [&]{
+        // Read all the existing documents in one pass. (Docs that don't exist yet are also
+        // instantiated, so putDocument won't look for them.) Each doc is cached here and reused
+        // by later requests in the batch for the same docID.
+        unordered_map<slice, Retained<Document>> docs;
+        vector<slice> docIDs;
+        for (size_t i = 0; i < count; ++i) {
+            slice docID = requests[i].docID;
+            if (docID.buf && docs.emplace(docID, nullptr).second)
+                docIDs.push_back(docID);
+        }
+        for (const Record &rec : database->defaultKeyStore().getMany(docIDs))
+            docs[rec.key()] = database->documentFactory().newDocumentInstance(rec);
+
+        for (size_t i = 0; i < count; ++i) {
+            C4DocPutRequest rq = requests[i];
+            rq.save = true;
+            C4DocPutResult &result = results[i];
+            result = {};
+            Retained<Document> doc;
+            if (checkPutRequest(&rq, &result.error)) {
+                Retained<Document> *cached = rq.docID.buf ? &docs[rq.docID] : nullptr;
+                try {
+                    Retained<Document> current;
+                    if (cached && *cached) {
+                        current = *cached;
+                        current->selectCurrentRevision();
+                    }
+                    int commonAncestorIndex;
+                    doc = putDocument(database, &rq, current, commonAncestorIndex, &result.error);
+                } catchError(&result.error)
+                if (cached)
+                    *cached = doc;      // after a failure this is null, so the doc will be re-read
+            }
+            if (doc) {
+                result.sequence = doc->selectedRev.sequence;
+                result.revFlags = doc->selectedRev.flags;
+            }
+        }
+        return true;
+    });
 }
 
 
@@ -17,6 +17,7 @@
 //
 
 #pragma once
+#include "c4BlobStore.h"
 #include "c4Document.h"
 #include "c4Replicator.h"
 
@@ -62,6 +63,15 @@ void c4db_lock(C4Database *db) C4API;
 /** Unlocks the mutex locked by c4db_lock. */
 void c4db_unlock(C4Database *db) C4API;
 
+/** Sets the maximum number of connections the database opens for running live queries in the
+    background. (The default is 4.) Queries on different connections can run in parallel. */
+void c4db_setMaxBackgroundReaders(C4Database *db C4NONNULL, unsigned maxReaders) C4API;
+
+/** Returns true if the blob exists, and if so keeps it from being garbage-collected for a while,
+    as though it had just been written. For a caller that skips writing a blob it already has,
+    because a document it's about to save references it. */
+bool c4blob_claim(C4BlobStore* C4NONNULL, C4BlobKey) C4API;
+
 /** Compiles a JSON query and returns the result set as JSON: an array with one item per result,
     and each result is an array of columns. */
 C4SliceResult c4db_rawQuery(C4Database *database C4NONNULL, C4String query, C4Error *outError) C4API;
@@ -33,7 +33,8 @@ using namespace litecore;
 using namespace fleece::impl;
 
 CBL_CORE_API const C4QueryOptions kC4DefaultQueryOptions = {
-    true    // rankFullText
+    true,   // rankFullText
+    false   // streaming
 };
 
 
@@ -220,10 +221,23 @@ bool c4db_createIndex(C4Database *database,
                                                 indexSpecJSON,
                                                 (IndexSpec::Type)indexType,
                                                 (const IndexSpec::Options*)indexOptions);
+        if (indexOptions && indexOptions->background)
+            database->startIndexBuilder();
     });
 }
 
 
+double c4db_getIndexBuildProgress(C4Database *database,
+                                  C4Slice name,
+                                  C4Error *outError) noexcept
+{
+    try {
+        return database->defaultKeyStore().indexBuildProgress(name);
+    } catchError(outError)
+    return -1.0;
+}
+
+
 bool c4db_deleteIndex(C4Database *database,
                       C4Slice name,
                       C4Error *outError) noexcept
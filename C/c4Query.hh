@@ -39,7 +39,14 @@ struct c4Query : public RefCounted, public fleece::InstanceCountedIn<c4Query>, L
     void setParameters(slice parameters)    {_parameters = parameters;}
 
     Retained<C4QueryEnumeratorImpl> createEnumerator(const C4QueryOptions *c4options, slice encodedParameters) {
-        Query::Options options(encodedParameters ? encodedParameters : _parameters);
+        bool streaming = c4options && c4options->streaming;
+        Query::Options options(encodedParameters ? encodedParameters : _parameters,
+                               0, 0, streaming);
+        unique_lock<recursive_mutex> lock;
+        if (streaming) {
+            // It'll begin a read transaction on the database's connection:
+            lock = unique_lock<recursive_mutex>(_database->clientMutex());
+        }
         return wrapEnumerator( _query->createEnumerator(&options) );
     }
 
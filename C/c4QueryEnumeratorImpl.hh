@@ -14,6 +14,7 @@
 #include "Query.hh"
 #include "InstanceCounted.hh"
 #include "RefCounted.hh"
+#include <mutex>
 
 using namespace std;
 using namespace litecore;
@@ -31,10 +32,16 @@ namespace c4Internal {
         ,_query(query)
         ,_enum(e)
         ,_hasFullText(_enum->hasFullText())
+        ,_streaming(_enum->options().streaming)
         {
             clearPublicFields();
         }
 
+        ~C4QueryEnumeratorImpl() {
+            auto lock = streamingLock();
+            _enum = nullptr;
+        }
+
         QueryEnumerator& enumerator() const {
             if (!_enum)
                 error::_throw(error::InvalidParameter, "Query enumerator has been closed");
@@ -42,10 +49,12 @@ namespace c4Internal {
         }
 
         int64_t getRowCount() const {
+            auto lock = streamingLock();
             return enumerator().getRowCount();
         }
 
         bool next() {
+            auto lock = streamingLock();
             if (!enumerator().next()) {
                 clearPublicFields();
                 return false;
@@ -55,6 +64,7 @@ namespace c4Internal {
         }
 
         void seek(int64_t rowIndex) {
+            auto lock = streamingLock();
             enumerator().seek(rowIndex);
             if (rowIndex >= 0)
                 populatePublicFields();
@@ -79,6 +89,7 @@ namespace c4Internal {
         }
 
         C4QueryEnumeratorImpl* refresh() {
+            auto lock = streamingLock();
             QueryEnumerator* newEnum = enumerator().refresh(_query);
             if (newEnum)
                 return retain(new C4QueryEnumeratorImpl(_database, _query, newEnum));
@@ -87,6 +98,7 @@ namespace c4Internal {
         }
 
         void close() noexcept {
+            auto lock = streamingLock();
             _enum = nullptr;
         }
 
@@ -95,10 +107,20 @@ namespace c4Internal {
         }
 
     private:
+        // A streaming enumerator steps a live statement, and holds a read transaction, on the
+        // database's own connection; it does so under the database's lock (c4db_lock) so it
+        // can't interleave with other threads' use of the connection.
+        unique_lock<recursive_mutex> streamingLock() const {
+            if (!_streaming)
+                return {};
+            return unique_lock<recursive_mutex>(_database->clientMutex());
+        }
+
         Retained<Database> _database;
         Retained<Query> _query;
         Retained<QueryEnumerator> _enum;
         bool _hasFullText;
+        bool _streaming;
     };
 
     
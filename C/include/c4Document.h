@@ -358,6 +358,33 @@ extern "C" {
                           size_t *outCommonAncestorIndex,
                           C4Error *outError) C4API;
 
+    /** The outcome of one request in a call to `c4doc_putBatch`. */
+    typedef struct {
+        C4SequenceNumber sequence;  ///< Sequence of the inserted revision, or 0 if it failed
+        C4RevisionFlags revFlags;   ///< Flags of the inserted revision (e.g. kRevIsConflict)
+        C4Error error;              ///< The error, if the request failed
+    } C4DocPutResult;
+
+    /** Performs a series of Put operations, as though by calling `c4doc_put` on each request
+        in order and saving the document. (The requests' `save` fields are ignored.)
+        This is much faster than separate calls when importing or pulling many documents: the
+        existing documents are all read with one query, and a document that's the target of
+        several requests is only read once.
+        Must be called within a transaction. The failure of one request doesn't stop the
+        others; its error is stored in the corresponding result.
+        @param database  The database to save to.
+        @param requests  An array of put requests.
+        @param count  The number of requests.
+        @param results  An array of `count` results, which will be filled in.
+        @param outError  On failure of the entire batch, the error will be stored here.
+        @return  True if the requests were processed (though some may have failed), false if
+                 the batch as a whole failed. */
+    bool c4doc_putBatch(C4Database *database C4NONNULL,
+                        const C4DocPutRequest requests[],
+                        size_t count,
+                        C4DocPutResult results[],
+                        C4Error *outError) C4API;
+
     /** Convenience function to create a new document. This just a wrapper around c4doc_put.
         If the document already exists, it will fail with the error kC4ErrorConflict.
         @param db  The database to create the document in
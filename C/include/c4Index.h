@@ -68,6 +68,15 @@ extern "C" {
             To provide a custom list of words, use a string containing the words in lowercase
             separated by spaces. */
         const char *stopWords;
+
+        /** If true, `c4db_createIndex` returns without indexing the existing documents; they're
+            added in the background, in small transactions that don't block other writers for
+            long. Documents saved in the meantime are indexed as usual. The index isn't used by
+            queries until it's complete (see `c4db_getIndexBuildProgress`); until then, a query
+            that requires it (like a full-text `MATCH`) fails with kC4ErrorNoSuchIndex.
+            Only full-text, array and predictive indexes can be built in the background; a value
+            index is a single SQLite index that is always built immediately. */
+        bool background;
     } C4IndexOptions;
 
 
@@ -130,6 +139,16 @@ extern "C" {
                           const C4IndexOptions *indexOptions,
                           C4Error *outError) C4API;
 
+    /** Returns how much of an index has been built, from 0.0 to 1.0. This is only less than 1.0
+        while an index created with the `background` option is being populated.
+        @param database  The database.
+        @param name  The name of the index.
+        @param outError  On failure, will be set to the error status.
+        @return  The fraction built, or -1.0 on failure (e.g. if there's no such index.) */
+    double c4db_getIndexBuildProgress(C4Database *database C4NONNULL,
+                                      C4String name,
+                                      C4Error *outError) C4API;
+
     /** Deletes an index that was created by `c4db_createIndex`.
         @param database  The database to index.
         @param name The name of the index to delete
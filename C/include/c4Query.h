@@ -79,10 +79,17 @@ extern "C" {
     /** Options for running queries. */
     typedef struct {
         bool rankFullText;      ///< Should full-text results be ranked by relevance?
+        bool streaming;         ///< Read rows lazily instead of collecting them all up front.
+                                ///< Until the last row is read (or the enumerator is closed
+                                ///< or freed), c4db_beginTransaction on the same C4Database
+                                ///< fails with kC4ErrorBusy. The enumerator's functions take
+                                ///< the database's lock (see c4db_lock) while they read rows.
+                                ///< Calling c4queryenum_seek, c4queryenum_getRowCount or
+                                ///< c4queryenum_refresh reads all the remaining rows.
     } C4QueryOptions;
 
 
-    /** Default query options. Has skip=0, limit=UINT_MAX, rankFullText=true. */
+    /** Default query options. Has skip=0, limit=UINT_MAX, rankFullText=true, streaming=false. */
 	CBL_CORE_API extern const C4QueryOptions kC4DefaultQueryOptions;
 
 
@@ -21,6 +21,7 @@
 #include "c4DocEnumerator.h"
 #include "c4BlobStore.h"
 #include "FilePath.hh"
+#include <algorithm>
 #include <cmath>
 #include <errno.h>
 #include <iostream>
@@ -452,6 +453,59 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Auto-Expiration After Reopen",
     C4Log("---- Done...");
 }
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Auto-Expiration Separate Rev Bodies", "[Database][C]")
+{
+    if (!isRevTrees())
+        return;
+    C4DatabaseConfig config = *c4db_getConfig(db);
+    config.flags |= kC4DB_SeparateRevBodies;
+    closeDB();
+    C4Error err;
+    db = c4db_open(databasePath(), &config, &err);
+    REQUIRE(db);
+
+    // The file's schema version is bumped, so builds that can't read out-of-line bodies
+    // (whose highest readable version is 399) refuse to open it:
+    {
+        litecore::FilePath path(alloc_slice(c4db_getPath(db)).asString(), "db.sqlite3");
+        sqlite3 *sqlite;
+        REQUIRE(sqlite3_open_v2(path.path().c_str(), &sqlite, SQLITE_OPEN_READONLY, nullptr)
+                    == SQLITE_OK);
+        sqlite3_stmt *stmt;
+        REQUIRE(sqlite3_prepare_v2(sqlite, "PRAGMA user_version", -1, &stmt, nullptr) == SQLITE_OK);
+        REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+        CHECK(sqlite3_column_int(stmt, 0) >= 400);
+        sqlite3_finalize(stmt);
+        sqlite3_close(sqlite);
+    }
+
+    c4db_startHousekeeping(db);
+    createRev("expire_me_first"_sl, kRevID, kFleeceBody);
+    createRev("expire_me_first"_sl, kRev2ID, kFleeceBody, kRevKeepBody);
+    createRev("expire_me_first"_sl, kRev3ID, kFleeceBody);
+    static const uint8_t kRev2Key[] = {'e','x','p','i','r','e','_','m','e','_','f','i','r','s','t',
+                                       0, 0x02, 0xc0, 0x01, 0xd0, 0x0d};
+    auto hasStoredBody = [&] {
+        C4RawDocument *raw = c4raw_get(db, C4STR("default_revbodies"),
+                                       slice(kRev2Key, sizeof(kRev2Key)), nullptr);
+        if (!raw)
+            return false;
+        c4raw_free(raw);
+        return true;
+    };
+    REQUIRE(hasStoredBody());
+
+    auto expire = c4_now() + 1500*ms;
+    REQUIRE(c4doc_setExpiration(db, "expire_me_first"_sl, expire, &err));
+
+    // When the Housekeeper expires the doc, it deletes its stored bodies too:
+    C4Log("---- Wait till expiration time...");
+    sleep(2u);
+    REQUIRE(c4_now() >= expire);
+    CHECK(c4doc_get(db, "expire_me_first"_sl, true, &err) == nullptr);
+    CHECK(!hasStoredBody());
+}
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database CancelExpire", "[Database][C]")
 {
     C4Slice docID = C4STR("expire_me");
@@ -561,6 +615,148 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact", "[Database][C]")
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Blob Collection", "[Database][C]")
+{
+    REQUIRE(c4db_startHousekeeping(db));
+
+    C4Error err;
+    C4Slice doc1ID = C4STR("doc001");
+    C4Slice doc2ID = C4STR("doc002");
+    C4Slice doc3ID = C4STR("doc003");
+    vector<string> atts;
+    C4BlobKey key1, key2;
+    {
+        TransactionHelper t(db);
+        atts.emplace_back("This is the first attachment");
+        key1 = addDocWithAttachments(doc1ID, atts, "text/plain")[0];
+
+        atts.clear();
+        atts.emplace_back("This is the second attachment");
+        key2 = addDocWithAttachments(doc2ID, atts, "text/plain")[0];
+        addDocWithAttachments(doc3ID, atts, "text/plain");
+    }
+
+    C4BlobStore* store = c4db_getBlobStore(db, &err);
+    REQUIRE(store);
+
+    // Deleting the only doc that uses a blob lets the Housekeeper delete it, without compacting:
+    createRev(doc1ID, kRev2ID, kC4SliceNull, kRevDeleted);
+    WaitUntil(2000, [&]{return c4blob_getSize(store, key1) == -1;});
+    CHECK(c4blob_getSize(store, key1) == -1);
+    CHECK(c4blob_getSize(store, key2) > 0);
+
+    // The second blob is still used by doc003 after doc002 is purged:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, doc2ID, &err));
+    }
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key2) > 0);
+
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, doc3ID, &err));
+    }
+    WaitUntil(2000, [&]{return c4blob_getSize(store, key2) == -1;});
+    CHECK(c4blob_getSize(store, key2) == -1);
+
+    // A blob that's been claimed (by a replicator that's about to save a doc using it) isn't
+    // deleted when the only saved doc referencing it goes away:
+    C4Slice doc4ID = C4STR("doc004");
+    atts.clear();
+    atts.emplace_back("This is the fourth attachment");
+    C4BlobKey key4;
+    {
+        TransactionHelper t(db);
+        key4 = addDocWithAttachments(doc4ID, atts, "text/plain")[0];
+    }
+    CHECK(c4blob_claim(store, key4));
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, doc4ID, &err));
+    }
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, key4) > 0);
+
+    // Once a saved doc references it, it's collected normally:
+    {
+        TransactionHelper t(db);
+        addDocWithAttachments(doc4ID, atts, "text/plain");
+    }
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, doc4ID, &err));
+    }
+    WaitUntil(2000, [&]{return c4blob_getSize(store, key4) == -1;});
+    CHECK(c4blob_getSize(store, key4) == -1);
+
+    // A blob that was just written isn't deleted by compaction, even if it was written through
+    // another handle on the same database (as the replicator does):
+    C4BlobKey newKey, otherKey;
+    REQUIRE(c4blob_create(store, "new"_sl, nullptr, &newKey, &err));
+    C4Database *db2 = c4db_openAgain(db, &err);
+    REQUIRE(db2);
+    C4BlobStore *store2 = c4db_getBlobStore(db2, &err);
+    REQUIRE(store2);
+    REQUIRE(c4blob_create(store2, "other"_sl, nullptr, &otherKey, &err));
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, newKey) > 0);
+    CHECK(c4blob_getSize(store, otherKey) > 0);
+
+    // ...and once a doc saved through the first handle references it, it's collected normally:
+    C4Slice doc5ID = C4STR("doc005");
+    {
+        C4SliceResult keyStr = c4blob_keyToString(otherKey);
+        string json = json5("{attached: [{'" + string(kC4ObjectTypeProperty) + "': '"
+                            + kC4ObjectType_Blob + "', digest: '" + toString(C4Slice(keyStr))
+                            + "', length: 5}]}");
+        c4slice_free(keyStr);
+        TransactionHelper t(db);
+        C4SliceResult body = c4db_encodeJSON(db, c4str(json.c_str()), &err);
+        REQUIRE(body.buf);
+        C4DocPutRequest rq = {};
+        rq.docID = doc5ID;
+        rq.revFlags = kRevHasAttachments;
+        rq.allocedBody = body;
+        rq.save = true;
+        C4Document *doc = c4doc_put(db, &rq, nullptr, &err);
+        c4slice_free(body);
+        REQUIRE(doc);
+        c4doc_release(doc);
+    }
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, doc5ID, &err));
+    }
+    WaitUntil(2000, [&]{return c4blob_getSize(store, otherKey) == -1;});
+    CHECK(c4blob_getSize(store, otherKey) == -1);
+    c4db_release(db2);
+
+    // But a blob that no document ever referenced, and that nothing has protected since the
+    // database was opened (as if left over from an earlier process), is deleted. Write it in
+    // a separate directory, with the same encryption key, and move it into place:
+    string orphanDir = TempDir() + "orphan_blobs" + kPathSeparator;
+    litecore::FilePath(orphanDir, "").delRecursive();
+    C4BlobStore *orphanStore = c4blob_openStore(c4str(orphanDir.c_str()), kC4DB_Create,
+                                                &c4db_getConfig(db)->encryptionKey, &err);
+    REQUIRE(orphanStore);
+    C4BlobKey orphanKey;
+    REQUIRE(c4blob_create(orphanStore, "orphan"_sl, nullptr, &orphanKey, &err));
+    c4blob_deleteStore(orphanStore, &err);      // (the file has been moved out by then)
+    C4SliceResult dbPath = c4db_getPath(db);
+    string blobDir = toString(C4Slice(dbPath)) + "Attachments" + kPathSeparator;
+    c4slice_free(dbPath);
+    C4SliceResult orphanKeyStr = c4blob_keyToString(orphanKey);
+    string orphanName = toString(C4Slice(orphanKeyStr)).substr(5) + ".blob";   // skip "sha1-"
+    c4slice_free(orphanKeyStr);
+    replace(orphanName.begin(), orphanName.end(), '/', '_');
+    litecore::FilePath(orphanDir, orphanName).moveTo(litecore::FilePath(blobDir, orphanName));
+    CHECK(c4blob_getSize(store, orphanKey) > 0);
+    REQUIRE(c4db_compact(db, &err));
+    CHECK(c4blob_getSize(store, orphanKey) == -1);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database copy", "[Database][C]") {
     C4Slice doc1ID = C4STR("doc001");
     C4Slice doc2ID = C4STR("doc002");
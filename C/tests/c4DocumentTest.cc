@@ -694,6 +694,65 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document Put", "[Database][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document Put Batch", "[Database][C]") {
+    if (!isRevTrees()) return;
+    C4Slice docID2 = C4STR("otherdoc");
+    createRev(docID2, kRevID, kFleeceBody);
+
+    C4Slice history1[1] = {kRevID};
+    C4Slice history2[2] = {kRev2ID, kRevID};
+    C4DocPutRequest rqs[4] = {};
+    // Insert rev 1 and then rev 2 of a new doc:
+    rqs[0].docID = kDocID;
+    rqs[0].body = kFleeceBody;
+    rqs[0].existingRevision = true;
+    rqs[0].history = history1;
+    rqs[0].historyCount = 1;
+    rqs[1] = rqs[0];
+    rqs[1].history = history2;
+    rqs[1].historyCount = 2;
+    // Update an existing doc:
+    rqs[2].docID = docID2;
+    rqs[2].body = kFleeceBody;
+    rqs[2].history = history1;
+    rqs[2].historyCount = 1;
+    // Conflicting update of the first doc, whose current rev is now rev 2:
+    rqs[3] = rqs[2];
+    rqs[3].docID = kDocID;
+
+    C4DocPutResult results[4];
+    C4Error error;
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4doc_putBatch(db, rqs, 4, results, &error));
+    }
+    for (int i = 0; i < 3; ++i) {
+        CHECK(results[i].error.code == 0);
+        CHECK(results[i].sequence == C4SequenceNumber(2 + i));
+        CHECK((results[i].revFlags & kRevLeaf));
+    }
+    CHECK(results[3].error.domain == LiteCoreDomain);
+    CHECK(results[3].error.code == kC4ErrorConflict);
+    CHECK(results[3].sequence == 0);
+
+    C4Document *doc = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == kRev2ID);
+    CHECK(doc->sequence == 3);
+    c4doc_release(doc);
+    doc = c4doc_get(db, docID2, true, &error);
+    REQUIRE(doc);
+    CHECK(c4rev_getGeneration(doc->revID) == 2);
+    CHECK(doc->sequence == 4);
+    c4doc_release(doc);
+
+    // Must be called in a transaction:
+    CHECK(!c4doc_putBatch(db, rqs, 1, results, &error));
+    CHECK(error.domain == LiteCoreDomain);
+    CHECK(error.code == kC4ErrorNotInTransaction);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document Update", "[Database][C]") {
     C4Log("Begin test");
     C4Error error;
@@ -866,6 +925,98 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document Conflict", "[Database][C]") {
     c4doc_release(doc);
 }
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document Separate Rev Bodies", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+
+    // Reopen the db so it stores non-current revision bodies outside the rev tree:
+    C4DatabaseConfig config = *c4db_getConfig(db);
+    config.flags |= kC4DB_SeparateRevBodies;
+    closeDB();
+    C4Error err;
+    db = c4db_open(databasePath(), &config, &err);
+    REQUIRE(db);
+
+    const auto kFleeceBody2 = json2fleece("{'ok':'go'}");
+    const auto kFleeceBody3 = json2fleece("{'ubu':'roi'}");
+    const auto kFleeceBody4 = json2fleece("{'conflict':true}");
+    createRev(kDocID, kRevID, kFleeceBody);
+    createRev(kDocID, kRev2ID, kFleeceBody2, kRevKeepBody);
+    createRev(kDocID, kRev3ID, kFleeceBody3);
+    {
+        // "Pull" a conflicting revision:
+        TransactionHelper t(db);
+        C4Slice history[2] = {C4STR("3-ababab"), kRev2ID};
+        C4DocPutRequest rq = {};
+        rq.existingRevision = true;
+        rq.docID = kDocID;
+        rq.history = history;
+        rq.historyCount = 2;
+        rq.allowConflict = true;
+        rq.body = kFleeceBody4;
+        rq.save = true;
+        auto doc = c4doc_put(db, &rq, nullptr, &err);
+        REQUIRE(doc);
+        c4doc_release(doc);
+    }
+
+    // Out-of-line bodies are keyed by docID, a zero byte, and the binary revID:
+    static const uint8_t kRev2Key[]    = {'m','y','d','o','c', 0, 0x02, 0xc0, 0x01, 0xd0, 0x0d};
+    static const uint8_t kConflictKey[] = {'m','y','d','o','c', 0, 0x03, 0xab, 0xab, 0xab};
+    auto storedBody = [&](slice key) {
+        alloc_slice body;
+        C4RawDocument *raw = c4raw_get(db, C4STR("default_revbodies"), key, nullptr);
+        if (raw) {
+            body = alloc_slice(raw->body);
+            c4raw_free(raw);
+        }
+        return body;
+    };
+    CHECK(storedBody(slice(kRev2Key, sizeof(kRev2Key))) == kFleeceBody2);
+    CHECK(storedBody(slice(kConflictKey, sizeof(kConflictKey))) == kFleeceBody4);
+
+    // The bodies are read back on demand:
+    reopenDB();
+    C4Document *doc = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(doc);
+    CHECK(doc->selectedRev.revID == kRev3ID);
+    CHECK(doc->selectedRev.body == kFleeceBody3);
+    REQUIRE(c4doc_selectRevision(doc, kRev2ID, false, &err));
+    CHECK(!doc->selectedRev.body.buf);
+    CHECK(c4doc_hasRevisionBody(doc));
+    REQUIRE(c4doc_loadRevisionBody(doc, &err));
+    CHECK(doc->selectedRev.body == kFleeceBody2);
+    REQUIRE(c4doc_selectRevision(doc, C4STR("3-ababab"), true, &err));
+    CHECK(doc->selectedRev.body == kFleeceBody4);
+    REQUIRE(c4doc_selectRevision(doc, kRevID, true, &err));
+    CHECK(!c4doc_hasRevisionBody(doc));
+
+    // When the conflicting rev becomes current, its body moves back into the tree:
+    C4Slice conflictRevID = C4STR("3-ababab");
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4doc_resolveConflict(doc, conflictRevID, kRev3ID, kC4SliceNull, 0, &err));
+        REQUIRE(c4doc_save(doc, 0, &err));
+    }
+    c4doc_release(doc);
+    CHECK(!storedBody(slice(kConflictKey, sizeof(kConflictKey))));
+    CHECK(storedBody(slice(kRev2Key, sizeof(kRev2Key))) == kFleeceBody2);
+
+    reopenDB();
+    doc = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(doc);
+    CHECK(doc->selectedRev.revID == conflictRevID);
+    CHECK(doc->selectedRev.body == kFleeceBody4);
+    c4doc_release(doc);
+
+    // Purging the doc deletes its remaining stored bodies:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, kDocID, &err));
+    }
+    CHECK(!storedBody(slice(kRev2Key, sizeof(kRev2Key))));
+}
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document from Fleece", "[Database][C]") {
     if (!isRevTrees())
         return;
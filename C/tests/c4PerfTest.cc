@@ -220,3 +220,90 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Import Wikipedia", "[Perf][C][.slow]") {
     reopenDB();
     readRandomDocs(numDocs, 100000);
 }
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Find doc ancestors", "[Perf][C][.slow]") {
+    // Looks up random batches of 200 docs with c4db_findDocAncestors, the way the replicator
+    // does for incoming `changes` messages, as the database grows.
+    if (!isRevTrees()) return;
+    static constexpr unsigned kBatchSize = 200, kNumBatches = 500;
+
+    std::vector<std::string> docIDStrs(kBatchSize);
+    std::vector<C4String> docIDs(kBatchSize), revIDs(kBatchSize, kRev2ID);
+    std::vector<C4SliceResult> ancestors(kBatchSize);
+    unsigned numDocs = 0;
+    for (unsigned dbSize : {10000u, 100000u, 1000000u}) {
+        {
+            TransactionHelper t(db);
+            for (; numDocs < dbSize; ++numDocs) {
+                char docID[20];
+                sprintf(docID, "doc-%07u", numDocs + 1);
+                createRev(c4str(docID), kRevID, kFleeceBody);
+            }
+        }
+        std::cerr << "Finding ancestors in a database of " << numDocs << " docs...\n";
+        Benchmark b;
+        for (unsigned batch = 0; batch < kNumBatches; ++batch) {
+            for (unsigned i = 0; i < kBatchSize; ++i) {
+                char docID[20];
+                sprintf(docID, "doc-%07u", ((unsigned)litecore::RandomNumber() % numDocs) + 1);
+                docIDStrs[i] = docID;
+                docIDs[i] = c4str(docIDStrs[i].c_str());
+            }
+            C4Error error;
+            b.start();
+            REQUIRE(c4db_findDocAncestors(db, kBatchSize, 20, true, 1,
+                                          docIDs.data(), revIDs.data(), ancestors.data(), &error));
+            b.stop();
+            for (auto &anc : ancestors) {
+                CHECK(anc.size > 0);
+                c4slice_free(anc);
+            }
+        }
+        b.printReport(1, "batch");
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Put many small docs", "[Perf][C][.slow]") {
+    // Creates 100,000 small docs with c4doc_put, then another 100,000 with c4doc_putBatch,
+    // in transactions of 1000 docs like the replicator's Inserter.
+    static constexpr unsigned kNumDocs = 100000, kBatchSize = 1000;
+
+    alloc_slice body = json2fleece("{'n':1,'name':'small doc'}");
+    std::vector<std::string> docIDStrs(kBatchSize);
+    std::vector<C4DocPutRequest> rqs(kBatchSize);
+    std::vector<C4DocPutResult> results(kBatchSize);
+    for (int pass = 0; pass < 2; ++pass) {
+        bool batched = (pass == 1);
+        Stopwatch st;
+        for (unsigned start = 0; start < kNumDocs; start += kBatchSize) {
+            for (unsigned i = 0; i < kBatchSize; ++i) {
+                char docID[20];
+                sprintf(docID, "%s-%07u", (batched ? "batch" : "doc"), start + i);
+                docIDStrs[i] = docID;
+                C4DocPutRequest &rq = rqs[i];
+                rq = {};
+                rq.docID = c4str(docIDStrs[i].c_str());
+                rq.body = body;
+                rq.save = true;
+            }
+            TransactionHelper t(db);
+            C4Error error;
+            if (batched) {
+                REQUIRE(c4doc_putBatch(db, rqs.data(), kBatchSize, results.data(), &error));
+                for (auto &result : results)
+                    REQUIRE(result.error.code == 0);
+            } else {
+                for (auto &rq : rqs) {
+                    C4Document *doc = c4doc_put(db, &rq, nullptr, &error);
+                    REQUIRE(doc);
+                    c4doc_release(doc);
+                }
+            }
+        }
+        st.printReport(batched ? "Creating docs with c4doc_putBatch"
+                               : "Creating docs with c4doc_put", kNumDocs, "doc");
+    }
+    CHECK(c4db_getDocumentCount(db) == 2 * kNumDocs);
+}
@@ -20,6 +20,7 @@
 #include "c4BlobStore.h"
 #include "c4Observer.h"
 #include "StringUtil.hh"
+#include <atomic>
 #include <thread>
 
 
@@ -402,6 +403,36 @@ N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query FTS", "[Query][C][FTS]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query FTS Background Index", "[Query][C][FTS]") {
+    C4Error err;
+    C4IndexOptions options = {};
+    options.background = true;
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"),
+                             kC4FullTextIndex, &options, &err));
+    // Wait for the background build to finish:
+    double progress;
+    for (int i = 0; i < 100; ++i) {
+        progress = c4db_getIndexBuildProgress(db, C4STR("byStreet"), &err);
+        REQUIRE(progress >= 0.0);
+        if (progress == 1.0)
+            break;
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    REQUIRE(progress == 1.0);
+
+    compile(json5("['MATCH', 'byStreet', 'Hwy']"));
+    auto results = runFTS();
+    CHECK(results.size() == 5);
+
+    {
+        ExpectingExceptions x;
+        CHECK(c4db_getIndexBuildProgress(db, C4STR("nonexistent"), &err) == -1.0);
+        CHECK(err.domain == LiteCoreDomain);
+        CHECK(err.code == kC4ErrorNoSuchIndex);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query FTS multiple properties", "[Query][C][FTS]") {
     C4Error err;
     REQUIRE(c4db_createIndex(db, C4STR("byAddress"),
@@ -797,6 +828,42 @@ N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query Seek", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query streaming blocks transactions", "[Query][C][!throws]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    C4QueryOptions options = kC4DefaultQueryOptions;
+    options.streaming = true;
+    C4Error error;
+    auto e = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e);
+    REQUIRE(c4queryenum_next(e, &error));
+    {
+        ExpectingExceptions x;
+        CHECK(!c4db_beginTransaction(db, &error));
+        CHECK(error.domain == LiteCoreDomain);
+        CHECK(error.code == kC4ErrorBusy);
+        CHECK(!c4db_isInTransaction(db));
+    }
+    REQUIRE(c4queryenum_next(e, &error));
+
+    SECTION("Close") {
+        c4queryenum_close(e);
+    }
+    SECTION("Release") {
+        c4queryenum_release(e);
+        e = nullptr;
+    }
+    SECTION("Read to end") {
+        while (c4queryenum_next(e, &error))
+            ;
+        CHECK(error.code == 0);
+    }
+
+    // Now a transaction can begin:
+    addPersonInState("added_later", "CA");
+    c4queryenum_release(e);
+}
+
+
 N_WAY_TEST_CASE_METHOD(NestedQueryTest, "C4Query ANY nested", "[Query][C]") {
     compile(json5("['ANY', 'Shape', ['.', 'shapes'], ['=', ['?', 'Shape', 'color'], 'red']]"));
     CHECK(run() == (vector<string>{"0000001", "0000003"}));
@@ -934,6 +1001,67 @@ N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query observer", "[Query][C][!throws]") {
     CHECK(c4queryenum_getRowCount(e2, &error) == 8);
 }
 
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query multiple observers", "[Query][C][!throws]") {
+    c4db_setMaxBackgroundReaders(db, 2);
+    const char* kStates[3] = {"CA", "TX", "AL"};
+
+    struct State {
+        atomic<int> count {0};
+        atomic<int64_t> firstRowCount {-1};     // Row count seen by the first call since reset
+        void reset()    {count = 0; firstRowCount = -1;}
+    };
+    State states[3];
+    c4::ref<C4Query> queries[3];
+    c4::ref<C4QueryObserver> observers[3];
+
+    auto callback = [](C4QueryObserver *obs, C4Query *query, void *context) {
+        auto state = (State*)context;
+        c4::ref<C4QueryEnumerator> e = c4queryobs_getEnumerator(obs, false, nullptr);
+        int64_t rowCount = e ? c4queryenum_getRowCount(e, nullptr) : -1;
+        int64_t unset = -1;
+        state->firstRowCount.compare_exchange_strong(unset, rowCount);
+        ++state->count;
+    };
+    C4Error error;
+    for (int i = 0; i < 3; ++i) {
+        string json = json5(stringWithFormat("['=', ['.', 'contact', 'address', 'state'], '%s']",
+                                             kStates[i]));
+        queries[i] = c4query_new(db, c4str(json.c_str()), &error);
+        REQUIRE(queries[i]);
+        observers[i] = c4queryobs_create(queries[i], callback, &states[i]);
+        c4queryobs_setEnabled(observers[i], true);
+    }
+
+    C4Log("---- Waiting for query observers...");
+    WaitUntil(2000, [&]{return states[0].count > 0 && states[1].count > 0 && states[2].count > 0;});
+    int64_t rowCounts[3];
+    for (int i = 0; i < 3; ++i) {
+        CHECK(states[i].count == 1);
+        rowCounts[i] = states[i].firstRowCount;
+        CHECK(rowCounts[i] >= 0);
+        states[i].reset();
+    }
+
+    addPersonInState("after1", "TX");
+    C4Log("---- Waiting for 2nd call of query observer...");
+    WaitUntil(2000, [&]{return states[1].count > 0;});
+    CHECK(states[1].count == 1);
+    CHECK(states[1].firstRowCount == rowCounts[1] + 1);
+
+    // Each querier handles changes in order, so if the TX change had notified the other
+    // observers, that call would come before the one for their own change:
+    C4Log("---- Changing the other queries' results...");
+    addPersonInState("after2", "CA");
+    addPersonInState("after3", "AL");
+    WaitUntil(2000, [&]{return states[0].count > 0 && states[2].count > 0;});
+    CHECK(states[0].firstRowCount == rowCounts[0] + 1);
+    CHECK(states[2].firstRowCount == rowCounts[2] + 1);
+
+    for (int i = 0; i < 3; ++i)
+        c4queryobs_setEnabled(observers[i], false);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4QueryTest, "Delete index", "[Query][C][!throws]") {
     C4Error err;
     C4String names[2] = { C4STR("length"), C4STR("byStreet") };
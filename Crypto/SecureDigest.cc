@@ -18,10 +18,13 @@
 
 #include "SecureDigest.hh"
 #include "Error.hh"
+#include <algorithm>
+#include <atomic>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdocumentation-deprecated-sync"
 #include "mbedtls/sha1.h"
+#include "mbedtls/sha256.h"
 #pragma clang diagnostic pop
 
 #ifdef __APPLE__
@@ -31,11 +34,275 @@
 #ifdef USE_COMMON_CRYPTO
     #include <CommonCrypto/CommonDigest.h>
     #define _CONTEXT ((CC_SHA1_CTX*)_context)
+    #define _CONTEXT256 ((CC_SHA256_CTX*)_context)
 #else
     #define _CONTEXT ((mbedtls_sha1_context*)_context)
+    #define _CONTEXT256 ((mbedtls_sha256_context*)_context)
+
+    // CommonCrypto already uses the CPU's SHA instructions; on x86-64 we do it ourselves:
+    #if defined(__x86_64__) || defined(_M_X64)
+        #define SHA_X86
+        #include <immintrin.h>
+        #ifdef _MSC_VER
+            #include <intrin.h>
+            #define TARGET_SHA
+        #else
+            #include <cpuid.h>
+            #define TARGET_SHA __attribute__((target("sha,ssse3,sse4.1")))
+        #endif
+    #endif
 #endif
 
+#define _HWCONTEXT ((HWContext<5>*)_context)
+#define _HWCONTEXT256 ((HWContext<8>*)_context)
+
 namespace litecore {
+    using namespace std;
+
+#pragma mark - HARDWARE DIGESTS:
+
+    // Processes `nBlocks` 64-byte blocks, updating the digest state.
+    using BlockFn = void (*)(uint32_t *state, const uint8_t *data, size_t nBlocks);
+
+    // Context of a builder using a BlockFn; the builders' `_context` holds this instead of the
+    // library's context struct. (SHA-1 and SHA-256 pad messages the same way.)
+    template <unsigned N>
+    struct HWContext {
+        uint64_t length;            // Total bytes added
+        uint32_t state[N];          // Digest state, as native-endian words
+        uint32_t bufferLen;         // Number of bytes in `buffer`
+        uint8_t  buffer[64];        // Partial block not yet processed
+    };
+
+    static constexpr uint32_t kSHA1InitialState[5] = {
+        0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    static constexpr uint32_t kSHA256InitialState[8] = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+
+#if defined(SHA_X86)
+    static constexpr uint32_t kSHA256RoundConstants[64] = {
+        0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+        0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+        0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+        0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+        0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+        0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+        0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+        0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+#endif
+
+
+#if defined(SHA_X86)
+
+    // SHA-1 rounds 4g..4g+3 using SHA-NI. `msg` holds the last four message-schedule words
+    // groups; `e` alternates between the two E registers.
+    template <int G>
+    TARGET_SHA static inline void sha1RoundsX86(__m128i &abcd, __m128i e[2], __m128i msg[4],
+                                                 const uint8_t *data) {
+        constexpr int W = G % 4;
+        if constexpr (G < 4) {
+            const __m128i kByteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+            msg[W] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * G)), kByteSwap);
+        }
+        if constexpr (G == 0)
+            e[0] = _mm_add_epi32(e[0], msg[0]);
+        else
+            e[G % 2] = _mm_sha1nexte_epu32(e[G % 2], msg[W]);
+        e[(G + 1) % 2] = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e[G % 2], G / 5);
+        if constexpr (G >= 3 && G <= 18)
+            msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], msg[W]);
+        if constexpr (G >= 1 && G <= 16)
+            msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], msg[W]);
+        if constexpr (G >= 2 && G <= 17)
+            msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], msg[W]);
+    }
+
+
+    template <int... G>
+    TARGET_SHA static inline void sha1BlockX86(__m128i &abcd, __m128i e[2], __m128i msg[4],
+                                                const uint8_t *data, integer_sequence<int, G...>) {
+        (sha1RoundsX86<G>(abcd, e, msg, data), ...);
+    }
+
+
+    TARGET_SHA static void sha1BlocksX86(uint32_t *state, const uint8_t *data, size_t nBlocks) {
+        __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+        __m128i e[2] = {_mm_set_epi32(int(state[4]), 0, 0, 0), _mm_setzero_si128()};
+        __m128i msg[4];
+        for (; nBlocks > 0; --nBlocks, data += 64) {
+            __m128i abcdSaved = abcd, eSaved = e[0];
+            sha1BlockX86(abcd, e, msg, data, make_integer_sequence<int, 20>());
+            e[0] = _mm_sha1nexte_epu32(e[0], eSaved);
+            abcd = _mm_add_epi32(abcd, abcdSaved);
+        }
+        _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+        state[4] = uint32_t(_mm_extract_epi32(e[0], 3));
+    }
+
+
+    // SHA-256 rounds 4g..4g+3 using SHA-NI.
+    template <int G>
+    TARGET_SHA static inline void sha256RoundsX86(__m128i &state0, __m128i &state1, __m128i msg[4],
+                                                   const uint8_t *data) {
+        constexpr int W = G % 4;
+        if constexpr (G < 4) {
+            const __m128i kByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+            msg[W] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * G)), kByteSwap);
+        }
+        __m128i wk = _mm_add_epi32(msg[W],
+                                   _mm_loadu_si128((const __m128i*)&kSHA256RoundConstants[4 * G]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+        if constexpr (G >= 3 && G <= 14) {
+            constexpr int N = (G + 1) % 4;
+            msg[N] = _mm_add_epi32(msg[N], _mm_alignr_epi8(msg[W], msg[(G + 3) % 4], 4));
+            msg[N] = _mm_sha256msg2_epu32(msg[N], msg[W]);
+        }
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+        if constexpr (G >= 1 && G <= 12)
+            msg[(G + 3) % 4] = _mm_sha256msg1_epu32(msg[(G + 3) % 4], msg[W]);
+    }
+
+
+    template <int... G>
+    TARGET_SHA static inline void sha256BlockX86(__m128i &state0, __m128i &state1, __m128i msg[4],
+                                                  const uint8_t *data, integer_sequence<int, G...>) {
+        (sha256RoundsX86<G>(state0, state1, msg, data), ...);
+    }
+
+
+    TARGET_SHA static void sha256BlocksX86(uint32_t *state, const uint8_t *data, size_t nBlocks) {
+        // SHA-NI wants the state as ABEF and CDGH:
+        __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+        __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+        __m128i msg[4];
+        for (; nBlocks > 0; --nBlocks, data += 64) {
+            __m128i saved0 = state0, saved1 = state1;
+            sha256BlockX86(state0, state1, msg, data, make_integer_sequence<int, 16>());
+            state0 = _mm_add_epi32(state0, saved0);
+            state1 = _mm_add_epi32(state1, saved1);
+        }
+        tmp = _mm_shuffle_epi32(state0, 0x1B);
+        state1 = _mm_shuffle_epi32(state1, 0xB1);
+        _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+        _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+    }
+
+
+    static bool cpuHasSHA() {
+        // Needs SHA (CPUID leaf 7, EBX bit 29), SSSE3 and SSE4.1 (leaf 1, ECX bits 9 and 19).
+        unsigned leaf1[4] = {}, leaf7[4] = {};
+    #ifdef _MSC_VER
+        int regs[4];
+        __cpuid(regs, 0);
+        if (regs[0] < 7)
+            return false;
+        __cpuid(regs, 1);
+        leaf1[2] = unsigned(regs[2]);
+        __cpuidex(regs, 7, 0);
+        leaf7[1] = unsigned(regs[1]);
+    #else
+        if (__get_cpuid_max(0, nullptr) < 7)
+            return false;
+        __cpuid(1, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+        __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+    #endif
+        return (leaf7[1] & (1u << 29)) && (leaf1[2] & (1u << 9)) && (leaf1[2] & (1u << 19));
+    }
+
+    static BlockFn hardwareSHA1Blocks()     {return cpuHasSHA() ? &sha1BlocksX86 : nullptr;}
+    static BlockFn hardwareSHA256Blocks()   {return cpuHasSHA() ? &sha256BlocksX86 : nullptr;}
+
+#else
+
+    static BlockFn hardwareSHA1Blocks()     {return nullptr;}
+    static BlockFn hardwareSHA256Blocks()   {return nullptr;}
+
+#endif
+
+
+    // The CPU is probed only once:
+    static BlockFn const sSHA1Blocks = hardwareSHA1Blocks();
+    static BlockFn const sSHA256Blocks = hardwareSHA256Blocks();
+
+    static atomic<bool> sHardwareEnabled {true};
+
+
+    bool DigestUsesHardware() {
+        return sSHA1Blocks && sHardwareEnabled;
+    }
+
+    void EnableDigestHardware(bool enable) {
+        sHardwareEnabled = enable;
+    }
+
+
+    template <unsigned N>
+    static void hwStart(HWContext<N> *ctx, const uint32_t (&initialState)[N]) {
+        ctx->length = 0;
+        ctx->bufferLen = 0;
+        memcpy(ctx->state, initialState, sizeof(ctx->state));
+    }
+
+
+    template <unsigned N>
+    static void hwUpdate(HWContext<N> *ctx, BlockFn blocks, fleece::slice s) {
+        auto data = (const uint8_t*)s.buf;
+        size_t size = s.size;
+        ctx->length += size;
+        if (ctx->bufferLen > 0) {
+            size_t n = min(size, sizeof(ctx->buffer) - ctx->bufferLen);
+            memcpy(&ctx->buffer[ctx->bufferLen], data, n);
+            ctx->bufferLen += uint32_t(n);
+            data += n;
+            size -= n;
+            if (ctx->bufferLen < sizeof(ctx->buffer))
+                return;
+            blocks(ctx->state, ctx->buffer, 1);
+            ctx->bufferLen = 0;
+        }
+        if (size >= 64) {
+            blocks(ctx->state, data, size / 64);
+            data += size & ~size_t(63);
+            size &= 63;
+        }
+        memcpy(ctx->buffer, data, size);
+        ctx->bufferLen = uint32_t(size);
+    }
+
+
+    template <unsigned N>
+    static void hwFinish(HWContext<N> *ctx, BlockFn blocks, uint8_t *result) {
+        // Pad with a 1 bit, then zeroes, then the big-endian message length in bits:
+        uint8_t *buffer = ctx->buffer;
+        uint32_t len = ctx->bufferLen;
+        buffer[len++] = 0x80;
+        if (len > 56) {
+            memset(&buffer[len], 0, 64 - len);
+            blocks(ctx->state, buffer, 1);
+            len = 0;
+        }
+        memset(&buffer[len], 0, 56 - len);
+        uint64_t bitLength = ctx->length * 8;
+        for (int i = 0; i < 8; ++i)
+            buffer[56 + i] = uint8_t(bitLength >> (56 - 8 * i));
+        blocks(ctx->state, buffer, 1);
+
+        for (unsigned i = 0; i < N; ++i) {
+            uint32_t word = ctx->state[i];
+            result[4*i + 0] = uint8_t(word >> 24);
+            result[4*i + 1] = uint8_t(word >> 16);
+            result[4*i + 2] = uint8_t(word >> 8);
+            result[4*i + 3] = uint8_t(word);
+        }
+    }
+
+
+#pragma mark - SHA-1:
+
 
     void SHA1::computeFrom(fleece::slice s) {
         (SHA1Builder() << s).finish(&bytes, sizeof(bytes));
@@ -50,8 +317,15 @@ namespace litecore {
     }
 
 
-    SHA1Builder::SHA1Builder() {
+    SHA1Builder::SHA1Builder()
+    :_hardware(sSHA1Blocks && sHardwareEnabled)
+    {
         static_assert(sizeof(_context) >= sizeof(mbedtls_sha1_context));
+        static_assert(sizeof(_context) >= sizeof(HWContext<5>));
+        if (_hardware) {
+            hwStart(_HWCONTEXT, kSHA1InitialState);
+            return;
+        }
 #ifdef USE_COMMON_CRYPTO
         static_assert(sizeof(_context) >= sizeof(CC_SHA1_CTX));
         CC_SHA1_Init(_CONTEXT);
@@ -63,6 +337,10 @@ namespace litecore {
 
 
     SHA1Builder& SHA1Builder::operator<< (fleece::slice s) {
+        if (_hardware) {
+            hwUpdate(_HWCONTEXT, sSHA1Blocks, s);
+            return *this;
+        }
 #ifdef USE_COMMON_CRYPTO
         CC_SHA1_Update(_CONTEXT, s.buf, (CC_LONG)s.size);
 #else
@@ -74,6 +352,10 @@ namespace litecore {
 
     void SHA1Builder::finish(void *result, size_t resultSize) {
         DebugAssert(resultSize == sizeof(SHA1::bytes));
+        if (_hardware) {
+            hwFinish(_HWCONTEXT, sSHA1Blocks, (uint8_t*)result);
+            return;
+        }
 #ifdef USE_COMMON_CRYPTO
         CC_SHA1_Final((uint8_t*)result, _CONTEXT);
 #else
@@ -82,4 +364,68 @@ namespace litecore {
 #endif
     }
 
+
+#pragma mark - SHA-256:
+
+
+    void SHA256::computeFrom(fleece::slice s) {
+        (SHA256Builder() << s).finish(&bytes, sizeof(bytes));
+    }
+
+
+    bool SHA256::setDigest(fleece::slice s) {
+        if (s.size != sizeof(bytes))
+            return false;
+        memcpy(bytes, s.buf, sizeof(bytes));
+        return true;
+    }
+
+
+    SHA256Builder::SHA256Builder()
+    :_hardware(sSHA256Blocks && sHardwareEnabled)
+    {
+        static_assert(sizeof(_context) >= sizeof(mbedtls_sha256_context));
+        static_assert(sizeof(_context) >= sizeof(HWContext<8>));
+        if (_hardware) {
+            hwStart(_HWCONTEXT256, kSHA256InitialState);
+            return;
+        }
+#ifdef USE_COMMON_CRYPTO
+        static_assert(sizeof(_context) >= sizeof(CC_SHA256_CTX));
+        CC_SHA256_Init(_CONTEXT256);
+#else
+        mbedtls_sha256_init(_CONTEXT256);
+        mbedtls_sha256_starts(_CONTEXT256, 0);
+#endif
+    }
+
+
+    SHA256Builder& SHA256Builder::operator<< (fleece::slice s) {
+        if (_hardware) {
+            hwUpdate(_HWCONTEXT256, sSHA256Blocks, s);
+            return *this;
+        }
+#ifdef USE_COMMON_CRYPTO
+        CC_SHA256_Update(_CONTEXT256, s.buf, (CC_LONG)s.size);
+#else
+        mbedtls_sha256_update(_CONTEXT256, (unsigned char*)s.buf, s.size);
+#endif
+        return *this;
+    }
+
+
+    void SHA256Builder::finish(void *result, size_t resultSize) {
+        DebugAssert(resultSize == sizeof(SHA256::bytes));
+        if (_hardware) {
+            hwFinish(_HWCONTEXT256, sSHA256Blocks, (uint8_t*)result);
+            return;
+        }
+#ifdef USE_COMMON_CRYPTO
+        CC_SHA256_Final((uint8_t*)result, _CONTEXT256);
+#else
+        mbedtls_sha256_finish(_CONTEXT256, (uint8_t*)result);
+        mbedtls_sha256_free(_CONTEXT256);
+#endif
+    }
+
 }
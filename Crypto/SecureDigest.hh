@@ -70,10 +70,74 @@ namespace litecore {
         }
 
     private:
-        uint8_t _context[100];  // big enough to hold any platform's context struct
+        alignas(8) uint8_t _context[100];  // big enough to hold any platform's context struct
+        bool _hardware;                     // true if using the CPU's SHA instructions
     };
 
 
+    /// A SHA-256 digest.
+    class SHA256 {
+    public:
+        SHA256()                               { memset(bytes, 0, sizeof(bytes)); }
+
+        /// Constructs instance with a SHA-256 digest of the data in `s`
+        explicit SHA256(fleece::slice s)       {computeFrom(s);}
+
+        /// Computes a SHA-256 digest of the data
+        void computeFrom(fleece::slice);
+
+        /// Stores a digest; returns false if slice is the wrong size
+        bool setDigest(fleece::slice);
+
+        /// The digest as a slice
+        operator fleece::slice() const          {return {bytes, sizeof(bytes)};}
+
+        bool operator==(const SHA256 &x) const  {return memcmp(&bytes, &x.bytes, sizeof(bytes)) == 0;}
+        bool operator!= (const SHA256 &x) const {return !(*this == x);}
+
+    private:
+        char bytes[32];
+
+        friend class SHA256Builder;
+    };
+
+
+    /// Builder for creating SHA-256 digests from piece-by-piece data.
+    class SHA256Builder {
+    public:
+        SHA256Builder();
+
+        /// Add data
+        SHA256Builder& operator<< (fleece::slice s);
+
+        /// Add a single byte
+        SHA256Builder& operator<< (uint8_t b)   {return *this << fleece::slice(&b, 1);}
+
+        /// Finish and write the digest to `result`. (Don't reuse the builder.)
+        void finish(void *result, size_t resultSize);
+
+        /// Finish and return the digest as a SHA256 object. (Don't reuse the builder.)
+        SHA256 finish() {
+            SHA256 result;
+            finish(&result.bytes, sizeof(result.bytes));
+            return result;
+        }
+
+    private:
+        alignas(8) uint8_t _context[112];  // big enough to hold any platform's context struct
+        bool _hardware;                     // true if using the CPU's SHA instructions
+    };
+
+
+    /// True if digests are being computed with the CPU's SHA instructions (x86 SHA-NI),
+    /// which are detected at runtime. On Apple platforms this is always false, since
+    /// CommonCrypto makes that choice itself.
+    bool DigestUsesHardware();
+
+    /// Disables (or re-enables) use of the CPU's SHA instructions, for tests and benchmarks.
+    /// Only affects builders created afterwards. Has no effect if the CPU lacks them.
+    void EnableDigestHardware(bool);
+
 }
 
 
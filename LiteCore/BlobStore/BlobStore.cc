@@ -25,6 +25,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
 
 namespace litecore {
     using namespace std;
@@ -186,6 +188,7 @@ namespace litecore {
         if (expectedKey && *expectedKey != key)
             error::_throw(error::CorruptData);
         Blob blob(_store, key);
+        _store.protect(key);       // until a document references it
         if(!blob.path().exists()) {
             _tmpPath.setReadOnly(true);
             _tmpPath.moveTo(blob.path());
@@ -205,14 +208,78 @@ namespace litecore {
 #pragma mark - DELETING:
     
     void BlobStore::deleteAllExcept(const unordered_set<string> &inUse) {
-        _dir.forEachFile([&inUse](const FilePath &path) {
-            if(find(inUse.cbegin(), inUse.cend(), path.fileName()) == inUse.cend()) {
-                path.del();
+        _dir.forEachFile([&](const FilePath &path) {
+            if (inUse.find(path.fileName()) == inUse.end()) {
+                blobKey key;
+                if (key.readFromFilename(path.fileName()))
+                    deleteUnlessProtected(key);
+                else
+                    path.del();
             }
         });
     }
 
 
+    // The protected blobs of a directory, shared by all the BlobStores on it.
+    struct BlobStore::Protections {
+        using clock = std::chrono::steady_clock;
+
+        std::mutex                              mutex;
+        unordered_map<string, clock::time_point> expirations;   // filename -> expiration time
+        size_t                                  pruneAt {100};  // Size at which to prune
+    };
+
+
+    shared_ptr<BlobStore::Protections> BlobStore::protectionsFor(const FilePath &dir) {
+        // (Never freed, since BlobStores may outlive static destructors.)
+        static auto sMutex = new std::mutex;
+        static auto sByDir = new unordered_map<string, shared_ptr<Protections>>;
+        lock_guard<std::mutex> lock(*sMutex);
+        auto &protections = (*sByDir)[dir.canonicalPath()];
+        if (!protections)
+            protections = make_shared<Protections>();
+        return protections;
+    }
+
+
+    void BlobStore::protect(const blobKey &key) {
+        auto &p = *_protections;
+        auto now = Protections::clock::now();
+        lock_guard<std::mutex> lock(p.mutex);
+        if (p.expirations.size() >= p.pruneAt) {
+            // Forget protections that have expired, so the map doesn't keep growing:
+            for (auto i = p.expirations.begin(); i != p.expirations.end(); ) {
+                if (i->second <= now)
+                    i = p.expirations.erase(i);
+                else
+                    ++i;
+            }
+            p.pruneAt = max(p.expirations.size() * 2, size_t(100));
+        }
+        p.expirations[key.filename()] = now + kProtectionTime;
+    }
+
+
+    void BlobStore::unprotect(const blobKey &key) {
+        auto &p = *_protections;
+        lock_guard<std::mutex> lock(p.mutex);
+        if (!p.expirations.empty())
+            p.expirations.erase(key.filename());
+    }
+
+
+    bool BlobStore::deleteUnlessProtected(const blobKey &key) {
+        // The lock is held while deleting, so a concurrent `protect` call either prevents the
+        // deletion or happens after the file is gone.
+        auto &p = *_protections;
+        lock_guard<std::mutex> lock(p.mutex);
+        auto i = p.expirations.find(key.filename());
+        if (i != p.expirations.end() && i->second > Protections::clock::now())
+            return false;
+        return get(key).path().del();
+    }
+
+
 #pragma mark - BLOBSTORE:
 
 
@@ -230,6 +297,7 @@ namespace litecore {
                 error::_throw(error::NotFound);
             _dir.mkdir();
         }
+        _protections = protectionsFor(_dir);
     }
 
 
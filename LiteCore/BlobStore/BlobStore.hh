@@ -21,6 +21,8 @@
 #include "FilePath.hh"
 #include "Stream.hh"
 #include "SecureDigest.hh"
+#include <chrono>
+#include <memory>
 #include <unordered_set>
 
 namespace litecore {
@@ -138,7 +140,7 @@ namespace litecore {
         uint64_t totalSize() const;
 
         void deleteStore()                          {_dir.delRecursive();}
-        void deleteAllExcept(const std::unordered_set<std::string>& inUse);
+        void deleteAllExcept(const std::unordered_set<std::string>& inUse); // skips protected blobs
 
         bool has(const blobKey &key) const          {return get(key).exists();}
 
@@ -147,12 +149,33 @@ namespace litecore {
 
         Blob put(slice data, const blobKey *expectedKey =nullptr);
 
+        /** Keeps a blob from being garbage-collected for a while (`kProtectionTime`), since
+            it's about to be referenced by a document that hasn't been saved yet. Blobs are
+            protected automatically when installed; a caller that skips writing a blob because
+            it already exists should call this.
+            Protections are shared by all BlobStore instances on the same directory, since
+            each database handle has its own. */
+        void protect(const blobKey&);
+
+        /** Removes the protection of a blob, once a saved document references it. */
+        void unprotect(const blobKey&);
+
+        /** Deletes a blob, unless it's protected. Returns true if it was deleted. */
+        bool deleteUnlessProtected(const blobKey&);
+
+        /** How long a blob stays protected if no document ends up referencing it. */
+        static constexpr std::chrono::seconds kProtectionTime {10 * 60};
+
         void copyBlobsTo(BlobStore &toStore);       // Copy my blobs into toStore
         void moveTo(BlobStore &toStore);            // Replace toStore's dir & options
 
     private:
+        struct Protections;
+        static std::shared_ptr<Protections> protectionsFor(const FilePath &dir);
+
         FilePath const  _dir;                           // Location
         Options         _options;                       // Option/capability flags
+        std::shared_ptr<Protections> _protections;      // Shared with other BlobStores on _dir
     };
 
 }
@@ -20,16 +20,39 @@
 #include "DataFile.hh"
 #include "Database.hh"
 #include "SequenceTracker.hh"
+#include "Error.hh"
+#include "Logging.hh"
 #include "c4ExceptionUtils.hh"
+#include <algorithm>
 
 namespace litecore {
     using namespace actor;
     using namespace std::placeholders;
 
 
+    // Delegate of the reader connections. It's separate from the BackgroundDB so that commits
+    // aren't reported to the transaction observers once per reader.
+    class BackgroundDB::ReaderDelegate : public DataFile::Delegate {
+    public:
+        explicit ReaderDelegate(Database *db)                 :_database(db) { }
+
+        slice fleeceAccessor(slice recordBody) const override {
+            return _database->fleeceAccessor(recordBody);
+        }
+
+        alloc_slice blobAccessor(const fleece::impl::Dict *dict) const override {
+            return _database->blobAccessor(dict);
+        }
+
+    private:
+        Database* const _database;
+    };
+
+
     BackgroundDB::BackgroundDB(Database *db)
     :access_lock(db->dataFile()->openAnother(this))
     ,_database(db)
+    ,_readerDelegate(new ReaderDelegate(db))
     { }
 
 
@@ -38,6 +61,14 @@ namespace litecore {
             delete df;
             df = nullptr;
         });
+
+        std::lock_guard<std::mutex> lock(_readersMutex);
+        for (auto &pooled : _readers) {
+            pooled.reader->use([](DataFile* &df) {
+                delete df;
+                df = nullptr;
+            });
+        }
     }
 
     BackgroundDB::~BackgroundDB() {
@@ -59,6 +90,52 @@ namespace litecore {
     }
 
 
+    void BackgroundDB::setMaxReaders(unsigned maxReaders) {
+        std::lock_guard<std::mutex> lock(_readersMutex);
+        _maxReaders = std::max(maxReaders, 1u);
+    }
+
+
+    BackgroundDB::Reader* BackgroundDB::acquireReader() {
+        std::lock_guard<std::mutex> lock(_readersMutex);
+        auto best = std::min_element(_readers.begin(), _readers.end(), [](auto &a, auto &b) {
+            return a.clients < b.clients;
+        });
+        if (best == _readers.end() || (best->clients > 0 && _readers.size() < _maxReaders)) {
+            DataFile *df = nullptr;
+            use([&](DataFile *writer) {
+                if (writer) {
+                    // Readers only run queries, so open them read-only:
+                    DataFile::Options options = writer->options();
+                    options.writeable = false;
+                    options.create = false;
+                    options.upgradeable = false;
+                    df = writer->openAnother(_readerDelegate.get(), &options);
+                }
+            });
+            if (!df)
+                error::_throw(error::NotOpen);
+            _readers.push_back({std::make_unique<Reader>(std::move(df))});
+            best = _readers.end() - 1;
+            LogToAt(DBLog, Verbose, "BackgroundDB: opened reader #%zu", _readers.size());
+        }
+        ++best->clients;
+        return best->reader.get();
+    }
+
+
+    void BackgroundDB::releaseReader(Reader *reader) {
+        std::lock_guard<std::mutex> lock(_readersMutex);
+        for (auto &pooled : _readers) {
+            if (pooled.reader.get() == reader) {
+                Assert(pooled.clients > 0);
+                --pooled.clients;
+                return;
+            }
+        }
+    }
+
+
     void BackgroundDB::useInTransaction(TransactionTask task) {
         use([=](DataFile* dataFile) {
             if (!dataFile)
@@ -69,7 +146,7 @@ namespace litecore {
 
             bool commit;
             try {
-                commit = task(dataFile, &sequenceTracker);
+                commit = task(dataFile, t, &sequenceTracker);
             } catch (const exception &x) {
                 t.abort();
                 sequenceTracker.endTransaction(false);
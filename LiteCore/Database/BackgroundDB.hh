@@ -9,6 +9,8 @@
 #include "DataFile.hh"
 #include "access_lock.hh"
 #include "function_ref.hh"
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace c4Internal {
@@ -19,6 +21,9 @@ namespace litecore {
     class SequenceTracker;
 
 
+    /** A separate connection to a Database's file, for use by background tasks. It's used
+        directly for writes (which stay serialized), and it also manages a pool of reader
+        connections so that queries can run in parallel with each other and with writes. */
     class BackgroundDB : public access_lock<DataFile*>, private DataFile::Delegate {
     public:
         BackgroundDB(c4Internal::Database*);
@@ -26,7 +31,23 @@ namespace litecore {
 
         void close();
 
-        using TransactionTask = function_ref<bool(DataFile*, SequenceTracker*)>;
+        /** A pooled connection, to be used only for reading. */
+        using Reader = access_lock<DataFile*>;
+
+        static constexpr unsigned kDefaultMaxReaders = 4;
+
+        /** Sets the maximum number of reader connections to open. Readers that are already
+            open stay open. */
+        void setMaxReaders(unsigned maxReaders);
+
+        /** Assigns a reader connection to a client. Clients are spread across the pool; another
+            connection is opened if every open one is already in use and the pool isn't full.
+            The client must call releaseReader when it's done. */
+        Reader* acquireReader();
+
+        void releaseReader(Reader* NONNULL);
+
+        using TransactionTask = function_ref<bool(DataFile*, Transaction&, SequenceTracker*)>;
 
         void useInTransaction(TransactionTask task);
 
@@ -45,8 +66,19 @@ namespace litecore {
         void externalTransactionCommitted(const SequenceTracker &sourceTracker) override;
         void notifyTransactionObservers();
 
+        class ReaderDelegate;
+
+        struct PooledReader {
+            std::unique_ptr<Reader> reader;
+            unsigned clients {0};
+        };
+
         c4Internal::Database* _database;
         std::vector<TransactionObserver*> _transactionObservers;
+        std::unique_ptr<ReaderDelegate> _readerDelegate;    // Delegate of the reader DataFiles
+        std::vector<PooledReader> _readers;                 // The reader pool
+        unsigned _maxReaders {kDefaultMaxReaders};
+        std::mutex _readersMutex;                           // Protects _readers, _maxReaders
     };
 
 }
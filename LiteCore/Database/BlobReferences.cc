@@ -0,0 +1,172 @@
+//
+// BlobReferences.cc
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "BlobReferences.hh"
+#include "BlobStore.hh"
+#include "DataFile.hh"
+#include "KeyStore.hh"
+#include "Record.hh"
+#include "RecordEnumerator.hh"
+#include <vector>
+
+namespace litecore {
+    using namespace std;
+
+    static const string kDocBlobsStoreName   = "docBlobs";
+    static const string kBlobRefsStoreName   = "blobRefs";
+    static const string kGarbageStoreName    = "blobGarbage";
+    static const slice  kPopulatedKey        = "blobReferencesPopulated"_sl;
+
+    // In a "docBlobs" record, the filenames are separated by newlines. (Blob filenames are
+    // base64 digests with a ".blob" suffix, so they can't contain one.)
+    static constexpr char kSeparator = '\n';
+
+
+    static KeyStore& getStore(Transaction &t, const string &name) {
+        return t.dataFile().getKeyStore(name, KeyStore::Capabilities::defaults);
+    }
+
+
+    BlobReferences::BlobReferences(Transaction &t)
+    :_transaction(t)
+    ,_docBlobs(getStore(t, kDocBlobsStoreName))
+    ,_blobRefs(getStore(t, kBlobRefsStoreName))
+    ,_garbage(getStore(t, kGarbageStoreName))
+    { }
+
+
+    /*static*/ bool BlobReferences::isPopulated(DataFile &dataFile) {
+        auto &info = dataFile.getKeyStore(DataFile::kInfoKeyStoreName);
+        return info.get(kPopulatedKey).exists();
+    }
+
+
+    void BlobReferences::setPopulated() {
+        Record rec(kPopulatedKey);
+        rec.setBodyAsUInt(1);
+        _transaction.dataFile().getKeyStore(DataFile::kInfoKeyStoreName).write(rec, _transaction);
+    }
+
+
+    bool BlobReferences::setDocumentBlobs(slice docID, const BlobSet &blobs) {
+        Record rec = _docBlobs.get(docID);
+        BlobSet oldBlobs = decodeBlobSet(rec.body());
+        if (blobs == oldBlobs)
+            return false;
+
+        bool garbage = false;
+        for (auto &blob : blobs) {
+            if (oldBlobs.find(blob) == oldBlobs.end())
+                addRef(blob);
+        }
+        for (auto &blob : oldBlobs) {
+            if (blobs.find(blob) == blobs.end())
+                garbage = removeRef(blob) || garbage;
+        }
+
+        if (blobs.empty())
+            _docBlobs.del(docID, _transaction);
+        else
+            _docBlobs.set(docID, encodeBlobSet(blobs), _transaction);
+        return garbage;
+    }
+
+
+    void BlobReferences::addRef(const string &filename) {
+        Record rec = _blobRefs.get(slice(filename));
+        uint64_t count = rec.exists() ? rec.bodyAsUInt() : 0;
+        if (count == 0)
+            _garbage.del(slice(filename), _transaction);   // It's no longer a candidate
+        rec.setBodyAsUInt(count + 1);
+        _blobRefs.write(rec, _transaction);
+    }
+
+
+    // Returns true if the blob is no longer referenced.
+    bool BlobReferences::removeRef(const string &filename) {
+        Record rec = _blobRefs.get(slice(filename));
+        uint64_t count = rec.exists() ? rec.bodyAsUInt() : 0;
+        if (count > 1) {
+            rec.setBodyAsUInt(count - 1);
+            _blobRefs.write(rec, _transaction);
+            return false;
+        }
+        _blobRefs.del(slice(filename), _transaction);
+        _garbage.set(slice(filename), nullslice, _transaction);
+        return true;
+    }
+
+
+    bool BlobReferences::isReferenced(slice filename) const {
+        return _blobRefs.get(filename, kMetaOnly).exists();
+    }
+
+
+    bool BlobReferences::collectGarbage(BlobStore &blobStore, unsigned maxBlobs) {
+        // Read the filenames first, since the enumerator can't be used while deleting records.
+        // One more than the limit is read, to tell whether there will be any left over.
+        vector<alloc_slice> filenames;
+        {
+            RecordEnumerator::Options options;
+            options.sortOption = kUnsorted;
+            options.contentOption = kMetaOnly;
+            RecordEnumerator e(_garbage, options);
+            while (filenames.size() <= maxBlobs && e.next())
+                filenames.push_back(e->key());
+        }
+        bool more = (filenames.size() > maxBlobs);
+        if (more)
+            filenames.pop_back();
+
+        for (auto &filename : filenames) {
+            // A document may have started using the blob again since it became garbage. If it's
+            // protected, it's about to be; if not, `Database::compact` will find it later.
+            if (!isReferenced(filename)) {
+                blobKey key;
+                if (key.readFromFilename(filename.asString()))
+                    blobStore.deleteUnlessProtected(key);
+            }
+            _garbage.del(filename, _transaction);
+        }
+        return more;
+    }
+
+
+    /*static*/ BlobReferences::BlobSet BlobReferences::decodeBlobSet(slice data) {
+        BlobSet blobs;
+        while (data.size > 0) {
+            auto sep = (const char*)data.findByte(kSeparator);
+            slice filename = sep ? slice(data.buf, sep) : data;
+            blobs.insert(filename.asString());
+            data.setStart(sep ? sep + 1 : data.end());
+        }
+        return blobs;
+    }
+
+
+    /*static*/ alloc_slice BlobReferences::encodeBlobSet(const BlobSet &blobs) {
+        string data;
+        for (auto &blob : blobs) {
+            if (!data.empty())
+                data += kSeparator;
+            data += blob;
+        }
+        return alloc_slice(data);
+    }
+
+}
@@ -0,0 +1,82 @@
+//
+// BlobReferences.hh
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include <set>
+#include <string>
+
+namespace litecore {
+    class BlobStore;
+    class DataFile;
+    class KeyStore;
+    class Transaction;
+
+    /** Persistent reference counts of the blobs used by a database's documents, so that
+        unreferenced blobs can be found without decoding every document.
+        It uses three KeyStores:
+        - "docBlobs" maps a docID to the filenames of the blobs its stored revisions reference;
+        - "blobRefs" maps a blob filename to the number of documents that reference it;
+        - "blobGarbage" holds the filenames of blobs whose count has dropped to zero, which are
+          candidates for deletion.
+        The tables are only kept up to date once they've been populated (see `isPopulated`.) */
+    class BlobReferences {
+    public:
+        using BlobSet = std::set<std::string>;
+
+        /** Number of unreferenced blobs deleted per call to `collectGarbage`. */
+        static constexpr unsigned kGarbageChunkSize = 100;
+
+        explicit BlobReferences(Transaction&);
+
+        /** True if the tables describe every document in the DataFile. Until they're populated
+            (by `Database::compact`) the only way to find the blobs in use is to scan all docs. */
+        static bool isPopulated(DataFile&);
+
+        /** Marks the tables as complete; from now on they must be kept up to date. */
+        void setPopulated();
+
+        /** Records the set of blobs referenced by a document's revisions, adjusting the counts
+            of blobs it's added or stopped referencing. Returns true if any blob's count dropped
+            to zero, i.e. if there's new garbage to collect. */
+        bool setDocumentBlobs(slice docID, const BlobSet&);
+
+        /** Removes a purged document's references. Returns true if there's new garbage. */
+        bool documentPurged(slice docID)                    {return setDocumentBlobs(docID, {});}
+
+        /** True if any document references the blob with this filename. */
+        bool isReferenced(slice filename) const;
+
+        /** Deletes up to `maxBlobs` unreferenced blobs from the BlobStore. Blobs the BlobStore
+            has protected (because they were just written) are kept, but no longer tracked as
+            garbage. Returns true if more remain to be deleted. */
+        bool collectGarbage(BlobStore&, unsigned maxBlobs =kGarbageChunkSize);
+
+    private:
+        static BlobSet decodeBlobSet(slice);
+        static alloc_slice encodeBlobSet(const BlobSet&);
+        void addRef(const std::string &filename);
+        bool removeRef(const std::string &filename);
+
+        Transaction& _transaction;
+        KeyStore& _docBlobs;
+        KeyStore& _blobRefs;
+        KeyStore& _garbage;
+    };
+
+}
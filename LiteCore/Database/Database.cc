@@ -23,12 +23,15 @@
 #include "c4Document+Fleece.h"
 #include "BackgroundDB.hh"
 #include "Housekeeper.hh"
+#include "IndexBuilder.hh"
+#include "BlobReferences.hh"
 #include "DataFile.hh"
 #include "Record.hh"
 #include "SequenceTracker.hh"
 #include "FleeceImpl.hh"
 #include "BlobStore.hh"
 #include "Upgrader.hh"
+#include "VersionedDocument.hh"
 #include "SecureRandomize.hh"
 #include "StringUtil.hh"
 #include <functional>
@@ -115,6 +118,8 @@ namespace c4Internal {
         options.writeable = (config.flags & kC4DB_ReadOnly) == 0;
         options.upgradeable = (config.flags & kC4DB_NoUpgrade) == 0;
         options.useDocumentKeys = true;
+        options.separateRevBodies = (config.flags & kC4DB_SeparateRevBodies) != 0
+                                        && config.versioning == kC4RevisionTrees;
         options.encryptionAlgorithm = (EncryptionAlgorithm)config.encryptionKey.algorithm;
         if (options.encryptionAlgorithm != kNoEncryption) {
 #ifdef COUCHBASE_ENTERPRISE
@@ -164,10 +169,12 @@ namespace c4Internal {
             info.write(doc, t);
             (void)generateUUID(kPublicUUIDKey, t);
             (void)generateUUID(kPrivateUUIDKey, t);
+            BlobReferences(t).setPopulated();       // There are no docs, so nothing to scan
             t.commit();
         } else if (config.versioning != kC4RevisionTrees) {
             error::_throw(error::WrongFormat);
         }
+        _blobReferencesPopulated = BlobReferences::isPopulated(*_dataFile);
 
         // Set up the DocumentFactory:
         DocumentFactory* factory;
@@ -179,6 +186,10 @@ namespace c4Internal {
             default:                error::_throw(error::InvalidParameter);
         }
         _documentFactory.reset(factory);
+
+        // Resume populating any indexes whose background build was interrupted:
+        if (!(config.flags & kC4DB_ReadOnly) && defaultKeyStore().indexBuildsPending())
+            startIndexBuilder();
     }
 
 
@@ -186,6 +197,8 @@ namespace c4Internal {
         Assert(_transactionLevel == 0,
                "Database being destructed while in a transaction");
         FLEncoder_Free(_flEncoder);
+        if (_indexBuilder)
+            _indexBuilder->stop();      // it may still have a chunk scheduled on _backgroundDB
         // Eagerly close the data file to ensure that no other instances will
         // be trying to use me as a delegate (for example in externalTransactionCommitted)
         // after I'm already in an invalid state
@@ -246,56 +259,146 @@ namespace c4Internal {
         return factory->deleteFile(path);
     }
 
-    unordered_set<string> Database::collectBlobs() {
-        RecordEnumerator::Options options;
-        options.onlyBlobs = true;
-        options.sortOption = kUnsorted;
-        RecordEnumerator e(defaultKeyStore(), options);
-        unordered_set<string> usedDigests;
-        while (e.next()) {
-            Retained<Document> doc = documentFactory().newDocumentInstance(*e);
-            doc->selectCurrentRevision();
-            do {
-                if(!doc->loadSelectedRevBody()) {
-                    continue;
+    // Adds the filenames of all the blobs referenced by a revision body to `filenames`.
+    void Database::findBlobFilenames(const Dict *body, set<string> &filenames) {
+        // Iterate over blobs:
+        Document::findBlobReferences(body, [&](const Dict *blob) {
+            blobKey key;
+            if (Document::dictIsBlob(blob, key))    // get the key
+                filenames.insert(key.filename());
+            return true;
+        });
+
+        // Now look for old-style _attachments:
+        auto attachments = body->get(slice(kC4LegacyAttachmentsProperty));
+        if (attachments) {
+            blobKey key;
+            for (Dict::iterator i(attachments->asDict()); i; ++i) {
+                auto att = i.value()->asDict();
+                if (att) {
+                    const Value* digest = att->get(slice(kC4BlobDigestProperty));
+                    if (digest && key.readFromBase64(digest->asString())) {
+                        filenames.insert(key.filename());
+                    }
                 }
+            }
+        }
+    }
 
-                Retained<Doc> fleeceDoc = doc->fleeceDoc();
-                const Dict* body = fleeceDoc->asDict();
-
-                // Iterate over blobs:
-                Document::findBlobReferences(body, [&](const Dict *blob) {
-                    blobKey key;
-                    if (Document::dictIsBlob(blob, key))    // get the key
-                        usedDigests.insert(key.filename());
-                    return true;
-                });
 
-                // Now look for old-style _attachments:
-                auto attachments = body->get(slice(kC4LegacyAttachmentsProperty));
-                if (attachments) {
-                    blobKey key;
-                    for (Dict::iterator i(attachments->asDict()); i; ++i) {
-                        auto att = i.value()->asDict();
-                        if (att) {
-                            const Value* digest = att->get(slice(kC4BlobDigestProperty));
-                            if (digest && key.readFromBase64(digest->asString())) {
-                                usedDigests.insert(key.filename());
-                            }
-                        }
-                    }
+    // Scans every document with attachments, to record the blobs they reference. This only has
+    // to be done once, for a database created before blob references were tracked. The scan is
+    // done in batches, each in its own transaction, so the database isn't locked for long.
+    // Documents saved by other transactions in the meantime get higher sequences, so they're
+    // scanned again at the end -- even if they're now deleted or have no blobs, since they may
+    // have dropped blobs they were already counted as referencing.
+    void Database::populateBlobReferences() {
+        _dataFile->_logInfo("Scanning documents to record their blob references...");
+        const sequence_t startSequence = defaultKeyStore().lastSequence();
+        sequence_t lastSequence = 0;
+        bool done = false;
+        while (!done) {
+            TransactionHelper t(this);
+            BlobReferences refs(t);
+            RecordEnumerator::Options options;
+            options.onlyBlobs = (lastSequence < startSequence);
+            options.includeDeleted = !options.onlyBlobs;
+            RecordEnumerator e(defaultKeyStore(), lastSequence, options);
+            unsigned count = 0;
+            while (true) {
+                if (!e.next()) {
+                    // Finished this pass; if it was the first one, go on to the second:
+                    done = !options.onlyBlobs;
+                    lastSequence = max(lastSequence, startSequence);
+                    break;
+                } else if (options.onlyBlobs && e->sequence() > startSequence) {
+                    lastSequence = startSequence;
+                    break;
                 }
-            } while(doc->selectNextRevision());
+                Retained<Document> doc = documentFactory().newDocumentInstance(*e);
+                set<string> filenames;
+                doc->selectCurrentRevision();
+                do {
+                    if(!doc->loadSelectedRevBody()) {
+                        continue;
+                    }
+
+                    Retained<Doc> fleeceDoc = doc->fleeceDoc();
+                    if (fleeceDoc)
+                        findBlobFilenames(fleeceDoc->asDict(), filenames);
+                } while(doc->selectNextRevision());
+                refs.setDocumentBlobs(doc->docID, filenames);
+                lastSequence = e->sequence();
+                if (++count >= BlobReferences::kGarbageChunkSize)
+                    break;
+            }
+            if (done)
+                refs.setPopulated();
+            t.commit();
         }
-        
-        return usedDigests;
     }
 
+
+    // Keeps a document's blob references up to date; called from Document::save.
+    void Database::documentBlobsChanged(slice docID, const set<string> &blobFilenames) {
+        if (BlobReferences(transaction()).setDocumentBlobs(docID, blobFilenames))
+            _blobsUnreferenced = true;
+        // The blobs are referenced now, so they don't need protecting from garbage collection:
+        for (auto &filename : blobFilenames) {
+            blobKey key;
+            if (key.readFromFilename(filename))
+                blobStore()->unprotect(key);
+        }
+    }
+
+
+    // Deletes the files in the BlobStore that aren't referenced by any document, including
+    // ones that never were. Each batch of files is checked in a transaction, so no document
+    // referencing a blob can be saved between checking and deleting it.
+    void Database::deleteUnreferencedBlobs() {
+        auto tooOld = time(nullptr) - chrono::duration_cast<chrono::seconds>(
+                                                            BlobStore::kProtectionTime).count();
+        unique_ptr<TransactionHelper> t;
+        unsigned count = 0;
+        blobStore()->dir().forEachFile([&](const FilePath &path) {
+            string filename = path.fileName();
+            blobKey key;
+            if (key.readFromFilename(filename)) {
+                if (!t)
+                    t.reset(new TransactionHelper(this));
+                if (!BlobReferences(*t).isReferenced(slice(filename)))
+                    blobStore()->deleteUnlessProtected(key);
+                if (++count % BlobReferences::kGarbageChunkSize == 0) {
+                    t->commit();
+                    t.reset();
+                }
+            } else if (path.lastModified() < tooOld) {
+                path.del();         // Temporary file left behind by an incomplete write
+            }
+        });
+        if (t)
+            t->commit();
+    }
+
+
     void Database::compact() {
         mustNotBeInTransaction();
+        if (!_blobReferencesPopulated) {
+            populateBlobReferences();
+            _blobReferencesPopulated = true;
+        }
+
+        // Delete the blobs that have become unreferenced, a batch per transaction, then sweep
+        // the BlobStore for any that were never referenced by a saved document:
+        bool more;
+        do {
+            TransactionHelper t(this);
+            more = BlobReferences(t).collectGarbage(*blobStore());
+            t.commit();
+        } while (more);
+        deleteUnreferencedBlobs();
+
         dataFile()->compact();
-        unordered_set<string> digestsInUse = collectBlobs();
-        blobStore()->deleteAllExcept(digestsInUse);
     }
 
 
@@ -427,6 +530,10 @@ namespace c4Internal {
             _housekeeper->stop();
             _housekeeper = nullptr;
         }
+        if (_indexBuilder) {
+            _indexBuilder->stop();
+            _indexBuilder = nullptr;
+        }
         if (_backgroundDB)
             _backgroundDB->close();
     }
@@ -443,6 +550,18 @@ namespace c4Internal {
     }
 
 
+    void Database::startIndexBuilder() {
+        if (inTransaction()) {
+            // The index isn't visible to the background connection until the transaction commits
+            _buildIndexesAfterCommit = true;
+            return;
+        }
+        if (!_indexBuilder)
+            _indexBuilder = new IndexBuilder(this);
+        _indexBuilder->start();
+    }
+
+
 #pragma mark - UUIDS:
 
 
@@ -493,7 +612,15 @@ namespace c4Internal {
 
     void Database::beginTransaction() {
         if (++_transactionLevel == 1) {
-            _transaction = new Transaction(_dataFile.get());
+            try {
+                _transaction = new Transaction(_dataFile.get());
+            } catch (...) {
+                --_transactionLevel;
+                throw;
+            }
+            // Another connection may have populated the blob references since we checked:
+            if (!_blobReferencesPopulated)
+                _blobReferencesPopulated = BlobReferences::isPopulated(*_dataFile);
             if (_sequenceTracker) {
                 _sequenceTracker->use([](SequenceTracker &st) {
                     st.beginTransaction();
@@ -554,6 +681,18 @@ namespace c4Internal {
         }
         delete _transaction;
         _transaction = nullptr;
+
+        if (_blobsUnreferenced) {
+            _blobsUnreferenced = false;
+            if (committed && _housekeeper)
+                _housekeeper->blobsUnreferenced();
+        }
+
+        if (_buildIndexesAfterCommit) {
+            _buildIndexesAfterCommit = false;
+            if (committed)
+                startIndexBuilder();
+        }
     }
 
 
@@ -679,6 +818,10 @@ namespace c4Internal {
 
 
     bool Database::purgeDocument(slice docID) {
+        if (_dataFile->options().separateRevBodies)
+            VersionedDocument::deleteExternalBodies(defaultKeyStore(), docID, transaction());
+        if (_blobReferencesPopulated)
+            documentBlobsChanged(docID, {});
         if (!defaultKeyStore().del(docID, transaction()))
             return false;
         if (_sequenceTracker) {
@@ -691,14 +834,21 @@ namespace c4Internal {
 
 
     int64_t Database::purgeExpiredDocs() {
+        // The callback is called before each doc is deleted, so it can delete its blob references:
+        KeyStore::ExpirationCallback deleteBlobRefs;
+        if (_blobReferencesPopulated)
+            deleteBlobRefs = [&](slice docID) { documentBlobsChanged(docID, {}); };
+        auto &keyStore = _dataFile->defaultKeyStore();
         if (_sequenceTracker) {
             return _sequenceTracker->use<int64_t>([&](SequenceTracker &st) {
-                return _dataFile->defaultKeyStore().expireRecords([&](slice docID) {
+                return VersionedDocument::expireRecords(keyStore, transaction(), [&](slice docID) {
+                    if (deleteBlobRefs)
+                        deleteBlobRefs(docID);
                     st.documentPurged(docID);
                 });
             });
         } else {
-            return _dataFile->defaultKeyStore().expireRecords(nullptr);
+            return VersionedDocument::expireRecords(keyStore, transaction(), deleteBlobRefs);
         }
     }
 
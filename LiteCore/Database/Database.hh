@@ -27,6 +27,7 @@
 #include "access_lock.hh"
 #include <memory>
 #include <mutex>
+#include <set>
 #include <unordered_set>
 
 namespace fleece { namespace impl {
@@ -37,9 +38,11 @@ namespace fleece { namespace impl {
 } }
 namespace litecore {
     class SequenceTracker;
+    class BlobReferences;
     class BlobStore;
     class BackgroundDB;
     class Housekeeper;
+    class IndexBuilder;
 }
 
 
@@ -123,6 +126,7 @@ namespace c4Internal {
         int64_t purgeExpiredDocs();
         bool setExpiration(slice docID, expiration_t);
         bool startHousekeeping();
+        void startIndexBuilder();
 
 #if DEBUG
         void validateRevisionBody(slice body);
@@ -146,6 +150,7 @@ namespace c4Internal {
 
         void lockClientMutex()                              {_clientMutex.lock();}
         void unlockClientMutex()                            {_clientMutex.unlock();}
+        recursive_mutex& clientMutex()                      {return _clientMutex;}
 
         // DataFile::Delegate API:
         virtual slice fleeceAccessor(slice recordBody) const override;
@@ -162,6 +167,10 @@ namespace c4Internal {
     public:
         // should be private, but called from Document
         void documentSaved(Document* NONNULL);
+        bool tracksBlobReferences() const                   {return _blobReferencesPopulated;}
+        void documentBlobsChanged(slice docID, const std::set<std::string> &blobFilenames);
+        static void findBlobFilenames(const fleece::impl::Dict* NONNULL body,
+                                      std::set<std::string> &filenames);
 
     protected:
         virtual ~Database();
@@ -176,7 +185,8 @@ namespace c4Internal {
         UUID generateUUID(slice key, Transaction&, bool overwrite =false);
 
         std::unique_ptr<BlobStore> createBlobStore(const std::string &dirname, C4EncryptionKey) const;
-        std::unordered_set<std::string> collectBlobs();
+        void populateBlobReferences();
+        void deleteUnreferencedBlobs();
         void removeUnusedBlobs(const std::unordered_set<std::string> &used);
 
         FilePath                    _dataFilePath;          // Path of the DataFile
@@ -192,6 +202,10 @@ namespace c4Internal {
         recursive_mutex             _clientMutex;           // Mutex for c4db_lock/unlock
         unique_ptr<BackgroundDB>    _backgroundDB;          // for background operations
         Retained<Housekeeper>       _housekeeper;           // for expiration/cleanup tasks
+        Retained<IndexBuilder>      _indexBuilder;          // for background index builds
+        bool                        _buildIndexesAfterCommit {false}; // startIndexBuilder deferred
+        bool                        _blobReferencesPopulated {false}; // BlobReferences are in use
+        bool                        _blobsUnreferenced {false}; // Transaction created blob garbage
     };
 
 }
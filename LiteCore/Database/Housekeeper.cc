@@ -20,23 +20,32 @@
 #include "Database.hh"
 #include "SequenceTracker.hh"
 #include "BackgroundDB.hh"
+#include "BlobReferences.hh"
 #include "DataFile.hh"
+#include "VersionedDocument.hh"
 #include "Logging.hh"
 #include <inttypes.h>
+#include <optional>
 
 namespace litecore {
     using namespace c4Internal;
     using namespace actor;
 
+    // Pause between batches of blob deletions, giving other connections the write lock:
+    static constexpr delay_t kBlobCollectionInterval {0.005};
+
+
     Housekeeper::Housekeeper(Database *db)
     :Actor("Housekeeper")
     ,_bgdb(db->backgroundDatabase())
+    ,_blobStore(db->blobStore())
     ,_expiryTimer(std::bind(&Housekeeper::_doExpiration, this))
     { }
 
 
     void Housekeeper::start() {
         enqueue(&Housekeeper::_scheduleExpiration);
+        enqueue(&Housekeeper::_startBlobCollection);    // in case garbage was left over
     }
 
 
@@ -47,6 +56,7 @@ namespace litecore {
 
 
     void Housekeeper::_stop() {
+        _stopped = true;
         _expiryTimer.stop();
         LogToAt(DBLog, Verbose, "Housekeeper: stopped.");
     }
@@ -70,15 +80,23 @@ namespace litecore {
 
     void Housekeeper::_doExpiration() {
         LogToAt(DBLog, Verbose, "Housekeeper: expiring documents...");
-        _bgdb->useInTransaction([&](DataFile* dataFile, SequenceTracker *sequenceTracker) -> bool {
-            KeyStore::ExpirationCallback callback;
-            auto &keyStore = dataFile->defaultKeyStore();
-            if (sequenceTracker)
-                callback = [&](slice docID) { sequenceTracker->documentPurged(docID); };
-            keyStore.expireRecords(callback);
+        bool garbage = false;
+        _bgdb->useInTransaction([&](DataFile* dataFile, Transaction &t,
+                                    SequenceTracker *sequenceTracker) -> bool {
+            std::optional<BlobReferences> blobRefs;
+            if (BlobReferences::isPopulated(*dataFile))
+                blobRefs.emplace(t);
+            VersionedDocument::expireRecords(dataFile->defaultKeyStore(), t, [&](slice docID) {
+                if (blobRefs && blobRefs->documentPurged(docID))
+                    garbage = true;
+                if (sequenceTracker)
+                    sequenceTracker->documentPurged(docID);
+            });
             return true;
         });
 
+        if (garbage)
+            _startBlobCollection();
         _scheduleExpiration();
     }
 
@@ -92,4 +110,43 @@ namespace litecore {
             LogToAt(DBLog, Verbose, "Housekeeper: rescheduled expiration, now in %" PRIi64 "ms", delay);
     }
 
+
+    void Housekeeper::blobsUnreferenced() {
+        enqueue(&Housekeeper::_startBlobCollection);
+    }
+
+
+    void Housekeeper::_startBlobCollection() {
+        if (_collectingBlobs || _stopped)
+            return;
+        _collectingBlobs = true;
+        _collectBlobs();
+    }
+
+
+    // Deletes a batch of unreferenced blobs, then schedules the next batch if there are more.
+    void Housekeeper::_collectBlobs() {
+        if (_stopped)
+            return;
+        bool more = false;
+        try {
+            _bgdb->useInTransaction([&](DataFile* dataFile, Transaction &t,
+                                        SequenceTracker*) -> bool {
+                if (!BlobReferences::isPopulated(*dataFile))
+                    return false;
+                more = BlobReferences(t).collectGarbage(*_blobStore);
+                return true;
+            });
+        } catch (const std::exception &x) {
+            // The candidates are persistent, so they'll be retried next time.
+            LogToAt(DBLog, Error, "Housekeeper: error deleting unused blobs: %s", x.what());
+        }
+        if (more) {
+            enqueueAfter(kBlobCollectionInterval, &Housekeeper::_collectBlobs);
+        } else {
+            LogToAt(DBLog, Verbose, "Housekeeper: deleted unused blobs");
+            _collectingBlobs = false;
+        }
+    }
+
 }
@@ -16,6 +16,7 @@ namespace c4Internal {
 
 namespace litecore {
     class BackgroundDB;
+    class BlobStore;
 
     class Housekeeper : public actor::Actor {
     public:
@@ -32,14 +33,22 @@ namespace litecore {
         /// reschedule its next expiration for earlier if necessary.
         void documentExpirationChanged(expiration_t exp);
 
+        /// Informs the Housekeeper that blobs have become unreferenced, so it can delete them.
+        void blobsUnreferenced();
+
     private:
         void _start();
         void _stop();
         void _scheduleExpiration();
         void _doExpiration();
+        void _startBlobCollection();
+        void _collectBlobs();
 
         BackgroundDB* _bgdb;
+        BlobStore* _blobStore;
         actor::Timer _expiryTimer;
+        bool _collectingBlobs {false};
+        bool _stopped {false};
     };
 
 
@@ -0,0 +1,102 @@
+//
+// IndexBuilder.cc
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "IndexBuilder.hh"
+#include "Database.hh"
+#include "BackgroundDB.hh"
+#include "DataFile.hh"
+#include "Logging.hh"
+#include <algorithm>
+
+namespace litecore {
+    using namespace c4Internal;
+    using namespace actor;
+
+    // Pause between chunks, giving other connections a chance to get the write lock:
+    static constexpr delay_t kChunkInterval {0.005};
+
+    // Delays before retrying a chunk that failed; doubles with each consecutive failure:
+    static constexpr delay_t kMinRetryInterval {0.1}, kMaxRetryInterval {60.0};
+
+
+    IndexBuilder::IndexBuilder(Database *db)
+    :Actor("IndexBuilder")
+    ,_bgdb(db->backgroundDatabase())
+    { }
+
+
+    void IndexBuilder::start() {
+        enqueue(&IndexBuilder::_start);
+    }
+
+
+    void IndexBuilder::stop() {
+        enqueue(&IndexBuilder::_stop);
+        waitTillCaughtUp();
+    }
+
+
+    void IndexBuilder::_start() {
+        if (_building || _stopped)
+            return;
+        LogToAt(DBLog, Verbose, "IndexBuilder: building indexes...");
+        _building = true;
+        _buildChunk();
+    }
+
+
+    void IndexBuilder::_stop() {
+        _stopped = true;
+        LogToAt(DBLog, Verbose, "IndexBuilder: stopped.");
+    }
+
+
+    void IndexBuilder::_buildChunk() {
+        if (_stopped)
+            return;
+        bool more = false;
+        try {
+            _bgdb->useInTransaction([&](DataFile* dataFile, Transaction&, SequenceTracker*) -> bool {
+                more = buildChunk(dataFile);
+                return true;
+            });
+            _retryInterval = delay_t::zero();
+        } catch (const std::exception &x) {
+            // The pending work is persistent, so nothing is lost; but queries can't use the
+            // index until it's complete, so try again soon instead of waiting for a reopen.
+            _retryInterval = (_retryInterval == delay_t::zero()) ? kMinRetryInterval
+                                                : std::min(2 * _retryInterval, kMaxRetryInterval);
+            LogToAt(DBLog, Error, "IndexBuilder: error building index (retrying in %.1f sec): %s",
+                    _retryInterval.count(), x.what());
+            enqueueAfter(_retryInterval, &IndexBuilder::_buildChunk);
+            return;
+        }
+        if (more) {
+            enqueueAfter(kChunkInterval, &IndexBuilder::_buildChunk);
+        } else {
+            LogToAt(DBLog, Verbose, "IndexBuilder: finished building indexes");
+            _building = false;
+        }
+    }
+
+
+    bool IndexBuilder::buildChunk(DataFile *dataFile) {
+        return dataFile->defaultKeyStore().continueIndexBuilds(kChunkSize);
+    }
+
+}
@@ -0,0 +1,66 @@
+//
+// IndexBuilder.hh
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include "Actor.hh"
+
+namespace c4Internal {
+    class Database;
+}
+
+namespace litecore {
+    class BackgroundDB;
+    class DataFile;
+
+    /** Populates indexes that were created with the `background` option, on the BackgroundDB.
+        Each chunk of records is indexed in its own short transaction, so other writers are
+        only held up briefly. The pending work is persistent, so an interrupted build resumes
+        the next time the database is opened; if a chunk fails, it's retried after a delay that
+        grows with each consecutive failure. */
+    class IndexBuilder : public actor::Actor {
+    public:
+        /// Creates an IndexBuilder for a Database.
+        explicit IndexBuilder(c4Internal::Database* NONNULL);
+
+        /// Asynchronously starts building any pending indexes. Does nothing if already building.
+        void start();
+
+        /// Synchronously stops the IndexBuilder. After this returns it will do nothing.
+        void stop();
+
+        /// Number of records indexed per transaction.
+        static constexpr unsigned kChunkSize = 1000;
+
+    protected:
+        /// Indexes the next chunk of records, in a transaction on `dataFile`. Returns true if
+        /// there's more to do. (Virtual so tests can inject failures.)
+        virtual bool buildChunk(DataFile* NONNULL);
+
+    private:
+        void _start();
+        void _stop();
+        void _buildChunk();
+
+        BackgroundDB* _bgdb;
+        actor::delay_t _retryInterval {0};  // Delay before retrying a failed chunk; 0 if none
+        bool _building {false};
+        bool _stopped {false};
+    };
+
+}
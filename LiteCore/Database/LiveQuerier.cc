@@ -46,6 +46,7 @@ namespace litecore {
     :Logging(QueryLog)
     ,_database(db)
     ,_backgroundDB(db->backgroundDatabase())
+    ,_reader(_backgroundDB->acquireReader())
     ,_expression(query->expression())
     ,_language(query->language())
     ,_continuous(continuous)
@@ -53,14 +54,17 @@ namespace litecore {
     {
         logInfo("Created on Query %s", query->loggingName().c_str());
         // Note that we don't keep a reference to `_query`, because it's tied to `db`, but we
-        // need to run the query on `_backgroundDB`. So instead we save the query text and
+        // need to run the query on `_reader`. So instead we save the query text and
         // language, and create a new Query instance the first time `_runQuery` is called.
+        // (Compiling `query` on `db` already made any schema change it needs, such as adding the
+        // `expiration` column, which the read-only reader couldn't make itself.)
     }
 
 
     LiveQuerier::~LiveQuerier() {
         if (_query)
             _stop();
+        _backgroundDB->releaseReader(_reader);
         logVerbose("Deleted");
     }
 
@@ -94,7 +98,7 @@ namespace litecore {
 
     void LiveQuerier::_stop() {
         if (_query) {
-            _backgroundDB->use([&](DataFile *df) {
+            _reader->use([&](DataFile *df) {
                 _query = nullptr;
                 _currentEnumerator = nullptr;
                 if (_continuous)
@@ -130,32 +134,50 @@ namespace litecore {
         _waitingToRun = false;
         logVerbose("Running query...");
         Retained<QueryEnumerator> newQE;
+        bool unchanged = false;
         C4Error error = {};
         fleece::Stopwatch st;
-        _backgroundDB->use([&](DataFile *df) {
+        _reader->use([&](DataFile *df) {
             try {
-                // Create my own Query object associated with the Backgrounder's DataFile:
+                if (!df)
+                    error::_throw(error::NotOpen);
+                // Create my own Query object associated with the background reader's DataFile.
+                // A continuous query asks to be incremental, so that later runs only need to
+                // re-evaluate the docs that changed:
                 if (!_query) {
-                    _query = df->defaultKeyStore().compileQuery(_expression, _language);
+                    _query = df->defaultKeyStore().compileQuery(_expression, _language,
+                                                                _continuous);
                     if (_continuous)
                         _backgroundDB->addTransactionObserver(this);
                 }
-                // Now run the query:
-                newQE = _query->createEnumerator(&options);
+                // Now run the query, or refresh the current results:
+                if (_currentEnumerator) {
+                    bool changed;
+                    newQE = _currentEnumerator->refreshAdvancing(_query, changed);
+                    if (!changed) {
+                        // Keep the up-to-date copy, but don't notify the delegate:
+                        if (newQE)
+                            _currentEnumerator = newQE;
+                        newQE = nullptr;
+                        unchanged = true;
+                    }
+                } else {
+                    newQE = _query->createEnumerator(&options);
+                }
             } catchError(&error);
         });
         auto time = st.elapsedMS();
 
-        if (!newQE)
+        if (!newQE && !unchanged)
             logError("Query failed with error %s", c4error_descriptionStr(error));
 
         if (_continuous) {
+            if (unchanged) {
+                logVerbose("Results unchanged at seq %" PRIu64 " (%.3fms)",
+                           _currentEnumerator->lastSequence(), time);
+                return; // no delegate call
+            }
             if (newQE) {
-                if (_currentEnumerator && !_currentEnumerator->obsoletedBy(newQE)) {
-                    logVerbose("Results unchanged at seq %" PRIu64 " (%.3fms)",
-                               newQE->lastSequence(), time);
-                    return; // no delegate call
-                }
                 logInfo("Results changed at seq %" PRIu64 " (%.3fms)", newQE->lastSequence(), time);
                 _currentEnumerator = newQE;
             }
@@ -60,6 +60,7 @@ namespace litecore {
 
         Retained<c4Internal::Database> _database;       // The database
         BackgroundDB* _backgroundDB;                    // Shadow DB on background thread
+        BackgroundDB::Reader* _reader;                  // Pooled connection the query runs on
         Delegate* _delegate;                            // Whom ya gonna call?
         alloc_slice _expression;                        // The query text
         QueryLanguage _language;                        // The query language (JSON or N1QL)
@@ -61,6 +61,7 @@ namespace c4Internal {
         :Document(other)
         ,_versionedDoc(other._versionedDoc)
         ,_selectedRev(nullptr)
+        ,_savedWithAttachments(other._savedWithAttachments)
         {
             if (other._selectedRev)
                 _selectedRev = _versionedDoc[other._selectedRev->revID];
@@ -78,6 +79,7 @@ namespace c4Internal {
             flags = (C4DocumentFlags)_versionedDoc.flags();
             if (_versionedDoc.exists())
                 flags = (C4DocumentFlags)(flags | kDocExists);
+            _savedWithAttachments = _versionedDoc.hasAttachments();
 
             initRevID();
             selectCurrentRevision();
@@ -111,6 +113,8 @@ namespace c4Internal {
 
         bool loadSelectedRevBody() override {
             loadRevisions();
+            if (!selectedRev.body.buf && _selectedRev && _selectedRev->isBodyExternal())
+                selectedRev.body = _selectedRev->body();    // reads it from the body store
             return selectedRev.body.buf != nullptr;
         }
 
@@ -121,7 +125,8 @@ namespace c4Internal {
                 selectedRev.revID = _selectedRevIDBuf;
                 selectedRev.flags = (C4RevisionFlags)rev->flags;
                 selectedRev.sequence = rev->sequence;
-                selectedRev.body = rev->body();
+                // (An out-of-line body isn't read until loadSelectedRevBody, since that can throw)
+                selectedRev.body = rev->isBodyExternal() ? nullslice : rev->body();
                 return true;
             } else {
                 clearSelectedRevision();
@@ -235,7 +240,11 @@ namespace c4Internal {
                 _versionedDoc.prune(maxRevTreeDepth);
             else
                 _versionedDoc.prune();
-            switch (_versionedDoc.save(_db->transaction())) {
+            bool changed = _versionedDoc.changed();
+            auto result = _versionedDoc.save(_db->transaction());
+            if (result != litecore::VersionedDocument::kConflict && changed)
+                updateBlobReferences();
+            switch (result) {
                 case litecore::VersionedDocument::kConflict:
                     return false;
                 case litecore::VersionedDocument::kNoNewSequence:
@@ -252,6 +261,28 @@ namespace c4Internal {
             }
         }
 
+        // Tells the Database which blobs the stored revisions now reference. Skipped for docs
+        // that have never had attachments, so they don't pay for the lookup.
+        void updateBlobReferences() {
+            bool hasAttachments = _versionedDoc.hasAttachments();
+            if (_db->tracksBlobReferences() && (hasAttachments || _savedWithAttachments)) {
+                set<string> blobs;
+                if (hasAttachments) {
+                    for (auto rev : _versionedDoc.allRevisions()) {
+                        if (rev->hasAttachments()) {
+                            slice body = rev->body();
+                            if (body.size > 0) {
+                                Retained<Doc> doc = _versionedDoc.fleeceDocFor(body);
+                                Database::findBlobFilenames(doc->asDict(), blobs);
+                            }
+                        }
+                    }
+                }
+                _db->documentBlobsChanged(_versionedDoc.docID(), blobs);
+            }
+            _savedWithAttachments = hasAttachments;
+        }
+
         int32_t purgeRevision(C4Slice revID) override {
             int32_t total;
             if (revID.buf)
@@ -509,6 +540,7 @@ namespace c4Internal {
     private:
         VersionedDocument _versionedDoc;
         const Rev *_selectedRev;
+        bool _savedWithAttachments {false};     // Did the saved doc have attachments?
     };
 
 
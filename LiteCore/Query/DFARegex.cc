@@ -0,0 +1,521 @@
+//
+// DFARegex.cc
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "DFARegex.hh"
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+using namespace fleece;
+
+namespace litecore {
+
+    // Largest repeat count allowed in a `{n,m}` quantifier.
+    static constexpr int kMaxRepeat = 1000;
+
+    // Largest NFA allowed; bigger patterns are left to std::regex.
+    static constexpr size_t kMaxNFAStates = 10000;
+
+    // Max number of DFA states cached. (Each takes about 1KB.) When the cache fills up, it's
+    // cleared and rebuilt as needed.
+    static constexpr size_t kMaxDFAStates = 500;
+
+
+    // Parse tree of a pattern.
+    struct DFARegex::Node {
+        enum Type {
+            kBytes,         // Matches one byte in `bytes`
+            kConcat,        // Matches `kids` in sequence (or the empty string, if no kids)
+            kAlt,           // Matches any of `kids`
+            kRepeat,        // Matches `min` to `max` (-1 = unlimited) repetitions of kids[0]
+        };
+
+        explicit Node(Type t)   :type(t) { }
+
+        Type type;
+        ByteSet bytes;
+        vector<unique_ptr<Node>> kids;
+        int min {1}, max {1};
+    };
+
+
+    namespace {
+        using ByteSet = bitset<256>;
+        using Node = DFARegex::Node;
+
+        // Thrown when a pattern uses syntax that isn't supported (or is invalid.)
+        struct Unsupported { };
+
+
+        static ByteSet byteRange(int lo, int hi) {
+            ByteSet bytes;
+            for (int c = lo; c <= hi; ++c)
+                bytes.set(c);
+            return bytes;
+        }
+
+        static ByteSet digitBytes()     {return byteRange('0', '9');}
+        static ByteSet wordBytes()      {return digitBytes() | byteRange('A', 'Z')
+                                                | byteRange('a', 'z') | byteRange('_', '_');}
+        static ByteSet spaceBytes()     {return byteRange('\t', '\r') | byteRange(' ', ' ');}
+
+        static int hexDigit(int c) {
+            if (c >= '0' && c <= '9')   return c - '0';
+            if (c >= 'a' && c <= 'f')   return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F')   return c - 'A' + 10;
+            throw Unsupported();
+        }
+
+
+        // Recursive-descent parser for the ECMAScript subset that DFARegex supports.
+        class Parser {
+        public:
+            explicit Parser(slice pattern)  :_pat(pattern) { }
+
+            unique_ptr<Node> parse() {
+                if (peek('^')) {
+                    ++_pos;
+                    anchoredStart = true;
+                }
+                auto root = parseAlternation();
+                if (_pos < _pat.size)
+                    throw Unsupported();        // unbalanced ')'
+                if ((anchoredStart || anchoredEnd) && root->type == Node::kAlt)
+                    throw Unsupported();        // anchor applies to only one alternative
+                return root;
+            }
+
+            bool anchoredStart {false}, anchoredEnd {false};
+
+        private:
+            bool atEnd() const          {return _pos >= _pat.size;}
+            bool peek(char c) const     {return !atEnd() && _pat[_pos] == c;}
+
+            uint8_t nextByte() {
+                if (atEnd())
+                    throw Unsupported();
+                return _pat[_pos++];
+            }
+
+            static unique_ptr<Node> bytesNode(const ByteSet &bytes) {
+                auto node = make_unique<Node>(Node::kBytes);
+                node->bytes = bytes;
+                return node;
+            }
+
+            unique_ptr<Node> parseAlternation() {
+                auto first = parseConcatenation();
+                if (!peek('|'))
+                    return first;
+                auto alt = make_unique<Node>(Node::kAlt);
+                alt->kids.push_back(move(first));
+                while (peek('|')) {
+                    ++_pos;
+                    alt->kids.push_back(parseConcatenation());
+                }
+                return alt;
+            }
+
+            unique_ptr<Node> parseConcatenation() {
+                auto cat = make_unique<Node>(Node::kConcat);
+                while (!atEnd() && !peek('|') && !peek(')'))
+                    cat->kids.push_back(parseRepetition());
+                return cat;
+            }
+
+            unique_ptr<Node> parseRepetition() {
+                auto atom = parseAtom();
+                int min, max;
+                if (peek('*')) {
+                    min = 0; max = -1; ++_pos;
+                } else if (peek('+')) {
+                    min = 1; max = -1; ++_pos;
+                } else if (peek('?')) {
+                    min = 0; max = 1; ++_pos;
+                } else if (peek('{')) {
+                    ++_pos;
+                    min = max = parseNumber();
+                    if (peek(',')) {
+                        ++_pos;
+                        max = peek('}') ? -1 : parseNumber();
+                    }
+                    if (nextByte() != '}' || (max >= 0 && max < min))
+                        throw Unsupported();
+                } else {
+                    return atom;
+                }
+                // A lazy quantifier matches the same strings, just preferring shorter ones, which
+                // doesn't affect whether or where a match starts:
+                if (peek('?'))
+                    ++_pos;
+                if (peek('*') || peek('+') || peek('?') || peek('{'))
+                    throw Unsupported();
+                auto rep = make_unique<Node>(Node::kRepeat);
+                rep->min = min;
+                rep->max = max;
+                rep->kids.push_back(move(atom));
+                return rep;
+            }
+
+            int parseNumber() {
+                int n = 0;
+                if (atEnd() || !isdigit(_pat[_pos]))
+                    throw Unsupported();
+                while (!atEnd() && isdigit(_pat[_pos])) {
+                    n = 10 * n + (_pat[_pos++] - '0');
+                    if (n > kMaxRepeat)
+                        throw Unsupported();
+                }
+                return n;
+            }
+
+            unique_ptr<Node> parseAtom() {
+                uint8_t c = nextByte();
+                switch (c) {
+                    case '(': {
+                        if (peek('?')) {
+                            // Only non-capturing groups; lookaheads aren't regular.
+                            ++_pos;
+                            if (nextByte() != ':')
+                                throw Unsupported();
+                        }
+                        ++_depth;
+                        auto group = parseAlternation();
+                        --_depth;
+                        if (nextByte() != ')')
+                            throw Unsupported();
+                        return group;
+                    }
+                    case '.': {
+                        ByteSet bytes;
+                        bytes.set();
+                        bytes.reset('\n');
+                        bytes.reset('\r');
+                        return bytesNode(bytes);
+                    }
+                    case '[':
+                        return bytesNode(parseClass());
+                    case '\\': {
+                        ByteSet bytes;
+                        parseEscape(bytes);
+                        return bytesNode(bytes);
+                    }
+                    case '$':
+                        if (atEnd() && _depth == 0) {
+                            anchoredEnd = true;
+                            return make_unique<Node>(Node::kConcat);
+                        }
+                        throw Unsupported();
+                    case '^': case '*': case '+': case '?': case '{': case '}': case ']': case ')':
+                        throw Unsupported();
+                    default: {
+                        ByteSet bytes;
+                        bytes.set(c);
+                        return bytesNode(bytes);
+                    }
+                }
+            }
+
+            // Parses the rest of a `[...]` character class.
+            ByteSet parseClass() {
+                bool negate = peek('^');
+                if (negate)
+                    ++_pos;
+                if (peek(']'))
+                    throw Unsupported();        // `[]` and `[^]` are special in ECMAScript
+                ByteSet bytes;
+                while (!peek(']')) {
+                    ByteSet item;
+                    int lo = parseClassAtom(item);
+                    if (peek('-') && _pos + 1 < _pat.size && _pat[_pos + 1] != ']') {
+                        ++_pos;
+                        int hi = parseClassAtom(item);
+                        // Ranges of non-ASCII bytes depend on std::regex's `char` signedness:
+                        if (lo < 0 || hi < 0 || lo > hi || hi >= 0x80)
+                            throw Unsupported();
+                        item = byteRange(lo, hi);
+                    }
+                    bytes |= item;
+                }
+                ++_pos;
+                if (negate)
+                    bytes.flip();
+                return bytes;
+            }
+
+            // Parses a single item in a character class, adding its bytes to `bytes`.
+            // Returns the byte if it was a single byte, else -1.
+            int parseClassAtom(ByteSet &bytes) {
+                uint8_t c = nextByte();
+                if (c == '\\')
+                    return parseEscape(bytes);
+                else if (c == '[')
+                    throw Unsupported();        // POSIX classes like `[:alpha:]`
+                bytes.set(c);
+                return c;
+            }
+
+            // Parses the rest of a backslash escape, adding its bytes to `bytes`.
+            // Returns the byte if it's a single byte, else -1.
+            int parseEscape(ByteSet &bytes) {
+                uint8_t c = nextByte();
+                switch (c) {
+                    case 'd':   bytes |= digitBytes(); return -1;
+                    case 'D':   bytes |= ~digitBytes(); return -1;
+                    case 'w':   bytes |= wordBytes(); return -1;
+                    case 'W':   bytes |= ~wordBytes(); return -1;
+                    case 's':   bytes |= spaceBytes(); return -1;
+                    case 'S':   bytes |= ~spaceBytes(); return -1;
+                    case 't':   c = '\t'; break;
+                    case 'n':   c = '\n'; break;
+                    case 'v':   c = '\v'; break;
+                    case 'f':   c = '\f'; break;
+                    case 'r':   c = '\r'; break;
+                    case 'x': {
+                        int hi = hexDigit(nextByte());
+                        c = uint8_t(16 * hi + hexDigit(nextByte()));
+                        break;
+                    }
+                    default:
+                        // Backreferences, `\b`, `\B`, `\c`, `\u`, `\0` etc. aren't supported:
+                        if (isalnum(c) || c >= 0x80)
+                            throw Unsupported();
+                        break;
+                }
+                bytes.set(c);
+                return c;
+            }
+
+            slice _pat;
+            size_t _pos {0};
+            int _depth {0};
+        };
+    }
+
+
+#pragma mark - AUTOMATON:
+
+
+    DFARegex::Automaton::Automaton(const Node &root, bool reverse, bool unanchored)
+    :_reverse(reverse)
+    ,_unanchored(unanchored)
+    {
+        _nfaMatch = addNFAState({});
+        _nfaStart = build(root, _nfaMatch);
+        vector<bool> seen(_nfa.size());
+        addClosure(_nfaStart, _startSet, seen);
+        sort(_startSet.begin(), _startSet.end());
+    }
+
+
+    int DFARegex::Automaton::addNFAState(NFAState s) {
+        if (_nfa.size() >= kMaxNFAStates)
+            throw Unsupported();
+        _nfa.push_back(move(s));
+        return int(_nfa.size() - 1);
+    }
+
+
+    // Adds NFA states matching `node` that lead to state `next`; returns the entry state.
+    // A reverse automaton matches the reversed strings, so it concatenates backwards.
+    int DFARegex::Automaton::build(const Node &node, int next) {
+        switch (node.type) {
+            case Node::kBytes: {
+                NFAState s;
+                s.bytes = node.bytes;
+                s.outs = {next};
+                return addNFAState(move(s));
+            }
+            case Node::kConcat:
+                if (_reverse) {
+                    for (auto i = node.kids.begin(); i != node.kids.end(); ++i)
+                        next = build(**i, next);
+                } else {
+                    for (auto i = node.kids.rbegin(); i != node.kids.rend(); ++i)
+                        next = build(**i, next);
+                }
+                return next;
+            case Node::kAlt: {
+                NFAState s;
+                s.split = true;
+                for (auto &kid : node.kids)
+                    s.outs.push_back(build(*kid, next));
+                return addNFAState(move(s));
+            }
+            case Node::kRepeat: {
+                const Node &kid = *node.kids[0];
+                if (node.max < 0) {
+                    // Unlimited: a split that either loops through the kid or exits.
+                    int loop = addNFAState({});
+                    int body = build(kid, loop);
+                    _nfa[loop].split = true;
+                    _nfa[loop].outs = {body, next};
+                    next = loop;
+                } else {
+                    // Optional repetitions, each of which can exit early:
+                    int exit = next;
+                    for (int i = node.min; i < node.max; ++i) {
+                        NFAState s;
+                        s.split = true;
+                        s.outs = {build(kid, next), exit};
+                        next = addNFAState(move(s));
+                    }
+                }
+                for (int i = 0; i < node.min; ++i)
+                    next = build(kid, next);
+                return next;
+            }
+        }
+        return next;
+    }
+
+
+    // Adds the NFA states reachable from `nfaState` by epsilon transitions (not including
+    // splits themselves) to `set`.
+    void DFARegex::Automaton::addClosure(int nfaState, StateSet &set, vector<bool> &seen) const {
+        vector<int> stack {nfaState};
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            if (seen[s])
+                continue;
+            seen[s] = true;
+            if (_nfa[s].split)
+                stack.insert(stack.end(), _nfa[s].outs.rbegin(), _nfa[s].outs.rend());
+            else
+                set.push_back(s);
+        }
+    }
+
+
+    // Returns the DFA state representing a (sorted) set of NFA states, creating it if necessary.
+    int DFARegex::Automaton::stateFor(StateSet &&set) {
+        auto i = _dfaIndex.find(set);
+        if (i != _dfaIndex.end())
+            return i->second;
+        if (_dfa.size() >= kMaxDFAStates) {
+            // Cache is full; start over. Callers only hold onto the state being returned.
+            _dfa.clear();
+            _dfaIndex.clear();
+            _dfaStart = -1;
+        }
+        DFAState state;
+        state.accepting = binary_search(set.begin(), set.end(), _nfaMatch);
+        fill(begin(state.next), end(state.next), -1);
+        state.nfaStates = move(set);
+        int index = int(_dfa.size());
+        _dfaIndex.emplace(state.nfaStates, index);
+        _dfa.push_back(move(state));
+        return index;
+    }
+
+
+    int DFARegex::Automaton::start() {
+        if (_dfaStart < 0)
+            _dfaStart = stateFor(StateSet(_startSet));
+        return _dfaStart;
+    }
+
+
+    int DFARegex::Automaton::next(int state, uint8_t byte) {
+        int next = _dfa[state].next[byte];
+        if (next >= 0)
+            return next;
+
+        StateSet set;
+        vector<bool> seen(_nfa.size());
+        for (int s : _dfa[state].nfaStates) {
+            if (_nfa[s].bytes[byte])
+                addClosure(_nfa[s].outs[0], set, seen);
+        }
+        if (_unanchored) {
+            // A match may begin at any position, so the start state is always live:
+            for (int s : _startSet) {
+                if (!seen[s])
+                    set.push_back(s);
+            }
+        }
+        sort(set.begin(), set.end());
+
+        size_t cacheSize = _dfa.size();
+        next = stateFor(move(set));
+        if (_dfa.size() >= cacheSize)           // (else the cache was cleared; `state` is gone)
+            _dfa[state].next[byte] = next;
+        return next;
+    }
+
+
+#pragma mark - DFAREGEX:
+
+
+    unique_ptr<DFARegex> DFARegex::compile(slice pattern) {
+        try {
+            Parser parser(pattern);
+            auto root = parser.parse();
+            return unique_ptr<DFARegex>(new DFARegex(*root,
+                                                     parser.anchoredStart, parser.anchoredEnd));
+        } catch (const Unsupported&) {
+            return nullptr;
+        }
+    }
+
+
+    DFARegex::DFARegex(const Node &root, bool anchoredStart, bool anchoredEnd)
+    :_anchoredStart(anchoredStart)
+    ,_anchoredEnd(anchoredEnd)
+    ,_forward(root, false, !anchoredStart)
+    ,_reverse(root, true, !anchoredEnd)
+    { }
+
+
+    bool DFARegex::search(slice str) {
+        // Without a `$`, the first time the DFA reaches an accepting state there's a match.
+        int state = _forward.start();
+        if (!_anchoredEnd && _forward.isAccepting(state))
+            return true;
+        for (size_t i = 0; i < str.size; ++i) {
+            state = _forward.next(state, str[i]);
+            if (_forward.isDead(state))
+                return false;
+            if (!_anchoredEnd && _forward.isAccepting(state))
+                return true;
+        }
+        return _forward.isAccepting(state);
+    }
+
+
+    int64_t DFARegex::position(slice str) {
+        if (_anchoredStart)
+            return search(str) ? 0 : -1;
+        // Run the reversed pattern backwards from the end of the string; every position at
+        // which it accepts is the start of a match, and the last one is the leftmost.
+        int64_t result = -1;
+        int state = _reverse.start();
+        if (_reverse.isAccepting(state))
+            result = str.size;
+        for (size_t i = str.size; i-- > 0; ) {
+            state = _reverse.next(state, str[i]);
+            if (_reverse.isDead(state))
+                break;
+            if (_reverse.isAccepting(state))
+                result = i;
+        }
+        return result;
+    }
+
+}
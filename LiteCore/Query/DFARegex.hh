@@ -0,0 +1,99 @@
+//
+// DFARegex.hh
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "fleece/slice.hh"
+#include <bitset>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace litecore {
+
+    /** A regular expression matcher that never backtracks: the pattern is compiled to an NFA,
+        which is run as a DFA whose states are built lazily as the input needs them. Matching
+        takes time linear in the length of the input.
+
+        Only the common subset of ECMAScript syntax is supported: literals, `.`, bracketed
+        character classes, `\d \w \s` and their negations, groups, alternation, greedy or lazy
+        quantifiers, and `^` / `$` at the start / end of the pattern. Like std::regex on `char`,
+        it matches bytes, not Unicode characters. `compile` returns nullptr for any other
+        pattern (backreferences, lookahead, `\b`, ...), in which case use std::regex instead.
+
+        An instance caches DFA states as it runs, so it's not thread-safe. */
+    class DFARegex {
+    public:
+        /** Compiles a pattern, or returns nullptr if it can't be handled (see above.) */
+        static std::unique_ptr<DFARegex> compile(fleece::slice pattern);
+
+        /** Returns true if the pattern matches any part of `str`, like std::regex_search. */
+        bool search(fleece::slice str);
+
+        /** Returns the offset in `str` at which the leftmost match starts, or -1 if none. */
+        int64_t position(fleece::slice str);
+
+        struct Node;
+
+    private:
+        using ByteSet = std::bitset<256>;
+
+        class Automaton {
+        public:
+            Automaton(const Node &root, bool reverse, bool unanchored);
+            int start();
+            int next(int state, uint8_t byte);
+            bool isAccepting(int state) const   {return _dfa[state].accepting;}
+            bool isDead(int state) const        {return _dfa[state].nfaStates.empty();}
+
+        private:
+            using StateSet = std::vector<int>;
+
+            struct NFAState {
+                ByteSet bytes;                  // Bytes that advance to outs[0] (if not a split)
+                std::vector<int> outs;          // Successor states
+                bool split {false};             // If true, an epsilon transition to all outs
+            };
+
+            struct DFAState {
+                StateSet nfaStates;             // Sorted NFA states (no splits) this represents
+                bool accepting;                 // True if nfaStates contains the match state
+                int next[256];                  // Successor for each byte, or -1 if not known yet
+            };
+
+            int addNFAState(NFAState);
+            int build(const Node&, int next);
+            void addClosure(int nfaState, StateSet &set, std::vector<bool> &seen) const;
+            int stateFor(StateSet&&);
+
+            std::vector<NFAState> _nfa;
+            int _nfaStart, _nfaMatch;
+            StateSet _startSet;                 // Closure of _nfaStart
+            bool _reverse, _unanchored;
+            std::vector<DFAState> _dfa;
+            std::map<StateSet,int> _dfaIndex;   // Maps StateSet -> index in _dfa
+            int _dfaStart {-1};
+        };
+
+        DFARegex(const Node &root, bool anchoredStart, bool anchoredEnd);
+
+        bool _anchoredStart, _anchoredEnd;      // Pattern starts with `^` / ends with `$`
+        Automaton _forward;                     // Finds whether there's a match
+        Automaton _reverse;                     // Runs backwards to find where a match starts
+    };
+
+}
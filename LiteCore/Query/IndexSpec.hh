@@ -38,6 +38,7 @@ namespace litecore {
             bool ignoreDiacritics;  ///< True to strip diacritical marks/accents from letters
             bool disableStemming;   ///< Disables stemming
             const char* stopWords;  ///< NULL for default, or comma-delimited string, or empty
+            bool background;        ///< Populate the index in the background, in chunks
         };
 
         IndexSpec(std::string name_,
@@ -67,14 +67,17 @@ namespace litecore {
             Options() { }
             
             Options(const Options &o)
-            :paramBindings(o.paramBindings), afterSequence(o.afterSequence) { }
+            :paramBindings(o.paramBindings), afterSequence(o.afterSequence)
+            ,streaming(o.streaming) { }
 
             template <class T>
-            Options(T bindings, sequence_t afterSeq =0, uint64_t withPurgeCount =0)
-            :paramBindings(bindings), afterSequence(afterSeq), purgeCount(withPurgeCount) { }
+            Options(T bindings, sequence_t afterSeq =0, uint64_t withPurgeCount =0,
+                    bool stream =false)
+            :paramBindings(bindings), afterSequence(afterSeq), purgeCount(withPurgeCount)
+            ,streaming(stream) { }
 
-            Options after(sequence_t afterSeq) const {return Options(paramBindings, afterSeq, purgeCount);}
-            Options withPurgeCount(uint64_t purgeCnt) const {return Options(paramBindings, afterSequence, purgeCnt);}
+            Options after(sequence_t afterSeq) const {return Options(paramBindings, afterSeq, purgeCount, streaming);}
+            Options withPurgeCount(uint64_t purgeCnt) const {return Options(paramBindings, afterSequence, purgeCnt, streaming);}
 
             bool notOlderThan(sequence_t afterSeq, uint64_t purgeCnt) const {
                 return afterSequence > 0 && afterSequence >= afterSeq && purgeCnt == purgeCount;
@@ -83,6 +86,7 @@ namespace litecore {
             alloc_slice const paramBindings;
             sequence_t const  afterSequence {0};
             uint64_t const purgeCount {0};
+            bool const streaming {false};   ///< Step the statement lazily instead of recording
         };
 
         virtual QueryEnumerator* createEnumerator(const Options* =nullptr) =0;
@@ -114,7 +118,8 @@ namespace litecore {
         virtual uint64_t missingColumns() const noexcept =0;
         
         /** Random access to rows. May not be supported by all implementations, but does work with
-            the current SQLite query implementation. */
+            the current SQLite query implementation. (A streaming enumerator has to run the
+            rest of the query to support these, so it loses its memory advantage.) */
         virtual int64_t getRowCount() const         {return -1;}
         virtual void seek(int64_t rowIndex)         {error::_throw(error::UnsupportedOperation);}
 
@@ -125,6 +130,17 @@ namespace litecore {
             that will return the new results. Otherwise returns null. */
         virtual QueryEnumerator* refresh(Query *query) =0;
 
+        /** Like refresh(), except that if the database has changed but the results haven't, it
+            returns an enumerator on the same results as of the database's current sequence, so
+            the next call doesn't have to look at those changes again. `outChanged` is set to
+            true only if the results changed. This enumerator is left alone, since other
+            threads may be using it. */
+        virtual QueryEnumerator* refreshAdvancing(Query *query, bool &outChanged) {
+            QueryEnumerator *e = refresh(query);
+            outChanged = (e != nullptr);
+            return e;
+        }
+
         virtual bool obsoletedBy(const QueryEnumerator*) =0;
 
     protected:
@@ -0,0 +1,77 @@
+//
+// QueryCache.cc
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "QueryCache.hh"
+
+using namespace std;
+
+namespace litecore {
+
+    QueryCache::TranslationRef QueryCache::get(const string &key, int64_t schemaVersion) {
+        lock_guard<mutex> lock(_mutex);
+        _clearIfStale(schemaVersion);
+        auto i = _index.find(key);
+        if (i == _index.end()) {
+            ++_misses;
+            return nullptr;
+        }
+        ++_hits;
+        _lru.splice(_lru.begin(), _lru, i->second);     // Move entry to front
+        return i->second->second;
+    }
+
+
+    void QueryCache::put(const string &key, int64_t schemaVersion, TranslationRef translation) {
+        lock_guard<mutex> lock(_mutex);
+        _clearIfStale(schemaVersion);
+        if (auto i = _index.find(key); i != _index.end()) {
+            i->second->second = move(translation);
+            _lru.splice(_lru.begin(), _lru, i->second);
+            return;
+        }
+        _lru.emplace_front(key, move(translation));
+        _index[key] = _lru.begin();
+        if (_lru.size() > _capacity) {
+            _index.erase(_lru.back().first);
+            _lru.pop_back();
+        }
+    }
+
+
+    void QueryCache::clear() {
+        lock_guard<mutex> lock(_mutex);
+        _lru.clear();
+        _index.clear();
+    }
+
+
+    QueryCache::Stats QueryCache::stats() const {
+        lock_guard<mutex> lock(_mutex);
+        return {_hits, _misses, _lru.size()};
+    }
+
+
+    void QueryCache::_clearIfStale(int64_t schemaVersion) {
+        if (schemaVersion != _schemaVersion) {
+            _lru.clear();
+            _index.clear();
+            _schemaVersion = schemaVersion;
+        }
+    }
+
+}
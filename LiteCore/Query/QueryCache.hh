@@ -0,0 +1,88 @@
+//
+// QueryCache.hh
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "fleece/slice.hh"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace litecore {
+
+    /** The result of translating a JSON or N1QL query into SQL: everything a SQLiteQuery needs
+        except the compiled SQLite statement itself. */
+    struct QueryTranslation {
+        fleece::alloc_slice      json;                  // JSON form of the query
+        std::string              sql;                   // Main SQL statement
+        std::string              changedRowsSQL;        // SQL for incremental updates, or empty
+        std::set<std::string>    parameters;            // Names of the bindable parameters
+        std::vector<std::string> ftsTables;             // Names of the FTS tables used
+        std::vector<std::string> columnTitles;          // Titles of result columns
+        unsigned                 firstCustomResultColumn;
+        bool                     usesExpiration;
+    };
+
+
+    /** An LRU cache of QueryTranslations belonging to a DataFile, so that compiling the same
+        query again skips the N1QL and JSON parsers and the QueryParser.
+        A translation depends on which index tables exist, so every entry is tagged with the
+        database's schema version (`PRAGMA schema_version`) and the cache is emptied when a
+        lookup sees a different version. Since a rollback reverts the version, the DataFile also
+        empties it when a transaction is aborted. Thread-safe. */
+    class QueryCache {
+    public:
+        static constexpr size_t kDefaultCapacity = 50;
+
+        using TranslationRef = std::shared_ptr<const QueryTranslation>;
+
+        explicit QueryCache(size_t capacity =kDefaultCapacity)  :_capacity(capacity) { }
+
+        /** Returns the cached translation for `key`, or null. */
+        TranslationRef get(const std::string &key, int64_t schemaVersion);
+
+        /** Adds a translation, evicting the least recently used one if the cache is full. */
+        void put(const std::string &key, int64_t schemaVersion, TranslationRef);
+
+        /** Removes all entries. */
+        void clear();
+
+        struct Stats {
+            uint64_t hits, misses;
+            size_t   count;
+        };
+
+        Stats stats() const;
+
+    private:
+        void _clearIfStale(int64_t schemaVersion);
+
+        using Entry = std::pair<std::string, TranslationRef>;
+
+        mutable std::mutex _mutex;
+        size_t const _capacity;
+        std::list<Entry> _lru;                                      // Most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+        int64_t _schemaVersion {-1};
+        uint64_t _hits {0}, _misses {0};
+    };
+
+}
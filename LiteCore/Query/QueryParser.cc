@@ -163,6 +163,9 @@ namespace litecore {
         _columnTitles.clear();
         _1stCustomResultCol = 0;
         _isAggregateQuery = _aggregatesOK = _propertiesUseSourcePrefix = _checkedExpiration = false;
+        _usesSubquery = false;
+        _incrementalSQL.clear();
+        _dbPrefix.clear();
 
         _aliases.insert({_dbAlias, kDBAlias});
     }
@@ -312,6 +315,31 @@ namespace litecore {
                 _sql << " LIMIT -1";            // SQL does not allow OFFSET without LIMIT
         }
         writeOrderOrLimitClause(operands, "OFFSET"_sl, "OFFSET");
+
+        // Save a variant with the docID as an extra column, if the results can be updated
+        // incrementally, i.e. each row depends only on its own document:
+        bool singleSource = all_of(_aliases.begin(), _aliases.end(), [](auto &alias) {
+            return alias.second == kDBAlias || alias.second == kResultAlias;
+        });
+        if (singleSource && !_isAggregateQuery && !_usesSubquery && _ftsTables.empty()
+                && _indexJoinTables.empty()
+                && !getCaseInsensitive(operands, "ORDER_BY"_sl)
+                && !getCaseInsensitive(operands, "LIMIT"_sl)
+                && !getCaseInsensitive(operands, "OFFSET"_sl)) {
+            if (!_dbAlias.empty())
+                _dbPrefix = quoteTableName(_dbAlias) + ".";
+            string str = _sql.str();
+            _incrementalSQL = str.substr(0, (size_t)startPosOfWhat) + _dbPrefix + "key, "
+                            + str.substr((size_t)startPosOfWhat);
+        }
+    }
+
+
+    string QueryParser::incrementalSQL(bool onlyChanged) const {
+        if (_incrementalSQL.empty() || !onlyChanged)
+            return _incrementalSQL;
+        // The WHERE clause is the last one, so the sequence test can be appended to it:
+        return _incrementalSQL + " AND " + _dbPrefix + "sequence > :since";
     }
 
 
@@ -1073,6 +1101,7 @@ namespace litecore {
             writeSelect(dict);
         } else {
             // Nested SELECT; use a fresh parser
+            _usesSubquery = true;
             QueryParser nested(this);
             nested.parse(dict);
             _sql << nested.SQL();
@@ -1358,11 +1387,21 @@ namespace litecore {
         if (param) {
             _sql << ", ";
             parseNode(param);
+        } else if (fn == kValueFnName && !property.empty() && isInResultList()) {
+            // A result column gets the row's sequence too, which lets fl_value cache the body
+            // decoded by the first column for the others. (Other clauses don't, because their
+            // expressions have to match the ones in CREATE INDEX.)
+            _sql << ", " << tablePrefix << "sequence";
         }
         _sql << ")";
     }
 
 
+    bool QueryParser::isInResultList() const {
+        return find(_context.begin(), _context.end(), &kResultListOperation) != _context.end();
+    }
+
+
     void QueryParser::writeUnnestPropertyGetter(slice fn, Path &property,
                                                 const string &alias, aliasType type)
     {
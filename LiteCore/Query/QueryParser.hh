@@ -81,6 +81,13 @@ namespace litecore {
         bool isAggregateQuery() const                               {return _isAggregateQuery;}
         bool usesExpiration() const                                 {return _checkedExpiration;}
 
+        /** If the query's results can be updated incrementally (it has a single source, and no
+            aggregates, subqueries, FTS, ordering or limits), returns its SQL with the docID
+            prepended as an extra result column; if `onlyChanged` is true, the rows are also
+            restricted to sequences greater than the parameter `:since`.
+            Otherwise returns an empty string. */
+        std::string incrementalSQL(bool onlyChanged =false) const;
+
         std::string expressionSQL(const fleece::impl::Value*);
         std::string whereClauseSQL(const fleece::impl::Value*, string_view dbAlias);
         std::string eachExpressionSQL(const fleece::impl::Value*);
@@ -184,6 +191,7 @@ namespace litecore {
         void writeCollation();
         void parseCollatableNode(const fleece::impl::Value*);
         void writeMetaProperty(slice fn, const std::string &tablePrefix, const char *property);
+        bool isInResultList() const;
 
         void parseJoin(const fleece::impl::Dict*);
 
@@ -216,6 +224,9 @@ namespace litecore {
         bool _isAggregateQuery {false};             // Is this an aggregate query?
         bool _checkedDeleted {false};               // Has query accessed _deleted meta-property?
         bool _checkedExpiration {false};            // Has query accessed _expiration meta-property?
+        bool _usesSubquery {false};                 // Does query contain a nested SELECT?
+        std::string _incrementalSQL;                // SQL with docID column, if incremental
+        std::string _dbPrefix;                      // Qualifier of the db's columns, if any
         Collation _collation;                       // Collation in use during parse
         bool _collationUsed {true};                 // Emitted SQL "COLLATION" yet?
         bool _functionWantsCollation {false};       // The current function wants to receive collation in its argument list
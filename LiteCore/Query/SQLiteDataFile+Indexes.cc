@@ -155,6 +155,68 @@ namespace litecore {
             sql << "DROP TRIGGER IF EXISTS \"" << tableName << "::" << kTriggerSuffixes[i] << "\";";
         }
         exec(sql.str());
+        unregisterIndexBuild(tableName);
+    }
+
+
+#pragma mark - BACKGROUND INDEX BUILDS:
+
+
+    /*  An index table created with the `background` option starts out empty; its triggers keep
+        it up to date as records change, while existing records are added to it in chunks by
+        SQLiteKeyStore::continueIndexBuilds. The pending work is stored in the 'indexBuilds'
+        table, which only exists while there is some:
+            - indexTableName (string primary key)
+            - keyStore (string)
+            - populateSQL (string): INSERT statement that indexes records with rowids in [?1, ?2]
+                that aren't already in the index table
+            - nextRowID (integer): the first rowid not yet indexed
+            - endRowID (integer): the last rowid that existed when the index was created */
+
+
+    bool SQLiteDataFile::indexBuildTableExists() const {
+        return tableExists("indexBuilds");
+    }
+
+
+    void SQLiteDataFile::registerIndexBuild(const string &indexTableName,
+                                            const string &keyStoreName,
+                                            const string &populateSQL,
+                                            int64_t endRowID)
+    {
+        Assert(inTransaction());
+        exec("CREATE TABLE IF NOT EXISTS indexBuilds (indexTableName TEXT PRIMARY KEY,"
+             " keyStore TEXT NOT NULL, populateSQL TEXT NOT NULL,"
+             " nextRowID INTEGER NOT NULL, endRowID INTEGER NOT NULL) WITHOUT ROWID");
+        SQLite::Statement stmt(*this, "INSERT OR REPLACE INTO indexBuilds "
+                                      "(indexTableName, keyStore, populateSQL, nextRowID, endRowID) "
+                                      "VALUES (?, ?, ?, 0, ?)");
+        stmt.bindNoCopy(1, indexTableName);
+        stmt.bindNoCopy(2, keyStoreName);
+        stmt.bindNoCopy(3, populateSQL);
+        stmt.bind(      4, (long long)endRowID);
+        LogStatement(stmt);
+        stmt.exec();
+    }
+
+
+    void SQLiteDataFile::unregisterIndexBuild(const string &indexTableName) {
+        if (!indexBuildTableExists())
+            return;
+        SQLite::Statement stmt(*this, "DELETE FROM indexBuilds WHERE indexTableName=?");
+        stmt.bindNoCopy(1, indexTableName);
+        LogStatement(stmt);
+        stmt.exec();
+    }
+
+
+    // True if an index table hasn't been fully populated yet, so queries mustn't use it.
+    bool SQLiteDataFile::indexTableIsBuilding(const string &indexTableName) const {
+        if (!indexBuildTableExists())
+            return false;
+        SQLite::Statement stmt(*_sqlDb, "SELECT 1 FROM indexBuilds WHERE indexTableName=?");
+        stmt.bindNoCopy(1, indexTableName);
+        return stmt.executeStep();
     }
 
 
@@ -55,10 +55,10 @@ namespace litecore {
         }
     }
 
-    // fl_value(body, propertyPath) -> propertyValue
+    // fl_value(body, propertyPath [, sequence]) -> propertyValue
     static void fl_value(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         try {
-            QueryFleeceScope scope(ctx, argv);
+            QueryFleeceScope scope(ctx, argv, (argc > 2 ? argv[2] : nullptr));
             setResultFromValue(ctx, scope.root);
         } catch (const std::exception &) {
             sqlite3_result_error(ctx, "fl_value: exception!", -1);
@@ -499,6 +499,7 @@ namespace litecore {
     const SQLiteFunctionSpec kFleeceFunctionsSpec[] = {
         { "fl_root",           1, fl_root },
         { "fl_value",          2, fl_value },
+        { "fl_value",          3, fl_value },
         { "fl_version",        1, fl_version },
         { "fl_nested_value",   2, fl_nested_value },
         { "fl_fts_value",      2, fl_fts_value },
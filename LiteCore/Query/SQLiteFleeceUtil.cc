@@ -36,23 +36,19 @@ namespace litecore {
     const char* const kFleeceValuePointerType = "FleeceValue";
 
 
-    static slice argAsDocBody(sqlite3_context* ctx, sqlite3_value *arg, bool &copied) {
-        copied = false;
+    // Returns the Fleece data of the document body in `arg`, or nullslice if there's none.
+    // Also sets `versionID` to the part of the record preceding the data, if any.
+    static slice argAsDocBody(sqlite3_context* ctx, sqlite3_value *arg, slice &versionID) {
         auto type = sqlite3_value_type(arg);
         if (type == SQLITE_NULL)
             return nullslice;             // No 'body' column; may be deleted doc
         Assert(type == SQLITE_BLOB);
         Assert(sqlite3_value_subtype(arg) == 0);
-        slice fleece = fleeceAccessor(ctx, valueAsSlice(arg));
-
-        if (size_t(fleece.buf) & 1) {
-            // Fleece data at odd addresses used to be allowed, and CBL 2.0/2.1 didn't 16-bit-align
-            // revision data, so it could occur. Now that it's not allowed, we have to work around
-            // this by copying the data to an even address. (#589)
-            fleece = fleece.copy();
-            copied = true;
-        }
-        return fleece;
+        slice record = valueAsSlice(arg);
+        slice data = fleeceAccessor(ctx, record);
+        if (data.buf > record.buf && data.buf < record.end())
+            versionID = slice(record.buf, data.buf);
+        return data;
     }
 
 
@@ -125,29 +121,103 @@ namespace litecore {
     }
 
 
-    QueryFleeceScope::QueryFleeceScope(sqlite3_context *ctx, sqlite3_value **argv)
-    :Scope(argAsDocBody(ctx, argv[0], _copied),
-           ((fleeceFuncContext*)sqlite3_user_data(ctx))->sharedKeys)
+    QueryFleeceScope::QueryFleeceScope(sqlite3_context *ctx, sqlite3_value **argv,
+                                       sqlite3_value *sequenceArg)
+    :root(nullptr)
     {
-        if (data()) {
-            root = Value::fromTrustedData(data());
-            if (!root) {
-                Warn("Invalid Fleece data in SQLite table");
-                error::_throw(error::CorruptRevisionData);
-            }
-        } else {
+        auto context = (fleeceFuncContext*)sqlite3_user_data(ctx);
+        slice versionID;
+        slice data = argAsDocBody(ctx, argv[0], versionID);
+        if (!data) {
             root = Dict::kEmpty;             // No current revision body; may be deleted rev
+        } else if (context->docCache && sequenceArg
+                       && sqlite3_value_type(sequenceArg) == SQLITE_INTEGER) {
+            auto sequence = (sequence_t)sqlite3_value_int64(sequenceArg);
+            root = context->docCache->root(sequence, versionID, data, context->sharedKeys);
+        }
+        if (data && !root) {
+            if (size_t(data.buf) & 1) {
+                // Fleece data at odd addresses used to be allowed, and CBL 2.0/2.1 didn't
+                // 16-bit-align revision data, so it could occur. Now that it's not allowed, we
+                // have to work around this by copying the data to an even address. (#589)
+                alloc_slice copied(data);
+                _scope.emplace(copied, context->sharedKeys);
+                data = copied;
+            } else {
+                _scope.emplace(data, context->sharedKeys);
+            }
+            root = Value::fromTrustedData(data);
+        }
+        if (!root) {
+            Warn("Invalid Fleece data in SQLite table");
+            error::_throw(error::CorruptRevisionData);
         }
         if (sqlite3_value_type(argv[1]) != SQLITE_NULL)
         root = evaluatePathFromArg(ctx, argv, 1, root);
     }
 
 
-    QueryFleeceScope::~QueryFleeceScope() {
-        if (_copied) {
-            unregister();
-            data().free();
+    bool QueryDocCache::Key::matches(sequence_t seq, slice vers, slice data,
+                                     SharedKeys *sk) const
+    {
+        return seq == sequence && data.size == dataSize && sk == sharedKeys
+            && vers == slice(versionID, versionIDSize);
+    }
+
+
+    void QueryDocCache::Key::set(sequence_t seq, slice vers, slice data, SharedKeys *sk) {
+        sequence = seq;
+        if (vers.size > 0)
+            memcpy(versionID, vers.buf, vers.size);
+        versionIDSize = vers.size;
+        dataSize = data.size;
+        sharedKeys = sk;
+    }
+
+
+    const Value* QueryDocCache::root(sequence_t sequence, slice versionID, slice data,
+                                     SharedKeys *sharedKeys)
+    {
+        if (versionID.size > kMaxVersionIDSize)
+            return nullptr;
+        Entry *victim = &_entries[0];
+        for (Entry &entry : _entries) {
+            if (entry.root && entry.key.matches(sequence, versionID, data, sharedKeys)) {
+                entry.lastUsed = ++_useCount;
+                return entry.root;
+            }
+            if (entry.lastUsed < victim->lastUsed)
+                victim = &entry;
+        }
+
+        if (!_lastUncached.matches(sequence, versionID, data, sharedKeys)) {
+            // First time this row's been seen; it may be the only time, so don't copy it yet.
+            _lastUncached.set(sequence, versionID, data, sharedKeys);
+            return nullptr;
+        }
+
+        // Second time; replace the least recently used entry with it:
+        _lastUncached = Key();
+        victim->scope.reset();
+        victim->root = nullptr;
+        victim->data = alloc_slice(data);               // (The copy is always evenly aligned.)
+        victim->scope.emplace(victim->data, sharedKeys);
+        victim->root = Value::fromTrustedData(victim->data);
+        victim->key.set(sequence, versionID, data, sharedKeys);
+        victim->lastUsed = ++_useCount;
+        return victim->root;
+    }
+
+
+    void QueryDocCache::clear() {
+        for (Entry &entry : _entries) {
+            entry.scope.reset();
+            entry.root = nullptr;
+            entry.data = nullslice;
+            entry.key = Key();
+            entry.lastUsed = 0;
         }
+        _lastUncached = Key();
     }
 
 
@@ -281,8 +351,10 @@ namespace litecore {
     }
 
 
-    void RegisterSQLiteFunctions(sqlite3 *db, fleeceFuncContext context)
+    shared_ptr<QueryDocCache> RegisterSQLiteFunctions(sqlite3 *db, fleeceFuncContext context)
     {
+        auto docCache = make_shared<QueryDocCache>();
+        context.docCache = docCache;
         registerFunctionSpecs(db, context, kFleeceFunctionsSpec);
         registerFunctionSpecs(db, context, kRankFunctionsSpec);
         registerFunctionSpecs(db, context, kN1QLFunctionsSpec);
@@ -294,7 +366,9 @@ namespace litecore {
         // The functions registered below operate on virtual tables, not on the actual db,
         // so they should not use the db's Fleece accessor. That's why we clear it first.
         context.delegate = nullptr;
+        context.docCache = nullptr;
         registerFunctionSpecs(db, context, kFleeceNullAccessorFunctionsSpec);
+        return docCache;
     }
 
 
@@ -21,6 +21,7 @@
 #include "DataFile.hh"
 #include "SQLite_Internal.hh"
 #include "FleeceImpl.hh"
+#include <optional>
 #include <sqlite3.h>
 
 
@@ -42,14 +43,68 @@ namespace litecore {
     }
 
     // Takes a document body from argv[0] and key-path from argv[1].
-    // Establishes a scope for the Fleece data, and evaluates the path, setting `root`
-    class QueryFleeceScope : public fleece::impl::Scope {
+    // Establishes a scope for the Fleece data, and evaluates the path, setting `root`.
+    // If `sequenceArg` is given, it's the row's `sequence` column, which lets the body be cached.
+    class QueryFleeceScope {
     public:
-        QueryFleeceScope(sqlite3_context *ctx, sqlite3_value **argv);
-        ~QueryFleeceScope();
+        QueryFleeceScope(sqlite3_context *ctx, sqlite3_value **argv,
+                         sqlite3_value *sequenceArg =nullptr);
         const fleece::impl::Value *root;
     private:
-        bool _copied;
+        std::optional<fleece::impl::Scope> _scope;  // Used if the body isn't in the QueryDocCache
+    };
+
+
+    // Remembers the Fleece bodies of the last few rows that fl_value was called on more than
+    // once, each copied and with a Scope registered, so the several calls made on one row don't
+    // each have to set one up.
+    // A row is recognized by its sequence, which the caller passes in (the QueryParser adds it to
+    // the fl_value calls in a SELECT's result columns), together with its `versionID`: the bytes
+    // of its record that precede the Fleece data (see DataFile::Delegate::fleeceAccessor.)
+    // A record gets a new sequence whenever its body changes, except when the current revision
+    // of a rev tree changes without a new one being added (a purge), which changes its revID.
+    // A rolled-back transaction can reuse sequences, so the DataFile clears the cache then.
+    // The body itself is never compared, and its address isn't trusted, since SQLite reads every
+    // row's column into the same buffer.
+    // A body is only copied the second time its row is seen, so a statement that reads each body
+    // once costs no more than it would without the cache; and several entries are kept, so a
+    // JOIN alternating between docs doesn't thrash it.
+    class QueryDocCache {
+    public:
+        // Returns the root Value of the Fleece document `data`, or nullptr if it isn't cached
+        // (yet), in which case the caller has to set up its own Scope.
+        const fleece::impl::Value* root(sequence_t, slice versionID, slice data,
+                                        fleece::impl::SharedKeys*);
+
+        // Forgets all cached bodies.
+        void clear();
+
+    private:
+        static constexpr size_t kMaxVersionIDSize = 64;
+        static constexpr size_t kNumEntries = 4;
+
+        struct Key {
+            sequence_t sequence {0};
+            uint8_t versionID[kMaxVersionIDSize];
+            size_t versionIDSize {0};
+            size_t dataSize {0};
+            fleece::impl::SharedKeys* sharedKeys {nullptr};
+
+            bool matches(sequence_t, slice versionID, slice data, fleece::impl::SharedKeys*) const;
+            void set(sequence_t, slice versionID, slice data, fleece::impl::SharedKeys*);
+        };
+
+        struct Entry {
+            Key key;
+            alloc_slice data;                               // Evenly-aligned copy of the body
+            std::optional<fleece::impl::Scope> scope;
+            const fleece::impl::Value* root {nullptr};
+            uint64_t lastUsed {0};
+        };
+
+        Entry _entries[kNumEntries];
+        Key _lastUncached;                  // The last row returned uncached
+        uint64_t _useCount {0};
     };
 
 
@@ -53,14 +53,20 @@ namespace litecore {
             db().exec(sql);
 
             QueryParser qp(*this);
+            qp.setBodyColumnName("old.body");
+            string oldValue = qp.expressionSQL(expression);
             qp.setBodyColumnName("new.body");
+            string newValue = qp.expressionSQL(expression);
             string eachExpr = qp.eachExpressionSQL(expression);
 
             // Populate the index-table with data from existing documents:
-            db().exec(CONCAT("INSERT INTO \"" << unnestTableName << "\" (docid, i, body) "
-                             "SELECT new.rowid, _each.rowid, _each.value " <<
-                             "FROM " << kvTableName << " as new, " << eachExpr << " AS _each "
-                             "WHERE (new.flags & 1) = 0"));
+            populateIndexTable(options, unnestTableName,
+                               CONCAT("INSERT INTO \"" << unnestTableName << "\" (docid, i, body) "
+                                      "SELECT new.rowid, _each.rowid, _each.value " <<
+                                      "FROM " << kvTableName << " as new, " << eachExpr << " AS _each "
+                                      "WHERE (new.flags & 1) = 0 AND new.rowid BETWEEN ?1 AND ?2 "
+                                      "AND NOT EXISTS (SELECT 1 FROM \"" << unnestTableName << "\" "
+                                                      "WHERE docid = new.rowid)"));
 
             // Set up triggers to keep the index-table up to date
             // ...on insertion:
@@ -81,15 +87,13 @@ namespace litecore {
                           "WHEN (old.flags & 1) = 0",
                           deleteTriggerExpr);
 
-            // ...on update:
-            createTrigger(unnestTableName, "preupdate",
-                          "BEFORE UPDATE OF body, flags",
-                          "WHEN (old.flags & 1) = 0",
-                          deleteTriggerExpr);
-            createTrigger(unnestTableName, "postupdate",
+            // ...on update, but only if the array changed or the doc was (un)deleted:
+            createTrigger(unnestTableName, "upd",
                           "AFTER UPDATE OF body, flags",
-                          "WHEN (new.flags & 1 = 0)",
-                          insertTriggerExpr);
+                          CONCAT("WHEN (old.flags & 1) != (new.flags & 1) OR "
+                                 << oldValue << " IS NOT " << newValue),
+                          CONCAT(deleteTriggerExpr << "; "
+                                 << insertTriggerExpr << "WHERE (new.flags & 1) = 0"));
         }
         return unnestTableName;
     }
@@ -43,14 +43,18 @@ namespace litecore {
         auto ftsTableName = FTSTableName(spec.name);
         // Collect the name of each FTS column and the SQL expression that populates it:
         QueryParser qp(*this);
-        qp.setBodyColumnName("new.body");
-        vector<string> colNames, colExprs;
+        vector<string> colNames, colExprs, colChanges;
         for (Array::iterator i(spec.what()); i; ++i) {
             colNames.push_back(CONCAT('"' << QueryParser::FTSColumnName(i.value()) << '"'));
-            colExprs.push_back(qp.FTSExpressionSQL(i.value()));
+            qp.setBodyColumnName("new.body");
+            string newExpr = qp.FTSExpressionSQL(i.value());
+            qp.setBodyColumnName("old.body");
+            colChanges.push_back(CONCAT(qp.FTSExpressionSQL(i.value()) << " IS NOT " << newExpr));
+            colExprs.push_back(move(newExpr));
         }
         string columns = join(colNames, ", ");
         string exprs = join(colExprs, ", ");
+        string changes = join(colChanges, " OR ");
 
         auto where = spec.where();
         qp.setBodyColumnName("body");
@@ -68,9 +72,12 @@ namespace litecore {
         }
 
         // Index the existing records:
-        db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
-                         "SELECT rowid, " << exprs << " FROM kv_" << name() << " AS new "
-                         << whereNewSQL));
+        populateIndexTable(spec.optionsPtr(), ftsTableName,
+                           CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
+                                  "SELECT rowid, " << exprs << " FROM kv_" << name() << " AS new "
+                                  << whereNewSQL << " AND new.rowid BETWEEN ?1 AND ?2 "
+                                  "AND NOT EXISTS (SELECT 1 FROM \"" << ftsTableName << "\" "
+                                                  "WHERE docid = new.rowid)"));
 
         // Set up triggers to keep the FTS table up to date
         // ...on insertion:
@@ -89,15 +96,16 @@ namespace litecore {
                       whereOldSQL,
                       deleteOldSQL);
 
-        // ...on update:
-        createTrigger(ftsTableName, "preupdate",
-                      "BEFORE UPDATE OF body",
-                      whereOldSQL,
-                      deleteOldSQL);
-        createTrigger(ftsTableName, "postupdate",
+        // ...on update. Re-tokenizing is expensive, so the row is only replaced if the indexed
+        // text changed or the doc started or stopped matching the WHERE clause:
+        string whereOld = whereOldSQL.substr(whereOldSQL.find(' ') + 1);   // skip "WHERE"
+        string whereNew = whereNewSQL.substr(whereNewSQL.find(' ') + 1);
+        createTrigger(ftsTableName, "upd",
                       "AFTER UPDATE OF body",
-                      whereNewSQL,
-                      insertNewSQL);
+                      CONCAT("WHEN (" << whereOld << ") IS NOT (" << whereNew << ") OR " << changes),
+                      CONCAT(deleteOldSQL << "; "
+                             << "INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
+                             << "SELECT new.rowid, " << exprs << " " << whereNewSQL));
         return true;
     }
 
@@ -26,6 +26,7 @@
 #include "StringUtil.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "Stopwatch.hh"
+#include <algorithm>
 
 using namespace std;
 using namespace fleece;
@@ -140,6 +141,108 @@ namespace litecore {
     }
 
 
+    // Fills a newly created index table from the existing records. `populateSQL` is an INSERT
+    // statement that indexes the records whose rowids are in [?1, ?2] and that aren't in the
+    // table yet. With the `background` option this only schedules the work: the table's triggers
+    // already keep it current, and continueIndexBuilds() will add the existing records later.
+    void SQLiteKeyStore::populateIndexTable(const IndexSpec::Options *options,
+                                            const string &indexTableName,
+                                            const string &populateSQL)
+    {
+        int64_t endRowID = db().intQuery(CONCAT("SELECT max(rowid) FROM " << tableName()).c_str());
+        if (options && options->background && endRowID > 0) {
+            LogTo(QueryLog, "Index table '%s' will be populated in the background",
+                  indexTableName.c_str());
+            db().registerIndexBuild(indexTableName, name(), populateSQL, endRowID);
+        } else {
+            SQLite::Statement stmt(db(), populateSQL);
+            stmt.bind(1, (long long)0);
+            stmt.bind(2, (long long)endRowID);
+            LogStatement(stmt);
+            stmt.exec();
+        }
+    }
+
+
+    double SQLiteKeyStore::indexBuildProgress(slice indexName) {
+        for (auto &spec : db().getIndexes(this)) {
+            if (slice(spec.name) != indexName)
+                continue;
+            if (spec.indexTableName.empty() || !db().indexBuildTableExists())
+                return 1.0;
+            SQLite::Statement stmt(db(), "SELECT nextRowID, endRowID FROM indexBuilds "
+                                         "WHERE indexTableName=?");
+            stmt.bindNoCopy(1, spec.indexTableName);
+            if (!stmt.executeStep())
+                return 1.0;
+            int64_t nextRowID = stmt.getColumn(0).getInt64(), endRowID = stmt.getColumn(1).getInt64();
+            return min(double(nextRowID) / double(endRowID + 1), 1.0);
+        }
+        error::_throw(error::NoSuchIndex);
+    }
+
+
+    bool SQLiteKeyStore::indexBuildsPending() const {
+        if (!db().indexBuildTableExists())
+            return false;
+        SQLite::Statement stmt(db(), "SELECT 1 FROM indexBuilds WHERE keyStore=?");
+        stmt.bindNoCopy(1, name());
+        return stmt.executeStep();
+    }
+
+
+    bool SQLiteKeyStore::continueIndexBuilds(unsigned maxRecords) {
+        Assert(maxRecords > 0);
+        if (!db().indexBuildTableExists())
+            return false;
+        string indexTableName, populateSQL;
+        int64_t nextRowID, endRowID;
+        {
+            SQLite::Statement stmt(db(), "SELECT indexTableName, populateSQL, nextRowID, endRowID "
+                                         "FROM indexBuilds WHERE keyStore=? LIMIT 1");
+            stmt.bindNoCopy(1, name());
+            if (!stmt.executeStep())
+                return false;
+            indexTableName = stmt.getColumn(0).getString();
+            populateSQL = stmt.getColumn(1).getString();
+            nextRowID = stmt.getColumn(2).getInt64();
+            endRowID = stmt.getColumn(3).getInt64();
+        }
+
+        // The chunk ends at the rowid of the maxRecords'th record, since rowids may be sparse:
+        int64_t lastRowID = endRowID;
+        {
+            SQLite::Statement stmt(db(), CONCAT("SELECT rowid FROM " << tableName() <<
+                                                " WHERE rowid >= ? ORDER BY rowid LIMIT 1 OFFSET ?"));
+            stmt.bind(1, (long long)nextRowID);
+            stmt.bind(2, (long long)maxRecords - 1);
+            if (stmt.executeStep())
+                lastRowID = min(stmt.getColumn(0).getInt64(), endRowID);
+        }
+        {
+            SQLite::Statement stmt(db(), populateSQL);
+            stmt.bind(1, (long long)nextRowID);
+            stmt.bind(2, (long long)lastRowID);
+            LogStatement(stmt);
+            stmt.exec();
+        }
+
+        if (lastRowID >= endRowID) {
+            LogTo(QueryLog, "Finished populating index table '%s'", indexTableName.c_str());
+            db().unregisterIndexBuild(indexTableName);
+            return indexBuildsPending();
+        } else {
+            LogVerbose(QueryLog, "Populated index table '%s' through rowid %lld of %lld",
+                       indexTableName.c_str(), (long long)lastRowID, (long long)endRowID);
+            SQLite::Statement stmt(db(), "UPDATE indexBuilds SET nextRowID=? WHERE indexTableName=?");
+            stmt.bind(1, (long long)lastRowID + 1);
+            stmt.bindNoCopy(2, indexTableName);
+            stmt.exec();
+            return true;
+        }
+    }
+
+
     vector<IndexSpec> SQLiteKeyStore::getIndexes() const {
         vector<IndexSpec> result;
         for (auto &spec : db().getIndexes(nullptr)) {
@@ -164,7 +267,8 @@ namespace litecore {
 
     // Part of the QueryParser delegate API
     bool SQLiteKeyStore::tableExists(const std::string &tableName) const {
-        return db().tableExists(tableName);
+        // An index table that's still being populated in the background mustn't be used yet:
+        return db().tableExists(tableName) && !db().indexTableIsBuilding(tableName);
     }
 
 }
@@ -85,9 +85,13 @@ namespace litecore {
 
             // Populate the index-table with data from existing documents:
             string predictExpr = qp.expressionSQL(expression);
-            db().exec(CONCAT("INSERT INTO \"" << predTableName << "\" (docid, body) "
-                             "SELECT rowid, " << predictExpr <<
-                             "FROM " << kvTableName << " WHERE (flags & 1) = 0"));
+            populateIndexTable(options, predTableName,
+                               CONCAT("INSERT INTO \"" << predTableName << "\" (docid, body) "
+                                      "SELECT rowid, " << predictExpr <<
+                                      " FROM " << kvTableName << " WHERE (flags & 1) = 0 "
+                                      "AND rowid BETWEEN ?1 AND ?2 "
+                                      "AND NOT EXISTS (SELECT 1 FROM \"" << predTableName << "\" "
+                                                      "WHERE docid = " << kvTableName << ".rowid)"));
 
             // Set up triggers to keep the index-table up to date
             // ...on insertion:
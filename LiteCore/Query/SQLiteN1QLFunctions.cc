@@ -20,6 +20,7 @@
 
 #include "SQLite_Internal.hh"
 #include "SQLiteFleeceUtil.hh"
+#include "DFARegex.hh"
 #include "Path.hh"
 #include "Error.hh"
 #include "Logging.hh"
@@ -700,13 +701,65 @@ namespace litecore {
 #pragma mark - REGULAR EXPRESSIONS:
 
 
+    // A compiled regex pattern. It's cached as auxdata of the pattern argument, so it's compiled
+    // once per statement instead of once per row (like the Path in evaluatePathFromArg.)
+    class CachedRegex {
+    public:
+        explicit CachedRegex(slice pattern)
+        :_pattern(pattern)
+        ,_dfa(DFARegex::compile(pattern))
+        { }
+
+        // The faster DFA matcher, or null if it doesn't support the pattern.
+        DFARegex* dfa()                 {return _dfa.get();}
+
+        // The std::regex, compiled on first use. Throws regex_error if the pattern is invalid.
+        const regex& stdRegex() {
+            if (!_regex)
+                _regex = make_unique<regex>(_pattern, regex_constants::ECMAScript);
+            return *_regex;
+        }
+
+    private:
+        string _pattern;
+        unique_ptr<DFARegex> _dfa;
+        unique_ptr<regex> _regex;
+    };
+
+
+    // Calls `fn` with the CachedRegex for the pattern in argv[argNo], creating it if necessary.
+    static void withRegex(sqlite3_context* ctx, sqlite3_value **argv, int argNo,
+                          function_ref<void(CachedRegex&)> fn) noexcept
+    {
+        auto re = (CachedRegex*)sqlite3_get_auxdata(ctx, argNo);
+        bool isNew = (re == nullptr);
+        try {
+            if (isNew)
+                re = new CachedRegex(stringSliceArgument(argv[argNo]));
+            fn(*re);
+        } catch (const regex_error &) {
+            sqlite3_result_error(ctx, "invalid regular expression", -1);
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "regular expression function caught an exception!", -1);
+        }
+        // SQLite may call the destructor right away, so this has to come after using `re`:
+        if (isNew && re)
+            sqlite3_set_auxdata(ctx, argNo, re, [](void *aux) { delete (CachedRegex*)aux; });
+    }
+
+
     static void regexp_like(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         auto str = stringSliceArgument(argv[0]);
         auto pattern = stringSliceArgument(argv[1]);
         if (str && pattern) {
-            regex r((const char*)pattern.buf, pattern.size, regex_constants::ECMAScript);
-            bool result = regex_search((const char*)str.buf, (const char*)str.end(), r);
-            sqlite3_result_int(ctx, result != 0);
+            withRegex(ctx, argv, 1, [&](CachedRegex &re) {
+                bool result;
+                if (auto dfa = re.dfa())
+                    result = dfa->search(str);
+                else
+                    result = regex_search((const char*)str.buf, (const char*)str.end(), re.stdRegex());
+                sqlite3_result_int(ctx, result != 0);
+            });
         }
     }
 
@@ -714,14 +767,20 @@ namespace litecore {
         auto str = stringSliceArgument(argv[0]);
         auto pattern = stringSliceArgument(argv[1]);
         if (str && pattern) {
-            regex r((const char*)pattern.buf, pattern.size, regex_constants::ECMAScript);
-            cmatch pattern_match;
-            if(!regex_search((const char*)str.buf, (const char*)str.end(), pattern_match, r)) {
-                sqlite3_result_int64(ctx, -1);
-                return;
-            }
+            withRegex(ctx, argv, 1, [&](CachedRegex &re) {
+                if (auto dfa = re.dfa()) {
+                    sqlite3_result_int64(ctx, dfa->position(str));
+                    return;
+                }
+                cmatch pattern_match;
+                if(!regex_search((const char*)str.buf, (const char*)str.end(), pattern_match,
+                                 re.stdRegex())) {
+                    sqlite3_result_int64(ctx, -1);
+                    return;
+                }
 
-            sqlite3_result_int64(ctx, pattern_match.prefix().length());
+                sqlite3_result_int64(ctx, pattern_match.prefix().length());
+            });
         }
     }
 
@@ -735,25 +794,31 @@ namespace litecore {
                 n = sqlite3_value_int(argv[3]);
             }
 
-            regex r((const char*)pattern.buf, pattern.size, regex_constants::ECMAScript);
-            string s(str);
-            auto iter = sregex_iterator(s.begin(), s.end(), r);
-            auto last_iter = iter;
-            auto stop = sregex_iterator();
-            if (iter == stop) {
-                sqlite3_result_value(ctx, argv[0]);
-            } else {
-                string result;
-                auto out = back_inserter(result);
-                for(; n-- && iter != stop; ++iter) {
-                    out = copy(iter->prefix().first, iter->prefix().second, out);
-                    out = iter->format(out, (const char*)replacement.buf, (const char*)replacement.end());
-                    last_iter = iter;
+            withRegex(ctx, argv, 1, [&](CachedRegex &re) {
+                // The DFA can't tell where a match ends, but it can rule out any match quickly:
+                if (auto dfa = re.dfa(); dfa && !dfa->search(str)) {
+                    sqlite3_result_value(ctx, argv[0]);
+                    return;
                 }
+                string s(str);
+                auto iter = sregex_iterator(s.begin(), s.end(), re.stdRegex());
+                auto last_iter = iter;
+                auto stop = sregex_iterator();
+                if (iter == stop) {
+                    sqlite3_result_value(ctx, argv[0]);
+                } else {
+                    string result;
+                    auto out = back_inserter(result);
+                    for(; n-- && iter != stop; ++iter) {
+                        out = copy(iter->prefix().first, iter->prefix().second, out);
+                        out = iter->format(out, (const char*)replacement.buf, (const char*)replacement.end());
+                        last_iter = iter;
+                    }
 
-                out = copy(last_iter->suffix().first, last_iter->suffix().second, out);
-                sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
-            }
+                    out = copy(last_iter->suffix().first, last_iter->suffix().second, out);
+                    sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
+                }
+            });
         }
     }
 
@@ -22,6 +22,7 @@
 #include "Logging.hh"
 #include "Query.hh"
 #include "QueryParser.hh"
+#include "QueryCache.hh"
 #include "n1ql_parser.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
@@ -33,6 +34,7 @@
 #include <sqlite3.h>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 
 extern "C" {
 #include "sqlite3_unicodesn_tokenizer.h"        // for unicodesn_tokenizerRunningQuery()
@@ -52,57 +54,124 @@ namespace litecore {
         kFTSOffsetsCol
     };
 
+    // Implicit column in incremental query result:
+    enum {
+        kDocIDCol
+    };
+
+    // If more docs than this have changed, an incremental query just runs again from scratch:
+    static constexpr size_t kMaxIncrementalChanges = 1000;
+
 
     class SQLiteQuery : public Query {
     public:
-        SQLiteQuery(SQLiteKeyStore &keyStore, slice queryStr, QueryLanguage language)
+        SQLiteQuery(SQLiteKeyStore &keyStore, slice queryStr, QueryLanguage language,
+                    bool incremental)
         :Query(keyStore, queryStr, language)
         {
             static constexpr const char* kLanguageName[] = {"JSON", "N1QL"};
             logInfo("Compiling %s query: %.*s", kLanguageName[(int)language], SPLAT(queryStr));
 
+            auto translation = translate(keyStore, queryStr, language, incremental);
+            _json = translation->json;
+            _parameters = translation->parameters;
+            _ftsTables = translation->ftsTables;
+            _columnTitles = translation->columnTitles;
+            _1stCustomResultColumn = translation->firstCustomResultColumn;
+            _changedRowsSQL = translation->changedRowsSQL;
+            if (translation->usesExpiration) {
+                // A read-only connection, like a BackgroundDB reader, can't alter the table; the
+                // column has to be added by a writeable connection compiling the query first.
+                if (keyStore.db().options().writeable)
+                    keyStore.addExpiration();
+                else if (!keyStore.hasExpiration())
+                    error::_throw(error::NotWriteable,
+                                  "Query uses _expiration, but this read-only connection can't "
+                                  "add the expiration column");
+            }
+
+            const string &sql = translation->sql;
+            logInfo("Compiled as %s", sql.c_str());
+            LogTo(SQL, "Compiled {Query#%u}: %s", getObjectRef(), sql.c_str());
+            _statement.reset(keyStore.compile(sql));
+        }
+
+
+        // Translates a query to SQL, or gets the translation from the DataFile's QueryCache.
+        QueryCache::TranslationRef translate(SQLiteKeyStore &keyStore, slice queryStr,
+                                             QueryLanguage language, bool incremental)
+        {
+            // Translations depending on a half-built index table mustn't be cached, since the
+            // table becomes usable without any schema change:
+            QueryCache &cache = keyStore.db().queryCache();
+            bool cacheable = !keyStore.indexBuildsPending();
+            int64_t schemaVersion = 0;
+            string cacheKey;
+            if (cacheable) {
+                schemaVersion = keyStore.db().schemaCookie();
+                cacheKey = CONCAT(keyStore.name() << '\0' << int(language) << int(incremental)
+                                  << string(queryStr));
+                if (auto translation = cache.get(cacheKey, schemaVersion); translation) {
+                    logVerbose("Using cached translation");
+                    return translation;
+                }
+            }
+
+            auto translation = make_shared<QueryTranslation>();
             switch (language) {
                 case QueryLanguage::kJSON:
-                    _json = queryStr;
+                    translation->json = queryStr;
                     break;
                 case QueryLanguage::kN1QL: {
                     unsigned errPos;
                     FLMutableDict result = n1ql::parse(string(queryStr), &errPos);
                     if (!result)
                         throw Query::parseError("N1QL syntax error", errPos);
-                    _json = ((MutableDict*)result)->toJSON(true);
+                    translation->json = ((MutableDict*)result)->toJSON(true);
                     FLMutableDict_Release(result);
                     break;
                 }
             }
 
             QueryParser qp(keyStore);
-            qp.parseJSON(_json);
+            qp.parseJSON(translation->json);
 
-            _parameters = qp.parameters();
-            for (auto p = _parameters.begin(); p != _parameters.end();) {
+            translation->parameters = qp.parameters();
+            auto &params = translation->parameters;
+            for (auto p = params.begin(); p != params.end();) {
                 if (hasPrefix(*p, "opt_"))
-                    p = _parameters.erase(p);       // Optional param, don't warn if it's unbound
+                    p = params.erase(p);            // Optional param, don't warn if it's unbound
                 else
                     ++p;
             }
 
-            _ftsTables = qp.ftsTablesUsed();
-            for (auto ftsTable : _ftsTables) {
+            translation->ftsTables = qp.ftsTablesUsed();
+            for (auto ftsTable : translation->ftsTables) {
                 if (!keyStore.db().tableExists(ftsTable))
                     error::_throw(error::NoSuchIndex, "'match' test requires a full-text index");
+                if (keyStore.db().indexTableIsBuilding(ftsTable))
+                    error::_throw(error::NoSuchIndex, "full-text index is still being built");
             }
 
-            if (qp.usesExpiration())
-                keyStore.addExpiration();
+            translation->usesExpiration = qp.usesExpiration();
+            translation->sql = qp.SQL();
+            translation->firstCustomResultColumn = qp.firstCustomResultColumn();
+            if (incremental) {
+                string keyedSQL = qp.incrementalSQL();
+                if (!keyedSQL.empty()) {
+                    // The docID is recorded as a hidden first column, so rows can be replaced:
+                    translation->sql = keyedSQL;
+                    translation->changedRowsSQL = qp.incrementalSQL(true);
+                    ++translation->firstCustomResultColumn;
+                } else {
+                    logInfo("Query is not simple enough to update incrementally");
+                }
+            }
+            translation->columnTitles = qp.columnTitles();
 
-            string sql = qp.SQL();
-            logInfo("Compiled as %s", sql.c_str());
-            LogTo(SQL, "Compiled {Query#%u}: %s", getObjectRef(), sql.c_str());
-            _statement.reset(keyStore.compile(sql));
-            
-            _1stCustomResultColumn = qp.firstCustomResultColumn();
-            _columnTitles = qp.columnTitles();
+            if (cacheable)
+                cache.put(cacheKey, schemaVersion, translation);
+            return translation;
         }
 
 
@@ -110,6 +179,8 @@ namespace litecore {
             logInfo("Closing query (db is closing)");
             _statement.reset();
             _matchedTextStatement.reset();
+            _changedKeysStatement.reset();
+            _changedRowsStatement.reset();
             Query::close();
         }
 
@@ -178,12 +249,30 @@ namespace litecore {
 
         QueryEnumerator* createEnumerator(const Options *options) override;
 
+        bool isIncremental() const                  {return !_changedRowsSQL.empty();}
+
+        // Updates the results of an incremental query by re-evaluating only the docs changed
+        // since `current` was created. Sets `newEnum` to the new results, or to null if the
+        // database hasn't changed; if the results are unchanged it's a copy of `current` as of
+        // the current sequence, and `changed` is false. (`current` itself isn't modified, since
+        // it may be in use by other threads.) Returns false if the results have to be
+        // recomputed from scratch instead.
+        bool refreshIncrementally(const SQLiteQueryEnumerator *current,
+                                  SQLiteQueryEnumerator* &newEnum, bool &changed);
+
         shared_ptr<SQLite::Statement> statement() const {
             if (!_statement)
                 error::_throw(error::NotOpen);
             return _statement;
         }
 
+        // Compiles a private copy of the statement, for an enumerator that needs to keep it
+        // stepping while other enumerators are created.
+        shared_ptr<SQLite::Statement> newStatement() const {
+            auto &df = (SQLiteDataFile&) keyStore().dataFile();
+            return make_shared<SQLite::Statement>(df, statement()->getQuery(), true);
+        }
+
         unsigned objectRef() const                  {return getObjectRef();}   // (for logging)
 
         set<string> _parameters;            // Names of the bindable parameters
@@ -199,12 +288,35 @@ namespace litecore {
         shared_ptr<SQLite::Statement> _statement;           // Compiled SQLite statement
         unique_ptr<SQLite::Statement> _matchedTextStatement;// Gets the matched text
         vector<string> _columnTitles;                       // Titles of columns
+        string _changedRowsSQL;                             // SQL of incremental update
+        unique_ptr<SQLite::Statement> _changedKeysStatement;// Finds docIDs changed since a seq
+        shared_ptr<SQLite::Statement> _changedRowsStatement;// Result rows changed since a seq
     };
 
 
 #pragma mark - QUERY ENUMERATOR:
 
 
+    // Parses the implicit FTS columns of a result row into a list of FullTextTerms.
+    static void parseFullTextTerms(const Array *row, QueryEnumerator::FullTextTerms &terms) {
+        terms.clear();
+        uint64_t dataSource = row->get(kFTSRowidCol)->asInt();
+        // The offsets() function returns a string of space-separated numbers in groups of 4.
+        string offsets = row->get(kFTSOffsetsCol)->asString().asString();
+        const char *termStr = offsets.c_str();
+        while (*termStr) {
+            uint32_t n[4];
+            for (int i = 0; i < 4; ++i) {
+                char *next;
+                n[i] = (uint32_t)strtol(termStr, &next, 10);
+                termStr = next;
+            }
+            terms.push_back({dataSource, n[0], n[1], n[2], n[3]});
+            // {rowid, key #, term #, byte offset, byte length}
+        }
+    }
+
+
     // Query enumerator that reads from prerecorded Fleece data (generated by fastForward(), below)
     // Each array item is a row, which is itself an array of column values.
     class SQLiteQueryEnumerator : public QueryEnumerator, Logging {
@@ -225,8 +337,25 @@ namespace litecore {
         {
             logInfo("Created on {Query#%u} with %llu rows (%zu bytes) in %.3fms",
                 query->objectRef(), rowCount, recording->data().size, elapsedTime*1000);
+            // Index the rows now, before anyone else can see me:
+            if (query->isIncremental()) {
+                uint32_t index = 0;
+                for (Array::iterator i(rows()); i; i += 2, index += 2)
+                    _rowIndexByDocID[i[0u]->asArray()->get(kDocIDCol)->asString()] = index;
+            }
         }
 
+        // Copy constructor, for the same results as of a later sequence.
+        SQLiteQueryEnumerator(const SQLiteQueryEnumerator &other, sequence_t lastSequence)
+        :QueryEnumerator(&other._options, lastSequence, other._purgeCount)
+        ,Logging(QueryLog)
+        ,_recording(other._recording)
+        ,_iter(_recording->asArray())
+        ,_1stCustomResultColumn(other._1stCustomResultColumn)
+        ,_hasFullText(other._hasFullText)
+        ,_rowIndexByDocID(other._rowIndexByDocID)
+        { }
+
         ~SQLiteQueryEnumerator() {
             logInfo("Deleted");
         }
@@ -276,6 +405,15 @@ namespace litecore {
             return _iter[1u]->asUnsigned();
         }
 
+        // The recorded rows, alternating with their missing-column bitmaps.
+        const Array* rows() const                   {return _recording->asArray();}
+
+        // Finds the index (in rows()) of the row of an incremental query with the given docID.
+        int64_t indexOfDoc(slice docID) const {
+            auto found = _rowIndexByDocID.find(docID);
+            return (found != _rowIndexByDocID.end()) ? found->second : -1;
+        }
+
 
         virtual bool obsoletedBy(const QueryEnumerator *otherE) override {
             if (!otherE)
@@ -300,10 +438,17 @@ namespace litecore {
         }
 
         QueryEnumerator* refresh(Query *query) override {
-            auto newOptions = _options.after(_lastSequence).withPurgeCount(_purgeCount);
             auto sqliteQuery = (SQLiteQuery*)query;
-            unique_ptr<SQLiteQueryEnumerator> newEnum(
-                (SQLiteQueryEnumerator*)sqliteQuery->createEnumerator(&newOptions) );
+            if (sqliteQuery->isIncremental()) {
+                SQLiteQueryEnumerator *newEnum;
+                bool changed;
+                if (sqliteQuery->refreshIncrementally(this, newEnum, changed)) {
+                    unique_ptr<SQLiteQueryEnumerator> e(newEnum);
+                    return changed ? e.release() : nullptr;
+                }
+            }
+
+            unique_ptr<SQLiteQueryEnumerator> newEnum(rerun(sqliteQuery));
             if (obsoletedBy(newEnum.get())) {
                 // Results have changed, so return new enumerator:
                 return newEnum.release();
@@ -311,26 +456,25 @@ namespace litecore {
             return nullptr;
         }
 
+        QueryEnumerator* refreshAdvancing(Query *query, bool &outChanged) override {
+            auto sqliteQuery = (SQLiteQuery*)query;
+            SQLiteQueryEnumerator *newEnum;
+            if (sqliteQuery->isIncremental()
+                    && sqliteQuery->refreshIncrementally(this, newEnum, outChanged))
+                return newEnum;
+
+            newEnum = rerun(sqliteQuery);
+            outChanged = newEnum && (newEnum->purgeCount() != _purgeCount
+                                     || newEnum->_recording->data() != _recording->data());
+            return newEnum;
+        }
+
         bool hasFullText() const override {
             return _hasFullText;
         }
 
         const FullTextTerms& fullTextTerms() override {
-            _fullTextTerms.clear();
-            uint64_t dataSource = _iter->asArray()->get(kFTSRowidCol)->asInt();
-            // The offsets() function returns a string of space-separated numbers in groups of 4.
-            string offsets = _iter->asArray()->get(kFTSOffsetsCol)->asString().asString();
-            const char *termStr = offsets.c_str();
-            while (*termStr) {
-                uint32_t n[4];
-                for (int i = 0; i < 4; ++i) {
-                    char *next;
-                    n[i] = (uint32_t)strtol(termStr, &next, 10);
-                    termStr = next;
-                }
-                _fullTextTerms.push_back({dataSource, n[0], n[1], n[2], n[3]});
-                // {rowid, key #, term #, byte offset, byte length}
-            }
+            parseFullTextTerms(_iter->asArray(), _fullTextTerms);
             return _fullTextTerms;
         }
 
@@ -338,24 +482,35 @@ namespace litecore {
         string loggingClassName() const override    {return "QueryEnum";}
 
     private:
+        // Runs the query again, if the database has changed since I was created.
+        SQLiteQueryEnumerator* rerun(SQLiteQuery *query) const {
+            // (The new results are always recorded, even if I was streamed, so they can be compared)
+            Query::Options newOptions(_options.paramBindings, _lastSequence, _purgeCount);
+            return (SQLiteQueryEnumerator*)query->createEnumerator(&newOptions);
+        }
+
         Retained<Doc> _recording;
         Array::iterator _iter;
         unsigned _1stCustomResultColumn;    // Column index of the 1st column declared in JSON
         bool _hasFullText;
         bool _first {true};
+        unordered_map<slice, uint32_t, fleece::sliceHash> _rowIndexByDocID; // Incremental only
     };
 
 
 
     // Reads from 'live' SQLite statement and records the results into a Fleece array,
     // which is then used as the data source of a SQLiteQueryEnum.
+    // Alternatively, it can be stepped one row at a time by a SQLiteStreamingQueryEnumerator.
     class SQLiteQueryRunner {
     public:
-        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence, uint64_t purgeCount)
+        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options,
+                          sequence_t lastSequence, uint64_t purgeCount,
+                          shared_ptr<SQLite::Statement> statement =nullptr)
         :_query(query)
         ,_lastSequence(lastSequence)
         ,_purgeCount(purgeCount)
-        ,_statement(query->statement())
+        ,_statement(statement ? statement : query->statement())
         ,_sk(query->keyStore().dataFile().documentKeys())
         ,_options(options ? *options : Query::Options())
         {
@@ -458,11 +613,44 @@ namespace litecore {
             return true;
         }
 
+        // Writes the current row as an array of column values, returning the missing-column bitmap.
+        uint64_t encodeRow(Encoder &enc) {
+            int nCols = _statement->getColumnCount();
+            // (An incremental query's hidden docID column doesn't get a bit, so the bits are
+            // the same as they'd be without it.)
+            int firstBitCol = _query->isIncremental() ? 1 : 0;
+            uint64_t missingCols = 0;
+            enc.beginArray(nCols);
+            for (int i = 0; i < nCols; ++i) {
+                if (!encodeColumn(enc, i) && i >= firstBitCol && i - firstBitCol < 64)
+                    missingCols |= (1ull << (i - firstBitCol));
+            }
+            enc.endArray();
+            return missingCols;
+        }
+
+        // Advances the statement to the next row; returns false at the end.
+        bool step() {
+            unicodesn_tokenizerRunningQuery(true);
+            try {
+                bool gotRow = _statement->executeStep();
+                unicodesn_tokenizerRunningQuery(false);
+                return gotRow;
+            } catch (...) {
+                unicodesn_tokenizerRunningQuery(false);
+                throw;
+            }
+        }
+
+        // Resets the statement so it'll run again from the first row (keeping the bindings.)
+        void rewind() {
+            _statement->reset();
+        }
+
         // Collects all the (remaining) rows into a Fleece array of arrays,
         // and returns an enumerator impl that will replay them.
         SQLiteQueryEnumerator* fastForward() {
             fleece::Stopwatch st;
-            int nCols = _statement->getColumnCount();
             uint64_t rowCount = 0;
             // Give this encoder its own SharedKeys instead of using the database's DocumentKeys,
             // because the query results might include dicts with new keys that aren't in the
@@ -475,13 +663,7 @@ namespace litecore {
             unicodesn_tokenizerRunningQuery(true);
             try {
                 while (_statement->executeStep()) {
-                    uint64_t missingCols = 0;
-                    enc.beginArray(nCols);
-                    for (int i = 0; i < nCols; ++i) {
-                        if (!encodeColumn(enc, i) && i < 64)
-                            missingCols |= (1 << i);
-                    }
-                    enc.endArray();
+                    uint64_t missingCols = encodeRow(enc);
                     // Add an integer containing a bit-map of which columns are missing/undefined:
                     enc.writeUInt(missingCols);
                     ++rowCount;
@@ -510,9 +692,286 @@ namespace litecore {
 
 
 
+    // Query enumerator that steps a live SQLite statement lazily, encoding only the current row.
+    // It holds a read-only transaction open until it reaches the end, so the rows are consistent
+    // with its lastSequence; until then the DataFile can't begin a write Transaction.
+    // It uses the DataFile's own connection, so callers must serialize it with other use of the
+    // DataFile (C4QueryEnumeratorImpl holds the database's client lock while stepping it.)
+    // Random access (seek, getRowCount) and refresh need the entire result set, so they switch
+    // it over to a recorded SQLiteQueryEnumerator.
+    class SQLiteStreamingQueryEnumerator : public QueryEnumerator, Logging {
+    public:
+        SQLiteStreamingQueryEnumerator(SQLiteQuery *query,
+                                       const Query::Options *options,
+                                       sequence_t lastSequence,
+                                       uint64_t purgeCount,
+                                       unique_ptr<ReadOnlyTransaction> transaction,
+                                       unique_ptr<SQLiteQueryRunner> runner)
+        :QueryEnumerator(options, lastSequence, purgeCount)
+        ,Logging(QueryLog)
+        ,_query(query)
+        ,_transaction(move(transaction))
+        ,_runner(move(runner))
+        ,_sk(new SharedKeys)
+        ,_1stCustomResultColumn(query->_1stCustomResultColumn)
+        ,_hasFullText(!query->_ftsTables.empty())
+        {
+            // Like the recorder, use private SharedKeys since rows may have keys that aren't
+            // in the DocumentKeys.
+            _enc.setSharedKeys(_sk);
+            logInfo("Created streaming enumerator on {Query#%u}", query->objectRef());
+        }
+
+        ~SQLiteStreamingQueryEnumerator() {
+            logInfo("Deleted");
+        }
+
+        virtual int64_t getRowCount() const override {
+            const_cast<SQLiteStreamingQueryEnumerator*>(this)->record();
+            return _recorded->getRowCount();
+        }
+
+        virtual void seek(int64_t rowIndex) override {
+            record();
+            _recorded->seek(rowIndex);
+        }
+
+        bool next() override {
+            if (_recorded)
+                return _recorded->next();
+            if (!_runner)
+                return false;
+            if (!_runner->step()) {
+                logInfo("END after %lld rows", (long long)(_rowIndex + 1));
+                _atEnd = true;
+                _row = nullptr;
+                finish();
+                return false;
+            }
+            _missingColumns = _runner->encodeRow(_enc);
+            _row = _enc.finishDoc();
+            ++_rowIndex;
+            if (willLog(LogLevel::Verbose)) {
+                alloc_slice json = _row->asArray()->toJSON();
+                logVerbose("--> %.*s", SPLAT(json));
+            }
+            return true;
+        }
+
+        Array::iterator columns() const noexcept override {
+            if (_recorded)
+                return _recorded->columns();
+            Array::iterator i(_row->asArray());
+            i += _1stCustomResultColumn;
+            return i;
+        }
+
+        uint64_t missingColumns() const noexcept override {
+            return _recorded ? _recorded->missingColumns() : _missingColumns;
+        }
+
+        virtual bool obsoletedBy(const QueryEnumerator *otherE) override {
+            record();
+            return _recorded->obsoletedBy(otherE);
+        }
+
+        QueryEnumerator* refresh(Query *query) override {
+            record();
+            return _recorded->refresh(query);
+        }
+
+        bool hasFullText() const override {
+            return _hasFullText;
+        }
+
+        const FullTextTerms& fullTextTerms() override {
+            if (_recorded)
+                return _recorded->fullTextTerms();
+            parseFullTextTerms(_row->asArray(), _fullTextTerms);
+            return _fullTextTerms;
+        }
+
+    protected:
+        string loggingClassName() const override    {return "QueryEnum";}
+
+    private:
+        // Switches to recorded mode, positioning the recorded enumerator at the current row.
+        void record() {
+            if (_recorded)
+                return;
+            logInfo("Recording remaining results, for random access");
+            if (_runner) {
+                // Still in the read transaction, so just run the statement again from the start:
+                _runner->rewind();
+                _recorded = _runner->fastForward();
+            } else {
+                // Already finished; the results can only be reproduced if nothing has changed:
+                ReadOnlyTransaction t(_query->keyStore().dataFile());
+                if (_query->lastSequence() != _lastSequence || _query->purgeCount() != _purgeCount)
+                    error::_throw(error::UnsupportedOperation,
+                                  "Database has changed since streaming query finished");
+                SQLiteQueryRunner runner(_query, &_options, _lastSequence, _purgeCount,
+                                         _query->newStatement());
+                _recorded = runner.fastForward();
+            }
+            finish();
+            _row = nullptr;
+
+            if (_atEnd) {
+                int64_t rowCount = _recorded->getRowCount();
+                if (rowCount > 0) {
+                    _recorded->seek(rowCount - 1);
+                    _recorded->next();
+                }
+            } else if (_rowIndex >= 0) {
+                _recorded->seek(_rowIndex);
+            }
+        }
+
+        // Releases the statement, then the read transaction.
+        void finish() {
+            _runner.reset();
+            _transaction.reset();
+        }
+
+        Retained<SQLiteQuery> _query;
+        unique_ptr<ReadOnlyTransaction> _transaction;
+        unique_ptr<SQLiteQueryRunner> _runner;
+        Retained<SharedKeys> _sk;
+        Encoder _enc;
+        Retained<Doc> _row;                 // Current row (array of all columns)
+        uint64_t _missingColumns {0};
+        int64_t _rowIndex {-1};             // Index of current row
+        bool _atEnd {false};
+        Retained<SQLiteQueryEnumerator> _recorded;  // Set when falling back to recorded mode
+        unsigned _1stCustomResultColumn;    // Column index of the 1st column declared in JSON
+        bool _hasFullText;
+    };
+
+
+
+    bool SQLiteQuery::refreshIncrementally(const SQLiteQueryEnumerator *current,
+                                           SQLiteQueryEnumerator* &newEnum, bool &changed)
+    {
+        newEnum = nullptr;
+        changed = false;
+        ReadOnlyTransaction t(keyStore().dataFile());
+        sequence_t curSeq = lastSequence();
+        uint64_t purgeCnt = purgeCount();
+        sequence_t since = current->lastSequence();
+        if (purgeCnt != current->purgeCount())
+            return false;           // Purged docs can't be found by sequence
+        if (curSeq <= since)
+            return true;
+
+        fleece::Stopwatch st;
+        auto &keyStore = (SQLiteKeyStore&)this->keyStore();
+
+        // Find the IDs of all docs changed since the last run, including deleted ones.
+        // `changes` maps each docID to its index in `newRows`, or -1 if it's no longer a result.
+        vector<alloc_slice> changedDocIDs;
+        unordered_map<slice, int, fleece::sliceHash> changes;
+        {
+            keyStore.compile(_changedKeysStatement, "SELECT key FROM kv_@ WHERE sequence > ?");
+            UsingStatement u(_changedKeysStatement);
+            _changedKeysStatement->bind(1, (long long)since);
+            while (_changedKeysStatement->executeStep()) {
+                if (changedDocIDs.size() >= kMaxIncrementalChanges) {
+                    logVerbose("Too many changes since seq %" PRIu64 "; rerunning query", since);
+                    return false;
+                }
+                changedDocIDs.emplace_back(
+                        SQLiteKeyStore::columnAsSlice(_changedKeysStatement->getColumn(0)));
+                changes[changedDocIDs.back()] = -1;
+            }
+        }
+
+        // Evaluate the query on just those docs:
+        vector<pair<Retained<Doc>, uint64_t>> newRows;
+        auto sk = retained(new SharedKeys);
+        {
+            if (!_changedRowsStatement)
+                _changedRowsStatement.reset(keyStore.compile(_changedRowsSQL));
+            SQLiteQueryRunner runner(this, &current->options(), curSeq, purgeCnt,
+                                     _changedRowsStatement);
+            _changedRowsStatement->bind(":since", (long long)since);
+            Encoder enc;
+            enc.setSharedKeys(sk);
+            while (runner.step()) {
+                uint64_t missing = runner.encodeRow(enc);
+                Retained<Doc> row = enc.finishDoc();
+                changes[row->asArray()->get(kDocIDCol)->asString()] = (int)newRows.size();
+                newRows.emplace_back(row, missing);
+            }
+        }
+
+        // Have any result rows actually changed?
+        for (auto &change : changes) {
+            int64_t oldIndex = current->indexOfDoc(change.first);
+            if (oldIndex < 0 && change.second < 0)
+                continue;
+            if (oldIndex < 0 || change.second < 0) {
+                changed = true;
+                break;
+            }
+            auto &newRow = newRows[change.second];
+            if (current->rows()->get(uint32_t(oldIndex) + 1)->asUnsigned() != newRow.second
+                    || !current->rows()->get(uint32_t(oldIndex))->isEqual(newRow.first->root())) {
+                changed = true;
+                break;
+            }
+        }
+        if (!changed) {
+            logVerbose("%zu docs changed since seq %" PRIu64 " but results didn't (%.3fms)",
+                       changedDocIDs.size(), since, st.elapsedMS());
+            newEnum = new SQLiteQueryEnumerator(*current, curSeq);
+            return true;
+        }
+
+        // Patch the results: replace or remove changed rows, then append new ones at the end.
+        Encoder enc;
+        enc.setSharedKeys(sk);
+        enc.beginArray();
+        uint64_t rowCount = 0;
+        vector<bool> written(newRows.size());
+        for (Array::iterator i(current->rows()); i; i += 2) {
+            slice docID = i[0u]->asArray()->get(kDocIDCol)->asString();
+            auto change = changes.find(docID);
+            if (change == changes.end()) {
+                enc.writeValue(i[0u]);
+                enc.writeValue(i[1u]);
+            } else if (change->second >= 0) {
+                auto &newRow = newRows[change->second];
+                enc.writeValue(newRow.first->root());
+                enc.writeUInt(newRow.second);
+                written[change->second] = true;
+            } else {
+                continue;
+            }
+            ++rowCount;
+        }
+        for (size_t n = 0; n < newRows.size(); ++n) {
+            if (!written[n]) {
+                enc.writeValue(newRows[n].first->root());
+                enc.writeUInt(newRows[n].second);
+                ++rowCount;
+            }
+        }
+        enc.endArray();
+        logInfo("Incrementally updated results for %zu docs changed since seq %" PRIu64,
+                changedDocIDs.size(), since);
+        newEnum = new SQLiteQueryEnumerator(this, &current->options(), curSeq, purgeCnt,
+                                            enc.finishDoc(), rowCount, st.elapsed());
+        changed = true;
+        return true;
+    }
+
+
     // The factory method that creates a SQLite Query.
-    Retained<Query> SQLiteKeyStore::compileQuery(slice selectorExpression, QueryLanguage language) {
-        return new SQLiteQuery(*this, selectorExpression, language);
+    Retained<Query> SQLiteKeyStore::compileQuery(slice selectorExpression, QueryLanguage language,
+                                                 bool incremental)
+    {
+        return new SQLiteQuery(*this, selectorExpression, language, incremental);
     }
 
 
@@ -521,12 +980,20 @@ namespace litecore {
     QueryEnumerator* SQLiteQuery::createEnumerator(const Options *options) {
         // Start a read-only transaction, to ensure that the result of lastSequence() and purgeCount() will be
         // consistent with the query results.
-        ReadOnlyTransaction t(keyStore().dataFile());
+        auto t = make_unique<ReadOnlyTransaction>(keyStore().dataFile());
 
         sequence_t curSeq = lastSequence();
         uint64_t purgeCnt = purgeCount();
         if(options && options->notOlderThan(curSeq, purgeCnt))
             return nullptr;
+        if (options && options->streaming) {
+            // The streaming enumerator takes over the transaction, and gets its own statement
+            // since it'll keep stepping it after this method returns:
+            auto runner = make_unique<SQLiteQueryRunner>(this, options, curSeq, purgeCnt,
+                                                         newStatement());
+            return new SQLiteStreamingQueryEnumerator(this, options, curSeq, purgeCnt,
+                                                      move(t), move(runner));
+        }
         SQLiteQueryRunner recorder(this, options, curSeq, purgeCnt);
         return recorder.fastForward();
     }
@@ -105,7 +105,7 @@ namespace litecore {
         return offsetof(RawRevision, revID)
              + rev.revID.size
              + SizeOfVarInt(rev.sequence)
-             + rev._body.size;
+             + (rev._externalBody ? 0 : rev._body.size);
     }
 
     RawRevision* RawRevision::copyFrom(const Rev &rev) {
@@ -116,13 +116,16 @@ namespace litecore {
         this->parentIndex_BE = endian::enc16(uint16_t(rev.parent ? rev.parent->index() : kNoParent));
 
         uint8_t dstFlags = rev.flags & ~kNonPersistentFlags;
-        if (rev._body)
+        if (rev._externalBody)
+            dstFlags |= RawRevision::kHasExternalData;
+        else if (rev._body)
             dstFlags |= RawRevision::kHasData;
         this->flags = (Rev::Flags)dstFlags;
 
         void *dstData = offsetby(&this->revID[0], rev.revID.size);
         dstData = offsetby(dstData, PutUVarInt(dstData, rev.sequence));
-        memcpy(dstData, rev._body.buf, rev._body.size);
+        if (!rev._externalBody)
+            memcpy(dstData, rev._body.buf, rev._body.size);
 
         return (RawRevision*)offsetby(this, revSize);
     }
@@ -143,6 +146,7 @@ namespace litecore {
             dst._body = slice(data, end);
         else
             dst._body = nullslice;
+        dst._externalBody = (this->flags & RawRevision::kHasExternalData) != 0;
     }
 
 
@@ -54,9 +54,10 @@ namespace litecore {
 
         // Private RevisionFlags bits used in encoded form:
         enum : uint8_t {
-            kHasData = 0x80,  /**< Does this raw rev contain JSON/Fleece data? */
-            kNonPersistentFlags  = (Rev::kNew),         // Not saved to disk
-            kPersistentOnlyFlags = (kHasData),          // Only used on disk, not in memory
+            kHasData         = 0x80,  /**< Does this raw rev contain JSON/Fleece data? */
+            kHasExternalData = 0x04,  /**< Is the body stored outside the tree? (Reuses kNew's bit) */
+            kNonPersistentFlags  = (Rev::kNew),                  // Not saved to disk
+            kPersistentOnlyFlags = (kHasData | kHasExternalData), // Only used on disk, not in memory
         };
 
         uint32_t        size_BE;        // Total size of this tree rev (big-endian)
@@ -68,6 +69,8 @@ namespace litecore {
         // varint       sequence
         // if HasData flag:
         //    char      data[];         // Contains the revision body (JSON)
+        // (If the HasExternalData flag is set instead, the body is stored elsewhere by the
+        // owning VersionedDocument.)
 
         bool isValid() const {
             return size_BE != 0;
@@ -164,7 +164,12 @@ namespace litecore {
 
     slice Rev::body() const {
         slice body = _body;
-        if ((size_t)body.buf & 1) {
+        if (_usuallyFalse(!body.buf && _externalBody)) {
+            // Body isn't in the encoded tree, so have the owner read it from storage:
+            auto xthis = const_cast<Rev*>(this);
+            auto xowner = const_cast<RevTree*>(owner);
+            body = xthis->_body = (slice)xowner->copyBody(owner->readBodyOfRevision(this));
+        } else if ((size_t)body.buf & 1) {
             // Fleece data must be 2-byte-aligned, so we have to copy body to the heap:
             auto xthis = const_cast<Rev*>(this);
             auto xowner = const_cast<RevTree*>(owner);
@@ -206,7 +211,7 @@ namespace litecore {
     }
 
     bool RevTree::isBodyOfRevisionAvailable(const Rev* rev) const {
-        return rev->_body.buf != nullptr; // VersionedDocument overrides this
+        return rev->isBodyAvailable();
     }
 
     alloc_slice RevTree::readBodyOfRevision(const Rev* rev) const {
@@ -215,6 +220,11 @@ namespace litecore {
         return alloc_slice(); // VersionedDocument overrides this
     }
 
+    void RevTree::setBodyExternal(const Rev *rev, bool external) {
+        const_cast<Rev*>(rev)->_externalBody = external;
+        _changed = true;
+    }
+
     bool RevTree::confirmLeaf(Rev* testRev) {
         for (Rev *rev : _revs)
             if (rev->parent == testRev)
@@ -422,7 +432,7 @@ namespace litecore {
     }
 
     void RevTree::removeBody(const Rev* rev) {
-        if (rev->body()) {
+        if (rev->isBodyAvailable()) {
             const_cast<Rev*>(rev)->removeBody();
             _changed = true;
         }
@@ -431,7 +441,8 @@ namespace litecore {
     // Remove bodies of already-saved revs that are no longer leaves:
     void RevTree::removeNonLeafBodies() {
         for (Rev *rev : _revs) {
-            if (rev->_body.size > 0 && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
+            if ((rev->_body.size > 0 || rev->_externalBody)
+                    && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
                 rev->removeBody();
                 _changed = true;
             }
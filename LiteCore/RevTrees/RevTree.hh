@@ -38,8 +38,9 @@ namespace litecore {
         revid           revID;      /**< Revision ID (compressed) */
         sequence_t      sequence;   /**< DB sequence number that this revision has/had */
 
-        slice body() const;
-        bool isBodyAvailable() const{return _body.buf != nullptr;}
+        slice body() const;         /**< Reads an out-of-line body from storage if necessary */
+        bool isBodyAvailable() const{return _body.buf != nullptr || _externalBody;}
+        bool isBodyExternal() const {return _externalBody;}
 
         bool isLeaf() const         {return (flags & kLeaf) != 0;}
         bool isDeleted() const      {return (flags & kDeleted) != 0;}
@@ -73,11 +74,12 @@ namespace litecore {
 
     private:
         slice       _body;          /**< Revision body (JSON), or empty if not stored in this tree*/
+        bool        _externalBody {false}; /**< Is body stored outside the encoded tree? */
 
         void addFlag(Flags f)           {flags = (Flags)(flags | f);}
         void clearFlag(Flags f)         {flags = (Flags)(flags & ~f);}
         void removeBody()               {clearFlag((Flags)(kKeepBody | kHasAttachments));
-                                         _body = nullslice;}
+                                         _body = nullslice; _externalBody = false;}
         bool isMarkedForPurge() const   {return (flags & kPurge) != 0;}
 #if DEBUG
         void dump(std::ostream&);
@@ -175,6 +177,7 @@ namespace litecore {
         virtual bool isBodyOfRevisionAvailable(const Rev* r NONNULL) const;
         bool isLatestRemoteRevision(const Rev* NONNULL) const;
         virtual alloc_slice readBodyOfRevision(const Rev* r NONNULL) const;
+        void setBodyExternal(const Rev* NONNULL, bool external);
         virtual alloc_slice copyBody(slice body);
         virtual alloc_slice copyBody(const alloc_slice &body);
 #if DEBUG
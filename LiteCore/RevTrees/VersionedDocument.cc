@@ -25,12 +25,16 @@
 #include "varint.hh"
 #include "MutableArray.hh"
 #include "MutableDict.hh"
+#include <algorithm>
 #include <ostream>
 
 namespace litecore {
     using namespace fleece;
     using namespace fleece::impl;
 
+    // Suffix of the name of the KeyStore that holds a KeyStore's out-of-line revision bodies
+    static const char* const kBodyStoreSuffix = "_revbodies";
+
     VersionedDocument::VersionedDocument(KeyStore& store, slice docID)
     :_store(store), _rec(docID)
     {
@@ -47,6 +51,7 @@ namespace litecore {
     :RevTree(other)
     ,_store(other._store)
     ,_rec(other._rec)
+    ,_externalRevIDs(other._externalRevIDs)
     {
         updateScope();
     }
@@ -63,8 +68,13 @@ namespace litecore {
     void VersionedDocument::decode() {
         _unknown = false;
         updateScope();
+        _externalRevIDs.clear();
         if (_rec.body().buf) {
             RevTree::decode(_rec.body(), _rec.sequence());
+            for (auto rev : allRevisions()) {
+                if (rev->isBodyExternal())
+                    _externalRevIDs.emplace_back(rev->revID);
+            }
             // The kSynced flag is set when the document's current revision is pushed to a server.
             // This is done instead of updating the doc body, for reasons of speed. So when loading
             // the document, detect that flag and belatedly update the current revision's flags.
@@ -123,6 +133,98 @@ namespace litecore {
         return addScope(RevTree::copyBody(body));
     }
 
+#pragma mark - EXTERNAL BODIES:
+
+
+    // When the DataFile's `separateRevBodies` option is set, the bodies of revisions other than
+    // the current one are stored in a separate KeyStore, keyed by docID and revID, instead of in
+    // the encoded tree. That keeps the record small, so saving a new revision or querying the
+    // current one doesn't have to copy every kept ancestor body. The bodies are read back lazily
+    // by Rev::body(), which calls readBodyOfRevision().
+
+
+    KeyStore& VersionedDocument::bodyStore() const {
+        return _store.dataFile().getKeyStore(_store.name() + kBodyStoreSuffix,
+                                             KeyStore::Capabilities::defaults);
+    }
+
+    alloc_slice VersionedDocument::bodyKey(revid revID) const {
+        // The key is the docID, a zero byte (docIDs can't contain control characters), and
+        // the compressed revID:
+        slice docID = _rec.key();
+        alloc_slice key(docID.size + 1 + revID.size);
+        memcpy((void*)key.buf, docID.buf, docID.size);
+        ((uint8_t*)key.buf)[docID.size] = 0;
+        memcpy((uint8_t*)key.buf + docID.size + 1, revID.buf, revID.size);
+        return key;
+    }
+
+    alloc_slice VersionedDocument::readBodyOfRevision(const Rev *rev) const {
+        if (!rev->isBodyExternal())
+            return RevTree::readBodyOfRevision(rev);
+        Record rec = bodyStore().get(bodyKey(rev->revID));
+        if (!rec.exists()) {
+            alloc_slice revID = rev->revID.expanded();
+            error::_throw(error::CorruptRevisionData,
+                          "Missing out-of-line body of revision %.*s", SPLAT(revID));
+        }
+        return rec.body();
+    }
+
+    // Called before encoding. Makes sure the current revision's body is inline, where queries
+    // expect to find it; and if enabled, moves other revisions' bodies out of the tree.
+    void VersionedDocument::writeExternalBodies(Transaction &t) {
+        bool separate = _store.dataFile().options().separateRevBodies;
+        const Rev *current = currentRevision();
+        for (auto rev : allRevisions()) {
+            if (rev == current) {
+                if (rev->isBodyExternal()) {
+                    (void)rev->body();         // read it so it'll be encoded inline
+                    setBodyExternal(rev, false);
+                }
+            } else if (separate && !rev->isBodyExternal() && rev->body().size > 0) {
+                bodyStore().set(bodyKey(rev->revID), rev->body(), t);
+                setBodyExternal(rev, true);
+            }
+        }
+    }
+
+    // Called after saving. Deletes the stored bodies of revisions that have since been pruned,
+    // purged, or had their bodies removed (or moved back into the tree.)
+    void VersionedDocument::deleteStaleExternalBodies(Transaction &t) {
+        std::vector<alloc_slice> externalRevIDs;
+        for (auto rev : allRevisions()) {
+            if (rev->isBodyExternal())
+                externalRevIDs.emplace_back(rev->revID);
+        }
+        for (auto &revID : _externalRevIDs) {
+            if (std::find(externalRevIDs.begin(), externalRevIDs.end(), revID)
+                    == externalRevIDs.end())
+                bodyStore().del(bodyKey(revid(revID)), t);
+        }
+        _externalRevIDs = std::move(externalRevIDs);
+    }
+
+    void VersionedDocument::deleteExternalBodies(KeyStore &store, slice docID, Transaction &t) {
+        VersionedDocument doc(store, docID);
+        for (auto &revID : doc._externalRevIDs)
+            doc.bodyStore().del(doc.bodyKey(revid(revID)), t);
+    }
+
+
+    unsigned VersionedDocument::expireRecords(KeyStore &store, Transaction &t,
+                                              KeyStore::ExpirationCallback callback)
+    {
+        if (!store.dataFile().options().separateRevBodies)
+            return store.expireRecords(callback);
+        return store.expireRecords([&](slice docID) {
+            deleteExternalBodies(store, docID, t);
+            if (callback)
+                callback(docID);
+        });
+    }
+
+
     Retained<fleece::impl::Doc> VersionedDocument::fleeceDocFor(slice s) const {
         if (!s)
             return nullptr;
@@ -171,6 +273,7 @@ namespace litecore {
         bool createSequence;
         if (currentRevision()) {
             removeNonLeafBodies();
+            writeExternalBodies(transaction);
             auto newBody = encode();
             createSequence = seq == 0 || hasNewRevisions();
             // (Don't call _rec.setBody(), because it'd invalidate all the inner pointers from
@@ -188,6 +291,7 @@ namespace litecore {
             if (seq && !_store.del(_rec.key(), transaction, seq))
                 return kConflict;
         }
+        deleteStaleExternalBodies(transaction);
         _changed = false;
         return createSequence ? kNewSequence : kNoNewSequence;
     }
@@ -18,6 +18,7 @@
 
 #pragma once
 #include "RevTree.hh"
+#include "KeyStore.hh"
 #include "Record.hh"
 #include "Doc.hh"
 #include <memory>
@@ -28,7 +29,6 @@ namespace fleece { namespace impl {
 }}
 
 namespace litecore {
-    class KeyStore;
     class Transaction;
 
     /** Manages storage of a serialized RevTree in a Record. */
@@ -66,6 +66,15 @@ namespace litecore {
 
         bool updateMeta();
 
+        /** Deletes the out-of-line revision bodies of a document that's about to be purged
+            without going through save(). */
+        static void deleteExternalBodies(KeyStore&, slice docID, Transaction&);
+
+        /** Purges expired records like KeyStore::expireRecords, also deleting each one's
+            out-of-line revision bodies if the DataFile stores those. */
+        static unsigned expireRecords(KeyStore&, Transaction&,
+                                      KeyStore::ExpirationCallback =nullptr);
+
         fleece::Retained<fleece::impl::Doc> fleeceDocFor(slice) const;
 
         /** Given a Fleece Value, finds the VersionedDocument it belongs to. */
@@ -78,6 +87,7 @@ namespace litecore {
         void dump()          {RevTree::dump();}
 #endif
     protected:
+        virtual alloc_slice readBodyOfRevision(const Rev*) const override;
         virtual alloc_slice copyBody(slice body) override;
         virtual alloc_slice copyBody(const alloc_slice &body) override;
 #if DEBUG
@@ -99,9 +109,14 @@ namespace litecore {
         void decode();
         void updateScope();
         alloc_slice addScope(const alloc_slice &body);
+        KeyStore& bodyStore() const;
+        alloc_slice bodyKey(revid) const;
+        void writeExternalBodies(Transaction&);
+        void deleteStaleExternalBodies(Transaction&);
 
         KeyStore&       _store;
         Record          _rec;
         std::vector<Retained<VersFleeceDoc>> _fleeceScopes;
+        std::vector<alloc_slice> _externalRevIDs;   // Revs whose bodies are in bodyStore()
     };
 }
@@ -169,8 +169,8 @@ namespace litecore {
     }
 
 
-    DataFile* DataFile::openAnother(Delegate *delegate) {
-        return factory().openFile(_path, delegate, &_options);
+    DataFile* DataFile::openAnother(Delegate *delegate, const Options *options) {
+        return factory().openFile(_path, delegate, options ? options : &_options);
     }
 
 
@@ -372,7 +372,14 @@ namespace litecore {
         if (active) {
             _db._logVerbose("begin transaction");
             Signpost::begin(Signpost::transaction, uintptr_t(this));
-            _db._beginTransaction(this);
+            try {
+                _db._beginTransaction(this);
+            } catch (...) {
+                // The destructor won't run, so undo beginTransactionScope:
+                Signpost::end(Signpost::transaction, uintptr_t(this));
+                _db.endTransactionScope(this);
+                throw;
+            }
             _active = true;
             _db.transactionBegan(this);
         }
@@ -52,7 +52,10 @@ namespace litecore {
         class Delegate {
         public:
             virtual ~Delegate() =default;
-            // Callback that takes a record body and returns the portion of it containing Fleece data
+            // Callback that takes a record body and returns the portion of it containing Fleece data.
+            // If that portion doesn't start at the beginning, queries include the bytes before it
+            // (a rev tree's current-revision header) in the key they cache decoded bodies under,
+            // along with the record's sequence.
             virtual slice fleeceAccessor(slice recordBody) const =0;
             // Callback that takes a blob dictionary and returns the blob data
             virtual alloc_slice blobAccessor(const fleece::impl::Dict*) const =0;
@@ -66,6 +69,7 @@ namespace litecore {
             bool                writeable      :1;      ///< If false, db is opened read-only
             bool                useDocumentKeys:1;      ///< Use SharedKeys for Fleece docs
             bool                upgradeable    :1;      ///< DB schema can be upgraded
+            bool                separateRevBodies:1;    ///< Store non-current rev bodies out of line
             EncryptionAlgorithm encryptionAlgorithm;    ///< What encryption (if any)
             alloc_slice         encryptionKey;          ///< Encryption key, if encrypting
             static const Options defaults;
@@ -90,8 +94,8 @@ namespace litecore {
         /** Closes the database and deletes its file. */
         void deleteDataFile();
 
-        /** Opens another instance on the same file. */
-        DataFile* openAnother(Delegate* NONNULL);
+        /** Opens another connection to the same file, with my options unless others are given. */
+        DataFile* openAnother(Delegate* NONNULL, const Options* =nullptr);
 
         virtual uint64_t fileSize();
 
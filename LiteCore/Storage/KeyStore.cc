@@ -49,6 +49,14 @@ namespace litecore {
         fn(get(seq));
     }
 
+    vector<Record> KeyStore::getMany(const vector<slice> &keys) const {
+        vector<Record> recs;
+        recs.reserve(keys.size());
+        for (slice key : keys)
+            recs.push_back(get(key));
+        return recs;
+    }
+
     void KeyStore::readBody(Record &rec) const {
         if (!rec.body()) {
             Record fullDoc = rec.sequence() ? get(rec.sequence())
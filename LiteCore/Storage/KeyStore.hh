@@ -59,7 +59,7 @@ namespace litecore {
         const std::string& name() const             {return _name;}
         Capabilities capabilities() const           {return _capabilities;}
 
-        virtual uint64_t recordCount() const =0;
+        virtual uint64_t recordCount(bool includeDeleted =false) const =0;
         virtual sequence_t lastSequence() const =0;
         virtual uint64_t purgeCount() const =0;
 
@@ -80,12 +80,19 @@ namespace litecore {
         /** Reads a record whose key() is already set. */
         virtual bool read(Record &rec, ContentOption = kEntireBody) const =0;
 
+        /** Reads the records with the given (unique) keys, returning them in the same order.
+            Records that don't exist are returned with exists() false. Subclasses can override
+            this to read them all in fewer queries. */
+        virtual std::vector<Record> getMany(const std::vector<slice> &keys) const;
+
         /** Reads the body of a Record that's already been read with kMetaonly.
             Does nothing if the record's body is non-null. */
         virtual void readBody(Record &rec) const;
 
-        /** Creates a database query object. */
-        virtual Retained<Query> compileQuery(slice expr, QueryLanguage =QueryLanguage::kJSON) =0;
+        /** Creates a database query object. If `incremental` is true, and the query is simple
+            enough, refreshing its results will only re-evaluate the documents that changed. */
+        virtual Retained<Query> compileQuery(slice expr, QueryLanguage =QueryLanguage::kJSON,
+                                             bool incremental =false) =0;
 
         using WithDocBodyCallback = std::function<alloc_slice(slice docID, slice body, sequence_t)>;
 
@@ -153,6 +160,18 @@ namespace litecore {
         virtual void deleteIndex(slice name) =0;
         virtual std::vector<IndexSpec> getIndexes() const =0;
 
+        /** Returns how much of an index created with the `background` option has been populated,
+            from 0.0 to 1.0. An index that's still being built isn't used by queries. */
+        virtual double indexBuildProgress(slice name)                       {return 1.0;}
+
+        /** True if any indexes are waiting to be populated by `continueIndexBuilds`. */
+        virtual bool indexBuildsPending() const                             {return false;}
+
+        /** Populates the next chunk (up to `maxRecords` records) of an index that's being
+            built in the background. Must be called in a transaction.
+            @return  True if there's more work to do. */
+        virtual bool continueIndexBuilds(unsigned maxRecords)               {return false;}
+
         // public for complicated reasons; clients should never call it
         virtual ~KeyStore()                             { }
 
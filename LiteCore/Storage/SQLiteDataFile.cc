@@ -21,11 +21,13 @@
  * 201: Initial Version
  * 301: Add index table for use with FTS
  * 302: Add purgeCnt entry to kvmeta
+ * 303: Add liveCnt, deletedCnt, cntStamp entries to kvmeta
  */
 
 #include "SQLiteDataFile.hh"
 #include "SQLiteKeyStore.hh"
 #include "SQLite_Internal.hh"
+#include "SQLiteFleeceUtil.hh"
 #include "Record.hh"
 #include "UnicodeCollator.hh"
 #include "Error.hh"
@@ -135,7 +137,9 @@ namespace litecore {
         SQLite::Exception::logger = [](const SQLite::Exception &x) {
             LogToAt(SQL, Error, "%s (%d/%d)", x.what(), x.getErrorCode(), x.getExtendedErrorCode());
         };
-        Assert(sqlite3_libversion_number() >= 300900, "LiteCore requires SQLite 3.9+");
+        // 3.24 is the first version with UPSERT ("INSERT ... ON CONFLICT DO UPDATE"), which the
+        // kvmeta writes (lastSeq, purgeCnt, record counts) depend on:
+        Assert(sqlite3_libversion_number() >= 3024000, "LiteCore requires SQLite 3.24+");
         sqlite3_config(SQLITE_CONFIG_LOG, sqlite3_log_callback, NULL);
 #if defined(_MSC_VER) && !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
         setSqliteTempDirectory();
@@ -197,12 +201,13 @@ namespace litecore {
                       "PRAGMA journal_mode=WAL; "
                       "BEGIN; "
                       "CREATE TABLE IF NOT EXISTS "      // Table of metadata about KeyStores
-                      "  kvmeta (name TEXT PRIMARY KEY, lastSeq INTEGER DEFAULT 0, purgeCnt INTEGER DEFAULT 0) WITHOUT ROWID; "
-                      "PRAGMA user_version=302; "
+                      "  kvmeta (name TEXT PRIMARY KEY, lastSeq INTEGER DEFAULT 0, purgeCnt INTEGER DEFAULT 0, "
+                      "          liveCnt INTEGER, deletedCnt INTEGER, cntStamp INTEGER) WITHOUT ROWID; "
+                      "PRAGMA user_version=303; "
                       "END;"
                       );
                 Assert(intQuery("PRAGMA auto_vacuum") == 2, "Incremental vacuum was not enabled!");
-                _schemaVersion = SchemaVersion::WithPurgeCount;
+                _schemaVersion = SchemaVersion::WithRecordCounts;
                 // Create the default KeyStore's table:
                 (void)defaultKeyStore();
             } else if (_schemaVersion < SchemaVersion::MinReadable) {
@@ -229,6 +234,45 @@ namespace litecore {
                     }
                 }
             }
+
+            if (_schemaVersion < SchemaVersion::WithRecordCounts) {
+                // Schema upgrade: Add the record-count columns to the kvmeta table, and populate
+                // them by counting each KeyStore's records once. A read-only db can postpone
+                // this, since SQLiteKeyStore::recordCount() falls back to counting.
+                if (options().writeable) {
+                    if (!options().upgradeable)
+                        error::_throw(error::CantUpgradeDatabase);
+                    try {
+                        _exec("BEGIN");
+                        try {
+                            _exec("ALTER TABLE kvmeta ADD COLUMN liveCnt INTEGER; "
+                                  "ALTER TABLE kvmeta ADD COLUMN deletedCnt INTEGER; "
+                                  "ALTER TABLE kvmeta ADD COLUMN cntStamp INTEGER; ");
+                            rebuildRecordCounts();
+                            _exec("PRAGMA user_version=303; END;");
+                        } catch (...) {
+                            _exec("ROLLBACK");
+                            throw;
+                        }
+                        _schemaVersion = SchemaVersion::WithRecordCounts;
+                    } catch (const SQLite::Exception &x) {
+                        // Recover if the db file itself is read-only
+                        if (x.getErrorCode() != SQLITE_READONLY)
+                            throw;
+                    }
+                }
+            }
+
+            if (options().separateRevBodies && options().writeable
+                                             && _schemaVersion < SchemaVersion::WithExternalRevBodies) {
+                // Revision trees are about to be written with a flag bit (RawRevision::
+                // kHasExternalData) that older builds would misread as `kNew`, losing the bodies.
+                // Bumping the version past their MaxReadable makes them refuse to open the file.
+                // (Once bumped it stays, since existing trees may have external bodies.)
+                if (!isNew && !options().upgradeable)
+                    error::_throw(error::CantUpgradeDatabase);
+                ensureSchemaVersionAtLeast(SchemaVersion::WithExternalRevBodies);
+            }
         });
 
         _exec(format("PRAGMA cache_size=%d; "            // Memory cache
@@ -257,7 +301,7 @@ namespace litecore {
 
         // Register collators, custom functions, and the FTS tokenizer:
         RegisterSQLiteUnicodeCollations(sqlite, _collationContexts);
-        RegisterSQLiteFunctions(sqlite, {delegate(), documentKeys()});
+        _docCache = RegisterSQLiteFunctions(sqlite, {delegate(), documentKeys()});
         int rc = register_unicodesn_tokenizer(sqlite);
         if (rc != SQLITE_OK)
             warn("Unable to register FTS tokenizer: SQLite err %d", rc);
@@ -294,6 +338,14 @@ namespace litecore {
         _setLastSeqStmt.reset();
         _getPurgeCntStmt.reset();
         _setPurgeCntStmt.reset();
+        _getRecCountsStmt.reset();
+        _setRecCountsStmt.reset();
+        if (auto stats = _queryCache.stats(); stats.hits + stats.misses > 0) {
+            _log(LogLevel::Info, "Query cache: %llu hits, %llu misses (%.0f%% hit rate)",
+                 (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                 100.0 * stats.hits / (stats.hits + stats.misses));
+        }
+        _queryCache.clear();
         if (_sqlDb) {
             if (options().writeable) {
                 optimize();
@@ -453,6 +505,12 @@ namespace litecore {
 
     void SQLiteDataFile::_beginTransaction(Transaction*) {
         checkOpen();
+        // A read-only transaction (a SAVEPOINT) can't be upgraded; SQLite would just fail with
+        // "cannot start a transaction within a transaction". This happens when a streaming
+        // query enumerator is still reading rows:
+        if (!sqlite3_get_autocommit(_sqlDb->getHandle()))
+            error::_throw(error::Busy, "Can't begin a transaction while a read-only transaction "
+                                       "(e.g. a streaming query) is open on this connection");
         _exec("BEGIN");
     }
 
@@ -463,6 +521,16 @@ namespace litecore {
             ((SQLiteKeyStore&)ks).transactionWillEnd(commit);
         });
 
+        // A rollback reverts `PRAGMA schema_version` along with any schema changes, so the same
+        // version could later come back with a different schema; translations made during the
+        // transaction can't be trusted:
+        if (!commit)
+            _queryCache.clear();
+        // It also makes the sequences assigned during it available again, so bodies that queries
+        // cached by sequence can't be trusted either:
+        if (!commit && _docCache)
+            _docCache->clear();
+
         exec(commit ? "COMMIT" : "ROLLBACK");
     }
 
@@ -606,6 +674,71 @@ namespace litecore {
     }
 
 
+    // The record counts are only trusted if `cntStamp` matches the sum of `lastSeq` and
+    // `purgeCnt`, both of which only grow. SQLiteKeyStore rewrites all three together, so a
+    // mismatch means an older version of LiteCore, which doesn't know about the counts, has
+    // changed the KeyStore since; the caller then has to count the records itself. Changes that
+    // don't bump either number are caught by triggers that clear the stamp (see
+    // SQLiteKeyStore::createCountTriggers.)
+    bool SQLiteDataFile::recordCounts(const std::string& keyStoreName,
+                                      uint64_t &liveCount, uint64_t &deletedCount) const
+    {
+        if (_schemaVersion < SchemaVersion::WithRecordCounts)
+            return false;
+        compile(_getRecCountsStmt,
+                "SELECT liveCnt, deletedCnt FROM kvmeta "
+                "WHERE name=? AND cntStamp = lastSeq + purgeCnt");
+        UsingStatement u(_getRecCountsStmt);
+        _getRecCountsStmt->bindNoCopy(1, keyStoreName);
+        if (!_getRecCountsStmt->executeStep())
+            return false;
+        liveCount = (int64_t)_getRecCountsStmt->getColumn(0);
+        deletedCount = (int64_t)_getRecCountsStmt->getColumn(1);
+        return true;
+    }
+
+    // Must be called after setLastSequence() and setPurgeCount(), so the stamp matches them.
+    void SQLiteDataFile::setRecordCounts(SQLiteKeyStore& store,
+                                         uint64_t liveCount, uint64_t deletedCount)
+    {
+        Assert(_schemaVersion >= SchemaVersion::WithRecordCounts);
+        compile(_setRecCountsStmt,
+            "INSERT INTO kvmeta (name, liveCnt, deletedCnt, cntStamp) VALUES (?, ?, ?, 0) "
+            "ON CONFLICT (name) "
+            "DO UPDATE SET liveCnt = excluded.liveCnt, deletedCnt = excluded.deletedCnt, "
+            "              cntStamp = lastSeq + purgeCnt");
+        UsingStatement u(_setRecCountsStmt);
+        _setRecCountsStmt->bindNoCopy(1, store.name());
+        _setRecCountsStmt->bind(2, (long long)liveCount);
+        _setRecCountsStmt->bind(3, (long long)deletedCount);
+        _setRecCountsStmt->exec();
+    }
+
+
+    // Counts the records of every KeyStore and stores the results in kvmeta. Only called
+    // (inside a transaction) when upgrading the schema.
+    void SQLiteDataFile::rebuildRecordCounts() {
+        vector<string> names;
+        {
+            SQLite::Statement allStores(*_sqlDb, "SELECT substr(name,4) FROM sqlite_master"
+                                                 " WHERE type='table' AND name GLOB 'kv_*'"
+                                                 " AND name NOT GLOB '*:*'");
+            while (allStores.executeStep())
+                names.push_back(allStores.getColumn(0).getString());
+        }
+        for (auto &name : names) {
+            _exec(format("INSERT OR IGNORE INTO kvmeta (name) VALUES ('%s'); "
+                         "UPDATE kvmeta SET "
+                         "  liveCnt = (SELECT count(*) FROM kv_%s WHERE (flags & 1) != 1), "
+                         "  deletedCnt = (SELECT count(*) FROM kv_%s WHERE (flags & 1) = 1), "
+                         "  cntStamp = lastSeq + purgeCnt "
+                         "WHERE name='%s'",
+                         name.c_str(), name.c_str(), name.c_str(), name.c_str()));
+        }
+        logInfo("Counted the records of %zu KeyStores", names.size());
+    }
+
+
     uint64_t SQLiteDataFile::fileSize() {
         // Move all WAL changes into the main database file, so its size is accurate:
         _exec("PRAGMA wal_checkpoint(FULL)");
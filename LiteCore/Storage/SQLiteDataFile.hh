@@ -20,6 +20,7 @@
 
 #include "DataFile.hh"
 #include "IndexSpec.hh"
+#include "QueryCache.hh"
 #include "UnicodeCollator.hh"
 #include <optional>
 
@@ -33,6 +34,7 @@ namespace SQLite {
 namespace litecore {
 
     class SQLiteKeyStore;
+    class QueryDocCache;
     struct SQLiteIndexSpec;
 
 
@@ -63,6 +65,7 @@ namespace litecore {
                        const std::string &tableName, std::string &outSQL) const;
         bool schemaExistsWithSQL(const std::string &name, const std::string &type,
                                  const std::string &tableName, const std::string &sql);
+        bool indexTableIsBuilding(const std::string &indexTableName) const;
 
         fleece::alloc_slice rawQuery(const std::string &query) override;
 
@@ -80,6 +83,12 @@ namespace litecore {
         static Factory& sqliteFactory();
         virtual Factory& factory() const override   {return SQLiteDataFile::sqliteFactory();};
 
+        /** SQLite's schema cookie, which changes whenever any table or index is created or dropped. */
+        int64_t schemaCookie()                              {return intQuery("PRAGMA schema_version");}
+
+        /** Cache of translated queries, used by SQLiteQuery. */
+        QueryCache& queryCache()                            {return _queryCache;}
+
         // Get an index's row count, and/or all its rows. For debugging/troubleshooting only!
         void inspectIndex(slice name,
                           int64_t &outRowCount,
@@ -104,6 +113,9 @@ namespace litecore {
         void setLastSequence(SQLiteKeyStore&, sequence_t);
         uint64_t purgeCount(const std::string& keyStoreName) const;
         void setPurgeCount(SQLiteKeyStore&, uint64_t);
+        bool recordCounts(const std::string& keyStoreName,
+                          uint64_t &liveCount, uint64_t &deletedCount) const;
+        void setRecordCounts(SQLiteKeyStore&, uint64_t liveCount, uint64_t deletedCount);
 
         SQLite::Statement& compile(const std::unique_ptr<SQLite::Statement>& ref,
                                    const char *sql) const;
@@ -128,10 +140,13 @@ namespace litecore {
         enum class SchemaVersion {
             None            = 0,    // Newly created database
             MinReadable     = 201,  // Cannot open earlier versions than this (CBL 2.0)
-            MaxReadable     = 399,  // Cannot open versions newer than this
+            MaxReadable     = 499,  // Cannot open versions newer than this
 
             WithIndexTable  = 301,  // Added 'indexes' table (CBL 2.5)
             WithPurgeCount  = 302,  // Added 'purgeCnt' column to KeyStores (CBL 2.7)
+            WithRecordCounts= 303,  // Added 'liveCnt', 'deletedCnt', 'cntStamp' columns to KeyStores
+            WithExternalRevBodies = 400, // Rev trees may store bodies out of line (separateRevBodies).
+                                         // Older builds can't read those, and refuse to open it.
         };
 
         void reopenSQLiteHandle();
@@ -139,6 +154,7 @@ namespace litecore {
         void decrypt();
         bool _decrypt(EncryptionAlgorithm, slice key);
         int _exec(const std::string &sql);
+        void rebuildRecordCounts();
 
         bool indexTableExists();
         void ensureIndexTableExists();
@@ -147,14 +163,23 @@ namespace litecore {
                            const std::string &indexTableName);
         void unregisterIndex(slice indexName);
         void garbageCollectIndexTable(const std::string &tableName);
+        bool indexBuildTableExists() const;
+        void registerIndexBuild(const std::string &indexTableName,
+                                const std::string &keyStoreName,
+                                const std::string &populateSQL,
+                                int64_t endRowID);
+        void unregisterIndexBuild(const std::string &indexTableName);
         SQLiteIndexSpec specFromStatement(SQLite::Statement &stmt);
         std::vector<SQLiteIndexSpec> getIndexesOldStyle(const KeyStore *store =nullptr);
 
         std::unique_ptr<SQLite::Database>    _sqlDb;         // SQLite database object
         std::unique_ptr<SQLite::Statement>   _getLastSeqStmt, _setLastSeqStmt;
         std::unique_ptr<SQLite::Statement>   _getPurgeCntStmt, _setPurgeCntStmt;
+        std::unique_ptr<SQLite::Statement>   _getRecCountsStmt, _setRecCountsStmt;
         CollationContextVector               _collationContexts;
         SchemaVersion                        _schemaVersion {SchemaVersion::None};
+        QueryCache                           _queryCache;    // Recently compiled queries
+        std::shared_ptr<QueryDocCache>       _docCache;      // Bodies decoded by queries
     };
 
 
@@ -25,6 +25,7 @@
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "FleeceImpl.hh"
 #include <sstream>
+#include <algorithm>
 
 using namespace std;
 using namespace fleece;
@@ -69,6 +70,36 @@ namespace litecore {
                                   "  version BLOB,"
                                   "  body BLOB)"));
         }
+        createCountTriggers();
+    }
+
+
+    // Adds triggers that clear the stamp of the KeyStore's persisted record counts whenever a
+    // record is added or removed, or its deleted flag changes. SQLiteKeyStore rewrites the stamp
+    // when it commits such a change, having kept the counts current itself; but older versions
+    // of LiteCore, which can still open and write the file, don't -- and they don't always bump
+    // lastSeq or purgeCnt either (expiring docs, setting flags, sequence-less KeyStores.) The
+    // triggers are part of the schema, so they run for those versions too, and the next
+    // recordCount() falls back to counting.
+    void SQLiteKeyStore::createCountTriggers() {
+        auto &file = db();
+        if (file._schemaVersion < SQLiteDataFile::SchemaVersion::WithRecordCounts
+                || !file.options().writeable)
+            return;
+        if (file.intQuery(subst("SELECT count(*) FROM sqlite_master WHERE type='trigger'"
+                                " AND name GLOB 'kv_@::cnt_*'").c_str()) == 3)
+            return;
+        // If the table was created, or had its triggers dropped, by an older version, its counts
+        // can't be trusted, so the stamp is cleared here too:
+        file.execWithLock(subst(
+            "CREATE TRIGGER IF NOT EXISTS \"kv_@::cnt_ins\" AFTER INSERT ON kv_@"
+            "  BEGIN UPDATE kvmeta SET cntStamp=NULL WHERE name='@'; END; "
+            "CREATE TRIGGER IF NOT EXISTS \"kv_@::cnt_del\" AFTER DELETE ON kv_@"
+            "  BEGIN UPDATE kvmeta SET cntStamp=NULL WHERE name='@'; END; "
+            "CREATE TRIGGER IF NOT EXISTS \"kv_@::cnt_upd\" AFTER UPDATE OF flags ON kv_@"
+            "  WHEN (old.flags & 1) != (new.flags & 1)"
+            "  BEGIN UPDATE kvmeta SET cntStamp=NULL WHERE name='@'; END; "
+            "UPDATE kvmeta SET cntStamp=NULL WHERE name='@'"));
     }
 
 
@@ -88,11 +119,14 @@ namespace litecore {
         _delBySeqStmt.reset();
         _delByBothStmt.reset();
         _setFlagStmt.reset();
+        _setDeletedFlagStmt.reset();
         _setExpStmt.reset();
         _getExpStmt.reset();
         _nextExpStmt.reset();
         _findExpStmt.reset();
+        _countExpStmt.reset();
         _withDocBodiesStmt.reset();
+        _getManyStmt.reset();
         KeyStore::close();
     }
 
@@ -128,18 +162,67 @@ namespace litecore {
     }
 
 
-    uint64_t SQLiteKeyStore::recordCount() const {
-        if (!_recCountStmt) {
-            stringstream sql;
-            sql << "SELECT count(*) FROM kv_" << _name << " WHERE (flags & 1) != 1";
-            compile(_recCountStmt, sql.str().c_str());
+    // The live and deleted record counts are persisted in the `kvmeta` table, so this doesn't have
+    // to scan the table. Within a transaction they're cached, and the methods that add, delete or
+    // flag records keep the cached counts current; transactionWillEnd() saves them.
+    uint64_t SQLiteKeyStore::recordCount(bool includeDeleted) const {
+        int64_t live = _liveCount, deleted = _deletedCount;
+        if (live < 0) {
+            readRecordCounts(live, deleted);
+            if (db().inTransaction()) {
+                _liveCount = live;
+                _deletedCount = deleted;
+            }
+        }
+        return includeDeleted ? live + deleted : live;
+    }
+
+
+    void SQLiteKeyStore::readRecordCounts(int64_t &liveCount, int64_t &deletedCount) const {
+        uint64_t live, deleted;
+        if (db().recordCounts(_name, live, deleted)) {
+            liveCount = live;
+            deletedCount = deleted;
+            return;
         }
+        // Counts are missing or stale, so fall back to counting:
+        compile(_recCountStmt, "SELECT count(*), sum(flags & 1) FROM kv_@");
         UsingStatement u(_recCountStmt);
+        liveCount = deletedCount = 0;
         if (_recCountStmt->executeStep()) {
-            auto count = (int64_t)_recCountStmt->getColumn(0);
-            return count;
+            deletedCount = (int64_t)_recCountStmt->getColumn(1);
+            liveCount = (int64_t)_recCountStmt->getColumn(0) - deletedCount;
         }
-        return 0;
+    }
+
+
+    // Makes sure the counts are cached, before a write that will adjust them.
+    void SQLiteKeyStore::loadRecordCounts() const {
+        if (_liveCount < 0)
+            (void)recordCount();
+    }
+
+
+    // Binds `deleted` to the statement's parameter `param`, which is compared against the existing
+    // record's deleted flag, and executes the statement. Returns the number of rows changed.
+    // Writes use this to learn the prior state of the record they replace, which the record
+    // counts need, without having to read the record first.
+    int SQLiteKeyStore::execIfDeleted(SQLite::Statement &stmt, int param, bool deleted) {
+        UsingStatement u(stmt);
+        stmt.bind(param, (int)deleted);
+        return stmt.exec();
+    }
+
+
+    // Adjusts the cached counts after a record's flags change from `oldFlags` to `newFlags`;
+    // either may be -1, meaning the record didn't exist before, or doesn't exist after.
+    void SQLiteKeyStore::updateRecordCounts(int oldFlags, int newFlags) {
+        auto deleted = [](int flags) {return (flags & (int)DocumentFlags::kDeleted) != 0;};
+        if (oldFlags >= 0)
+            --(deleted(oldFlags) ? _deletedCount : _liveCount);
+        if (newFlags >= 0)
+            ++(deleted(newFlags) ? _deletedCount : _liveCount);
+        _recordCountsChanged = true;
     }
 
 
@@ -174,12 +257,19 @@ namespace litecore {
     }
 
     void SQLiteKeyStore::incrementPurgeCount() {
-        ++_purgeCount;
+        _purgeCount = purgeCount() + 1;     // (make sure the persisted count has been loaded)
         _purgeCountChanged = true;
     }
 
 
     void SQLiteKeyStore::transactionWillEnd(bool commit) {
+        // The persisted counts are stamped with the lastSeq and purgeCnt they go with, so they
+        // have to be rewritten whenever either of those changes:
+        bool saveCounts = commit && (_recordCountsChanged || _lastSequenceChanged
+                                                          || _purgeCountChanged);
+        if (saveCounts)
+            loadRecordCounts();
+
         if (_lastSequenceChanged) {
             if (commit)
                 db().setLastSequence(*this, _lastSequence);
@@ -192,8 +282,13 @@ namespace litecore {
             _purgeCountChanged = false;
         }
 
+        if (saveCounts)
+            db().setRecordCounts(*this, _liveCount, _deletedCount);
+        _recordCountsChanged = false;
+
         _lastSequence = -1;
         _purgeCountValid = false;
+        _liveCount = _deletedCount = -1;
 
         if (!commit && _uncommittedExpirationColumn)
             _hasExpirationColumn = false;
@@ -264,6 +359,49 @@ namespace litecore {
     }
 
 
+    // Number of keys looked up by one run of the `_getManyStmt` statement.
+    static constexpr size_t kGetManyBatchSize = 100;
+
+
+    vector<Record> SQLiteKeyStore::getMany(const vector<slice> &keys) const {
+        vector<Record> recs;
+        recs.reserve(keys.size());
+        unordered_map<slice,size_t> indices; // maps key -> index in keys[]
+        indices.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            recs.emplace_back(keys[i]);
+            indices.insert({keys[i], i});
+        }
+
+        // As in withDocBodies, the statement has a fixed number of key parameters, and unused
+        // ones are left NULL:
+        if (!_getManyStmt) {
+            stringstream sql;
+            sql << "SELECT sequence, flags, key, version, body FROM kv_@ WHERE key IN (";
+            for (size_t i = 0; i < kGetManyBatchSize; ++i)
+                sql << (i ? ",?" : "?");
+            sql << ")";
+            compile(_getManyStmt, sql.str().c_str());
+        }
+        SQLite::Statement &stmt = *_getManyStmt;
+
+        lock_guard<mutex> lock(_stmtMutex);
+        for (size_t start = 0; start < keys.size(); start += kGetManyBatchSize) {
+            size_t end = min(start + kGetManyBatchSize, keys.size());
+            UsingStatement u(stmt);
+            stmt.clearBindings();
+            for (size_t i = start; i < end; ++i)
+                stmt.bindNoCopy(int(1 + i - start), (const char*)keys[i].buf, (int)keys[i].size);
+            while (stmt.executeStep()) {
+                Record &rec = recs[indices[columnAsSlice(stmt.getColumn(2))]];
+                rec.updateSequence((int64_t)stmt.getColumn(0));
+                setRecordMetaAndBody(rec, stmt, kEntireBody);
+            }
+        }
+        return recs;
+    }
+
+
     Record SQLiteKeyStore::get(sequence_t seq /*, ContentOptions content*/) const {
         constexpr ContentOption content = kEntireBody;  // this used to be a param but not used
         Assert(_capabilities.sequences);
@@ -302,37 +440,6 @@ namespace litecore {
                                    const sequence_t *replacingSequence,
                                    bool newSequence)
     {
-        const char *opName;
-        SQLite::Statement *stmt;
-        if (replacingSequence == nullptr) {
-            // Default:
-            compile(_setStmt,
-                    "INSERT OR REPLACE INTO kv_@ (version, body, flags, sequence, key)"
-                    " VALUES (?, ?, ?, ?, ?)");
-            stmt = _setStmt.get();
-            opName = "set";
-        } else if (*replacingSequence == 0) {
-            // Insert only:
-            compile(_insertStmt,
-                    "INSERT OR IGNORE INTO kv_@ (version, body, flags, sequence, key)"
-                    " VALUES (?, ?, ?, ?, ?)");
-            stmt = _insertStmt.get();
-            opName = "insert";
-        } else {
-            // Replace only:
-            Assert(_capabilities.sequences);
-            compile(_replaceStmt,
-                    "UPDATE kv_@ SET version=?, body=?, flags=?, sequence=?"
-                    " WHERE key=? AND sequence=?");
-            stmt = _replaceStmt.get();
-            stmt->bind(6, (long long)*replacingSequence);
-            opName = "update";
-        }
-        stmt->bindNoCopy(1, vers.buf, (int)vers.size);
-        stmt->bindNoCopy(2, body.buf, (int)body.size);
-        stmt->bind(3, (int)flags);
-        stmt->bindNoCopy(5, (const char*)key.buf, (int)key.size);
-
         sequence_t seq = 0;
         if (_capabilities.sequences) {
             if (newSequence) {
@@ -341,20 +448,85 @@ namespace litecore {
                 Assert(replacingSequence && *replacingSequence > 0);
                 seq = *replacingSequence;
             }
-            stmt->bind(4, (long long)seq);
-        } else {
-            stmt->bind(4); // null
-            seq = 1;
         }
 
+        auto bindRecord = [&](SQLite::Statement &stmt) {
+            stmt.bindNoCopy(1, vers.buf, (int)vers.size);
+            stmt.bindNoCopy(2, body.buf, (int)body.size);
+            stmt.bind(3, (int)flags);
+            if (_capabilities.sequences)
+                stmt.bind(4, (long long)seq);
+            else
+                stmt.bind(4); // null
+            stmt.bindNoCopy(5, (const char*)key.buf, (int)key.size);
+        };
+
+        auto insert = [&]() {
+            compile(_insertStmt,
+                    "INSERT OR IGNORE INTO kv_@ (version, body, flags, sequence, key)"
+                    " VALUES (?, ?, ?, ?, ?)");
+            bindRecord(*_insertStmt);
+            UsingStatement u(*_insertStmt);
+            return _insertStmt->exec() > 0;
+        };
+
+        const char *opName;
+        if (replacingSequence == nullptr)
+            opName = "set";
+        else if (*replacingSequence == 0)
+            opName = "insert";
+        else
+            opName = "update";
         if (db().willLog(LogLevel::Verbose) && name() != "default")
             db()._logVerbose("KeyStore(%-s) %s %.*s", name().c_str(), opName, SPLAT(key));
 
-        UsingStatement u(*stmt);
-        if (stmt->exec() == 0)
-            return 0;               // condition wasn't met
+        // To keep the record counts current, the deleted flag of the record being replaced has to
+        // be known. Rather than reading it first, an update is tried that only matches a record
+        // whose deleted flag is the same as the new one's (the common case); if that fails, it's
+        // retried with the opposite flag.
+        loadRecordCounts();
+        const int kDeleted = (int)DocumentFlags::kDeleted;
+        bool deleted = (flags & DocumentFlags::kDeleted);
+        int oldFlags;
+        if (replacingSequence == nullptr) {
+            // Default: update the existing record, else insert a new one:
+            compile(_setStmt,
+                    "UPDATE kv_@ SET version=?, body=?, flags=?, sequence=?"
+                    " WHERE key=? AND (flags & 1) = ?");
+            bindRecord(*_setStmt);
+            if (execIfDeleted(*_setStmt, 6, deleted))
+                oldFlags = deleted ? kDeleted : 0;
+            else if (insert())
+                oldFlags = -1;
+            else if (execIfDeleted(*_setStmt, 6, !deleted))
+                oldFlags = deleted ? 0 : kDeleted;
+            else
+                return 0;
+        } else if (*replacingSequence == 0) {
+            // Insert only:
+            if (!insert())
+                return 0;           // condition wasn't met
+            oldFlags = -1;
+        } else {
+            // Replace only:
+            Assert(_capabilities.sequences);
+            compile(_replaceStmt,
+                    "UPDATE kv_@ SET version=?, body=?, flags=?, sequence=?"
+                    " WHERE key=? AND sequence=? AND (flags & 1) = ?");
+            bindRecord(*_replaceStmt);
+            _replaceStmt->bind(6, (long long)*replacingSequence);
+            if (execIfDeleted(*_replaceStmt, 7, deleted))
+                oldFlags = deleted ? kDeleted : 0;
+            else if (execIfDeleted(*_replaceStmt, 7, !deleted))
+                oldFlags = deleted ? 0 : kDeleted;
+            else
+                return 0;           // condition wasn't met
+        }
 
-        if (_capabilities.sequences && newSequence)
+        updateRecordCounts(oldFlags, (int)flags);
+        if (!_capabilities.sequences)
+            return 1;
+        if (newSequence)
             setLastSequence(seq);
         return seq;
     }
@@ -363,19 +535,31 @@ namespace litecore {
     bool SQLiteKeyStore::del(slice key, Transaction&, sequence_t seq) {
         Assert(key);
         SQLite::Statement *stmt;
+        int deletedParam;
         db()._logVerbose("SQLiteKeyStore(%s) del key '%.*s' seq %" PRIu64,
                         _name.c_str(), SPLAT(key), seq);
         if (seq) {
-            stmt = &compile(_delByBothStmt, "DELETE FROM kv_@ WHERE key=? AND sequence=?");
+            stmt = &compile(_delByBothStmt,
+                            "DELETE FROM kv_@ WHERE key=? AND sequence=? AND (flags & 1) = ?");
             stmt->bind(2, (long long)seq);
+            deletedParam = 3;
         } else {
-            stmt = &compile(_delByKeyStmt, "DELETE FROM kv_@ WHERE key=?");
+            stmt = &compile(_delByKeyStmt, "DELETE FROM kv_@ WHERE key=? AND (flags & 1) = ?");
+            deletedParam = 2;
         }
         stmt->bindNoCopy(1, (const char*)key.buf, (int)key.size);
-        UsingStatement u(*stmt);
-        if(stmt->exec() == 0)
+
+        // As in set(), find out whether the record was deleted by trying each possibility:
+        loadRecordCounts();
+        int oldFlags;
+        if (execIfDeleted(*stmt, deletedParam, false))
+            oldFlags = 0;
+        else if (execIfDeleted(*stmt, deletedParam, true))
+            oldFlags = (int)DocumentFlags::kDeleted;
+        else
             return false;
 
+        updateRecordCounts(oldFlags, -1);
         incrementPurgeCount();
         return true;
     }
@@ -384,6 +568,22 @@ namespace litecore {
     bool SQLiteKeyStore::setDocumentFlag(slice key, sequence_t seq, DocumentFlags flags,
                                          Transaction&)
     {
+        // Only the deleted flag affects the record counts. When setting it, first try to update
+        // a record that isn't deleted yet; if that matches, the record became deleted.
+        if (flags & DocumentFlags::kDeleted) {
+            loadRecordCounts();
+            compile(_setDeletedFlagStmt,
+                    "UPDATE kv_@ SET flags=(flags | ?) WHERE key=? AND sequence=?"
+                    " AND (flags & 1) = 0");
+            UsingStatement u(*_setDeletedFlagStmt);
+            _setDeletedFlagStmt->bind      (1, (unsigned)flags);
+            _setDeletedFlagStmt->bindNoCopy(2, (const char*)key.buf, (int)key.size);
+            _setDeletedFlagStmt->bind      (3, (long long)seq);
+            if (_setDeletedFlagStmt->exec() > 0) {
+                updateRecordCounts(0, (int)DocumentFlags::kDeleted);
+                return true;
+            }
+        }
         compile(_setFlagStmt, "UPDATE kv_@ SET flags=(flags | ?) WHERE key=? AND sequence=?");
         UsingStatement u(*_setFlagStmt);
         _setFlagStmt->bind      (1, (unsigned)flags);
@@ -397,6 +597,8 @@ namespace litecore {
         Transaction t(db());
         db().exec(string("DELETE FROM kv_"+name()));
         setLastSequence(0);
+        _liveCount = _deletedCount = 0;
+        _recordCountsChanged = true;
         t.commit();
     }
 
@@ -417,6 +619,10 @@ namespace litecore {
     }
 
 
+    // Number of docIDs looked up by one run of the `_withDocBodiesStmt` statement.
+    static constexpr size_t kWithDocBodiesBatchSize = 100;
+
+
     vector<alloc_slice> SQLiteKeyStore::withDocBodies(const vector<slice> &docIDs,
                                                       WithDocBodyCallback callback)
     {
@@ -425,42 +631,42 @@ namespace litecore {
 
         unordered_map<slice,size_t> docIndices; // maps docID -> index in docIDs[]
         docIndices.reserve(docIDs.size());
+        for (size_t i = 0; i < docIDs.size(); ++i)
+            docIndices.insert({docIDs[i], i});
 
-        // Construct SQL query with a big "IN (...)" clause for all the docIDs:
-        stringstream sql;
-        sql << "SELECT key, fl_callback(key, body, sequence, ?) FROM kv_" << name()
-            << " WHERE key IN ('";
-        unsigned n = 0;
-        for (slice docID : docIDs) {
-            docIndices.insert({docID, n});
-            if (n++ > 0)
-                sql << "','";
-            if (docID.findByte('\'')) {
-                string escaped(docID);
-                replace(escaped, "'", "''");
-                sql << escaped;
-            } else {
-                sql << docID;
-            }
+        // The statement takes a fixed number of docID parameters, so it only has to be compiled
+        // once. The docIDs are bound in batches of that size; unused parameters are left NULL,
+        // which never matches a key.
+        if (!_withDocBodiesStmt) {
+            stringstream sql;
+            sql << "SELECT key, fl_callback(key, body, sequence, ?1) FROM kv_@ WHERE key IN (";
+            for (size_t i = 0; i < kWithDocBodiesBatchSize; ++i)
+                sql << (i ? ",?" : "?");
+            sql << ")";
+            compile(_withDocBodiesStmt, sql.str().c_str());
         }
-        sql << "')";
-
-        SQLite::Statement stmt(db(), sql.str());
-        LogStatement(stmt);
-        stmt.bindPointer(1, &callback, kWithDocBodiesCallbackPointerType);
+        SQLite::Statement &stmt = *_withDocBodiesStmt;
 
         // Run the statement and put the results into an array in the same order as docIDs:
         alloc_slice empty(size_t(0));
         vector<alloc_slice> results(docIDs.size());
-        while (stmt.executeStep()) {
-            slice docID = columnAsSlice(stmt.getColumn(0));
-            slice value = textColumnAsSlice(stmt.getColumn(1));
-            size_t i = docIndices[docID];
-            //Log("    -- %zu: %.*s --> '%.*s'", i, SPLAT(docID), SPLAT(revs));
-            if (value.size == 0 && value.buf != 0)
-                results[i] = empty;     // reuse one empty slice instead of creating one per row
-            else
-                results[i] = alloc_slice(value);
+        for (size_t start = 0; start < docIDs.size(); start += kWithDocBodiesBatchSize) {
+            size_t end = min(start + kWithDocBodiesBatchSize, docIDs.size());
+            UsingStatement u(stmt);
+            stmt.clearBindings();
+            stmt.bindPointer(1, &callback, kWithDocBodiesCallbackPointerType);
+            for (size_t i = start; i < end; ++i)
+                stmt.bindNoCopy(int(2 + i - start), (const char*)docIDs[i].buf, (int)docIDs[i].size);
+            while (stmt.executeStep()) {
+                slice docID = columnAsSlice(stmt.getColumn(0));
+                slice value = textColumnAsSlice(stmt.getColumn(1));
+                size_t i = docIndices[docID];
+                //Log("    -- %zu: %.*s --> '%.*s'", i, SPLAT(docID), SPLAT(revs));
+                if (value.size == 0 && value.buf != 0)
+                    results[i] = empty;     // reuse one empty slice instead of creating one per row
+                else
+                    results[i] = alloc_slice(value);
+            }
         }
         return results;
     }
@@ -542,6 +748,13 @@ namespace litecore {
     unsigned SQLiteKeyStore::expireRecords(ExpirationCallback callback) {
         if (!hasExpiration())
             return 0;
+        if (!db().inTransaction()) {
+            // Make the deletion and the record-count update atomic:
+            Transaction t(db());
+            unsigned expired = expireRecords(callback);
+            t.commit();
+            return expired;
+        }
         expiration_t t = now();
         unsigned expired = 0;
         bool none = false;
@@ -556,8 +769,24 @@ namespace litecore {
             }
         }
         if (!none) {
+            loadRecordCounts();
+            {
+                compile(_countExpStmt,
+                        "SELECT count(*), sum(flags & 1) FROM kv_@ WHERE expiration <= ?");
+                UsingStatement u(*_countExpStmt);
+                _countExpStmt->bind(1, (long long)t);
+                if (_countExpStmt->executeStep()) {
+                    auto deleted = (int64_t)_countExpStmt->getColumn(1);
+                    _liveCount -= (int64_t)_countExpStmt->getColumn(0) - deleted;
+                    _deletedCount -= deleted;
+                    _recordCountsChanged = true;
+                }
+            }
             expired = db().exec(format("DELETE FROM kv_%s WHERE expiration <= %" PRId64,
                                        name().c_str(), t));
+            // Purging has to change the stamp on the persisted record counts:
+            if (expired > 0)
+                incrementPurgeCount();
         }
         db()._logInfo("Purged %u expired documents", expired);
         return expired;
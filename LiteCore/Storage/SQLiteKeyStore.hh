@@ -37,7 +37,7 @@ namespace litecore {
     /** SQLite implementation of KeyStore; corresponds to a SQL table. */
     class SQLiteKeyStore : public KeyStore, public QueryParser::delegate {
     public:
-        uint64_t recordCount() const override;
+        uint64_t recordCount(bool includeDeleted =false) const override;
         sequence_t lastSequence() const override;
         uint64_t purgeCount() const override;
 
@@ -65,6 +65,11 @@ namespace litecore {
 
         void deleteIndex(slice name) override;
         std::vector<IndexSpec> getIndexes() const override;
+        double indexBuildProgress(slice name) override;
+        bool indexBuildsPending() const override;
+        bool continueIndexBuilds(unsigned maxRecords) override;
+
+        std::vector<Record> getMany(const std::vector<slice> &keys) const override;
 
         virtual std::vector<alloc_slice> withDocBodies(const std::vector<slice> &docIDs,
                                                        WithDocBodyCallback callback) override;
@@ -87,7 +92,7 @@ namespace litecore {
         RecordEnumerator::Impl* newEnumeratorImpl(bool bySequence,
                                                   sequence_t since,
                                                   RecordEnumerator::Options) override;
-        Retained<Query> compileQuery(slice expression, QueryLanguage) override;
+        Retained<Query> compileQuery(slice expression, QueryLanguage, bool incremental) override;
 
         SQLite::Statement* compile(const std::string &sql) const;
         SQLite::Statement& compile(const std::unique_ptr<SQLite::Statement>& ref,
@@ -112,6 +117,11 @@ namespace litecore {
         std::string subst(const char *sqlTemplate) const;
         void setLastSequence(sequence_t seq);
         void incrementPurgeCount();
+        void createCountTriggers();
+        void readRecordCounts(int64_t &liveCount, int64_t &deletedCount) const;
+        void loadRecordCounts() const;
+        int execIfDeleted(SQLite::Statement&, int param, bool deleted);
+        void updateRecordCounts(int oldFlags, int newFlags);
         void createTrigger(string_view triggerName,
                            string_view triggerSuffix,
                            string_view operation,
@@ -122,6 +132,9 @@ namespace litecore {
                               const std::string &sourceTableName,
                               fleece::impl::Array::iterator &expressions);
         void _createFlagsIndex(const char *indexName NONNULL, DocumentFlags flag, bool &created);
+        void populateIndexTable(const IndexSpec::Options*,
+                                const std::string &indexTableName,
+                                const std::string &populateSQL);
         bool createFTSIndex(const IndexSpec&);
         bool createArrayIndex(const IndexSpec&);
         std::string createUnnestedTable(const fleece::impl::Value *arrayPath, const IndexSpec::Options*);
@@ -138,10 +151,12 @@ namespace litecore {
         std::unique_ptr<SQLite::Statement> _recCountStmt;
         std::unique_ptr<SQLite::Statement> _getByKeyStmt, _getCurByKeyStmt, _getMetaByKeyStmt;
         std::unique_ptr<SQLite::Statement> _getBySeqStmt, _getCurBySeqStmt, _getMetaBySeqStmt;
+        std::unique_ptr<SQLite::Statement> _getManyStmt;
         std::unique_ptr<SQLite::Statement> _setStmt, _insertStmt, _replaceStmt, _updateBodyStmt;
         std::unique_ptr<SQLite::Statement> _delByKeyStmt, _delBySeqStmt, _delByBothStmt;
-        std::unique_ptr<SQLite::Statement> _setFlagStmt, _withDocBodiesStmt;
+        std::unique_ptr<SQLite::Statement> _setFlagStmt, _setDeletedFlagStmt, _withDocBodiesStmt;
         std::unique_ptr<SQLite::Statement> _setExpStmt, _getExpStmt, _nextExpStmt, _findExpStmt;
+        std::unique_ptr<SQLite::Statement> _countExpStmt;
 
         bool _createdSeqIndex {false}, _createdConflictsIndex {false}, _createdBlobsIndex {false};
         bool _lastSequenceChanged {false};
@@ -149,6 +164,9 @@ namespace litecore {
         mutable bool _purgeCountValid {false};      // TODO: Use optional class from C++17
         mutable int64_t _lastSequence {-1};
         mutable std::atomic<uint64_t> _purgeCount {0};
+        bool _recordCountsChanged {false};
+        mutable int64_t _liveCount {-1};            // Cached within a transaction; -1 if unknown
+        mutable int64_t _deletedCount {-1};
         bool _hasExpirationColumn {false};
         bool _uncommittedExpirationColumn {false};
         mutable std::mutex _stmtMutex;
@@ -34,6 +34,7 @@ namespace fleece { namespace impl {
 
 
 namespace litecore {
+    class QueryDocCache;
 
     extern LogDomain SQL;
 
@@ -68,8 +69,10 @@ namespace litecore {
 
         DataFile::Delegate* delegate;
         fleece::impl::SharedKeys* const sharedKeys;
+        std::shared_ptr<QueryDocCache> docCache;    // Shared by all functions of a connection
     };
 
 
-    void RegisterSQLiteFunctions(sqlite3 *db, fleeceFuncContext);
+    // Registers LiteCore's SQL functions, and returns the cache of doc bodies they share.
+    std::shared_ptr<QueryDocCache> RegisterSQLiteFunctions(sqlite3 *db, fleeceFuncContext);
 }
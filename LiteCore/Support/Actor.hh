@@ -102,6 +102,14 @@ namespace litecore { namespace actor {
         :_mailbox(this, name, parentMailbox)
         { }
 
+#ifndef ACTORS_USE_GCD
+        /** Constructs an Actor whose messages are run by a specific Scheduler instead of the
+            shared one. The Scheduler must be started, and must outlive the Actor. */
+        Actor(const std::string &name, Scheduler *scheduler)
+        :_mailbox(this, name, nullptr, scheduler)
+        { }
+#endif
+
         /** Schedules a call to a method. */
         template <class Rcvr, class... Args>
         void enqueue(void (Rcvr::*fn)(Args...), Args... args) {
@@ -20,6 +20,7 @@
 #include "Actor.hh"
 #include "Logging.hh"
 #include "Timer.hh"
+#include <atomic>
 #include <climits>
 #include <functional>
 #include <memory>
@@ -52,9 +53,10 @@ namespace litecore { namespace actor {
         void push(ITEM *item) {
             std::lock_guard<std::mutex> lock(_mutex);
 
+            size_t capacity = _capacity;
             if (!_items) {
                 _items.reset(new std::vector<Retained<ITEM>>);
-                _items->reserve(_capacity ? _capacity : 200);
+                _items->reserve(capacity ? capacity : 200);
             }
             _items->push_back(item);
             if (!_scheduled) {
@@ -62,7 +64,7 @@ namespace litecore { namespace actor {
                 _scheduled = true;
                 _processLater(_generation);
             }
-            if (_latency > Timer::duration(0) && _capacity > 0 && _items->size() == _capacity) {
+            if (_latency.load() > Timer::duration(0) && capacity > 0 && _items->size() == capacity) {
                 // I'm full -- schedule a pop NOW
                 LogVerbose(SyncLog, "Batcher scheduling immediate pop");
                 _processNow(_generation);
@@ -83,10 +85,18 @@ namespace litecore { namespace actor {
             return move(_items);
         }
 
+        Timer::duration latency() const             {return _latency;}
+        size_t capacity() const                     {return _capacity;}
+
+        /** Changes the latency and capacity; they take effect with the next batch.
+            Thread-safe. */
+        void setLatency(Timer::duration latency)    {_latency = latency;}
+        void setCapacity(size_t capacity)           {_capacity = capacity;}
+
     private:
         std::function<void(int gen)> _processNow, _processLater;
-        Timer::duration _latency;
-        size_t _capacity;
+        std::atomic<Timer::duration> _latency;
+        std::atomic<size_t> _capacity;
         std::mutex _mutex;
         Items _items;
         int _generation {0};
@@ -111,7 +121,7 @@ namespace litecore { namespace actor {
                      Timer::duration latency ={},
                      size_t capacity = 0)
         :Batcher<ITEM>([=](int gen) {actor->enqueue(processor, gen);},
-                       [=](int gen) {actor->enqueueAfter(latency, processor, gen);},
+                       [=](int gen) {actor->enqueueAfter(this->latency(), processor, gen);},
                        latency,
                        capacity)
         { }
@@ -0,0 +1,120 @@
+//
+// LogBuffer.hh
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Logging.hh"
+#include "fleece/slice.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace litecore {
+
+    /** A fixed-size, lock-free ring buffer of log messages, written by a single thread and read
+        by a single (other) thread. Each message is stored as an Entry followed by a copy of its
+        format string (with its trailing NUL) and then its arguments as encoded by
+        LogEncoder::captureArgs. A message that doesn't fit is rejected, not blocked on, so
+        logging never waits for the reader. */
+    class LogBuffer {
+    public:
+        static constexpr size_t kCapacity = 64 * 1024;
+
+        struct Entry {
+            std::chrono::steady_clock::time_point time; // When the message was logged
+            const char* domain;                         // Domain name
+            const void* formatKey;                      // Address of the caller's format string
+                                                        //   (its token key; never dereferenced)
+            uint32_t    formatSize;                     // Size of the format copy, incl. NUL
+            uint32_t    argsSize;                       // Size of format + args following Entry
+            unsigned    objRef;                         // Logging object reference, or 0
+            LogLevel    level;                          // Log level
+        };
+
+        LogBuffer() =default;
+        LogBuffer(const LogBuffer&) =delete;
+        LogBuffer& operator=(const LogBuffer&) =delete;
+
+        /** Adds a message. Returns false if there isn't room for it. (Writer thread only.) */
+        bool write(const Entry &entry, fleece::slice args) {
+            size_t size = sizeof(Entry) + args.size;
+            size_t head = _head.load(std::memory_order_relaxed);
+            if (size > kCapacity - (head - _tail.load(std::memory_order_acquire)))
+                return false;
+            copyIn(head, &entry, sizeof(Entry));
+            copyIn(head + sizeof(Entry), args.buf, args.size);
+            _head.store(head + size, std::memory_order_release);
+            return true;
+        }
+
+        /** The number of bytes in use. Approximate unless called on the writer or reader thread. */
+        size_t used() const {
+            return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+        }
+
+        /** Removes all messages, calling `fn(const Entry&, fleece::slice args)` for each.
+            The `args` slice is only valid during the call. (Reader thread only.) */
+        template <class FN>
+        void drain(FN fn) {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            size_t head = _head.load(std::memory_order_acquire);
+            while (tail != head) {
+                Entry entry;
+                copyOut(tail, &entry, sizeof(Entry));
+                size_t argsPos = (tail + sizeof(Entry)) % kCapacity;
+                if (argsPos + entry.argsSize <= kCapacity) {
+                    fn(entry, fleece::slice(&_data[argsPos], entry.argsSize));
+                } else {
+                    _scratch.resize(entry.argsSize);
+                    copyOut(tail + sizeof(Entry), _scratch.data(), entry.argsSize);
+                    fn(entry, fleece::slice(_scratch.data(), entry.argsSize));
+                }
+                tail += sizeof(Entry) + entry.argsSize;
+            }
+            _tail.store(tail, std::memory_order_release);
+        }
+
+        std::atomic<bool> threadExited {false};     // Set when the writer thread exits
+
+    private:
+        void copyIn(size_t pos, const void *src, size_t size) {
+            if (size == 0)
+                return;
+            pos %= kCapacity;
+            size_t n = std::min(size, kCapacity - pos);
+            memcpy(&_data[pos], src, n);
+            memcpy(&_data[0], (const uint8_t*)src + n, size - n);
+        }
+
+        void copyOut(size_t pos, void *dst, size_t size) const {
+            if (size == 0)
+                return;
+            pos %= kCapacity;
+            size_t n = std::min(size, kCapacity - pos);
+            memcpy(dst, &_data[pos], n);
+            memcpy((uint8_t*)dst + n, &_data[0], size - n);
+        }
+
+        uint8_t _data[kCapacity];
+        std::atomic<size_t> _head {0};              // Total bytes ever written
+        std::atomic<size_t> _tail {0};              // Total bytes ever read
+        std::vector<uint8_t> _scratch;              // Reader's buffer for args that wrap around
+    };
+
+}
@@ -21,6 +21,8 @@
 #include "Endian.hh"
 #include "StringUtil.hh"
 #include "varint.hh"
+#include <algorithm>
+#include <cstring>
 #include <exception>
 #include <iostream>
 #include <time.h>
@@ -31,6 +33,7 @@
 #endif
 
 using namespace std;
+using namespace std::chrono;
 using namespace fleece;
 
 namespace litecore {
@@ -56,7 +59,7 @@ namespace litecore {
         auto now = LogDecoder::now();
         _writeUVarInt(now.secs);
         _lastElapsed = -(int)now.microsecs;  // so first delta will be accurate
-        _st.reset();
+        _startTime = clock::now();
     }
 
     LogEncoder::~LogEncoder() {
@@ -79,62 +82,61 @@ namespace litecore {
 
 
     int64_t LogEncoder::_timeElapsed() const {
-        return int64_t(_st.elapsed() * kTicksPerSec);
+        return duration_cast<microseconds>(clock::now() - _startTime).count();
     }
 
-    void LogEncoder::vlog(const char *domain, const map<unsigned, string> &objectMap,
-                          ObjectRef object, const char *format, va_list args) {
-        lock_guard<mutex> lock(_mutex);
 
-        // Write the number of ticks elapsed since the last message:
-        auto elapsed = _timeElapsed();
-        uint64_t delta = elapsed - _lastElapsed;
-        _lastElapsed = elapsed;
-        _writeUVarInt(delta);
+    template <class WRITER>
+    static void writeUVarInt(WRITER &writer, uint64_t n) {
+        uint8_t buf[kMaxVarintLen64];
+        writer.write(buf, PutUVarInt(buf, n));
+    }
 
-        // Write level, domain, format string:
-        _writer.write(&_level, sizeof(_level));
-        _writeStringToken(domain ? domain : "");
 
-        const auto objRef = (unsigned)object;
-        _writeUVarInt(objRef);
-        if (object != ObjectRef::None && _seenObjects.find(objRef) == _seenObjects.end()) {
-            _seenObjects.insert(objRef);
-            const auto i = objectMap.find(objRef);
-            if(i == objectMap.end()) {
-                _writer.write({"?\0", 2});
+    // Minimal Writer-compatible adapter that appends to a string.
+    struct StringWriter {
+        string &out;
+        void write(const void *data, size_t size)   {out.append((const char*)data, size);}
+        void write(slice s)                         {write(s.buf, s.size);}
+    };
+
+
+    // Parses the flags, width and precision of the `printf` substitution starting just after a
+    // '%', and returns a pointer to its type character (after any length modifiers.)
+    static const char* parseSubstitution(const char *c, bool &minus, bool &dotStar) {
+        minus = dotStar = false;
+        if (*c == '-') {
+            minus = true;
+            ++c;
+        }
+        c += strspn(c, "#0- +'");
+        while (isdigit(*c))
+            ++c;
+        if (*c == '.') {
+            ++c;
+            if (*c == '*') {
+                dotStar = true;
+                ++c;
             } else {
-                _writer.write(slice(i->second.c_str()));
-                _writer.write("\0", 1);
+                while (isdigit(*c))
+                    ++c;
             }
         }
+        c += strspn(c, "hljtzq");
+        return c;
+    }
 
-        _writeStringToken(format);
 
+    // Writes the arguments of a log message. Tokenized (`%-s`) strings are passed to `writeToken`.
+    template <class WRITER, class TOKEN_WRITER>
+    static void encodeArgs(WRITER &writer, const char *format, va_list args,
+                           TOKEN_WRITER writeToken)
+    {
         // Parse the format string looking for substitutions:
         for (const char *c = format; *c != '\0'; ++c) {
             if (*c == '%') {
-                bool minus = false;
-                bool dotStar = false;
-                ++c;
-                if (*c == '-') {
-                    minus = true;
-                    ++c;
-                }
-                c += strspn(c, "#0- +'");
-                while (isdigit(*c))
-                    ++c;
-                if (*c == '.') {
-                    ++c;
-                    if (*c == '*') {
-                        dotStar = true;
-                        ++c;
-                    } else {
-                        while (isdigit(*c))
-                            ++c;
-                    }
-                }
-                c += strspn(c, "hljtzq");
+                bool minus, dotStar;
+                c = parseSubstitution(c + 1, minus, dotStar);
 
                 switch(*c) {
                     case 'c':
@@ -152,8 +154,8 @@ namespace litecore {
                         else
                             param = va_arg(args, long long);
                         uint8_t sign = (param < 0) ? 1 : 0;
-                        _writer.write(&sign, 1);
-                        _writeUVarInt(abs(param));
+                        writer.write(&sign, 1);
+                        writeUVarInt(writer, abs(param));
                         break;
                     }
                     case 'u':
@@ -169,7 +171,7 @@ namespace litecore {
                             param = va_arg(args, unsigned long);
                         else
                             param = va_arg(args, unsigned long long);
-                        _writeUVarInt(param);
+                        writeUVarInt(writer, param);
                         break;
                     }
                     case 'e': case 'E':
@@ -177,7 +179,7 @@ namespace litecore {
                     case 'g': case 'G':
                     case 'a': case 'A': {
                         fleece::endian::littleEndianDouble param = va_arg(args, double);
-                        _writer.write(&param, sizeof(param));
+                        writer.write(&param, sizeof(param));
                         break;
                     }
                     case 's': {
@@ -191,11 +193,11 @@ namespace litecore {
                             size = strlen(str);
                         }
                         if (minus && !dotStar) {
-                            _writeStringToken(str);
+                            writeToken(str);
                         } else {
-                            _writeUVarInt(size);
+                            writeUVarInt(writer, size);
                             if (size > 0)
-                                _writer.write(str, size);
+                                writer.write(str, size);
                         }
                         break;
                     }
@@ -205,7 +207,7 @@ namespace litecore {
                             param = fleece::endian::encLittle64(param);
                         else
                             param = fleece::endian::encLittle32(param);
-                        _writer.write(&param, sizeof(param));
+                        writer.write(&param, sizeof(param));
                         break;
                     }
 #if __APPLE__
@@ -213,8 +215,8 @@ namespace litecore {
                         // "%@" substitutes an Objective-C or CoreFoundation object's description.
                         CFTypeRef param = va_arg(args, CFTypeRef);
                         if (param == nullptr) {
-                            _writeUVarInt(6);
-                            _writer.write("(null)", 6);
+                            writeUVarInt(writer, 6);
+                            writer.write("(null)", 6);
                         } else {
                             CFStringRef description;
                             if (CFGetTypeID(param) == CFStringGetTypeID())
@@ -222,8 +224,8 @@ namespace litecore {
                             else
                                 description = CFCopyDescription(param);
                             nsstring_slice descSlice(description);
-                            _writeUVarInt(descSlice.size);
-                            _writer.write(descSlice);
+                            writeUVarInt(writer, descSlice.size);
+                            writer.write(descSlice);
                             if (description != param)
                                 CFRelease(description);
                         }
@@ -237,7 +239,164 @@ namespace litecore {
                 }
             }
         }
+    }
+
+
+    void LogEncoder::vlog(const char *domain, const map<unsigned, string> &objectMap,
+                          ObjectRef object, const char *format, va_list args) {
+        lock_guard<mutex> lock(_mutex);
+        _writeHeader(clock::now(), domain, objectMap, object, format, format);
+        _writeArgs(format, args);
+        _finishMessage();
+    }
+
+
+    void LogEncoder::logCaptured(clock::time_point time, const char *domain,
+                                 const map<unsigned, string> &objectMap, ObjectRef object,
+                                 const void *formatKey, const char *format, slice capturedArgs)
+    {
+        lock_guard<mutex> lock(_mutex);
+        _writeHeader(time, domain, objectMap, object, formatKey, format);
+        _writeCapturedArgs(format, capturedArgs);
+        _finishMessage();
+    }
+
+
+    void LogEncoder::_writeHeader(clock::time_point time, const char *domain,
+                                  const map<unsigned, string> &objectMap,
+                                  ObjectRef object, const void *formatKey, const char *format)
+    {
+        // Write the number of ticks elapsed since the last message. (A captured message may be
+        // slightly older than the last one written; don't let time go backwards.)
+        auto elapsed = max<int64_t>(duration_cast<microseconds>(time - _startTime).count(), _lastElapsed);
+        uint64_t delta = elapsed - _lastElapsed;
+        _lastElapsed = elapsed;
+        _writeUVarInt(delta);
+
+        // Write level, domain, format string:
+        _writer.write(&_level, sizeof(_level));
+        _writeStringToken(domain ? domain : "");
 
+        const auto objRef = (unsigned)object;
+        _writeUVarInt(objRef);
+        if (object != ObjectRef::None && _seenObjects.find(objRef) == _seenObjects.end()) {
+            _seenObjects.insert(objRef);
+            const auto i = objectMap.find(objRef);
+            if(i == objectMap.end()) {
+                _writer.write({"?\0", 2});
+            } else {
+                _writer.write(slice(i->second.c_str()));
+                _writer.write("\0", 1);
+            }
+        }
+
+        _writeStringToken(formatKey, slice(format));
+    }
+
+
+    void LogEncoder::_writeArgs(const char *format, va_list args) {
+        encodeArgs(_writer, format, args, [this](const char *token) {
+            _writeStringToken(token);
+        });
+    }
+
+
+    /*static*/ void LogEncoder::captureArgs(string &out, const char *format, va_list args) {
+        // A tokenized string is captured as its address (its token key) followed by its contents:
+        StringWriter writer {out};
+        encodeArgs(writer, format, args, [&writer](const char *token) {
+            writer.write(&token, sizeof(token));
+            size_t size = strlen(token);
+            writeUVarInt(writer, size);
+            writer.write(token, size);
+        });
+    }
+
+
+    // Writes arguments captured by `captureArgs`. They're already in the output format, except
+    // for tokenized strings, so the format string has to be walked only if it has any of those.
+    void LogEncoder::_writeCapturedArgs(const char *format, slice args) {
+        if (!strstr(format, "%-")) {
+            _writer.write(args);
+            return;
+        }
+
+        auto copyBytes = [&](size_t size) {
+            if (size > args.size)
+                throw invalid_argument("Truncated captured log arguments");
+            _writer.write(args.buf, size);
+            args.moveStart(size);
+        };
+        auto readUVarInt = [&]() -> uint64_t {
+            uint64_t n;
+            size_t size = GetUVarInt(args, &n);
+            if (size == 0)
+                throw invalid_argument("Invalid captured log arguments");
+            args.moveStart(size);
+            return n;
+        };
+        auto copyUVarInt = [&]() -> uint64_t {
+            uint64_t n;
+            size_t size = GetUVarInt(args, &n);
+            if (size == 0)
+                throw invalid_argument("Invalid captured log arguments");
+            copyBytes(size);
+            return n;
+        };
+
+        for (const char *c = format; *c != '\0'; ++c) {
+            if (*c == '%') {
+                bool minus, dotStar;
+                c = parseSubstitution(c + 1, minus, dotStar);
+                switch(*c) {
+                    case 'c': case 'd': case 'i':
+                        copyBytes(1);
+                        copyUVarInt();
+                        break;
+                    case 'u': case 'x': case 'X':
+                        copyUVarInt();
+                        break;
+                    case 'e': case 'E':
+                    case 'f': case 'F':
+                    case 'g': case 'G':
+                    case 'a': case 'A':
+                        copyBytes(sizeof(double));
+                        break;
+                    case 's':
+                        if (minus && !dotStar) {
+                            const void *key;
+                            if (args.size < sizeof(key))
+                                throw invalid_argument("Truncated captured log arguments");
+                            memcpy(&key, args.buf, sizeof(key));
+                            args.moveStart(sizeof(key));
+                            auto size = readUVarInt();
+                            if (size > args.size)
+                                throw invalid_argument("Truncated captured log arguments");
+                            _writeStringToken(key, slice(args.buf, size));
+                            args.moveStart(size);
+                        } else {
+                            copyBytes(copyUVarInt());
+                        }
+                        break;
+                    case 'p':
+                        copyBytes(sizeof(size_t));
+                        break;
+#if __APPLE__
+                    case '@':
+                        copyBytes(copyUVarInt());
+                        break;
+#endif
+                    case '%':
+                        break;
+                    default:
+                        throw invalid_argument("Unknown type in LogEncoder format string");
+                }
+            }
+        }
+    }
+
+
+    void LogEncoder::_finishMessage() {
         if (_writer.length() > kBufferSize)
             _flush();
         else
@@ -245,18 +404,24 @@ namespace litecore {
     }
 
     void LogEncoder::_writeUVarInt(uint64_t n) {
-        uint8_t buf[kMaxVarintLen64];
-        _writer.write(buf, PutUVarInt(buf, n));
+        writeUVarInt(_writer, n);
     }
 
 
     void LogEncoder::_writeStringToken(const char *token) {
-        const auto name = _formats.find((size_t)token);
+        _writeStringToken(token, slice(token));
+    }
+
+
+    // Tokens are identified by the address of the original string.
+    void LogEncoder::_writeStringToken(const void *key, slice token) {
+        const auto name = _formats.find((size_t)key);
         if (name == _formats.end()) {
             const auto n = (unsigned)_formats.size();
-            _formats.insert({(size_t)token, n});
+            _formats.insert({(size_t)key, n});
             _writeUVarInt(n);
-            _writer.write(token, strlen(token)+1);  // add the actual string the first time
+            _writer.write(token);                   // add the actual string the first time
+            _writer.write("\0", 1);
         } else {
             _writeUVarInt(name->second);
         }
@@ -18,11 +18,11 @@
 
 #pragma once
 #include "Writer.hh"
-#include "Stopwatch.hh"
 #include "Timer.hh"
 #include "PlatformCompat.hh"
 #include "Logging.hh"
 #include <stdarg.h>
+#include <chrono>
 #include <iostream>
 #include <mutex>
 #include <unordered_map>
@@ -36,6 +36,8 @@ namespace litecore {
         The API is thread-safe. */
     class LogEncoder {
     public:
+        using clock = std::chrono::steady_clock;
+
         LogEncoder(std::ostream &out, LogLevel level);
         ~LogEncoder();
 
@@ -47,6 +49,20 @@ namespace litecore {
 
         void log(const char *domain, const std::map<unsigned, std::string>&, ObjectRef, const char *format, ...) __printflike(5, 6);
 
+        /** Encodes the arguments of a log message, to be logged later by `logCaptured`. This
+            doesn't touch any LogEncoder state, so it can be called on any thread without locking.
+            The encoded args are appended to `out`.
+            (Tokenized `%-s` strings are copied, since they may not survive until then.) */
+        static void captureArgs(std::string &out, const char *format, va_list args);
+
+        /** Logs a message whose arguments were encoded by `captureArgs`, giving the time at which
+            it was originally logged. `formatKey` is the address the format string was logged
+            with, which identifies it in the encoded log; `format` is its contents, which don't
+            have to be at that address any more. */
+        void logCaptured(clock::time_point, const char *domain,
+                         const std::map<unsigned, std::string>&, ObjectRef,
+                         const void *formatKey, const char *format, fleece::slice capturedArgs);
+
         void flush();
 
         /** A timestamp, given as a standard time_t (seconds since 1/1/1970) plus microseconds. */
@@ -65,8 +81,15 @@ namespace litecore {
 
     private:
         int64_t _timeElapsed() const;
+        void _writeHeader(clock::time_point, const char *domain,
+                          const std::map<unsigned, std::string>&, ObjectRef,
+                          const void *formatKey, const char *format);
+        void _writeArgs(const char *format, va_list args);
+        void _writeCapturedArgs(const char *format, fleece::slice args);
         void _writeUVarInt(uint64_t);
         void _writeStringToken(const char *token);
+        void _writeStringToken(const void *key, fleece::slice token);
+        void _finishMessage();
         void _flush();
         void _scheduleFlush();
         void performScheduledFlush();
@@ -75,7 +98,7 @@ namespace litecore {
         fleece::Writer _writer;
         std::ostream &_out;
         std::unique_ptr<actor::Timer> _flushTimer;
-        fleece::Stopwatch _st;
+        clock::time_point _startTime;
         int64_t _lastElapsed {0};
         int64_t _lastSaved {0};
         LogLevel _level;
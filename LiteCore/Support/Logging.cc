@@ -18,13 +18,20 @@
 
 #include "Logging.hh"
 #include "StringUtil.hh"
+#include "LogBuffer.hh"
 #include "LogEncoder.hh"
 #include "LogDecoder.hh"
 #include "PlatformIO.hh"
 #include "FilePath.hh"
+#include "ThreadUtil.hh"
+#include <algorithm>
+#include <condition_variable>
 #include <string>
 #include <fstream>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 #include <ctime>
 
 #if __APPLE__
@@ -53,10 +60,10 @@ namespace litecore {
     static LogDomain _ActorLog("Actor");
     LogDomain &ActorLog = _ActorLog;
 
-    LogLevel LogDomain::sCallbackMinLevel = LogLevel::Uninitialized;
+    atomic<LogLevel> LogDomain::sCallbackMinLevel {LogLevel::Uninitialized};
     static LogDomain::Callback_t sCallback = LogDomain::defaultCallback;
     static bool sCallbackPreformatted = false;
-    LogLevel LogDomain::sFileMinLevel = LogLevel::None;
+    atomic<LogLevel> LogDomain::sFileMinLevel {LogLevel::None};
     unsigned LogDomain::slastObjRef {0};
     map<unsigned, string> LogDomain::sObjNames;
     static ofstream* sFileOut[5] = {}; // File per log level
@@ -66,6 +73,7 @@ namespace litecore {
     static int64_t sMaxSize = 1024; // For rotation
     static string sInitialMessage;  // For rotation, goes at top of each log
     static mutex sLogMutex;
+    static vector<unsigned> sRetiredObjRefs;    // Unregistered objects that may still be in buffers
 
     static const char* const kLevelNames[] = {"debug", "verbose", "info",
                 "warning", "error", nullptr};
@@ -187,6 +195,211 @@ namespace litecore {
         }
     }
 
+#pragma mark - LOG BUFFERS:
+
+
+    // Messages bound for the encoded log files don't take sLogMutex: each thread captures them
+    // into its own LogBuffer, and a background thread periodically drains all the buffers,
+    // merges their messages by timestamp, and writes them to the LogEncoders.
+
+    static constexpr auto kLogFlushInterval = milliseconds(100);
+
+    static atomic<bool> sBufferingLogs {false};         // True while writing encoded log files
+    static atomic<uint64_t> sDroppedMessages {0};       // Messages dropped due to full buffers
+    static uint64_t sReportedDroppedMessages = 0;       // Dropped messages noted in the log
+    static mutex sLogBuffersMutex;                      // Protects sLogBuffers
+    // (These are allocated, and never freed, since the flusher thread may be running at exit:)
+    static auto &sLogBuffers = *new vector<shared_ptr<LogBuffer>>;  // Every thread's buffer
+    static auto &sFlusherMutex = *new mutex;
+    static auto &sFlusherCond = *new condition_variable;
+    static bool sFlushRequested = false;                // Protected by sFlusherMutex
+    static bool sFlusherStopping = false;               // Protected by sFlusherMutex
+    static thread *sFlusherThread = nullptr;            // Protected by sLogMutex
+
+    // How often the flusher retries taking sLogMutex when it's busy:
+    static constexpr auto kLogLockRetryInterval = milliseconds(5);
+
+    // Per-thread state. When the thread exits, its buffer is left for the flusher to drain
+    // and discard, and any further logging on that thread is done synchronously.
+    struct ThreadLogBuffer {
+        shared_ptr<LogBuffer> buffer;
+        string args;                                    // Reusable buffer for captured args
+        ~ThreadLogBuffer();
+    };
+
+    static LogBuffer* const kThreadExited = reinterpret_cast<LogBuffer*>(uintptr_t(1));
+    static thread_local LogBuffer* tLogBuffer = nullptr;
+    static thread_local ThreadLogBuffer tThreadLogBuffer;
+
+    ThreadLogBuffer::~ThreadLogBuffer() {
+        if (buffer)
+            buffer->threadExited = true;
+        tLogBuffer = kThreadExited;
+    }
+
+
+    static void requestLogFlush() {
+        {
+            lock_guard<mutex> lock(sFlusherMutex);
+            sFlushRequested = true;
+        }
+        sFlusherCond.notify_one();
+    }
+
+
+    // Body of the background thread that writes buffered messages to the log files.
+    static void runLogFlusher(void (*drain)()) {
+        SetThreadName("Log flusher (Couchbase Lite Core)");
+        unique_lock<mutex> lock(sFlusherMutex);
+        while (!sFlusherStopping) {
+            sFlusherCond.wait_for(lock, kLogFlushInterval,
+                                  []{return sFlushRequested || sFlusherStopping;});
+            sFlushRequested = false;
+            // stopLogFlusher() waits for this thread while holding sLogMutex, so don't block
+            // on sLogMutex; if it's busy, retry shortly:
+            while (!sFlusherStopping && !sLogMutex.try_lock())
+                sFlusherCond.wait_for(lock, kLogLockRetryInterval);
+            if (sFlusherStopping)
+                break;
+            lock.unlock();
+            if (sBufferingLogs)
+                drain();
+            sLogMutex.unlock();
+            lock.lock();
+        }
+    }
+
+
+    // Starts the flusher thread, if it isn't running. Must be called while holding sLogMutex.
+    static void startLogFlusher(void (*drain)()) {
+        if (!sFlusherThread)
+            sFlusherThread = new thread(runLogFlusher, drain);
+    }
+
+
+    // Stops the flusher thread and waits for it to exit. Must be called while holding sLogMutex.
+    static void stopLogFlusher() {
+        if (!sFlusherThread)
+            return;
+        {
+            lock_guard<mutex> lock(sFlusherMutex);
+            sFlusherStopping = true;
+        }
+        sFlusherCond.notify_one();
+        sFlusherThread->join();
+        delete sFlusherThread;
+        sFlusherThread = nullptr;
+        lock_guard<mutex> lock(sFlusherMutex);
+        sFlusherStopping = false;
+    }
+
+
+    // Captures a message into the calling thread's LogBuffer. Returns false if the thread is
+    // exiting, in which case the caller has to log it directly. If the buffer is full, the
+    // message is dropped (and counted) rather than waiting for the flusher.
+    static bool bufferLogMessage(LogLevel level, const char *domain, unsigned objRef,
+                                 const char *fmt, va_list args)
+    {
+        LogBuffer *buffer = tLogBuffer;
+        if (_usuallyFalse(buffer == nullptr)) {
+            auto newBuffer = make_shared<LogBuffer>();
+            {
+                lock_guard<mutex> lock(sLogBuffersMutex);
+                sLogBuffers.push_back(newBuffer);
+            }
+            tThreadLogBuffer.buffer = newBuffer;
+            tLogBuffer = buffer = newBuffer.get();
+        } else if (_usuallyFalse(buffer == kThreadExited)) {
+            return false;
+        }
+
+        // The format string is copied along with the args, since the caller's may not outlive
+        // the message:
+        string &capturedArgs = tThreadLogBuffer.args;
+        size_t formatSize = strlen(fmt) + 1;
+        capturedArgs.assign(fmt, formatSize);
+        LogEncoder::captureArgs(capturedArgs, fmt, args);
+        LogBuffer::Entry entry {LogEncoder::clock::now(), domain, fmt, uint32_t(formatSize),
+                                uint32_t(capturedArgs.size()), objRef, level};
+        size_t usedBefore = buffer->used();
+        if (!buffer->write(entry, fleece::slice(capturedArgs))) {
+            ++sDroppedMessages;
+            requestLogFlush();
+        } else if (usedBefore <= LogBuffer::kCapacity / 2
+                        && buffer->used() > LogBuffer::kCapacity / 2) {
+            requestLogFlush();          // Getting full; don't wait for the next interval
+        }
+        return true;
+    }
+
+
+    // Writes all buffered messages to the encoded log files, in timestamp order.
+    // Must be called while holding sLogMutex!
+    void LogDomain::drainBufferedLogs() {
+        struct Message {
+            LogBuffer::Entry entry;
+            size_t argsPos;
+        };
+        static auto &sMessages = *new vector<Message>;
+        static auto &sArgs = *new string;
+
+        {
+            lock_guard<mutex> lock(sLogBuffersMutex);
+            for (auto i = sLogBuffers.begin(); i != sLogBuffers.end(); ) {
+                bool exited = (*i)->threadExited;   // check first, so nothing's added after drain
+                (*i)->drain([](const LogBuffer::Entry &entry, fleece::slice args) {
+                    sMessages.push_back({entry, sArgs.size()});
+                    sArgs.append((const char*)args.buf, args.size);
+                });
+                if (exited)
+                    i = sLogBuffers.erase(i);
+                else
+                    ++i;
+            }
+        }
+
+        stable_sort(sMessages.begin(), sMessages.end(), [](const Message &a, const Message &b) {
+            return a.entry.time < b.entry.time;
+        });
+        for (auto &msg : sMessages) {
+            auto level = msg.entry.level;
+            auto encoder = sLogEncoder[(int)level];
+            if (!encoder)
+                continue;       // File logging was turned off since the message was buffered
+            const char *format = &sArgs[msg.argsPos];
+            size_t formatSize = msg.entry.formatSize;
+            encoder->logCaptured(msg.entry.time, msg.entry.domain, sObjNames,
+                                 (LogEncoder::ObjectRef)msg.entry.objRef,
+                                 msg.entry.formatKey, format,
+                                 fleece::slice(format + formatSize,
+                                               msg.entry.argsSize - formatSize));
+            if (sFileOut[(int)level]->tellp() >= sMaxSize)
+                Logging::rotateLog(level);
+        }
+        sMessages.clear();
+        sArgs.clear();
+
+        // Now that their messages have been written, forget objects that have gone away:
+        for (auto objRef : sRetiredObjRefs)
+            sObjNames.erase(objRef);
+        sRetiredObjRefs.clear();
+
+        uint64_t dropped = sDroppedMessages;
+        auto warningEncoder = sLogEncoder[(int)LogLevel::Warning];
+        if (dropped > sReportedDroppedMessages && warningEncoder) {
+            warningEncoder->log("", sObjNames, LogEncoder::None,
+                                "%" PRIu64 " log messages were dropped because logging fell behind",
+                                dropped - sReportedDroppedMessages);
+            sReportedDroppedMessages = dropped;
+        }
+    }
+
+
+    uint64_t LogDomain::droppedMessageCount() noexcept {
+        return sDroppedMessages;
+    }
+
+
 #pragma mark - GLOBAL SETTINGS:
 
 
@@ -208,6 +421,9 @@ namespace litecore {
         sMaxCount = max(0, options.maxCount);
         const bool teardown = needsTeardown(options);
         if(teardown) {
+            sBufferingLogs = false;
+            stopLogFlusher();
+            drainBufferedLogs();
             teardownEncoders();
             teardownFileOut();
         }
@@ -246,6 +462,9 @@ namespace litecore {
             call_once(f, []{
                 atexit([]{
                     if (sLogMutex.try_lock()) {     // avoid deadlock on crash inside logging code
+                        sBufferingLogs = false;
+                        stopLogFlusher();
+                        drainBufferedLogs();
                         if (sLogEncoder[0]) {
                             for(auto& encoder : sLogEncoder) {
                                 encoder->log("", {}, LogEncoder::None,
@@ -259,6 +478,11 @@ namespace litecore {
                     }
                 });
             });
+
+            if (sLogEncoder[0]) {
+                startLogFlusher(&drainBufferedLogs);
+                sBufferingLogs = true;
+            }
         }
         _invalidateEffectiveLevels();
     }
@@ -301,7 +525,7 @@ namespace litecore {
 
     // Only call while holding sLogMutex!
     LogLevel LogDomain::_callbackLogLevel() noexcept {
-        auto level = sCallbackMinLevel;
+        LogLevel level = sCallbackMinLevel;
         if (level == LogLevel::Uninitialized) {
             // Allow 'LiteCoreLog' env var to set initial callback level:
             level = kC4Cpp_DefaultLog.levelFromEnvironment();
@@ -357,7 +581,7 @@ namespace litecore {
         _level = level;
         // The effective level is the level at which I will actually trigger because there is
         // a place for my output to go:
-        _effectiveLevel = max((LogLevel)_level, min(_callbackLogLevel(), sFileMinLevel));
+        _effectiveLevel = max((LogLevel)_level, min(_callbackLogLevel(), sFileMinLevel.load()));
     }
 
 
@@ -383,6 +607,17 @@ namespace litecore {
         if (!willLog(level))
             return;
 
+        // Messages for the encoded log files go to this thread's buffer, without locking:
+        bool buffered = false;
+        if (sBufferingLogs && level >= sFileMinLevel) {
+            va_list args2;
+            va_copy(args2, args);
+            buffered = bufferLogMessage(level, _name, objRef, fmt, args2);
+            va_end(args2);
+        }
+        if (buffered && !(doCallback && level >= sCallbackMinLevel))
+            return;
+
         unique_lock<mutex> lock(sLogMutex);
 
         // Invoke the client callback:
@@ -412,8 +647,8 @@ namespace litecore {
             va_end(args2);
         }
 
-        // Write to the encoded log file:
-        if (level >= sFileMinLevel) {
+        // Write to the log file, if it wasn't buffered:
+        if (!buffered && level >= sFileMinLevel) {
             dylog(level, _name, (LogEncoder::ObjectRef)objRef, fmt, args);
         }
     }
@@ -532,7 +767,10 @@ namespace litecore {
 
     void LogDomain::unregisterObject(unsigned objectRef) {
         unique_lock<mutex> lock(sLogMutex);
-        sObjNames.erase(objectRef);
+        if (sBufferingLogs)
+            sRetiredObjRefs.push_back(objectRef);   // its name may still be needed by the flusher
+        else
+            sObjNames.erase(objectRef);
     }
 
 
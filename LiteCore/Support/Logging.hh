@@ -122,6 +122,11 @@ public:
     static void setCallbackLogLevel(LogLevel) noexcept;
     static void setFileLogLevel(LogLevel) noexcept;
 
+    /** The number of messages that couldn't be written to the encoded log files because the
+        logging thread's buffer was full. (Messages are buffered per thread and written to the
+        files by a background thread.) */
+    static uint64_t droppedMessageCount() noexcept;
+
 private:
     friend class Logging;
     static std::string getObject(unsigned);
@@ -137,6 +142,7 @@ private:
     static void _invalidateEffectiveLevels() noexcept;
 
     void dylog(LogLevel level, const char* domain, unsigned objRef, const char *fmt, va_list);
+    static void drainBufferedLogs();
 
     std::atomic<LogLevel> _effectiveLevel {LogLevel::Uninitialized};
     std::atomic<LogLevel> _level;
@@ -146,8 +152,8 @@ private:
     static unsigned slastObjRef;
     static std::map<unsigned,std::string> sObjNames;
     static LogDomain* sFirstDomain;
-    static LogLevel sCallbackMinLevel;
-    static LogLevel sFileMinLevel;
+    static std::atomic<LogLevel> sCallbackMinLevel;
+    static std::atomic<LogLevel> sFileMinLevel;
 };
 
 extern "C" LogDomain kC4Cpp_DefaultLog;
@@ -0,0 +1,76 @@
+//
+// MPSCQueue.hh
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <atomic>
+
+namespace litecore { namespace actor {
+
+    /** A lock-free, unbounded, intrusive multiple-producer/single-consumer queue.
+        (This is Dmitry Vyukov's algorithm.) Items are linked through their `NEXT` member, so
+        pushing doesn't allocate; an item must not be pushed again until it's been popped.
+        Any thread may push, but only one thread at a time may pop or call `mayHaveItems`.
+
+        Caveat: a push that's been interrupted midway hides any items pushed after it, so `pop`
+        may briefly return nullptr although `mayHaveItems` is true. */
+    template <class T, std::atomic<T*> T::*NEXT>
+    class MPSCQueue {
+    public:
+        MPSCQueue()                                 :_head(&_stub), _tail(&_stub) { }
+
+        MPSCQueue(const MPSCQueue&) =delete;
+        MPSCQueue& operator=(const MPSCQueue&) =delete;
+
+        void push(T *item) {
+            (item->*NEXT).store(nullptr, std::memory_order_relaxed);
+            T *prev = _head.exchange(item);
+            (prev->*NEXT).store(item, std::memory_order_release);
+        }
+
+        /** Removes and returns the oldest item, or returns nullptr if there's none. */
+        T* pop() {
+            T *tail = _tail;
+            T *next = (tail->*NEXT).load(std::memory_order_acquire);
+            if (tail == &_stub) {
+                if (!next)
+                    return nullptr;
+                _tail = tail = next;
+                next = (next->*NEXT).load(std::memory_order_acquire);
+            }
+            if (!next) {
+                if (tail != _head.load())
+                    return nullptr;     // a push is in progress
+                push(&_stub);
+                next = (tail->*NEXT).load(std::memory_order_acquire);
+                if (!next)
+                    return nullptr;
+            }
+            _tail = next;
+            return tail;
+        }
+
+        /** Returns false if the queue is empty and no push is in progress. */
+        bool mayHaveItems() const                   {return _tail != &_stub || _head.load() != &_stub;}
+
+    private:
+        std::atomic<T*> _head;          // Most recently pushed item
+        T*              _tail;          // Oldest item; only accessed by the consumer
+        T               _stub;          // Placeholder that keeps the list from being empty
+    };
+
+} }
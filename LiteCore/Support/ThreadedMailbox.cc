@@ -24,26 +24,24 @@
 #include "Timer.hh"
 #include "Logging.hh"
 #include "Channel.cc"       // Brings in the definitions of the template methods
+#include <condition_variable>
+#include <deque>
 #include <future>
 #include <random>
 #include <map>
+#include <mutex>
+#include <stdlib.h>
 
 using namespace std;
 
 namespace litecore { namespace actor {
 
 #if ACTORS_TRACK_STATS
-#define beginLatency()  fleece::Stopwatch st
-#define endLatency()    _maxLatency = max(_maxLatency, (double)st.elapsed())
 #define beginBusy()     _busy.start()
 #define endBusy()       _busy.stop()
-#define SELF            this, st
 #else
-#define beginLatency()
-#define endLatency()
 #define beginBusy()
 #define endBusy()
-#define SELF            this
 #endif
 
 #pragma mark - SCHEDULER:
@@ -68,9 +66,51 @@ namespace litecore { namespace actor {
     static random_device rd;
     static mt19937 sRandGen(rd());
 
+
+    /** State of one thread of a work-stealing Scheduler. Mailboxes are pushed to the lock-free
+        `inbox`; the owning thread moves them to `local`, which other threads steal from. */
+    struct Scheduler::Worker {
+        explicit Worker(Scheduler *s)           :scheduler(s) { }
+
+        Scheduler* const         scheduler;     // The Scheduler I belong to
+        MailboxInbox             inbox;
+        mutex                    localMutex;    // Protects `local`; also used for sleeping
+        deque<ThreadedMailbox*>  local;
+        atomic<size_t>           stealable {0}; // Size of `local`, readable without the lock
+        condition_variable       wakeup;
+        atomic<bool>             sleeping {false};
+    };
+
+
+    thread_local Scheduler::Worker* Scheduler::sCurrentWorker;
+
+
+    Scheduler::Scheduler(unsigned numThreads, bool workStealing)
+    :_numThreads(numThreads)
+    ,_workStealing(workStealing)
+    {
+        if (_numThreads == 0) {
+            _numThreads = thread::hardware_concurrency();
+            if (_numThreads == 0)
+                _numThreads = 2;
+        }
+        // The Workers are created up front so that Mailboxes can be scheduled before start():
+        if (_workStealing) {
+            while (_workers.size() < _numThreads)
+                _workers.emplace_back(new Worker(this));
+        }
+    }
+
+
+    Scheduler::~Scheduler() =default;
+
+
     Scheduler* Scheduler::sharedScheduler() {
         if (!sScheduler) {
-            sScheduler = new Scheduler;
+            bool workStealing = ACTORS_WORK_STEALING;
+            if (const char *env = getenv("LiteCoreWorkStealing"))
+                workStealing = (atoi(env) != 0);
+            sScheduler = new Scheduler(0, workStealing);
             sScheduler->start();
         }
         return sScheduler;
@@ -79,12 +119,9 @@ namespace litecore { namespace actor {
 
     void Scheduler::start() {
         if (!_started.test_and_set()) {
-            if (_numThreads == 0) {
-                _numThreads = thread::hardware_concurrency();
-                if (_numThreads == 0)
-                    _numThreads = 2;
-            }
-            LogTo(ActorLog, "Starting Scheduler<%p> with %u threads", this, _numThreads);
+            LogTo(ActorLog, "Starting Scheduler<%p> with %u threads%s",
+                  this, _numThreads, (_workStealing ? " (work-stealing)" : ""));
+            _stopping = false;
             for (unsigned id = 1; id <= _numThreads; id++)
                 _threadPool.emplace_back([this,id]{task(id);});
         }
@@ -93,10 +130,17 @@ namespace litecore { namespace actor {
 
     void Scheduler::stop() {
         LogTo(ActorLog, "Stopping Scheduler<%p>...", this);
-        _queue.close();
+        if (_workStealing) {
+            _stopping = true;
+            for (auto &worker : _workers)
+                wake(*worker);
+        } else {
+            _queue.close();
+        }
         for (auto &t : _threadPool) {
             t.join();
         }
+        _threadPool.clear();
         LogTo(ActorLog, "Scheduler<%p> has stopped", this);
         _started.clear();
     }
@@ -108,24 +152,271 @@ namespace litecore { namespace actor {
         sprintf(name, "Scheduler #%u (Couchbase Lite Core)", taskID);
         SetThreadName(name);
         ThreadedMailbox *mailbox;
-        while ((mailbox = _queue.pop()) != nullptr) {
-            LogToAt(ActorLog, Verbose, "   task %d calling Actor<%p>", taskID, mailbox);
-            mailbox->performNextMessage();
-            mailbox = nullptr;
+        if (_workStealing && taskID == 0) {
+            // runSynchronous: no Scheduler threads are running, so this thread is the only
+            // consumer of every Worker's inbox, and can act as each Worker in turn until
+            // they're all empty.
+            bool busy;
+            do {
+                busy = false;
+                for (auto &worker : _workers) {
+                    sCurrentWorker = worker.get();
+                    while ((mailbox = nextMailbox(worker.get())) != nullptr) {
+                        LogToAt(ActorLog, Verbose, "   task 0 calling Actor<%p>", mailbox);
+                        mailbox->performNextMessage();
+                        busy = true;
+                    }
+                }
+            } while (busy);
+            sCurrentWorker = nullptr;
+        } else if (_workStealing) {
+            Worker *me = _workers[taskID - 1].get();
+            sCurrentWorker = me;
+            while (true) {
+                while ((mailbox = nextMailbox(me)) != nullptr) {
+                    LogToAt(ActorLog, Verbose, "   task %d calling Actor<%p>", taskID, mailbox);
+                    mailbox->performNextMessage();
+                }
+                if (_stopping && !me->inbox.mayHaveItems())
+                    break;
+                idle(*me);
+            }
+            sCurrentWorker = nullptr;
+        } else {
+            while ((mailbox = _queue.pop()) != nullptr) {
+                LogToAt(ActorLog, Verbose, "   task %d calling Actor<%p>", taskID, mailbox);
+                mailbox->performNextMessage();
+                mailbox = nullptr;
+            }
         }
         LogTo(ActorLog, "   task %d finished", taskID);
     }
 
 
     void Scheduler::schedule(ThreadedMailbox *mbox) {
-        sScheduler->_queue.push(mbox);
+        if (_workStealing)
+            push(mbox);
+        else
+            _queue.push(mbox);
+    }
+
+
+    // Pushes a Mailbox to the current thread's Worker (it's likely to be rescheduling itself,
+    // or messaging a related Actor whose data is in this CPU's cache), else to the next Worker
+    // in round-robin order.
+    void Scheduler::push(ThreadedMailbox *mbox) {
+        Worker *worker = sCurrentWorker;
+        if (!worker || worker->scheduler != this)
+            worker = _workers[_nextWorker++ % _workers.size()].get();
+        worker->inbox.push(mbox);
+        if (worker->sleeping)
+            wake(*worker);
+    }
+
+
+    // Returns the next Mailbox for a Worker to run: from its own queue if possible, else one
+    // stolen from another Worker's. Returns nullptr if there's nothing to do.
+    ThreadedMailbox* Scheduler::nextMailbox(Worker *me) {
+        if (me) {
+            ThreadedMailbox *mbox = nullptr;
+            bool surplus;
+            {
+                lock_guard<mutex> lock(me->localMutex);
+                while (SchedulerLink *link = me->inbox.pop())
+                    me->local.push_back(static_cast<ThreadedMailbox*>(link));
+                if (!me->local.empty()) {
+                    mbox = me->local.front();
+                    me->local.pop_front();
+                }
+                me->stealable = me->local.size();
+                surplus = !me->local.empty();
+            }
+            if (surplus && _idleWorkers > 0)
+                wakeIdleWorker();       // Let an idle Worker steal the rest
+            if (mbox)
+                return mbox;
+        }
+        return steal(me);
+    }
+
+
+    // Takes half of the queued Mailboxes of some other Worker, returning the first and adding
+    // the rest to the thief's own queue.
+    ThreadedMailbox* Scheduler::steal(Worker *thief) {
+        size_t n = _workers.size();
+        size_t start = _nextWorker++;
+        for (size_t i = 0; i < n; ++i) {
+            Worker *victim = _workers[(start + i) % n].get();
+            if (victim == thief)
+                continue;
+            vector<ThreadedMailbox*> stolen;
+            bool surplus;
+            {
+                unique_lock<mutex> lock(victim->localMutex, try_to_lock);
+                if (!lock.owns_lock() || victim->local.empty())
+                    continue;
+                size_t count = (victim->local.size() + 1) / 2;
+                stolen.assign(victim->local.begin(), victim->local.begin() + count);
+                victim->local.erase(victim->local.begin(), victim->local.begin() + count);
+                victim->stealable = victim->local.size();
+                surplus = !victim->local.empty();
+            }
+            if (stolen.size() > 1) {
+                lock_guard<mutex> lock(thief->localMutex);
+                thief->local.insert(thief->local.end(), stolen.begin() + 1, stolen.end());
+                thief->stealable = thief->local.size();
+                surplus = true;
+            }
+            if (surplus && _idleWorkers > 0)
+                wakeIdleWorker();       // Pass it on; idle Workers don't poll for work
+            return stolen[0];
+        }
+        return nullptr;
+    }
+
+
+    // Blocks a Worker with nothing to do, until something's pushed to it or it's asked to
+    // help out. There's no timeout, so an idle Scheduler uses no CPU.
+    void Scheduler::idle(Worker &me) {
+        unique_lock<mutex> lock(me.localMutex);
+        me.sleeping = true;
+        ++_idleWorkers;
+        // These checks have to come after setting `sleeping` and `_idleWorkers`, so a
+        // concurrent push (or a Worker with surplus) either sees them and wakes me, or its
+        // work is visible here:
+        if (!me.inbox.mayHaveItems() && !_stopping && !hasStealableWork(&me))
+            me.wakeup.wait(lock);
+        --_idleWorkers;
+        me.sleeping = false;
+    }
+
+
+    bool Scheduler::hasStealableWork(Worker *thief) const {
+        for (auto &worker : _workers) {
+            if (worker.get() != thief && worker->stealable > 0)
+                return true;
+        }
+        return false;
+    }
+
+
+    void Scheduler::wake(Worker &worker) {
+        { lock_guard<mutex> lock(worker.localMutex); }   // Don't notify between its check & wait
+        worker.wakeup.notify_one();
+    }
+
+
+    void Scheduler::wakeIdleWorker() {
+        for (auto &worker : _workers) {
+            if (worker->sleeping) {
+                wake(*worker);
+                return;
+            }
+        }
     }
 
 
     // Explicitly instantiate the Channel specializations we need; this corresponds to the
     // "extern template..." declarations at the bottom of Actor.hh
     template class Channel<ThreadedMailbox*>;
-    template class Channel<std::function<void()>>;
+
+
+#pragma mark - MESSAGES:
+
+
+    // Freed MailboxMessages are kept in a per-thread cache for reuse. The threads that run
+    // Actors free more messages than they create, and the threads that post to Actors do the
+    // opposite; so a cache that grows too big hands a batch of messages to a shared pool, and
+    // an empty cache takes a batch from it. In the steady state, then, creating or destroying a
+    // message neither touches the heap nor takes a lock, except once per batch.
+    class MailboxMessageCache {
+    public:
+        static constexpr size_t kBatchSize = 64;            // Messages moved to/from sSpares at once
+        static constexpr size_t kMaxSpareBatches = 64;      // Max batches kept in sSpares
+
+        ~MailboxMessageCache() {
+            // On thread exit, give the cached messages to another thread if possible:
+            while (_count >= kBatchSize)
+                giveBatch();
+            freeList(_head);
+        }
+
+        MailboxMessage* pop() {
+            if (!_head && !takeBatch())
+                return new MailboxMessage;
+            MailboxMessage *msg = _head;
+            _head = msg->_next.load(memory_order_relaxed);
+            --_count;
+            return msg;
+        }
+
+        void push(MailboxMessage *msg) {
+            msg->_next.store(_head, memory_order_relaxed);
+            _head = msg;
+            if (++_count >= 2 * kBatchSize)
+                giveBatch();
+        }
+
+    private:
+        // Moves kBatchSize messages from my list to the shared pool (or the heap, if it's full.)
+        void giveBatch() {
+            MailboxMessage *batch = _head, *last = _head;
+            for (size_t i = 1; i < kBatchSize; ++i)
+                last = last->_next.load(memory_order_relaxed);
+            _head = last->_next.load(memory_order_relaxed);
+            last->_next.store(nullptr, memory_order_relaxed);
+            _count -= kBatchSize;
+            {
+                lock_guard<mutex> lock(sSparesMutex);
+                if (sSpares.size() < kMaxSpareBatches) {
+                    sSpares.push_back(batch);
+                    return;
+                }
+            }
+            freeList(batch);
+        }
+
+        // Takes a batch of messages from the shared pool, if it has any.
+        bool takeBatch() {
+            lock_guard<mutex> lock(sSparesMutex);
+            if (sSpares.empty())
+                return false;
+            _head = sSpares.back();
+            sSpares.pop_back();
+            _count = kBatchSize;
+            return true;
+        }
+
+        static void freeList(MailboxMessage *msg) {
+            while (msg) {
+                MailboxMessage *next = msg->_next.load(memory_order_relaxed);
+                delete msg;
+                msg = next;
+            }
+        }
+
+        MailboxMessage* _head {nullptr};
+        size_t          _count {0};
+
+        static mutex                    sSparesMutex;
+        static vector<MailboxMessage*>  sSpares;
+    };
+
+    mutex                    MailboxMessageCache::sSparesMutex;
+    vector<MailboxMessage*>  MailboxMessageCache::sSpares;
+
+    static thread_local MailboxMessageCache sMessageCache;
+
+
+    MailboxMessage* MailboxMessage::allocate() {
+        return sMessageCache.pop();
+    }
+
+
+    void MailboxMessage::destroy(MailboxMessage *msg) noexcept {
+        msg->_call(msg, false);
+        sMessageCache.push(msg);
+    }
 
 
 #pragma mark - MAILBOX:
@@ -133,25 +424,17 @@ namespace litecore { namespace actor {
     thread_local Actor* ThreadedMailbox::sCurrentActor;
 
 
-    ThreadedMailbox::ThreadedMailbox(Actor *a, const std::string &name, ThreadedMailbox *parent)
+    ThreadedMailbox::ThreadedMailbox(Actor *a, const std::string &name, ThreadedMailbox *parent,
+                                     Scheduler *scheduler)
     :_actor(a)
     ,_name(name)
-    {
-        Scheduler::sharedScheduler()->start();
-    }
+    ,_scheduler(scheduler ? scheduler : Scheduler::sharedScheduler())
+    { }
 
-    void ThreadedMailbox::enqueue(const std::function<void()> &f) {
-        beginLatency();
+    void ThreadedMailbox::enqueueMessage(MailboxMessage *msg) {
         retain(_actor);
-        const auto wrappedBlock = [f, SELF]
-        {
-            endLatency();
-            beginBusy();
-            safelyCall(f);
-            afterEvent();
-        };
-
-        if (push(wrappedBlock))
+        _queue.push(msg);
+        if (_queueSize++ == 0)
             reschedule();
     }
 
@@ -159,33 +442,24 @@ namespace litecore { namespace actor {
         if (delay <= delay_t::zero())
             return enqueue(f);
 
-        beginLatency();
         _delayedEventCount++;
         retain(_actor);
 
         auto timer = new Timer([f, this]
         { 
-            const auto wrappedBlock = [f, SELF]
-            {
-                endLatency();
-                beginBusy();
-                safelyCall(f);
-                --_delayedEventCount;
-                afterEvent();
-            };
-            
-            if (push(wrappedBlock))
-                reschedule();
+            enqueue(f);
+            --_delayedEventCount;
+            release(_actor);                // For enqueueAfter's retain call
         });
 
         timer->autoDelete();
         timer->fireAfter(chrono::duration_cast<Timer::duration>(delay));
     }
 
-    void ThreadedMailbox::safelyCall(const std::function<void()>& f) const
+    void ThreadedMailbox::safelyCall(MailboxMessage *msg) const
     {
         try {
-            f();
+            msg->run();
         } catch(std::exception& x) {
             _actor->caughtException(x);
         }
@@ -206,24 +480,31 @@ namespace litecore { namespace actor {
 
 
     void ThreadedMailbox::reschedule() {
-        Scheduler::schedule(this);
+        _scheduler->schedule(this);
     }
 
 
     void ThreadedMailbox::performNextMessage() {
         LogToAt(ActorLog, Verbose, "%s performNextMessage", _actor->actorName().c_str());
         DebugAssert(++_active == 1);     // Fail-safe check to detect 'impossible' re-entrant call
+        MailboxMessage *msg;
+        while ((msg = _queue.pop()) == nullptr)
+            this_thread::yield();       // Another thread is midway through pushing a message
+#if ACTORS_TRACK_STATS
+        _maxLatency = max(_maxLatency, (double)msg->_enqueuedAt.elapsed());
+#endif
         sCurrentActor = _actor;
-        auto &fn = front();
-        fn();
+        beginBusy();
+        safelyCall(msg);
+        afterEvent();
+        MailboxMessage::destroy(msg);
         sCurrentActor = nullptr;
         
         DebugAssert(--_active == 0);
 
-        bool empty;
-        popNoWaiting(empty);
+        bool more = (--_queueSize > 0);
         release(_actor); // For enqueue's retain call
-        if (!empty)
+        if (more)
             reschedule();
     }
 
@@ -23,16 +23,26 @@
 
 #pragma once
 #include "Channel.hh"
+#include "MPSCQueue.hh"
 #include "RefCounted.hh"
 #include "Stopwatch.hh"
 #include <atomic>
 #include <string>
 #include <thread>
 #include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 // Set to 1 to have Actor object report performance statistics in their destructors
 #define ACTORS_TRACK_STATS  0
 
+// Set to 1 to make the Scheduler use per-thread work-stealing queues, instead of running all
+// Mailboxes from a single shared queue. This is experimental, so it's off by default.
+// (The environment variable `LiteCoreWorkStealing`, set to 0 or 1, overrides this at runtime.)
+#define ACTORS_WORK_STEALING 0
+
 namespace litecore { namespace actor {
     using fleece::RefCounted;
     using fleece::Retained;
@@ -47,16 +57,84 @@ namespace litecore { namespace actor {
 
 
     #ifndef ACTORS_USE_GCD
-    /** Default Actor mailbox implementation that uses a thread pool run by a Scheduler. */
-    class ThreadedMailbox : Channel<std::function<void()>> {
+    /** Intrusive link by which the work-stealing Scheduler queues a ThreadedMailbox without
+        allocating. (A Mailbox is never in more than one scheduler queue at once.) */
+    struct SchedulerLink {
+        std::atomic<SchedulerLink*> _nextScheduled {nullptr};
+    };
+
+    using MailboxInbox = MPSCQueue<SchedulerLink, &SchedulerLink::_nextScheduled>;
+
+
+    /** An Actor call queued in a ThreadedMailbox. The closure is stored inline if it's no
+        bigger than kInlineSize (which covers a bound method with a few arguments), else on the
+        heap. Messages are recycled through per-thread caches, so creating one normally doesn't
+        allocate either. */
+    class MailboxMessage {
+    public:
+        static constexpr size_t kInlineSize = 96;
+
+        template <class F>
+        static MailboxMessage* create(F &&f) {
+            using Fn = std::decay_t<F>;
+            MailboxMessage *msg = allocate();
+            if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t)) {
+                new (msg->_storage) Fn(std::forward<F>(f));
+                msg->_call = [](MailboxMessage *m, bool run) {
+                    auto fn = reinterpret_cast<Fn*>(m->_storage);
+                    if (run) (*fn)(); else fn->~Fn();
+                };
+            } else {
+                *reinterpret_cast<Fn**>(msg->_storage) = new Fn(std::forward<F>(f));
+                msg->_call = [](MailboxMessage *m, bool run) {
+                    auto fn = *reinterpret_cast<Fn**>(m->_storage);
+                    if (run) (*fn)(); else delete fn;
+                };
+            }
+#if ACTORS_TRACK_STATS
+            msg->_enqueuedAt.reset();
+#endif
+            return msg;
+        }
+
+        /** Calls the closure. */
+        void run()                                          {_call(this, true);}
+
+        /** Destroys the closure and recycles the message. */
+        static void destroy(MailboxMessage*) noexcept;
+
+    private:
+        friend class ThreadedMailbox;
+        friend class MailboxMessageCache;
+
+        static MailboxMessage* allocate();
+
+        std::atomic<MailboxMessage*> _next {nullptr};
+        void (*_call)(MailboxMessage*, bool run);
+#if ACTORS_TRACK_STATS
+        fleece::Stopwatch _enqueuedAt;
+#endif
+        alignas(std::max_align_t) uint8_t _storage[kInlineSize];
+    };
+
+
+    class Scheduler;
+
+
+    /** Default Actor mailbox implementation that uses a thread pool run by a Scheduler.
+        Messages are queued in a lock-free MPSCQueue, so enqueueing never blocks. */
+    class ThreadedMailbox : SchedulerLink {
     public:
-        ThreadedMailbox(Actor*, const std::string &name ="", ThreadedMailbox *parentMailbox =nullptr);
+        ThreadedMailbox(Actor*, const std::string &name ="", ThreadedMailbox *parentMailbox =nullptr,
+                        Scheduler *scheduler =nullptr);
 
         const std::string& name() const                     {return _name;}
 
-        unsigned eventCount() const                         {return (unsigned)size() + (unsigned)_delayedEventCount;}
+        unsigned eventCount() const                         {return (unsigned)_queueSize + (unsigned)_delayedEventCount;}
+
+        template <class F>
+        void enqueue(F &&f)                                 {enqueueMessage(MailboxMessage::create(std::forward<F>(f)));}
 
-        void enqueue(const std::function<void()>&);
         void enqueueAfter(delay_t delay, const std::function<void()>&);
 
         static Actor* currentActor()                        {return sCurrentActor;}
@@ -68,15 +146,19 @@ namespace litecore { namespace actor {
     private:
         friend class Scheduler;
         
+        void enqueueMessage(MailboxMessage*);
         void reschedule();
         void performNextMessage();
         void afterEvent();
-        void safelyCall(const std::function<void()> &f) const;
+        void safelyCall(MailboxMessage*) const;
 
         Actor* const _actor;
         std::string const _name;
+        Scheduler* const _scheduler;                        // Runs my Actor's messages
 
-        int _delayedEventCount {0};
+        MPSCQueue<MailboxMessage, &MailboxMessage::_next> _queue;
+        std::atomic<int> _queueSize {0};
+        std::atomic<int> _delayedEventCount {0};
 #if DEBUG
         std::atomic_int _active {0};
 #endif
@@ -93,16 +175,23 @@ namespace litecore { namespace actor {
     };
 
     /** The Scheduler is reponsible for calling ThreadedMailboxes to run their Actor methods.
-        It managers a thread pool on which Mailboxes and Actors will run. */
+        It managers a thread pool on which Mailboxes and Actors will run.
+
+        In work-stealing mode each thread has its own queue: a Mailbox scheduled from a
+        Scheduler thread goes to that thread's queue, others are spread round-robin, and an
+        idle thread steals from the others' queues. Otherwise all threads pop from one shared
+        Channel. Either way a Mailbox is only scheduled once at a time, so an Actor's
+        messages are never run concurrently. */
     class Scheduler {
     public:
-        Scheduler(unsigned numThreads =0)
-        :_numThreads(numThreads)
-        { }
+        Scheduler(unsigned numThreads =0, bool workStealing =ACTORS_WORK_STEALING);
+        ~Scheduler();
 
         /** Returns a per-process shared instance. */
         static Scheduler* sharedScheduler();
 
+        bool workStealing() const                           {return _workStealing;}
+
         /** Starts the background threads that will run queued Actors. */
         void start();
 
@@ -110,29 +199,42 @@ namespace litecore { namespace actor {
         void stop();
 
         /** Runs the scheduler on the current thread; doesn't return until all pending
-            messages are handled. */
+            messages are handled. Must not be called while the Scheduler is started. */
         void runSynchronous()                               {task(0);}
 
     protected:
         friend class ThreadedMailbox;
 
         /** A request for an Actor's performNextMessage method to be called. */
-        static void schedule(ThreadedMailbox* mbox);
+        void schedule(ThreadedMailbox* mbox);
 
     private:
+        struct Worker;
+
         void task(unsigned taskID);
+        void push(ThreadedMailbox*);
+        ThreadedMailbox* nextMailbox(Worker*);
+        ThreadedMailbox* steal(Worker *thief);
+        void idle(Worker&);
+        bool hasStealableWork(Worker *thief) const;
+        void wake(Worker&);
+        void wakeIdleWorker();
 
         unsigned _numThreads;
-        Channel<ThreadedMailbox*> _queue;
+        bool const _workStealing;
+        Channel<ThreadedMailbox*> _queue;                   // Shared queue, if !_workStealing
+        std::vector<std::unique_ptr<Worker>> _workers;      // Per-thread queues, if _workStealing
+        std::atomic<unsigned> _nextWorker {0};              // Round-robin index for push()
+        std::atomic<int> _idleWorkers {0};
+        std::atomic<bool> _stopping {false};
         std::vector<std::thread> _threadPool;
         std::atomic_flag _started = ATOMIC_FLAG_INIT;
 
-
+        static thread_local Worker* sCurrentWorker;         // The current thread's Worker, if any
     };
 
     // This prevents the compiler from specializing Channel in every compilation unit:
     extern template class Channel<ThreadedMailbox*>;
-    extern template class Channel<std::function<void()>>;
 #endif
 
 } }
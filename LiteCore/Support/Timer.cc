@@ -31,7 +31,8 @@ namespace litecore { namespace actor {
 
 
     Timer::Manager::Manager()
-    :_thread([this](){ run(); })
+    :_epoch(clock::now())
+    ,_thread([this](){ run(); })
     { }
 
 
@@ -40,14 +41,11 @@ namespace litecore { namespace actor {
         SetThreadName("Timer (Couchbase Lite Core)");
         unique_lock<mutex> lock(_mutex);
         while(true) {
-            auto earliest = _schedule.begin();
-            if (earliest == _schedule.end()) {
-                // Schedule is empty; just wait for a change
-                _condition.wait(lock);
-
-            } else if (earliest->first <= clock::now()) {
-                // A Timer is ready to fire, so remove it and call the callback:
-                auto timer = earliest->second;
+            advanceTo(floorTick(clock::now()));
+            if (_due) {
+                // A Timer is ready to fire, so remove it and call the callback. (The due Timers
+                // are fired one at a time, so that stopping one that hasn't fired yet still works.)
+                auto timer = _due;
                 timer->_triggered = true;
                 _unschedule(timer);
 
@@ -57,15 +55,23 @@ namespace litecore { namespace actor {
                 try {
                     timer->_callback();
                 } catch (...) { }
+                bool autoDelete = timer->_autoDelete;        // (timer may be gone after the next line)
                 timer->_triggered = false;                   // note: not holding any lock
-                if (timer->_autoDelete)
+                if (autoDelete)
                     delete timer;
                 lock.lock();
 
             } else {
-                // Wait for the first timer's fireTime, or until the _schedule is updated:
-                auto nextFireTime = earliest->first;
-                _condition.wait_until(lock, nextFireTime);
+                // Wait for the next tick with something to do, or until the schedule is updated:
+                tick_t next;
+                if (nextEventTick(next)) {
+                    _wakeTick = next;
+                    _condition.wait_until(lock, _epoch + tick_duration(next));
+                } else {
+                    _wakeTick = UINT64_MAX;
+                    _condition.wait(lock);
+                }
+                _wakeTick = 0;
             }
         }
     }
@@ -78,45 +84,219 @@ namespace litecore { namespace actor {
     }
 
 
-    // Removes a Timer from _scheduled. Returns true if the next fire time is affected.
+#pragma mark - TIMING WHEEL:
+
+
+    // Converts a time to the first tick at or after it, so a Timer never fires early.
+    Timer::Manager::tick_t Timer::Manager::ceilTick(time t) const {
+        if (t <= _epoch)
+            return 0;
+        return chrono::ceil<tick_duration>(t - _epoch).count();
+    }
+
+
+    // Converts a time to the last tick at or before it.
+    Timer::Manager::tick_t Timer::Manager::floorTick(time t) const {
+        if (t <= _epoch)
+            return 0;
+        return chrono::floor<tick_duration>(t - _epoch).count();
+    }
+
+
+    // Returns a reference to the tail of a slot's list: the pointer to the last Timer's `_next`,
+    // or to the list head if it's empty. (A null tail also means it's empty.)
+    Timer**& Timer::Manager::tailOf(int16_t slot) {
+        if (slot == kDueSlot)
+            return _dueTail;
+        else if (slot == kOverflowSlot)
+            return _overflowTail;
+        else
+            return _wheelTails[slot / kSlots][slot % kSlots];
+    }
+
+
+    // Adds a Timer to the end of a list, so that Timers due at the same tick fire in the order
+    // they were scheduled. (Batcher and Inserter depend on that.)
+    void Timer::Manager::link(Timer *timer, Timer **list, int16_t slot) {
+        Timer** &tail = tailOf(slot);
+        if (!tail)
+            tail = list;
+        timer->_next = nullptr;
+        timer->_pprev = tail;
+        *tail = timer;
+        tail = &timer->_next;
+        timer->_slot = slot;
+        if (slot >= 0 && slot < kOverflowSlot)
+            _occupied[slot / kSlots][(slot % kSlots) / 64] |= (1ull << (slot % 64));
+    }
+
+
+    // Adds a scheduled Timer to the list for its _fireTick: the due list if that's already
+    // passed, else the lowest wheel level whose range (relative to _currentTick) covers it.
+    // Precondition: _mutex must be locked.
+    void Timer::Manager::_schedule(Timer *timer) {
+        tick_t tick = timer->_fireTick;
+        if (tick <= _currentTick) {
+            link(timer, &_due, kDueSlot);
+            return;
+        }
+        for (unsigned level = 0; level < kLevels; ++level) {
+            unsigned shift = kSlotBits * level;
+            if (((tick ^ _currentTick) >> (shift + kSlotBits)) == 0) {
+                unsigned index = (tick >> shift) % kSlots;
+                link(timer, &_wheel[level][index], int16_t(level * kSlots + index));
+                return;
+            }
+        }
+        link(timer, &_overflow, kOverflowSlot);
+    }
+
+
+    // Removes a Timer from its list.
     // Precondition: _mutex must be locked.
-    // Postconditions: timer is not in _scheduled. timer->_state != kScheduled.
-    bool Timer::Manager::_unschedule(Timer *timer) {
+    // Postconditions: timer is not in any list. timer->_state != kScheduled.
+    void Timer::Manager::_unschedule(Timer *timer) {
         if (timer->_state != kScheduled)
-            return false;
-        bool affectsTiming = (timer->_entry == _schedule.begin());
-        _schedule.erase(timer->_entry);
-        timer->_entry = _schedule.end();
+            return;
+        int16_t slot = timer->_slot;
+        *timer->_pprev = timer->_next;
+        if (timer->_next)
+            timer->_next->_pprev = timer->_pprev;
+        else
+            tailOf(slot) = timer->_pprev;
+        if (slot >= 0 && slot < kOverflowSlot && _wheel[slot / kSlots][slot % kSlots] == nullptr)
+            _occupied[slot / kSlots][(slot % kSlots) / 64] &= ~(1ull << (slot % 64));
+        timer->_next = nullptr;
+        timer->_pprev = nullptr;
+        timer->_slot = kDueSlot;
         timer->_state = kUnscheduled;
         timer->_fireTime = time();
-        return affectsTiming && !_schedule.empty();
     }
 
 
+    // Empties a list, re-adding its Timers according to the current tick. Used to cascade a
+    // higher-level slot into the lower levels (or the due list) when its time range begins.
+    void Timer::Manager::reschedule(Timer **list) {
+        Timer *timer = *list;
+        if (!timer)
+            return;
+        int16_t slot = timer->_slot;
+        *list = nullptr;
+        tailOf(slot) = nullptr;
+        if (slot >= 0 && slot < kOverflowSlot)
+            _occupied[slot / kSlots][(slot % kSlots) / 64] &= ~(1ull << (slot % 64));
+        while (timer) {
+            Timer *next = timer->_next;
+            _schedule(timer);
+            timer = next;
+        }
+    }
+
+
+    // Returns the index of the first occupied slot of a level at or after `start`, or -1.
+    int Timer::Manager::nextOccupied(unsigned level, unsigned start) const {
+        for (unsigned word = start / 64; word < kWordsPerLevel; ++word) {
+            uint64_t bits = _occupied[level][word];
+            if (word == start / 64)
+                bits &= ~0ull << (start % 64);
+            if (bits) {
+                unsigned bit = 0;
+                while (!(bits & 1)) {
+                    bits >>= 1;
+                    ++bit;
+                }
+                return int(word * 64 + bit);
+            }
+        }
+        return -1;
+    }
+
+
+    // Finds the next tick after _currentTick at which a wheel slot has to be processed, i.e.
+    // the start of the time range of the first occupied slot in each level. Returns false if
+    // the wheel is empty.
+    bool Timer::Manager::nextEventTick(tick_t &outTick) const {
+        bool found = false;
+        tick_t best = UINT64_MAX;
+        for (unsigned level = 0; level < kLevels; ++level) {
+            unsigned shift = kSlotBits * level;
+            unsigned current = (_currentTick >> shift) % kSlots;
+            int index = nextOccupied(level, current + 1);
+            if (index >= 0) {
+                tick_t base = (_currentTick >> (shift + kSlotBits)) << (shift + kSlotBits);
+                tick_t tick = base | (tick_t(index) << shift);
+                if (tick < best) {
+                    best = tick;
+                    found = true;
+                }
+            }
+        }
+        if (_overflow) {
+            unsigned shift = kSlotBits * kLevels;
+            tick_t tick = ((_currentTick >> shift) + 1) << shift;
+            if (tick < best) {
+                best = tick;
+                found = true;
+            }
+        }
+        outTick = best;
+        return found;
+    }
+
+
+    // Processes the wheel up to the tick `now`, stopping early at a tick that makes any Timers
+    // due (so that Timers from different ticks fire in order.)
+    void Timer::Manager::advanceTo(tick_t now) {
+        tick_t next;
+        while (!_due && nextEventTick(next) && next <= now)
+            processTick(next);
+        if (!_due && now > _currentTick)
+            _currentTick = now;
+    }
+
+
+    // Makes `tick` current, cascading every slot whose time range starts at that tick, from
+    // the highest level down; the Timers due at `tick` end up in the due list.
+    void Timer::Manager::processTick(tick_t tick) {
+        _currentTick = tick;
+        if ((tick & ((tick_t(1) << (kSlotBits * kLevels)) - 1)) == 0)
+            reschedule(&_overflow);
+        for (int level = kLevels - 1; level >= 0; --level) {
+            unsigned shift = kSlotBits * level;
+            if ((tick & ((tick_t(1) << shift) - 1)) == 0)
+                reschedule(&_wheel[level][(tick >> shift) % kSlots]);
+        }
+    }
+
+
+#pragma mark - API:
+
+
     // Unschedules a timer, preventing it from firing if it hasn't been triggered yet.
     // (Called by Timer::stop())
     // Precondition: _mutex must NOT be locked.
-    // Postcondition: timer is not in _scheduled. timer->_state != kScheduled.
+    // Postcondition: timer is not scheduled. timer->_state != kScheduled.
     void Timer::Manager::unschedule(Timer *timer) {
         unique_lock<mutex> lock(_mutex);
-        if (_unschedule(timer))
-            _condition.notify_one();        // wakes up run() so it can recalculate its wait time
+        _unschedule(timer);
+        // (No need to wake up run(); at worst it wakes up for nothing at the old fire time.)
     }
 
 
     // Schedules or re-schedules a timer. (Called by Timer::fireAt/fireAfter())
     // If `earlier` is true, it will only move the fire time closer, else it returns `false`.
     // Precondition: _mutex must NOT be locked.
-    // Postcondition: timer is in _scheduled. timer->_state == kScheduled.
+    // Postcondition: timer is scheduled. timer->_state == kScheduled.
     bool Timer::Manager::setFireTime(Timer *timer, clock::time_point when, bool earlier) {
         unique_lock<mutex> lock(_mutex);
         if (earlier && timer->scheduled() && when >= timer->_fireTime)
             return false;
-        bool notify = _unschedule(timer);
-        timer->_entry = _schedule.insert({when, timer});
+        _unschedule(timer);
         timer->_state = kScheduled;
         timer->_fireTime = when;
-        if (timer->_entry == _schedule.begin() || notify)
+        timer->_fireTick = ceilTick(when);
+        _schedule(timer);
+        if (timer->_fireTick < _wakeTick)
             _condition.notify_one();        // wakes up run() so it can recalculate its wait time
         return true;
     }
@@ -18,9 +18,9 @@
 
 #pragma once
 #include <atomic>
+#include <cstdint>
 #include <chrono>
 #include <functional>
-#include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -89,25 +89,58 @@ namespace litecore { namespace actor {
 
         enum state : uint8_t {
             kUnscheduled,               // Idle
-            kScheduled,                 // In _scheduled queue, waiting to fire
+            kScheduled,                 // In the timer wheel or the due list, waiting to fire
         };
 
-        /** Internal singleton that tracks all scheduled Timers and runs a background thread. */
+        /** Internal singleton that tracks all scheduled Timers and runs a background thread.
+            Timers are kept in a hierarchical timing wheel: kLevels arrays of kSlots lists, where
+            level L holds Timers due within kSlots^(L+1) ticks, in the slot of their fire time's
+            L'th base-kSlots digit. As the current tick advances, each higher-level slot is
+            "cascaded" into the lower levels when its time range comes up. Scheduling and
+            unscheduling are O(1); firing collects all the Timers due at a tick at once.
+            Timers are appended to the ends of the lists, so the ones due at the same tick fire in
+            the order they were scheduled. */
         class Manager {
         public:
-            using map = std::multimap<time, Timer*>;
-            
+            using tick_t = uint64_t;
+            using tick_duration = std::chrono::milliseconds;
+
+            static constexpr unsigned kSlotBits = 8;
+            static constexpr unsigned kSlots = 1 << kSlotBits;
+            static constexpr unsigned kLevels = 4;
+            static constexpr unsigned kWordsPerLevel = kSlots / 64;
+            static constexpr int16_t  kDueSlot = -1, kOverflowSlot = kLevels * kSlots;
+
             Manager();
             bool setFireTime(Timer*, time, bool ifEarlier =false);
             void unschedule(Timer*);
             
         private:
-            bool _unschedule(Timer*);
+            tick_t ceilTick(time) const;
+            tick_t floorTick(time) const;
+            void _schedule(Timer*);
+            void _unschedule(Timer*);
+            void link(Timer*, Timer **list, int16_t slot);
+            Timer**& tailOf(int16_t slot);
+            void reschedule(Timer **list);
+            int nextOccupied(unsigned level, unsigned start) const;
+            bool nextEventTick(tick_t &tick) const;
+            void advanceTo(tick_t);
+            void processTick(tick_t);
             void run();
 
-            map _schedule;                      // A priority queue of Timers ordered by time
-            std::mutex _mutex;                  // Thread-safety for _schedule
-            std::condition_variable _condition; // Used to signal that _schedule has changed
+            time const _epoch;                  // Time of tick 0
+            tick_t _currentTick {0};            // Last tick processed
+            tick_t _wakeTick {UINT64_MAX};      // Tick run() is sleeping until
+            Timer* _wheel[kLevels][kSlots] {};  // Heads of the timer lists in each slot
+            uint64_t _occupied[kLevels][kWordsPerLevel] {}; // Bitmaps of non-empty slots
+            Timer** _wheelTails[kLevels][kSlots] {}; // Last `_next` link of each _wheel list
+            Timer* _overflow {nullptr};         // Timers due beyond the range of the wheel
+            Timer** _overflowTail {nullptr};    // Last `_next` link of _overflow
+            Timer* _due {nullptr};              // Timers ready to fire
+            Timer** _dueTail {nullptr};         // Last `_next` link of _due
+            std::mutex _mutex;                  // Thread-safety for all of the above
+            std::condition_variable _condition; // Used to signal that the schedule has changed
             std::thread _thread;                // Bg thread that waits & fires Timers
         };
 
@@ -121,7 +154,10 @@ namespace litecore { namespace actor {
         std::atomic<state> _state {kUnscheduled};   // Current state
         std::atomic<bool> _triggered {false};   // True while callback is being called
         bool _autoDelete {false};               // If true, delete after firing
-        Manager::map::iterator _entry;          // My map entry in Manager::_schedule
+        Manager::tick_t _fireTick {0};          // _fireTime converted to Manager ticks
+        Timer* _next {nullptr};                 // Next Timer in my Manager list
+        Timer** _pprev {nullptr};               // Pointer to the pointer to me in that list
+        int16_t _slot {Manager::kDueSlot};      // Which Manager list I'm in (level*kSlots + index)
     };
 
 } }
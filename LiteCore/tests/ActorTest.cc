@@ -0,0 +1,279 @@
+//
+// ActorTest.cc
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "LiteCoreTest.hh"
+#include "Actor.hh"
+#include "Channel.hh"
+#include "Stopwatch.hh"
+#include "Timer.hh"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace litecore;
+using namespace litecore::actor;
+
+
+static constexpr unsigned kNumProducers = 4;
+
+
+// Records the calls made to it, and whether any of them overlapped or arrived out of order.
+class CountingActor : public Actor {
+public:
+    CountingActor() :Actor("CountingActor") { }
+#ifndef ACTORS_USE_GCD
+    explicit CountingActor(Scheduler *s) :Actor("CountingActor", s) { }
+#endif
+
+    void add(unsigned producer, uint64_t seq)   {enqueue(&CountingActor::_add, producer, seq);}
+    void ping(atomic<uint64_t> *pong)           {enqueue(&CountingActor::_ping, pong);}
+
+    uint64_t count {0};
+    bool overlapped {false}, outOfOrder {false};
+
+private:
+    void _add(unsigned producer, uint64_t seq) {
+        if (_running.exchange(true))
+            overlapped = true;
+        if (seq != _lastSeq[producer] + 1)
+            outOfOrder = true;
+        _lastSeq[producer] = seq;
+        ++count;
+        _running = false;
+    }
+
+    void _ping(atomic<uint64_t> *pong) {
+        ++*pong;
+    }
+
+    atomic<bool> _running {false};
+    uint64_t _lastSeq[kNumProducers] {};
+};
+
+
+// Calls `fn(producerIndex)` on kNumProducers threads at once.
+static void runProducers(function<void(unsigned)> fn) {
+    vector<thread> threads;
+    for (unsigned p = 0; p < kNumProducers; ++p)
+        threads.emplace_back([=]{fn(p);});
+    for (auto &t : threads)
+        t.join();
+}
+
+
+TEST_CASE("Actor calls are serialized", "[Actor]") {
+    static constexpr uint64_t kCallsPerProducer = 25000;
+    Retained<CountingActor> actor = new CountingActor;
+    runProducers([&](unsigned p) {
+        for (uint64_t seq = 1; seq <= kCallsPerProducer; ++seq)
+            actor->add(p, seq);
+    });
+    actor->waitTillCaughtUp();
+    CHECK(actor->count == kNumProducers * kCallsPerProducer);
+    CHECK(!actor->overlapped);
+    CHECK(!actor->outOfOrder);
+    CHECK(actor->eventCount() == 0);
+}
+
+
+#ifndef ACTORS_USE_GCD
+TEST_CASE("Actor calls are serialized with work-stealing", "[Actor]") {
+    // Many Actors busy at once, so the Workers' queues fill up and idle Workers steal from them:
+    static constexpr unsigned kNumActors = 50;
+    static constexpr uint64_t kCallsPerProducer = 2000;
+    Scheduler scheduler(4, true);
+    REQUIRE(scheduler.workStealing());
+    scheduler.start();
+    {
+        vector<Retained<CountingActor>> actors;
+        for (unsigned i = 0; i < kNumActors; ++i)
+            actors.emplace_back(new CountingActor(&scheduler));
+        runProducers([&](unsigned p) {
+            for (uint64_t seq = 1; seq <= kCallsPerProducer; ++seq) {
+                for (auto &actor : actors)
+                    actor->add(p, seq);
+            }
+        });
+        for (auto &actor : actors) {
+            actor->waitTillCaughtUp();
+            CHECK(actor->count == kNumProducers * kCallsPerProducer);
+            CHECK(!actor->overlapped);
+            CHECK(!actor->outOfOrder);
+        }
+    }
+    scheduler.stop();
+}
+#endif
+
+
+TEST_CASE("Actor enqueue/dispatch performance", "[Actor][Perf][.]") {
+    // Compares an Actor's mailbox with a consumer thread popping std::functions from a Channel,
+    // which is how ThreadedMailbox used to queue messages.
+    static constexpr uint64_t kCallsPerProducer = 250000, kPings = 20000;
+    static constexpr uint64_t kTotal = kNumProducers * kCallsPerProducer;
+
+    {
+        Retained<CountingActor> actor = new CountingActor;
+        fleece::Stopwatch st;
+        runProducers([&](unsigned p) {
+            for (uint64_t seq = 1; seq <= kCallsPerProducer; ++seq)
+                actor->add(p, seq);
+        });
+        double enqueueTime = st.elapsed();
+        actor->waitTillCaughtUp();
+        st.stop();
+        REQUIRE(actor->count == kTotal);
+        fprintf(stderr, "Actor:   enqueue %.1f ns/call; all handled in %.1f ns/call\n",
+                enqueueTime / kTotal * 1e9, st.elapsed() / kTotal * 1e9);
+
+        // Latency: one message at a time, waiting for each to be handled:
+        atomic<uint64_t> pong {0};
+        fleece::Stopwatch st2;
+        for (uint64_t i = 1; i <= kPings; ++i) {
+            actor->ping(&pong);
+            while (pong < i)
+                this_thread::yield();
+        }
+        st2.stop();
+        fprintf(stderr, "Actor:   round trip %.1f ns\n", st2.elapsed() / kPings * 1e9);
+    }
+
+    {
+        Channel<function<void()>> channel;
+        uint64_t count = 0;
+        thread consumer([&]{
+            while (auto fn = channel.pop())
+                fn();
+        });
+        fleece::Stopwatch st;
+        runProducers([&](unsigned p) {
+            for (uint64_t seq = 1; seq <= kCallsPerProducer; ++seq)
+                channel.push(bind([&](uint64_t) {++count;}, seq));
+        });
+        double enqueueTime = st.elapsed();
+        atomic<bool> done {false};
+        channel.push([&]{done = true;});
+        while (!done)
+            this_thread::yield();
+        st.stop();
+        REQUIRE(count == kTotal);
+        fprintf(stderr, "Channel: enqueue %.1f ns/call; all handled in %.1f ns/call\n",
+                enqueueTime / kTotal * 1e9, st.elapsed() / kTotal * 1e9);
+
+        atomic<uint64_t> pong {0};
+        fleece::Stopwatch st2;
+        for (uint64_t i = 1; i <= kPings; ++i) {
+            channel.push([&]{++pong;});
+            while (pong < i)
+                this_thread::yield();
+        }
+        st2.stop();
+        fprintf(stderr, "Channel: round trip %.1f ns\n", st2.elapsed() / kPings * 1e9);
+
+        channel.close();
+        consumer.join();
+    }
+}
+
+
+TEST_CASE("Timers fire on time", "[Actor][Timer]") {
+    static constexpr unsigned kNumTimers = 500;
+    vector<unique_ptr<Timer>> timers;
+    vector<Timer::time> fireTimes(kNumTimers);
+    atomic<unsigned> fired {0}, early {0}, stopped {0};
+    auto start = Timer::clock::now();
+    for (unsigned i = 0; i < kNumTimers; ++i) {
+        fireTimes[i] = start + chrono::milliseconds(50 + (i * 7919) % 250);
+        timers.emplace_back(new Timer([&, i] {
+            if (Timer::clock::now() < fireTimes[i])
+                ++early;
+            if (i % 2)
+                ++stopped;
+            ++fired;
+        }));
+        timers.back()->fireAt(fireTimes[i]);
+    }
+    // Stop every other timer; and move one of the remaining ones to the far future and back:
+    for (unsigned i = 1; i < kNumTimers; i += 2)
+        timers[i]->stop();
+    CHECK(!timers[0]->fireEarlierAfter(chrono::hours(24)));
+    timers[0]->fireAfter(chrono::hours(24 * 60));
+    CHECK(timers[0]->fireEarlierAt(fireTimes[0]));
+
+    while (fired < kNumTimers / 2 && Timer::clock::now() < start + chrono::seconds(10))
+        this_thread::sleep_for(chrono::milliseconds(10));
+    this_thread::sleep_for(chrono::milliseconds(50));
+    CHECK(fired == kNumTimers / 2);
+    CHECK(early == 0);
+    CHECK(stopped == 0);
+    for (auto &timer : timers)
+        CHECK(!timer->scheduled());
+}
+
+
+TEST_CASE("Timers due at the same time fire in order", "[Actor][Timer]") {
+    static constexpr unsigned kNumTimers = 200;
+    vector<unique_ptr<Timer>> timers;
+    mutex orderMutex;
+    vector<unsigned> order;
+    auto addTimers = [&](unsigned n, Timer::time when) {
+        for (unsigned i = 0; i < n; ++i) {
+            unsigned index = unsigned(timers.size());
+            timers.emplace_back(new Timer([&, index] {
+                lock_guard<mutex> lock(orderMutex);
+                order.push_back(index);
+            }));
+            timers.back()->fireAt(when);
+        }
+    };
+
+    auto start = Timer::clock::now();
+    Timer::time when;
+    SECTION("Soon") {
+        // All in one slot of the lowest level of the wheel:
+        when = start + chrono::milliseconds(50);
+        addTimers(kNumTimers, when);
+    }
+    SECTION("Later") {
+        // In a higher level, cascaded into the lower one before firing:
+        when = start + chrono::milliseconds(700);
+        addTimers(kNumTimers, when);
+    }
+    SECTION("Mixed") {
+        // Half are cascaded from a higher level, half are scheduled once it's close:
+        when = start + chrono::milliseconds(700);
+        addTimers(kNumTimers / 2, when);
+        this_thread::sleep_until(when - chrono::milliseconds(100));
+        addTimers(kNumTimers / 2, when);
+    }
+
+    auto nFired = [&] {
+        lock_guard<mutex> lock(orderMutex);
+        return order.size();
+    };
+    while (nFired() < kNumTimers && Timer::clock::now() < start + chrono::seconds(10))
+        this_thread::sleep_for(chrono::milliseconds(10));
+    vector<unsigned> expected(kNumTimers);
+    iota(expected.begin(), expected.end(), 0);
+    lock_guard<mutex> lock(orderMutex);
+    CHECK(order == expected);
+}
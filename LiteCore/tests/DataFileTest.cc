@@ -17,6 +17,7 @@
 //
 
 #include "DataFile.hh"
+#include "SQLiteDataFile.hh"
 #include "RecordEnumerator.hh"
 #include "Error.hh"
 #include "FilePath.hh"
@@ -301,6 +302,101 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile DeleteDocAndReopen", "[Da
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile RecordCount", "[DataFile]") {
+    REQUIRE(store->recordCount() == 0);
+    sequence_t seqA;
+    {
+        Transaction t(db);
+        seqA = store->set("a"_sl, "1-a"_sl, "A"_sl, DocumentFlags::kNone, t);
+        store->set("b"_sl, "1-b"_sl, "B"_sl, DocumentFlags::kNone, t);
+        store->set("c"_sl, "1-c"_sl, nullslice, DocumentFlags::kDeleted, t);
+        CHECK(store->recordCount() == 2);
+        CHECK(store->recordCount(true) == 3);
+        t.commit();
+    }
+    CHECK(store->recordCount() == 2);
+    CHECK(store->recordCount(true) == 3);
+
+    {
+        // Aborted changes don't affect the counts:
+        Transaction t(db);
+        store->set("d"_sl, "1-d"_sl, "D"_sl, DocumentFlags::kNone, t);
+        CHECK(store->recordCount() == 3);
+        t.abort();
+    }
+    CHECK(store->recordCount() == 2);
+
+    {
+        Transaction t(db);
+        // Replacing a live record with a tombstone, and vice versa:
+        store->set("b"_sl, "2-b"_sl, nullslice, DocumentFlags::kDeleted, t);
+        store->set("c"_sl, "2-c"_sl, "C"_sl, DocumentFlags::kNone, t);
+        CHECK(store->recordCount() == 2);
+        CHECK(store->setDocumentFlag("a"_sl, seqA, DocumentFlags::kDeleted, t));
+        CHECK(store->recordCount() == 1);
+        CHECK(store->del("b"_sl, t));
+        CHECK(store->recordCount() == 1);
+        CHECK(store->recordCount(true) == 2);
+        t.commit();
+    }
+
+    reopenDatabase();
+    CHECK(store->recordCount() == 1);
+    CHECK(store->recordCount(true) == 2);
+
+    {
+        // Conditional replacement, and deleting a live record:
+        Transaction t(db);
+        sequence_t seqC = store->get("c"_sl).sequence();
+        sequence_t seqC2 = store->set("c"_sl, "3-c"_sl, nullslice, DocumentFlags::kDeleted,
+                                      t, &seqC);
+        CHECK(seqC2 > seqC);
+        CHECK(store->set("c"_sl, "4-c"_sl, "C"_sl, DocumentFlags::kNone, t, &seqC) == 0);
+        CHECK(store->recordCount() == 0);
+        CHECK(store->set("c"_sl, "4-c"_sl, "C"_sl, DocumentFlags::kNone, t, &seqC2) > 0);
+        CHECK(store->recordCount() == 1);
+        CHECK(store->del("c"_sl, t));
+        CHECK(!store->del("c"_sl, t));
+        store->set("e"_sl, "1-e"_sl, "E"_sl, DocumentFlags::kNone, t);
+        CHECK(store->recordCount() == 1);
+        CHECK(store->recordCount(true) == 2);
+        t.commit();
+    }
+
+    // Expiring records has to invalidate the persisted counts:
+    CHECK(store->setExpiration("e"_sl, KeyStore::now() - 10000));
+    CHECK(store->expireRecords() == 1);
+    CHECK(store->recordCount() == 0);
+    CHECK(store->recordCount(true) == 1);
+    reopenDatabase();
+    CHECK(store->recordCount() == 0);
+    CHECK(store->recordCount(true) == 1);
+
+    // So do changes made by older versions of LiteCore, which don't know about the counts and
+    // don't necessarily bump lastSeq or purgeCnt:
+    {
+        Transaction t(db);
+        store->set("f"_sl, "1-f"_sl, "F"_sl, DocumentFlags::kNone, t);
+        store->set("g"_sl, "1-g"_sl, "G"_sl, DocumentFlags::kNone, t);
+        t.commit();
+    }
+    CHECK(store->recordCount() == 2);
+    auto &sqliteDB = dynamic_cast<SQLiteDataFile&>(*db);
+    sqliteDB.execWithLock("UPDATE kv_default SET flags = flags | 1 WHERE key = 'f'");
+    CHECK(store->recordCount() == 1);
+    CHECK(store->recordCount(true) == 3);
+    sqliteDB.execWithLock("DELETE FROM kv_default WHERE key = 'g'");
+    CHECK(store->recordCount() == 0);
+    CHECK(store->recordCount(true) == 2);
+    reopenDatabase();
+    CHECK(store->recordCount() == 0);
+    CHECK(store->recordCount(true) == 2);
+
+    store->erase();
+    CHECK(store->recordCount(true) == 0);
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile KeyStoreInfo", "[DataFile]") {
     KeyStore &s = db->getKeyStore("store");
     REQUIRE(s.lastSequence() == 0);
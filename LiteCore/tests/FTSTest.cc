@@ -17,11 +17,18 @@
 //
 
 #include "DataFile.hh"
+#include "Database.hh"
+#include "IndexBuilder.hh"
 #include "Query.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
+#include "Stopwatch.hh"
 
 #include "LiteCoreTest.hh"
+#include "c4Database.hh"
+#include "c4Document+Fleece.h"
+#include <atomic>
+#include <thread>
 
 using namespace litecore;
 using namespace std;
@@ -131,6 +138,82 @@ TEST_CASE_METHOD(FTSTest, "Query Full-Text Unsupported Language", "[Query][FTS]"
 }
 
 
+// An IndexBuilder whose first few chunks fail, as if the background connection hit an error.
+class FailingIndexBuilder : public IndexBuilder {
+public:
+    FailingIndexBuilder(c4Internal::Database *db, int failures)
+    :IndexBuilder(db), _failures(failures) { }
+
+    std::atomic<int> attempts {0};
+
+protected:
+    bool buildChunk(DataFile *dataFile) override {
+        if (++attempts <= _failures)
+            error::_throw(error::Busy, "injected IndexBuilder failure");
+        return IndexBuilder::buildChunk(dataFile);
+    }
+
+private:
+    int const _failures;
+};
+
+
+TEST_CASE_METHOD(TestFixture, "Query Full-Text Background Build Retry", "[Query][FTS][!throws]") {
+    FilePath dbPath = GetPath("bgIndexRetry", "cblite2");
+    dbPath.delRecursive();
+    C4DatabaseConfig config { };
+    config.flags = kC4DB_Create;
+    config.storageEngine = kC4SQLiteStorageEngine;
+    config.versioning = kC4RevisionTrees;
+    C4Error error;
+    C4Database *db = c4db_open(slice(dbPath.path()), &config, &error);
+    REQUIRE(db);
+
+    REQUIRE(c4db_beginTransaction(db, &error));
+    for (int i = 0; i < 5; ++i) {
+        string docID = stringWithFormat("rec-%03d", i);
+        string json = stringWithFormat("{\"sentence\":\"Search number %d\"}", i);
+        C4SliceResult body = c4db_encodeJSON(db, slice(json), &error);
+        REQUIRE(body.buf);
+        C4Document *doc = c4doc_create(db, slice(docID), C4Slice(body), 0, &error);
+        REQUIRE(doc);
+        c4doc_release(doc);
+        c4slice_free(body);
+    }
+    REQUIRE(c4db_endTransaction(db, true, &error));
+
+    // Register the background build without letting the Database start its own builder:
+    KeyStore &store = db->defaultKeyStore();
+    IndexSpec::Options options {"english", true};
+    options.background = true;
+    store.createIndex("sentence", "[[\".sentence\"]]", IndexSpec::kFullText, &options);
+    REQUIRE(store.indexBuildsPending());
+
+    {
+        ExpectingExceptions x;
+        Retained<FailingIndexBuilder> builder = new FailingIndexBuilder(db, 2);
+        builder->start();
+        // The failed chunks are retried after a short delay, not abandoned until reopen:
+        for (int i = 0; i < 100 && store.indexBuildProgress("sentence"_sl) < 1.0; ++i)
+            this_thread::sleep_for(chrono::milliseconds(50));
+        builder->stop();
+        CHECK(builder->attempts == 3);
+    }
+    CHECK(!store.indexBuildsPending());
+    CHECK(store.indexBuildProgress("sentence"_sl) == 1.0);
+
+    Retained<Query> query{ store.compileQuery(json5(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'], WHAT: [['._id']]}]")) };
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 5);
+    e = nullptr;
+    query = nullptr;
+
+    REQUIRE(c4db_delete(db, &error));
+    c4db_release(db);
+}
+
+
 TEST_CASE_METHOD(FTSTest, "Query Full-Text Stop-words", "[Query][FTS]") {
     // Check that English stop-words like "the" and "is" are being ignored by FTS.
     createIndex({"en", true});
@@ -215,6 +298,125 @@ TEST_CASE_METHOD(FTSTest, "Query Full-Text Partial Index", "[Query][FTS]") {
 }
 
 
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Update", "[Query][FTS]") {
+    createIndex({"english", true});
+    const char *queryStr = "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                                        ORDER_BY: [['DESC', ['rank()', 'sentence']]],\
+                                            WHAT: [['.sentence']]}]";
+
+    // Change a property that isn't indexed; the doc must still be found:
+    {
+        Transaction t(store->dataFile());
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("sentence");
+        enc.writeString(kStrings[4]);
+        enc.writeKey("read");
+        enc.writeBool(true);
+        enc.endDictionary();
+        store->set("rec-004"_sl, enc.finish(), t);
+        t.commit();
+    }
+    testQuery(queryStr, {1, 2, 0, 4}, {3, 3, 1, 1});
+
+    // Change the indexed text; the old words must no longer match:
+    {
+        Transaction t(store->dataFile());
+        createDoc(t, 4, "Nothing to look for here");
+        createDoc(t, 3, "Search me");
+        t.commit();
+    }
+    Retained<Query> query{ store->compileQuery(json5(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'], ORDER_BY: [['._id']], WHAT: [['._id']]}]")) };
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    vector<string> docIDs;
+    while (e->next())
+        docIDs.push_back(string(e->columns()[0]->asString()));
+    CHECK(docIDs == (vector<string>{"rec-000", "rec-001", "rec-002", "rec-003"}));
+}
+
+
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Background Build", "[Query][FTS]") {
+    IndexSpec::Options options {"english", true};
+    options.background = true;
+    createIndex(options);
+    CHECK(store->indexBuildsPending());
+    CHECK(store->indexBuildProgress("sentence"_sl) == 0.0);
+
+    // The index can't be used until it's complete:
+    const char *queryStr = "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                                        ORDER_BY: [['._id']], WHAT: [['._id']]}]";
+    ExpectException(error::LiteCore, error::NoSuchIndex, [&]{
+        Retained<Query> query{ store->compileQuery(json5(queryStr)) };
+    });
+
+    // Update a doc in place before the build reaches it; the trigger indexes it, so the
+    // build has to skip it:
+    {
+        Transaction t(store->dataFile());
+        fleece::impl::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("sentence");
+        enc.writeString("Search, search");
+        enc.endDictionary();
+        sequence_t seq = store->get("rec-001"_sl).sequence();
+        CHECK(store->set("rec-001"_sl, enc.finish(), t, &seq) > 0);
+        t.commit();
+    }
+
+    int chunks = 0;
+    for (bool more = true; more; ++chunks) {
+        Transaction t(store->dataFile());
+        more = store->continueIndexBuilds(2);
+        t.commit();
+        CHECK(store->indexBuildProgress("sentence"_sl) <= 1.0);
+    }
+    CHECK(chunks == 3);
+    CHECK(!store->indexBuildsPending());
+    CHECK(store->indexBuildProgress("sentence"_sl) == 1.0);
+
+    Retained<Query> query{ store->compileQuery(json5(queryStr)) };
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    vector<string> docIDs;
+    while (e->next())
+        docIDs.push_back(string(e->columns()[0]->asString()));
+    CHECK(docIDs == (vector<string>{"rec-000", "rec-001", "rec-002", "rec-004"}));
+}
+
+
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Update Performance", "[Query][FTS][Perf][.]") {
+    static constexpr int kNumDocs = 10000;
+    string text;
+    for (int i = 0; i < 20; i++)
+        text += kStrings[i % 5], text += ' ';
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < kNumDocs; i++)
+            createDoc(t, i, text);
+        t.commit();
+    }
+    createIndex({"english", true});
+
+    // Update only a non-indexed property, which shouldn't require re-tokenizing the text:
+    Stopwatch st;
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < kNumDocs; i++) {
+            fleece::impl::Encoder enc;
+            enc.beginDictionary();
+            enc.writeKey("sentence");
+            enc.writeString(text);
+            enc.writeKey("read");
+            enc.writeBool(true);
+            enc.endDictionary();
+            store->set(slice(stringWithFormat("rec-%03d", i)), enc.finish(), t);
+        }
+        t.commit();
+    }
+    st.printReport("Updating non-indexed property", kNumDocs, "doc");
+}
+
+
 TEST_CASE_METHOD(FTSTest, "Test with array values", "[FTS][Query]") {
     // Tests fix for <https://issues.couchbase.com/browse/CBL-218>
 
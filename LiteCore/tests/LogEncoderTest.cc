@@ -24,6 +24,7 @@
 #include <regex>
 #include <sstream>
 #include <fstream>
+#include <thread>
 
 #define DATESTAMP "\\w+, \\d{2}/\\d{2}/\\d{2}"
 #define TIMESTAMP "\\d{2}:\\d{2}:\\d{2}\\.\\d{6}\\| "
@@ -292,3 +293,97 @@ TEST_CASE("Logging plaintext", "[Log]") {
     CHECK(lines[1].find("This will be in plaintext") != string::npos);
 }
 
+
+
+static void logCaptured(LogEncoder &logger, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    string captured;
+    LogEncoder::captureArgs(captured, format, args);
+    va_end(args);
+    logger.logCaptured(LogEncoder::clock::now(), nullptr, map<unsigned, string>(),
+                       LogEncoder::None, format, format, slice(captured));
+}
+
+
+TEST_CASE("LogEncoder captured args", "[Log]") {
+    stringstream out;
+    {
+        LogEncoder logger(out, LogLevel::Info);
+        string token = "Tweedledum";
+        slice buf("hello");
+        logCaptured(logger, "Int %d, Unsigned %u, Size %zx, Double %.1f", -1234567890, 42u,
+                    size_t(0xabcdabcd), 2.5);
+        logCaptured(logger, "Token %-s, slice is '%.*s' (hex %-.*s)",
+                    token.c_str(), SPLAT(buf), SPLAT(buf));
+        token = "Tweedledee";   // the captured token string must not depend on this
+        logCaptured(logger, "Token %-s again", "Tweedledum");
+    }
+    string result = dumpLog(out.str(), {});
+    regex expected(TIMESTAMP "---- Logging begins on " DATESTAMP " ----\\n"
+                   TIMESTAMP "Int -1234567890, Unsigned 42, Size abcdabcd, Double 2.5\\n"
+                   TIMESTAMP "Token Tweedledum, slice is 'hello' \\(hex 68656c6c6f\\)\\n"
+                   TIMESTAMP "Token Tweedledum again\\n");
+    CHECK(regex_match(result, expected));
+}
+
+
+TEST_CASE("Logging from multiple threads", "[Log]") {
+    static constexpr int kNumThreads = 4, kMessagesPerThread = 500;
+    char folderName[64];
+    sprintf(folderName, "Log_Threads_%lld/", chrono::milliseconds(time(nullptr)).count());
+    FilePath tmpLogDir = FilePath::tempDirectory()[folderName];
+    tmpLogDir.delRecursive();
+    tmpLogDir.mkdir();
+
+    LogFileOptions fileOptions { tmpLogDir.canonicalPath(), LogLevel::Verbose, 1024*1024, 1, false };
+    LogDomain::writeEncodedLogsTo(fileOptions, "Hello");
+    auto oldLevel = DBLog.level();
+    DBLog.setLevel(LogLevel::Verbose);
+    auto droppedBefore = LogDomain::droppedMessageCount();
+    vector<thread> threads;
+    for (int t = 0; t < kNumThreads; ++t) {
+        threads.emplace_back([=] {
+            for (int i = 0; i < kMessagesPerThread; ++i) {
+                // The format string is overwritten right away; the buffered message must have
+                // kept its own copy:
+                string format = "Thread %d message %d";
+                LogVerbose(DBLog, format.c_str(), t, i);
+                format.replace(0, 6, "XXXXXX");
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    auto dropped = LogDomain::droppedMessageCount() - droppedBefore;
+    DBLog.setLevel(oldLevel);
+
+    // Switching to another directory flushes the buffered messages to the files:
+    FilePath other = FilePath::tempDirectory()[string(folderName) + "2/"];
+    other.delRecursive();
+    other.mkdir();
+    LogFileOptions fileOptions2 { other.canonicalPath(), LogLevel::Verbose, 1024*1024, 1, false };
+    LogDomain::writeEncodedLogsTo(fileOptions2, "Hello");
+
+    vector<string> verboseFiles;
+    tmpLogDir.forEachFile([&](const FilePath f) {
+        if (f.path().find("verbose") != string::npos)
+            verboseFiles.push_back(f.path());
+    });
+    REQUIRE(verboseFiles.size() == 1);
+
+    ifstream fin(verboseFiles[0], ios::binary);
+    LogDecoder decoder(fin);
+    int count = 0;
+    int lastMessage[kNumThreads] = {-1, -1, -1, -1};
+    while (decoder.next()) {
+        string message = decoder.readMessage();
+        int t, i;
+        if (sscanf(message.c_str(), "Thread %d message %d", &t, &i) != 2)
+            continue;
+        CHECK(i > lastMessage[t]);          // each thread's messages are in order
+        lastMessage[t] = i;
+        ++count;
+    }
+    CHECK(count + dropped == kNumThreads * kMessagesPerThread);
+}
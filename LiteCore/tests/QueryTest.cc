@@ -146,6 +146,73 @@ TEST_CASE_METHOD(QueryTest, "Partial Index with NOT MISSING", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query translation cache", "[Query]") {
+    addNumberedDocs(1, 10);
+    QueryCache &cache = ((SQLiteDataFile&)store->dataFile()).queryCache();
+    string json = json5("['SELECT', {WHAT: ['.num'], WHERE: ['>', ['.num'], 5]}]");
+
+    auto stats0 = cache.stats();
+    CHECK(rowsInQuery(json) == 5);
+    auto stats1 = cache.stats();
+    CHECK(stats1.misses == stats0.misses + 1);
+    CHECK(stats1.hits == stats0.hits);
+
+    // Same query again is a cache hit:
+    CHECK(rowsInQuery(json) == 5);
+    auto stats2 = cache.stats();
+    CHECK(stats2.misses == stats1.misses);
+    CHECK(stats2.hits == stats1.hits + 1);
+
+    // Incremental mode and other query languages are cached separately:
+    Retained<Query> query = store->compileQuery(json, QueryLanguage::kJSON, true);
+    CHECK(cache.stats().misses == stats2.misses + 1);
+
+    // Creating an index changes the schema, which invalidates the cache:
+    store->createIndex("num"_sl, "[[\".num\"]]"_sl);
+    CHECK(rowsInQuery(json) == 5);
+    auto stats3 = cache.stats();
+    CHECK(stats3.misses == stats2.misses + 2);
+    CHECK(stats3.count == 1);
+
+    // Aborting a transaction reverts the schema version, so translations made during it
+    // (and any others) are discarded:
+    {
+        Transaction t(store->dataFile());
+        CHECK(rowsInQuery(json) == 5);
+        CHECK(cache.stats().count == 1);
+        t.abort();
+    }
+    CHECK(cache.stats().count == 0);
+    CHECK(rowsInQuery(json) == 5);
+    CHECK(cache.stats().misses == stats3.misses + 1);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query results after rollback", "[Query]") {
+    // Result columns cache the bodies they decode by sequence, and an aborted transaction makes
+    // its sequences available again, so the cache mustn't outlive it:
+    Retained<Query> query{ store->compileQuery(json5("{WHAT: ['.num', '.type']}")) };
+    auto firstNum = [&] {
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        REQUIRE(e->next());
+        return e->columns()[0]->asInt();
+    };
+    {
+        Transaction t(store->dataFile());
+        REQUIRE(writeNumberedDoc(1, nullslice, t) == 1);
+        CHECK(firstNum() == 1);
+        CHECK(firstNum() == 1);
+        t.abort();
+    }
+    {
+        Transaction t(store->dataFile());
+        REQUIRE(writeNumberedDoc(2, nullslice, t) == 1);    // same sequence, same body size
+        CHECK(firstNum() == 2);
+        t.commit();
+    }
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query SELECT", "[Query]") {
     addNumberedDocs();
     // Use a (SQL) query based on the Fleece "num" property:
@@ -322,6 +389,132 @@ TEST_CASE_METHOD(QueryTest, "Query refresh", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query incremental refresh", "[Query]") {
+    addNumberedDocs();
+    Retained<Query> query{ store->compileQuery(json5(
+                     "{WHAT: ['.num', ['*', ['.num'], ['.num']]], WHERE: ['>', ['.num'], 10]}"),
+                     QueryLanguage::kJSON, true) };
+    CHECK(query->columnCount() == 2);
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 90);
+    REQUIRE(e->next());
+    CHECK(e->columns().count() == 2);
+    CHECK(e->columns()[0]->asInt() == 11);
+    CHECK(e->missingColumns() == 0);
+
+    // Add a doc that doesn't alter the query:
+    {
+        Transaction t(db);
+        writeNumberedDoc(-1, nullslice, t);
+        t.commit();
+    }
+    CHECK(e->refresh(query) == nullptr);
+    CHECK(e->lastSequence() == 101);
+
+    // Change, delete and add docs that are in the results:
+    {
+        Transaction t(db);
+        writeDoc("rec-020"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("num");
+            enc.writeInt(2000);
+        });
+        store->set("rec-030"_sl, "2-ffff"_sl, nullslice, DocumentFlags::kDeleted, t);
+        writeNumberedDoc(500, nullslice, t);
+        t.commit();
+    }
+    Retained<QueryEnumerator> e2(e->refresh(query));
+    REQUIRE(e2 != nullptr);
+    CHECK(e2->getRowCount() == 90);
+    set<int64_t> nums;
+    while (e2->next()) {
+        CHECK(e2->columns().count() == 2);
+        int64_t num = e2->columns()[0]->asInt();
+        CHECK(e2->columns()[1]->asInt() == num * num);
+        nums.insert(num);
+    }
+    CHECK(nums.count(20) == 0);
+    CHECK(nums.count(2000) == 1);
+    CHECK(nums.count(30) == 0);
+    CHECK(nums.count(500) == 1);
+
+    // Results must match a full run:
+    Retained<Query> fullQuery{ store->compileQuery(json5(
+                     "{WHAT: ['.num', ['*', ['.num'], ['.num']]], WHERE: ['>', ['.num'], 10]}")) };
+    Retained<QueryEnumerator> full(fullQuery->createEnumerator());
+    set<int64_t> fullNums;
+    while (full->next())
+        fullNums.insert(full->columns()[0]->asInt());
+    CHECK(nums == fullNums);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query streaming", "[Query]") {
+    addNumberedDocs();
+    Retained<Query> query{ store->compileQuery(json5(
+                     "{WHAT: ['.num', ['*', ['.num'], ['.num']]], WHERE: ['>', ['.num'], 10]}")) };
+    Query::Options options(alloc_slice(), 0, 0, true);
+
+    SECTION("Sequential") {
+        int num = 11;
+        Retained<QueryEnumerator> e(query->createEnumerator(&options));
+        while (e->next()) {
+            auto cols = e->columns();
+            REQUIRE(cols.count() == 2);
+            CHECK(cols[0]->asInt() == num);
+            CHECK(cols[1]->asInt() == num * num);
+            ++num;
+        }
+        CHECK(num == 101);
+        CHECK(!e->next());
+        // Transaction was released at the end, so writing is allowed again:
+        Transaction t(db);
+        writeNumberedDoc(101, nullslice, t);
+        t.commit();
+    }
+
+    SECTION("Transaction while streaming") {
+        Retained<QueryEnumerator> e(query->createEnumerator(&options));
+        REQUIRE(e->next());
+        // The enumerator's read transaction can't be upgraded, so beginning one fails cleanly:
+        ExpectException(error::LiteCore, error::Busy, [&]{
+            Transaction t(db);
+        });
+        REQUIRE(e->next());
+        CHECK(e->columns()[0]->asInt() == 12);
+        // Once the enumerator is freed, writing is allowed again (which also shows the failed
+        // Transaction didn't leave its scope behind):
+        e = nullptr;
+        Transaction t(db);
+        writeNumberedDoc(101, nullslice, t);
+        t.commit();
+    }
+
+    SECTION("Interleaved with recorded enumerator") {
+        Retained<QueryEnumerator> e(query->createEnumerator(&options));
+        REQUIRE(e->next());
+        Retained<QueryEnumerator> e2(query->createEnumerator());
+        CHECK(e2->getRowCount() == 90);
+        REQUIRE(e->next());
+        CHECK(e->columns()[0]->asInt() == 12);
+    }
+
+    SECTION("Fall back to recorded") {
+        Retained<QueryEnumerator> e(query->createEnumerator(&options));
+        for (int i = 0; i < 5; ++i)
+            REQUIRE(e->next());
+        CHECK(e->columns()[0]->asInt() == 15);
+        CHECK(e->getRowCount() == 90);
+        // Position is preserved:
+        CHECK(e->columns()[0]->asInt() == 15);
+        REQUIRE(e->next());
+        CHECK(e->columns()[0]->asInt() == 16);
+        e->seek(50);
+        CHECK(e->columns()[0]->asInt() == 61);
+        CHECK(e->refresh(query) == nullptr);
+    }
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query boolean", "[Query]") {
     {
         Transaction t(store->dataFile());
@@ -658,6 +851,64 @@ TEST_CASE_METHOD(QueryTest, "Query regex", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query regex performance", "[Query][Perf][.]") {
+    static constexpr int kNumDocs = 100000;
+    {
+        Transaction t(store->dataFile());
+        for (int i = 1; i <= kNumDocs; i++)
+            writeNumberedDoc(i, slice(numberString(i)), t);
+        t.commit();
+    }
+    // The last pattern has a backreference, so it can't use DFARegex and falls back to std::regex.
+    // (Its backslash is escaped for JSON.)
+    for (const char *pattern : {"^nine.*", "one-(two|three)-", "[a-z]+-z[a-z]+$", "([a-z]+)-\\\\1-"}) {
+        Retained<Query> query{ store->compileQuery(json5(stringWithFormat(
+            "{'WHAT': ['._id'], WHERE: ['REGEXP_LIKE()', ['.str'], '%s']}", pattern))) };
+        Stopwatch st;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        uint64_t n = e->getRowCount();
+        st.printReport(stringWithFormat("REGEXP_LIKE '%s' (%llu matches)",
+                                        pattern, (unsigned long long)n).c_str(),
+                       kNumDocs, "doc");
+        CHECK(n > 0);
+    }
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query wide projection performance", "[Query][Perf][.]") {
+    static constexpr int kNumDocs = 100000;
+    {
+        Transaction t(store->dataFile());
+        for (int i = 1; i <= kNumDocs; i++) {
+            writeDoc(slice(stringWithFormat("rec-%06d", i)), DocumentFlags::kNone, t, [=](Encoder &enc) {
+                enc.writeKey("num");    enc.writeInt(i);
+                enc.writeKey("str");    enc.writeString(numberString(i));
+                enc.writeKey("even");   enc.writeBool(i % 2 == 0);
+                enc.writeKey("half");   enc.writeDouble(i / 2.0);
+                enc.writeKey("type");   enc.writeString("number");
+                enc.writeKey("digits"); enc.writeInt(int(numberString(i).size()));
+                enc.writeKey("mod7");   enc.writeInt(i % 7);
+                enc.writeKey("neg");    enc.writeInt(-i);
+            });
+        }
+        t.commit();
+    }
+    // Each property in the WHAT clause is a separate fl_value call on the same row's body:
+    for (const char *what : {"['.num']",
+                             "['.num', '.str', '.even', '.half', '.type', '.digits', '.mod7', '.neg']"}) {
+        Retained<Query> query{ store->compileQuery(json5(stringWithFormat(
+            "{'WHAT': %s, 'WHERE': ['>', ['.num'], 0]}", what))) };
+        Stopwatch st;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        int n = 0;
+        while (e->next())
+            ++n;
+        st.printReport(stringWithFormat("Query selecting %s", what).c_str(), n, "row");
+        CHECK(n == kNumDocs);
+    }
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query type check", "[Query]") {
     {
         Transaction t(store->dataFile());
@@ -1298,6 +1549,35 @@ protected:
         Log("-------- Un-deleting a doc --------");
         undeleteDoc("rec-090"_sl);
         checkQuery(88, 3);
+
+        Log("-------- Updating a doc but not its array --------");
+        {
+            Transaction t(store->dataFile());
+            writeDoc("rec-090"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+                enc.writeKey("numbers");
+                enc.beginArray();
+                for (int j = 85; j <= 90; j++)
+                    enc.writeString(numberString(j));
+                enc.endArray();
+                enc.writeKey("type");
+                enc.writeString("modified");
+            });
+            t.commit();
+        }
+        checkQuery(88, 3);
+
+        Log("-------- Updating a doc's array --------");
+        {
+            Transaction t(store->dataFile());
+            writeDoc("rec-090"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+                enc.writeKey("numbers");
+                enc.beginArray();
+                enc.writeString(numberString(1));
+                enc.endArray();
+            });
+            t.commit();
+        }
+        checkQuery(88, 2);
     }
 };
 
@@ -1440,6 +1720,31 @@ TEST_CASE_METHOD(QueryTest, "Query deleted docs", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query expiration on read-only connection", "[Query]") {
+    addNumberedDocs(1, 3);
+    auto options = db->options();
+    options.create = false;
+    options.writeable = false;
+    options.upgradeable = false;
+    unique_ptr<DataFile> reader(newDatabase(db->filePath(), &options));
+    string queryJSON = json5("{WHAT: ['._id', '._expiration'], ORDER_BY: [['._id']]}");
+
+    // The reader can't add the expiration column itself:
+    ExpectException(error::LiteCore, error::NotWriteable, [&]{
+        Retained<Query> query{ reader->defaultKeyStore().compileQuery(queryJSON) };
+    });
+
+    // Once the writeable connection has compiled the query, adding the column, the reader can:
+    Retained<Query> mainQuery{ store->compileQuery(queryJSON) };
+    Retained<Query> query{ reader->defaultKeyStore().compileQuery(queryJSON) };
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 3);
+    e = nullptr;
+    query = nullptr;
+    reader.reset();
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query expiration", "[Query]") {
     addNumberedDocs(1, 3);
     expiration_t now = KeyStore::now();
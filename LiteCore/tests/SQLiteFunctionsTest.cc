@@ -20,9 +20,12 @@
 #include "SQLite_Internal.hh"
 #include "StringUtil.hh"
 #include "UnicodeCollator.hh"
+#include "DFARegex.hh"
 #include "FleeceImpl.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
+#include "Stopwatch.hh"
 #include <sqlite3.h>
+#include <regex>
 
 using namespace litecore;
 using namespace fleece;
@@ -36,29 +39,46 @@ using namespace std;
 class SQLiteFunctionsTest : DataFile::Delegate {
 public:
 
-    static constexpr int numberOfOptions = 2;
+    static constexpr int numberOfOptions = 4;
+
+    // The version ID that records start with, when `withVersionIDs` is set. Every record gets
+    // the same one, so only their sequences tell them apart.
+    static constexpr slice kVersionID = "1-abcdef"_sl;
 
     SQLiteFunctionsTest(int which)
     :db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE)
+    ,withVersionIDs((which & 2) != 0)
     {
         // Run test once with shared keys, once without:
         if (which & 1)
             sharedKeys = new SharedKeys();
+        // ...and once with records that start with a version ID, like a rev tree's revision
+        // header, once without:
         RegisterSQLiteFunctions(db.getHandle(), {this, sharedKeys});
-        db.exec("CREATE TABLE kv (key TEXT, body BLOB)");
-        insertStmt = make_unique<SQLite::Statement>(db, "INSERT INTO kv (key, body) VALUES (?, ?)");
+        db.exec("CREATE TABLE kv (key TEXT, sequence INTEGER, body BLOB)");
+        insertStmt = make_unique<SQLite::Statement>(db,
+                                "INSERT INTO kv (key, sequence, body) VALUES (?, ?, ?)");
     }
 
     void insert(const char *key, const char *json) {
-        auto body = JSONConverter::convertJSON(slice(json5(json)), sharedKeys);
+        alloc_slice body = JSONConverter::convertJSON(slice(json5(json)), sharedKeys);
+        if (withVersionIDs) {
+            alloc_slice record(kVersionID.size + body.size);
+            memcpy((void*)record.buf, kVersionID.buf, kVersionID.size);
+            memcpy((void*)offsetby(record.buf, kVersionID.size), body.buf, body.size);
+            body = record;
+        }
         fleeceAccessor(body); // 'encode' the data in the database to test the accessor function
         insertStmt->bind(1, key);
-        insertStmt->bind(2, body.buf, (int)body.size);
+        insertStmt->bind(2, (long long)++lastSequence);
+        insertStmt->bind(3, body.buf, (int)body.size);
         insertStmt->exec();
         insertStmt->reset();
     }
 
     virtual slice fleeceAccessor(slice s) const override {
+        if (withVersionIDs)
+            s.moveStart(kVersionID.size);
         uint8_t* bytes = (uint8_t*)s.buf;
         for (size_t i = 0; i < s.size; ++i)
             bytes[i] ^= 0xFF;
@@ -103,6 +123,8 @@ protected:
     SQLite::Database db;
     unique_ptr<SQLite::Statement> insertStmt;
     Retained<SharedKeys> sharedKeys;
+    const bool withVersionIDs;
+    uint64_t lastSequence {0};
 };
 
 
@@ -123,6 +145,76 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_contains", "[Query]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_value of consecutive rows", "[Query]") {
+    // Given the row's sequence, fl_value caches each row's body across the calls made on it;
+    // make sure a row whose body is the same size as (or identical to) the previous one's, and
+    // whose version ID is the same, gets the right values.
+    insert("a", "{\"x\": \"one\", \"y\": 1}");
+    insert("b", "{\"x\": \"two\", \"y\": 2}");
+    insert("c", "{\"x\": \"two\", \"y\": 2}");
+    insert("d", "{\"x\": \"three\", \"y\": 3, \"z\": [1, 2]}");
+    insert("e", "{\"x\": \"one\", \"y\": 1}");
+    insert("f", "{\"x\": \"six\", \"y\": 6}");
+
+    const vector<string> expected {"one/1/-", "two/2/-", "two/2/-", "three/3/2", "one/1/-", "six/6/-"};
+    for (const char *seq : {"", ", sequence"}) {
+        // (The cache outlives the statement, so run each query twice.)
+        for (int pass = 0; pass < 2; ++pass) {
+            CHECK(query(stringWithFormat("SELECT fl_value(body, 'x'%s) || '/' "
+                                         "|| fl_value(body, 'y'%s) || '/' "
+                                         "|| ifnull(fl_count(body, 'z'), '-') FROM kv",
+                                         seq, seq)) == expected);
+        }
+    }
+
+    // A join alternates between two rows' bodies:
+    CHECK(query("SELECT fl_value(a.body, 'x', a.sequence) || '+' || fl_value(b.body, 'x', b.sequence) "
+                "|| '/' || fl_value(a.body, 'y', a.sequence) || '+' || fl_value(b.body, 'y', b.sequence) "
+                "FROM kv AS a JOIN kv AS b ON b.key = 'd' WHERE a.key < 'c' ORDER BY a.key")
+            == (vector<string>{"one+three/1+3", "two+three/2+3"}));
+
+    // A row whose body changes gets a new sequence:
+    db.exec("UPDATE kv SET sequence = 7, body = (SELECT body FROM kv WHERE key = 'f') WHERE key = 'b'");
+    CHECK(query("SELECT fl_value(body, 'x', sequence) || '/' || fl_value(body, 'y', sequence) "
+                "FROM kv WHERE key < 'c'")
+            == (vector<string>{"one/1", "six/6"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_value projection performance", "[Query][Perf][.]") {
+    // Given the sequence, the fl_value calls on a row share the QueryDocCache's decoded body;
+    // without, each call sets up its own Scope, as they all did before the cache existed.
+    static constexpr int kNumRows = 100000;
+    db.exec("BEGIN");
+    for (int i = 1; i <= kNumRows; ++i) {
+        insert(stringWithFormat("rec-%06d", i).c_str(),
+               stringWithFormat("{num: %d, str: 'n%d', even: %s, half: %g, type: 'number', "
+                                "mod7: %d, neg: %d, pad: '%s'}",
+                                i, i, (i % 2 ? "false" : "true"), i / 2.0, i % 7, -i,
+                                string(200, 'x').c_str()).c_str());
+    }
+    db.exec("COMMIT");
+
+    for (const char *seq : {"", ", sequence"}) {
+        for (const char *format : {"SELECT fl_value(body, 'num'%s) FROM kv",
+                                   "SELECT fl_value(body, 'num'%s), fl_value(body, 'str'%s), "
+                                          "fl_value(body, 'even'%s), fl_value(body, 'half'%s), "
+                                          "fl_value(body, 'type'%s), fl_value(body, 'mod7'%s), "
+                                          "fl_value(body, 'neg'%s), fl_value(body, 'pad'%s) FROM kv"}) {
+            string sql = stringWithFormat(format, seq, seq, seq, seq, seq, seq, seq, seq);
+            SQLite::Statement stmt(db, sql);
+            fleece::Stopwatch st;
+            int n = 0;
+            while (stmt.executeStep())
+                ++n;
+            st.printReport(stringWithFormat("%s: %s", (*seq ? "Cached" : "Uncached"),
+                                            sql.c_str()).c_str(), n, "row");
+            CHECK(n == kNumRows);
+        }
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite array_sum of fl_value", "[Query]") {
     insert("a",   "{\"hey\": [1, 2, 3, 4]}");
     insert("b",   "{\"hey\": [2, 4, 6, 8]}");
@@ -364,6 +456,61 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL string functions", "[Query]")
 }
 
 
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL regexp functions", "[Query]") {
+    insert("a", "{\"s\": \"foobar\"}");
+    insert("b", "{\"s\": \"barfoo\"}");
+    insert("c", "{\"s\": \"bar bar\"}");
+
+    // The pattern is compiled once per statement, and reused for every row:
+    CHECK(query("SELECT regexp_like(fl_value(body, 's'), '^foo.*') FROM kv")
+          == (vector<string>{"1", "0", "0"}));
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), 'o+') FROM kv")
+          == (vector<string>{"1", "4", "-1"}));
+    CHECK(query("SELECT regexp_replace(fl_value(body, 's'), 'b(a)r', '<$1>') FROM kv")
+          == (vector<string>{"foo<a>", "<a>foo", "<a> <a>"}));
+    // A backreference isn't supported by DFARegex, so std::regex is used:
+    CHECK(query("SELECT regexp_like(fl_value(body, 's'), '(bar) \\1') FROM kv")
+          == (vector<string>{"0", "0", "1"}));
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), '\\bfoo') FROM kv")
+          == (vector<string>{"0", "-1", "-1"}));
+    // Invalid pattern:
+    CHECK_THROWS_AS(query("SELECT regexp_like(fl_value(body, 's'), 'a(') FROM kv"),
+                    SQLite::Exception);
+}
+
+
+TEST_CASE("DFARegex", "[Query]") {
+    const char* kPatterns[] = {
+        "", "abc", "a.c", "^foo.*", "foo$", "^foo$", "^$", "$", "x*", "(ab|cd)+e", "[a-c]+d",
+        "[^abc]", "\\d{2,3}", "\\w+@\\w+\\.com", "colou?r", "a{3}", "a{2,}", "(a|b)*abb",
+        "\\s+value", ".*? value", "(?:ab)+", "[-a]", "[\\d.]+", "\\D\\W\\S", "abcd|c",
+        "a+?b", "(a*)*b", "^(a|b)c$", "\\x41", "(a|b)*a(a|b){6}",
+    };
+    const char* kStrings[] = {
+        "", "abc", "xabcx", "foo", "foobar", "barfoo", "colour", "color", "aaa", "ab", "ababb",
+        "abcde", "cde", "1234", "me@x.com", "cool value", "a.1 x", "A", "bbabababab", "a\nb",
+    };
+    for (const char *pattern : kPatterns) {
+        INFO("Pattern is " << pattern);
+        auto dfa = DFARegex::compile(slice(pattern));
+        REQUIRE(dfa);
+        regex re(pattern, regex_constants::ECMAScript);
+        for (const char *str : kStrings) {
+            INFO("String is " << str);
+            cmatch match;
+            bool found = regex_search(str, match, re);
+            CHECK(dfa->search(slice(str)) == found);
+            CHECK(dfa->position(slice(str)) == (found ? match.prefix().length() : -1));
+        }
+    }
+
+    for (const char *pattern : {"\\bfoo", "(a)\\1", "(?=a)", "a|^b", "a$b", "[[:alpha:]]", "a**", "a("}) {
+        INFO("Pattern is " << pattern);
+        CHECK(DFARegex::compile(slice(pattern)) == nullptr);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_blob", "[Query]") {
     insert("1",   "{attachment: {digest: 'sha1-foobar', content_type: 'text/plain'}}");
     insert("2",   "{attachment: {digest: 'sha1-bazz'}}");
@@ -0,0 +1,134 @@
+//
+// SecureDigestTest.cc
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "LiteCoreTest.hh"
+#include "SecureDigest.hh"
+#include "Stopwatch.hh"
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace litecore;
+
+
+// Calls `fn` with the CPU's SHA instructions enabled (if it has any), then again without.
+static void withEachImplementation(function<void()> fn) {
+    for (bool hardware : {true, false}) {
+        EnableDigestHardware(hardware);
+        INFO("Using hardware: " << DigestUsesHardware());
+        fn();
+    }
+    EnableDigestHardware(true);
+}
+
+
+static vector<uint8_t> testData(size_t size) {
+    vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i)
+        data[i] = uint8_t(i * 7 + (i >> 8));
+    return data;
+}
+
+
+TEST_CASE("SHA-1 known digests", "[Crypto]") {
+    withEachImplementation([] {
+        CHECK(slice(SHA1(""_sl)).hexString() == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+        CHECK(slice(SHA1("abc"_sl)).hexString() == "a9993e364706816aba3e25717850c26c9cd0d89d");
+        CHECK(slice(SHA1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"_sl)).hexString()
+              == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+        SHA1Builder builder;
+        string million(1000000, 'a');
+        builder << slice(million);
+        CHECK(slice(builder.finish()).hexString() == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    });
+}
+
+
+TEST_CASE("SHA-256 known digests", "[Crypto]") {
+    withEachImplementation([] {
+        CHECK(slice(SHA256(""_sl)).hexString()
+              == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        CHECK(slice(SHA256("abc"_sl)).hexString()
+              == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        CHECK(slice(SHA256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"_sl)).hexString()
+              == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+        SHA256Builder builder;
+        string million(1000000, 'a');
+        builder << slice(million);
+        CHECK(slice(builder.finish()).hexString()
+              == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    });
+}
+
+
+TEST_CASE("SHA digests of incremental input", "[Crypto]") {
+    // Every length around the padding boundaries, fed in pieces of various sizes, must match
+    // the one-shot digest computed without hardware:
+    auto data = testData(300);
+    for (size_t size = 0; size <= data.size(); ++size) {
+        slice input(data.data(), size);
+        EnableDigestHardware(false);
+        SHA1 expected1(input);
+        SHA256 expected256(input);
+        EnableDigestHardware(true);
+        CHECK(SHA1(input) == expected1);
+        CHECK(SHA256(input) == expected256);
+
+        for (size_t chunk : {1, 3, 63, 64, 65}) {
+            SHA1Builder builder1;
+            SHA256Builder builder256;
+            for (size_t pos = 0; pos < size; pos += chunk) {
+                slice piece(&data[pos], min(chunk, size - pos));
+                builder1 << piece;
+                builder256 << piece;
+            }
+            INFO("size=" << size << ", chunk=" << chunk);
+            CHECK(builder1.finish() == expected1);
+            CHECK(builder256.finish() == expected256);
+        }
+    }
+}
+
+
+TEST_CASE("SHA digest performance", "[Crypto][Perf][.]") {
+    fprintf(stderr, "Digests use CPU SHA instructions: %s\n", DigestUsesHardware() ? "yes" : "no");
+    for (size_t size : {size_t(1024), size_t(64 * 1024), size_t(16 * 1024 * 1024)}) {
+        auto data = testData(size);
+        slice input(data.data(), size);
+        const size_t totalBytes = 256 * 1024 * 1024;
+        const size_t reps = max(totalBytes / size, size_t(1));
+        for (bool hardware : {true, false}) {
+            EnableDigestHardware(hardware);
+            fleece::Stopwatch st1;
+            for (size_t i = 0; i < reps; ++i)
+                SHA1 digest(input);
+            double sha1Time = st1.elapsed();
+            fleece::Stopwatch st256;
+            for (size_t i = 0; i < reps; ++i)
+                SHA256 digest(input);
+            double sha256Time = st256.elapsed();
+            fprintf(stderr, "%8zu bytes, %s: SHA-1 %7.1f MB/sec, SHA-256 %7.1f MB/sec\n",
+                    size, (hardware ? "hardware" : "portable"),
+                    reps * size / sha1Time / 1e6, reps * size / sha256Time / 1e6);
+        }
+    }
+    EnableDigestHardware(true);
+}
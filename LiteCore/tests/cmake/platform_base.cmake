@@ -7,6 +7,7 @@ function(set_source_files_base)
 
     set(
         ${BASE_SSS_RESULT}
+        ActorTest.cc
         c4BaseTest.cc
         DataFileTest.cc
         DocumentKeysTest.cc
@@ -17,6 +18,7 @@ function(set_source_files_base)
         QueryParserTest.cc
         QueryTest.cc
         RevTreeTest.cc
+        SecureDigestTest.cc
         SequenceTrackerTest.cc
         SQLiteFunctionsTest.cc
         UpgraderTest.cc
@@ -43,8 +43,7 @@ using namespace litecore::websocket;
 
 namespace litecore { namespace blip {
 
-    static const size_t kDefaultFrameSize = 4096;       // Default size of frame
-    static const size_t kBigFrameSize = 16384;          // Max size of frame
+    static const size_t kDefaultFrameSize = 4096;       // Frame size while urgent msgs wait
 
     static const auto kDefaultCompressionLevel = (Deflater::CompressionLevel)6;
 
@@ -111,6 +110,7 @@ namespace litecore { namespace blip {
         Deflater                _outputCodec;
         Inflater                _inputCodec;
         unique_ptr<uint8_t[]>   _frameBuf;
+        FlowControl             _flowControl;
         RequestHandlers         _requestHandlers;
         size_t                  _maxOutboxDepth {0}, _totalOutboxDepth {0}, _countOutboxDepth {0};
         uint64_t                _totalBytesWritten {0}, _totalBytesRead {0};
@@ -163,6 +163,10 @@ namespace litecore { namespace blip {
             return _webSocket;
         }
 
+        FlowControl::Stats flowStats() const {
+            return _flowControl.stats();
+        }
+
         virtual std::string loggingIdentifier() const override {
             return _connection ? _connection->name() : Logging::loggingIdentifier();
         }
@@ -176,6 +180,10 @@ namespace litecore { namespace blip {
                   _numRequestsReceived, _totalBytesRead,
                   _timeOpen.elapsed(),
                   _maxOutboxDepth, _totalOutboxDepth/(double)_countOutboxDepth);
+            auto flow = _flowControl.stats();
+            LogTo(SyncLog, "BLIP flow control: window %u bytes, frames %zu bytes, RTT %.1fms (min %.1fms), delivery rate %.0f KB/sec",
+                  flow.window, flow.frameSize, flow.rtt * 1000, flow.minRTT * 1000,
+                  flow.deliveryRate / 1024);
             logStats();
         }
 
@@ -342,10 +350,10 @@ namespace litecore { namespace blip {
                     // Set up a buffer for the frame contents:
                     size_t maxSize = kDefaultFrameSize;
                     if (msg->urgent() || _outbox.empty() || !_outbox.front()->urgent())
-                        maxSize = kBigFrameSize;
+                        maxSize = _flowControl.frameSize();
 
                     if (!_frameBuf)
-                        _frameBuf.reset(new uint8_t[kMaxVarintLen64 + 1 + 4 + kBigFrameSize]);
+                        _frameBuf.reset(new uint8_t[kMaxVarintLen64 + 1 + 4 + FlowControl::kMaxFrameSize]);
                     slice out(_frameBuf.get(), maxSize);
                     WriteUVarInt(&out, msg->_number);
                     auto flagsPos = (FrameFlags*)out.buf;
@@ -372,7 +380,7 @@ namespace litecore { namespace blip {
                 
                 // Return message to the queue if it has more frames left to send:
                 if (frameFlags & kMoreComing) {
-                    if (msg->needsAck())
+                    if (msg->needsAck(_flowControl.window()))
                         freezeMessage(msg);
                     else
                         requeue(msg);
@@ -506,8 +514,12 @@ namespace litecore { namespace blip {
                 return;
             }
             
-            msg->receivedAck(byteCount);
-            if (frozen && !msg->needsAck())
+            // Let the FlowControl measure the round trip and adapt the window to it:
+            FlowControl::time sentAt;
+            uint32_t bytesAcked = msg->receivedAck(byteCount, sentAt);
+            if (sentAt != FlowControl::time())
+                _flowControl.receivedAck(bytesAcked, sentAt);
+            if (frozen && !msg->needsAck(_flowControl.window()))
                 thawMessage(msg);
         }
 
@@ -717,4 +729,9 @@ namespace litecore { namespace blip {
         return _io->webSocket();
     }
 
+
+    FlowControl::Stats Connection::flowStats() const {
+        return _io->flowStats();
+    }
+
 } }
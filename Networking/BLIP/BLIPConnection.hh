@@ -19,6 +19,7 @@
 #pragma once
 #include "WebSocketInterface.hh"
 #include "Message.hh"
+#include "FlowControl.hh"
 #include "Logging.hh"
 #include <atomic>
 
@@ -84,6 +85,10 @@ namespace litecore { namespace blip {
 
         virtual std::string loggingIdentifier() const override  {return _name;}
 
+        /** The current flow-control window, frame size and round-trip time, which adapt to
+            the network as ACKs arrive. */
+        FlowControl::Stats flowStats() const;
+
         /** Exposed only for testing. */
         websocket::WebSocket* webSocket() const;
 
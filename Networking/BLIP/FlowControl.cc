@@ -0,0 +1,122 @@
+//
+// FlowControl.cc
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "FlowControl.hh"
+#include <algorithm>
+
+using namespace std;
+
+namespace litecore { namespace blip {
+
+    // Weight of a new sample in the smoothed RTT (same as TCP's, RFC 6298):
+    static constexpr double kRTTGain = 0.125;
+
+    // Weight of a new sample in the delivery rate, if it's lower than the current estimate.
+    // (Higher samples are taken as-is, so the window can open up quickly.)
+    static constexpr double kRateGain = 0.25;
+
+    // Shortest interval a delivery-rate sample may cover; below this the timing is too noisy.
+    static constexpr auto kMinRateInterval = chrono::milliseconds(5);
+
+    // How long a minimum RTT is trusted. Expiring it lets a route change be noticed.
+    static constexpr auto kMinRTTLifetime = chrono::seconds(10);
+
+    // When the minimum RTT expires, the window is shrunk for at least this long (and at least
+    // two smoothed RTTs) so the queue drains, and the lowest RTT seen meanwhile replaces it.
+    static constexpr auto kMinProbeRTTTime = chrono::milliseconds(200);
+
+    // The window is this multiple of the bandwidth-delay product, leaving headroom for the
+    // window to grow until it's no longer the bottleneck.
+    static constexpr double kWindowGain = 2.0;
+
+    // A frame should take about this long to transmit at the estimated delivery rate.
+    static constexpr double kFrameTime = 0.002;
+
+
+    static double seconds(FlowControl::clock::duration d) {
+        return chrono::duration<double>(d).count();
+    }
+
+
+    void FlowControl::receivedAck(uint32_t bytesAcked, time sentAt, time now) {
+        double rtt = max(seconds(now - sentAt), 0.0);
+        _srtt = (_srtt > 0) ? _srtt + kRTTGain * (rtt - _srtt) : rtt;
+        if (_minRTT <= 0 || rtt <= _minRTT) {
+            // A new minimum is always believable:
+            _minRTT = rtt;
+            _minRTTStamp = now;
+        }
+
+        if (_probeRTTEnd != time()) {
+            // Probing: remember the lowest RTT seen while the queue drains. (Delivery-rate
+            // samples are skipped, since the small window holds the rate down.)
+            if (_probeMinRTT <= 0 || rtt < _probeMinRTT)
+                _probeMinRTT = rtt;
+            if (now >= _probeRTTEnd) {
+                _minRTT = _probeMinRTT;
+                _minRTTStamp = now;
+                _probeRTTEnd = time();
+                _rateStart = now;
+                _rateBytes = 0;
+            }
+        } else if (now - _minRTTStamp > kMinRTTLifetime) {
+            // The minimum is stale, but the current samples include any queueing delay; adopting
+            // them would inflate the window, which inflates the queue further. So start a probe.
+            auto duration = max(clock::duration(kMinProbeRTTTime),
+                                chrono::duration_cast<clock::duration>(
+                                                        chrono::duration<double>(2 * _srtt)));
+            _probeRTTEnd = now + duration;
+            _probeMinRTT = 0;
+        } else if (_rateStart == time()) {
+            // The first ACK only starts the clock; bytes acked after it are counted over an
+            // interval of at least one round trip:
+            _rateStart = now;
+        } else {
+            _rateBytes += bytesAcked;
+            auto elapsed = now - _rateStart;
+            if (elapsed >= kMinRateInterval && seconds(elapsed) >= _srtt) {
+                double sample = _rateBytes / seconds(elapsed);
+                _rate = (sample > _rate) ? sample : _rate + kRateGain * (sample - _rate);
+                _rateStart = now;
+                _rateBytes = 0;
+            }
+        }
+        update();
+    }
+
+
+    void FlowControl::update() {
+        if (_probeRTTEnd != time()) {
+            _window = kMinWindow;
+        } else if (_rate > 0) {
+            double window = kWindowGain * _rate * _minRTT;
+            _window = (uint32_t)min(max(window, double(kMinWindow)), double(kMaxWindow));
+            double frameSize = _rate * kFrameTime;
+            _frameSize = (size_t)min(max(frameSize, double(kMinFrameSize)), double(kMaxFrameSize));
+        }
+        _pubRTT = _srtt;
+        _pubMinRTT = _minRTT;
+        _pubRate = _rate;
+    }
+
+
+    FlowControl::Stats FlowControl::stats() const {
+        return {window(), frameSize(), _pubRTT, _pubMinRTT, _pubRate};
+    }
+
+} }
@@ -0,0 +1,88 @@
+//
+// FlowControl.hh
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace litecore { namespace blip {
+
+    /** Adapts a BLIP connection's flow control to the link it's running over.
+        Every ACK of an outgoing message gives a round-trip-time sample (the time since the frame
+        it acknowledges was sent) and adds to a delivery-rate sample (bytes acknowledged per
+        second.) From these it estimates the link's bandwidth-delay product, and sizes:
+        - the window, i.e. how many bytes of a message may be in flight without an ACK;
+        - the frame size used when no urgent messages are waiting.
+        Both stay within fixed bounds; the lower bounds are BLIP's traditional fixed values.
+        The minimum RTT is re-measured every 10 seconds, with the window briefly shrunk to its
+        minimum so that queueing delay doesn't get mistaken for link latency.
+
+        Only the connection's I/O actor updates it, but `stats()` may be called on any thread. */
+    class FlowControl {
+    public:
+        using clock = std::chrono::steady_clock;
+        using time = clock::time_point;
+
+        /** Window bounds. The minimum must stay above the peer's ACK threshold (50000 bytes),
+            or a message could stall waiting for an ACK that will never be sent. */
+        static constexpr uint32_t kMinWindow    = 128000;
+        static constexpr uint32_t kMaxWindow    = 8 * 1024 * 1024;
+
+        /** Frame size bounds. (Urgent messages still get interleaved in 4KB frames.) */
+        static constexpr size_t   kMinFrameSize = 16384;
+        static constexpr size_t   kMaxFrameSize = 65536;
+
+        struct Stats {
+            uint32_t window;            ///< Max bytes of a message that may be unacknowledged
+            size_t   frameSize;         ///< Max size of a non-urgent frame
+            double   rtt;               ///< Smoothed round-trip time, in seconds (0 if unknown)
+            double   minRTT;            ///< Minimum recent round-trip time, in seconds
+            double   deliveryRate;      ///< Estimated bytes/sec received by the peer
+        };
+
+        uint32_t window() const         {return _window.load(std::memory_order_relaxed);}
+        size_t frameSize() const        {return _frameSize.load(std::memory_order_relaxed);}
+
+        /** Call when an ACK arrives. `bytesAcked` is the number of bytes it newly acknowledges;
+            `sentAt` is the time the last of those bytes was sent. */
+        void receivedAck(uint32_t bytesAcked, time sentAt, time now =clock::now());
+
+        /** The current estimates. Thread-safe. */
+        Stats stats() const;
+
+    private:
+        void update();
+
+        // Estimator state; only used by the I/O actor:
+        double   _srtt {0}, _minRTT {0};            // Seconds
+        time     _minRTTStamp;                      // When _minRTT was measured
+        time     _probeRTTEnd;                      // End of current min-RTT probe, if any
+        double   _probeMinRTT {0};                  // Lowest RTT seen during the probe
+        time     _rateStart;                        // Start of current delivery-rate sample
+        uint64_t _rateBytes {0};                    // Bytes acked since _rateStart
+        double   _rate {0};                         // Bytes/sec
+
+        // Published values, readable from any thread:
+        std::atomic<uint32_t> _window {kMinWindow};
+        std::atomic<size_t>   _frameSize {kMinFrameSize};
+        std::atomic<double>   _pubRTT {0}, _pubMinRTT {0}, _pubRate {0};
+    };
+
+} }
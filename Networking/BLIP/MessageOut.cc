@@ -94,6 +94,8 @@ namespace litecore { namespace blip {
         if (_contents.hasMoreDataToSend()) {
             outFlags = (FrameFlags)(outFlags | kMoreComing);
             state = MessageProgress::kSending;
+            // Only a frame with more coming can be ACKed, so only those are timed:
+            _unackedFrames.emplace_back(_bytesSent, FlowControl::clock::now());
         } else if (noReply()) {
             state = MessageProgress::kComplete;
         } else {
@@ -103,9 +105,20 @@ namespace litecore { namespace blip {
     }
 
 
-    void MessageOut::receivedAck(uint32_t byteCount) {
-        if (byteCount <= _bytesSent)
-            _unackedBytes = min(_unackedBytes, (uint32_t)(_bytesSent - byteCount));
+    // Returns the number of bytes newly acknowledged, and sets `sentAt` to the time the frame
+    // ending at `byteCount` was sent. (The peer only ACKs at frame boundaries.)
+    uint32_t MessageOut::receivedAck(uint32_t byteCount, FlowControl::time &sentAt) {
+        if (byteCount > _bytesSent || byteCount <= _bytesAcked)
+            return 0;
+        _unackedBytes = min(_unackedBytes, (uint32_t)(_bytesSent - byteCount));
+        uint32_t newlyAcked = byteCount - _bytesAcked;
+        _bytesAcked = byteCount;
+        while (!_unackedFrames.empty() && _unackedFrames.front().first <= byteCount) {
+            if (_unackedFrames.front().first == byteCount)
+                sentAt = _unackedFrames.front().second;
+            _unackedFrames.pop_front();
+        }
+        return newlyAcked;
     }
 
 
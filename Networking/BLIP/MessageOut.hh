@@ -18,6 +18,8 @@
 
 #pragma once
 #include "MessageBuilder.hh"
+#include "FlowControl.hh"
+#include <deque>
 #include <ostream>
 
 namespace litecore { namespace blip {
@@ -47,8 +49,8 @@ namespace litecore { namespace blip {
 
         void dontCompress()                     {_flags = (FrameFlags)(_flags & ~kCompressed);}
         void nextFrameToSend(Codec &codec, slice &dst, FrameFlags &outFlags);
-        void receivedAck(uint32_t byteCount);
-        bool needsAck()                         {return _unackedBytes >= kMaxUnackedBytes;}
+        uint32_t receivedAck(uint32_t byteCount, FlowControl::time &sentAt);
+        bool needsAck(uint32_t window) const    {return _unackedBytes >= window;}
         MessageIn* createResponse();
         void disconnected();
 
@@ -58,8 +60,6 @@ namespace litecore { namespace blip {
         const char* findProperty(const char *propertyName);
 
     private:
-        static const uint32_t kMaxUnackedBytes = 128000;
-
         /** Manages the data (properties, body, data source) of a MessageOut. */
         class Contents {
         public:
@@ -82,6 +82,8 @@ namespace litecore { namespace blip {
         uint32_t _uncompressedBytesSent {0};    // Number of bytes of the data sent so far
         uint32_t _bytesSent {0};                // Number of bytes transmitted (after compression)
         uint32_t _unackedBytes {0};             // Bytes transmitted for which no ack received yet
+        uint32_t _bytesAcked {0};               // Highest byte count acked so far
+        std::deque<std::pair<uint32_t,FlowControl::time>> _unackedFrames; // (_bytesSent, time)
     };
 
 } }
@@ -8,6 +8,7 @@ function(set_source_files_base)
     set(
         ${BASE_SSS_RESULT}
         ${BLIP_LOCATION}/BLIPConnection.cc
+        ${BLIP_LOCATION}/FlowControl.cc
         ${BLIP_LOCATION}/Message.cc
         ${BLIP_LOCATION}/MessageBuilder.cc
         ${BLIP_LOCATION}/MessageOut.cc
@@ -371,6 +371,51 @@ namespace litecore { namespace net {
                     return false;
                 }
             }
+        } else if (headers["Transfer-Encoding"_sl].caseEquivalent("chunked"_sl)) {
+            // Read chunks, each prefixed by its hex length, until an empty one:
+            // <https://tools.ietf.org/html/rfc7230#section-4.1>
+            size_t length = 0;
+            while (true) {
+                alloc_slice line = readToDelimiter("\r\n"_sl);
+                if (!line) {
+                    body.reset();
+                    return false;
+                }
+                char *end;
+                uint64_t chunkSize = strtoull(string(line).c_str(), &end, 16);
+                if (!isxdigit(line[0]) || (*end != '\r' && *end != ';')) {
+                    setError(WebSocketDomain, 400, "Invalid HTTP chunk header"_sl);
+                    body.reset();
+                    return false;
+                }
+                if (chunkSize == 0)
+                    break;
+                // Check the size before allocating, since the peer can claim any size it likes:
+                if (chunkSize > kMaxChunkedBodySize - length) {
+                    setError(WebSocketDomain, 413, "HTTP body is too large"_sl);
+                    body.reset();
+                    return false;
+                }
+                body.resize(length + chunkSize);
+                char crlf[2];
+                if (readExactly((void*)&body[length], chunkSize) < ssize_t(chunkSize)
+                        || readExactly(crlf, 2) < 2) {
+                    body.reset();
+                    return false;
+                }
+                length += chunkSize;
+            }
+            body.resize(length);
+            // Skip any trailer headers, up to the final empty line:
+            while (true) {
+                alloc_slice line = readToDelimiter("\r\n"_sl);
+                if (!line) {
+                    body.reset();
+                    return false;
+                } else if (line.size == 2) {
+                    break;
+                }
+            }
         } else {
             // No Content-Length, so read till EOF:
             body.resize(1024);
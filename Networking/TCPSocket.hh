@@ -77,8 +77,12 @@ namespace litecore::net {
                                             bool includeDelimiter =true,
                                             size_t maxSize =kMaxDelimitedReadSize) MUST_USE_RESULT;
 
+        static constexpr size_t kMaxChunkedBodySize = 64 * 1024 * 1024;
+
         /// Reads an HTTP body, given the headers.
-        /// If there's a Content-Length header, reads that many bytes, otherwise reads till EOF.
+        /// If there's a Content-Length header, reads that many bytes; if the body is chunked,
+        /// reads and decodes the chunks; otherwise reads till EOF.
+        /// A chunked body larger than \ref kMaxChunkedBodySize fails with error {WebSocket, 413}.
         bool readHTTPBody(const websocket::Headers &headers, fleece::alloc_slice &body) MUST_USE_RESULT;
 
         bool atReadEOF() const                          {return _eofOnRead;}
@@ -53,7 +53,7 @@ namespace litecore { namespace REST {
 
         /** Unregisters a database by name.
             The C4Database will be closed if there are no other references to it. */
-        bool unregisterDatabase(std::string name);
+        virtual bool unregisterDatabase(std::string name);
 
         /** Returns the database registered under the given name. */
         c4::ref<C4Database> databaseNamed(const std::string &name);
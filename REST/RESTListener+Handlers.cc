@@ -23,10 +23,15 @@
 #include "c4DocEnumerator.h"
 #include "c4Document+Fleece.h"
 #include "c4Replicator.h"
+#include "c4ListenerInternal.hh"
 #include "Server.hh"
 #include "StringUtil.hh"
 #include "c4ExceptionUtils.hh"
+#include "c4Observer.h"
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 
 using namespace std;
 using namespace fleece;
@@ -91,7 +96,7 @@ namespace litecore { namespace REST {
         auto &json = rq.jsonEncoder();
         json.beginDict();
         json.writeKey("db_name"_sl);
-        json.writeString(rq.path(0));
+        json.writeString(rq.pathParam(0));
         json.writeKey("db_uuid"_sl);
         json.writeString(uuidStr);
         json.writeKey("doc_count"_sl);
@@ -107,7 +112,7 @@ namespace litecore { namespace REST {
     void RESTListener::handleCreateDatabase(RequestResponse &rq) {
         if (!_allowCreateDB)
             return rq.respondWithStatus(HTTPStatus::Forbidden, "Cannot create databases");
-        string dbName = rq.path(0);
+        string dbName = rq.pathParam(0);
         if (databaseNamed(dbName))
             return rq.respondWithStatus(HTTPStatus::PreconditionFailed, "Database exists");
         FilePath path;
@@ -129,7 +134,7 @@ namespace litecore { namespace REST {
     void RESTListener::handleDeleteDatabase(RequestResponse &rq, C4Database *db) {
         if (!_allowDeleteDB)
             return rq.respondWithStatus(HTTPStatus::Forbidden, "Cannot delete databases");
-        string name = rq.path(0);
+        string name = rq.pathParam(0);
         if (!unregisterDatabase(name))
             return rq.respondWithStatus(HTTPStatus::NotFound);
         C4Error err;
@@ -143,7 +148,24 @@ namespace litecore { namespace REST {
 #pragma mark - DOCUMENT HANDLERS:
 
 
-    void RESTListener::handleGetAllDocs(RequestResponse &rq, C4Database *db) {
+    // Writes a "doc" property with the enumerator's current document body, or else "error".
+    static void writeEnumeratedDoc(C4DocEnumerator *e, JSONEncoder &json) {
+        C4Error err;
+        alloc_slice docBody;
+        c4::ref<C4Document> doc = c4enum_getDocument(e, &err);
+        if (doc)
+            docBody = c4doc_bodyAsJSON(doc, false, &err);
+        if (docBody) {
+            json.writeKey("doc"_sl);
+            json.writeRaw(docBody);
+        } else {
+            json.writeKey("error"_sl);
+            json.writeString(slice(c4error_descriptionStr(err)));
+        }
+    }
+
+
+    void RESTListener::handleGetAllDocs(RequestResponse &rq) {
         // Apply options:
         C4EnumeratorOptions options;
         options.flags = kC4IncludeNonConflicted;
@@ -156,17 +178,21 @@ namespace litecore { namespace REST {
         int64_t limit = rq.intQuery("limit", INT64_MAX);
         // TODO: Implement startkey, endkey, etc.
 
-        // Create enumerator:
-        C4Error err;
+        // Create enumerator, on a separate connection since a slow client may take a while:
+        DatabaseConnection db = newDatabaseConnectionFor(rq);
+        if (!db)
+            return;
+        C4Error err {};
         c4::ref<C4DocEnumerator> e = c4db_enumerateAllDocs(db, &options, &err);
         if (!e)
             return rq.respondWithError(err);
 
-        // Enumerate, building JSON:
-        auto &json = rq.jsonEncoder();
-        json.beginDict();
-        json.writeKey("rows"_sl);
-        json.beginArray();
+        // Enumerate, streaming each row as JSON:
+        rq.setHeader("Content-Type", "application/json");
+        rq.setChunked();
+        rq.write("{\"rows\":[");
+        JSONEncoder json;
+        bool first = true;
         while (c4enum_next(e, &err)) {
             if (skip-- > 0)
                 continue;
@@ -184,26 +210,28 @@ namespace litecore { namespace REST {
             json.writeKey("rev"_sl);
             json.writeString(info.revID);
             json.endDict();
-
-            if (includeDocs) {
-                c4::ref<C4Document> doc = c4enum_getDocument(e, &err);
-                if (!doc)
-                    return rq.respondWithError(err);
-                alloc_slice docBody = c4doc_bodyAsJSON(doc, false, &err);
-                if (!docBody)
-                    return rq.respondWithError(err);
-                json.writeKey("doc"_sl);
-                json.writeRaw(docBody);
-            }
+            if (includeDocs)
+                writeEnumeratedDoc(e, json);
             json.endDict();
+
+            if (!first)
+                rq.write(","_sl);
+            first = false;
+            rq.write(json.finish());
+            json.reset();
         }
-        json.endArray();
-        json.endDict();
+        if (err.code) {
+            // The status was already sent, so the only way to report this is to cut off the body:
+            c4log(RESTLog, kC4LogWarning, "_all_docs failed to enumerate: %s",
+                  c4error_descriptionStr(err));
+            return rq.abort();
+        }
+        rq.write("]}");
     }
 
 
     void RESTListener::handleGetDoc(RequestResponse &rq, C4Database *db) {
-        string docID = rq.path(1);
+        string docID = rq.pathParam(1);
         C4Error err;
         c4::ref<C4Document> doc = c4doc_get(db, slice(docID), true, &err);
         if (!doc)
@@ -339,7 +367,7 @@ namespace litecore { namespace REST {
 
     // This handles PUT and DELETE of a document, as well as POST to a database.
     void RESTListener::handleModifyDoc(RequestResponse &rq, C4Database *db) {
-        string docID = rq.path(1);                       // will be empty for POST
+        string docID = rq.pathParam(1);                  // will be empty for POST
 
         // Parse the body:
         bool deleting = (rq.method() == Method::DELETE);
@@ -394,4 +422,187 @@ namespace litecore { namespace REST {
             return rq.respondWithStatus(HTTPStatus::BadRequest);
     }
 
+
+#pragma mark - CHANGES FEED:
+
+
+    // Default for the _changes `timeout` query parameter, in milliseconds
+    static constexpr int64_t kDefaultChangesTimeout = 60000;
+
+    // Longest a waiting _changes feed goes without checking whether the server is stopping
+    static constexpr auto kChangesPollInterval = chrono::seconds(1);
+
+
+    /** Lets a _changes feed wait for its database to change. */
+    class ChangesObserver {
+    public:
+        explicit ChangesObserver(C4Database *db)
+        :_observer(c4dbobs_create(db, &callback, this))
+        { }
+
+        ~ChangesObserver() {
+            c4dbobs_free(_observer);
+        }
+
+        /// Waits until the database changes, or the deadline passes. Returns true on a change.
+        bool waitUntil(chrono::steady_clock::time_point deadline) {
+            {
+                unique_lock<mutex> lock(_mutex);
+                if (!_cond.wait_until(lock, deadline, [&]{return _changed;}))
+                    return false;
+                _changed = false;
+            }
+            // Read the changes, which re-arms the callback. (The feed doesn't need them, since
+            // it enumerates by sequence.)
+            C4DatabaseChange changes[100];
+            bool external;
+            uint32_t n;
+            while ((n = c4dbobs_getChanges(_observer, changes, 100, &external)) > 0)
+                c4dbobs_releaseChanges(changes, n);
+            return true;
+        }
+
+    private:
+        static void callback(C4DatabaseObserver*, void *context) {
+            auto self = (ChangesObserver*)context;
+            lock_guard<mutex> lock(self->_mutex);
+            self->_changed = true;
+            self->_cond.notify_all();
+        }
+
+        mutex _mutex;
+        condition_variable _cond;
+        bool _changed {false};
+        C4DatabaseObserver* _observer;      // (Declared last, since its callback uses the above)
+    };
+
+
+    // Supports feed=normal, longpoll or continuous, and since, limit, include_docs, timeout
+    // and heartbeat, like CouchDB.
+    void RESTListener::handleChanges(RequestResponse &rq) {
+        string feed = rq.query("feed");
+        bool continuous = (feed == "continuous"), longpoll = (feed == "longpoll");
+        if (!continuous && !longpoll && !feed.empty() && feed != "normal")
+            return rq.respondWithStatus(HTTPStatus::BadRequest, "Invalid feed type");
+        DatabaseConnection db = newDatabaseConnectionFor(rq);
+        if (!db)
+            return;
+        if (continuous || longpoll)
+            rq.leaveWorkerPool();       // The feed may stay open indefinitely
+
+        C4SequenceNumber since;
+        if (rq.query("since") == "now")
+            since = c4db_getLastSequence(db);
+        else
+            since = C4SequenceNumber(max(rq.intQuery("since", 0), int64_t(0)));
+        int64_t limit = rq.intQuery("limit", INT64_MAX);
+        C4EnumeratorOptions options;
+        options.flags = kC4IncludeNonConflicted | kC4IncludeDeleted;
+        bool includeDocs = rq.boolQuery("include_docs");
+        if (includeDocs)
+            options.flags |= kC4IncludeBodies;
+        auto timeout = chrono::milliseconds(rq.intQuery("timeout", kDefaultChangesTimeout));
+        auto heartbeat = chrono::milliseconds(rq.intQuery("heartbeat", 0));
+
+        // Start observing before the first enumeration, so no change can be missed:
+        unique_ptr<ChangesObserver> observer;
+        if (continuous || longpoll)
+            observer = make_unique<ChangesObserver>(db);
+
+        rq.setHeader("Content-Type", "application/json");
+        rq.uncacheable();
+        rq.setChunked();
+        if (!continuous)
+            rq.write("{\"results\":[");
+
+        JSONEncoder json;
+        bool first = true;
+        auto deadline = chrono::steady_clock::now() + timeout;
+        while (true) {
+            // Write the changes since `since`:
+            C4Error err {};
+            c4::ref<C4DocEnumerator> e = c4db_enumerateChanges(db, since, &options, &err);
+            bool gotChanges = false;
+            while (e && limit > 0 && c4enum_next(e, &err)) {
+                C4DocumentInfo info;
+                c4enum_getDocumentInfo(e, &info);
+                since = info.sequence;
+                json.beginDict();
+                json.writeKey("seq"_sl);
+                json.writeUInt(info.sequence);
+                json.writeKey("id"_sl);
+                json.writeString(info.docID);
+                json.writeKey("changes"_sl);
+                json.beginArray();
+                json.beginDict();
+                json.writeKey("rev"_sl);
+                json.writeString(info.revID);
+                json.endDict();
+                json.endArray();
+                if (info.flags & kDocDeleted) {
+                    json.writeKey("deleted"_sl);
+                    json.writeBool(true);
+                }
+                if (includeDocs)
+                    writeEnumeratedDoc(e, json);
+                json.endDict();
+
+                if (continuous) {
+                    rq.write(json.finish());
+                    rq.write("\n"_sl);
+                } else {
+                    if (!first)
+                        rq.write(","_sl);
+                    rq.write(json.finish());
+                }
+                json.reset();
+                first = false;
+                gotChanges = true;
+                --limit;
+            }
+            if (!e || err.code) {
+                // The status was already sent, so the only way to report this is to cut off
+                // the body:
+                c4log(RESTLog, kC4LogWarning, "_changes feed failed to enumerate: %s",
+                      c4error_descriptionStr(err));
+                return rq.abort();
+            }
+            e = nullptr;
+
+            if (limit <= 0 || (!continuous && !(longpoll && first)))
+                break;
+            if (!rq.flush())
+                return;                 // Client disconnected
+            auto lastWrite = chrono::steady_clock::now();
+            if (gotChanges)
+                deadline = lastWrite + timeout;
+
+            // Wait for the database to change, sending heartbeats meanwhile:
+            bool changed = false;
+            while (!changed) {
+                auto now = chrono::steady_clock::now();
+                if (now >= deadline || server()->stopping())
+                    break;
+                auto wakeTime = min(deadline, now + kChangesPollInterval);
+                if (heartbeat.count() > 0)
+                    wakeTime = min(wakeTime, lastWrite + heartbeat);
+                changed = observer->waitUntil(wakeTime);
+                if (!changed && heartbeat.count() > 0
+                             && chrono::steady_clock::now() >= lastWrite + heartbeat) {
+                    rq.write("\n"_sl);
+                    if (!rq.flush())
+                        return;
+                    lastWrite = chrono::steady_clock::now();
+                }
+            }
+            if (!changed)
+                break;
+        }
+
+        if (continuous)
+            rq.printf("{\"last_seq\":%llu}\n", (unsigned long long)since);
+        else
+            rq.printf("],\"last_seq\":%llu}", (unsigned long long)since);
+    }
+
 } }
@@ -78,8 +78,9 @@ namespace litecore { namespace REST {
             addDBHandler(Method::POST,  "/[^_][^/]*|/[^_][^/]*/",    &RESTListener::handleModifyDoc);
 
             // Database-level special handlers:
-            addDBHandler(Method::GET,   "/[^_][^/]*/_all_docs",  &RESTListener::handleGetAllDocs);
+            addHandler  (Method::GET,   "/[^_][^/]*/_all_docs",  &RESTListener::handleGetAllDocs);
             addDBHandler(Method::POST,  "/[^_][^/]*/_bulk_docs", &RESTListener::handleBulkDocs);
+            addHandler  (Method::GET,   "/[^_][^/]*/_changes",   &RESTListener::handleChanges);
 
             // Document:
             addDBHandler(Method::GET,   "/[^_][^/]*/[^_].*",      &RESTListener::handleGetDoc);
@@ -263,9 +264,11 @@ namespace litecore { namespace REST {
 #pragma mark - UTILITIES:
 
 
+    // (The handlers are registered as concurrent: the listener's state is guarded by _mutex,
+    // and each database by its own lock.)
     void RESTListener::addHandler(Method method, const char *uri, HandlerMethod handler) {
         using namespace std::placeholders;
-        _server->addHandler(method, uri, bind(handler, this, _1));
+        _server->addHandler(method, uri, bind(handler, this, _1), true);
     }
 
     void RESTListener::addDBHandler(Method method, const char *uri, DBHandlerMethod handler) {
@@ -281,12 +284,12 @@ namespace litecore { namespace REST {
                 }
                 c4db_unlock(db);
             }
-        });
+        }, true);
     }
 
     
     c4::ref<C4Database> RESTListener::databaseFor(RequestResponse &rq) {
-        string dbName = rq.path(0);
+        string dbName = rq.pathParam(0);
         if (dbName.empty()) {
             rq.respondWithStatus(HTTPStatus::BadRequest);
             return nullptr;
@@ -297,6 +300,81 @@ namespace litecore { namespace REST {
         return db;
     }
 
+
+    // Most idle connections kept per database by newDatabaseConnectionFor
+    static constexpr size_t kMaxSpareConnections = 4;
+
+
+    RESTListener::DatabaseConnection RESTListener::newDatabaseConnectionFor(RequestResponse &rq) {
+        c4::ref<C4Database> db = databaseFor(rq);
+        if (!db)
+            return {};
+        string name = rq.pathParam(0);
+        {
+            lock_guard<mutex> lock(_mutex);
+            auto i = _spareConnections.find(name);
+            if (i != _spareConnections.end() && (C4Database*)i->second.shared == db
+                                             && !i->second.connections.empty()) {
+                c4::ref<C4Database> spare = move(i->second.connections.back());
+                i->second.connections.pop_back();
+                return DatabaseConnection(this, name, move(db), move(spare));
+            }
+        }
+
+        C4Error err;
+        c4db_lock(db);
+        c4::ref<C4Database> newDB = c4db_openAgain(db, &err);
+        c4db_unlock(db);
+        if (!newDB) {
+            rq.respondWithError(err);
+            return {};
+        }
+        return DatabaseConnection(this, name, move(db), move(newDB));
+    }
+
+
+    void RESTListener::returnDatabaseConnection(const string &name, C4Database *shared,
+                                                c4::ref<C4Database> &&db)
+    {
+        lock_guard<mutex> lock(_mutex);
+        // Don't keep it if the database has since been unregistered (or replaced):
+        if ((C4Database*)databaseNamed(name) != shared)
+            return;
+        auto &spares = _spareConnections[name];
+        if ((C4Database*)spares.shared != shared) {
+            spares.shared = c4db_retain(shared);
+            spares.connections.clear();
+        }
+        if (spares.connections.size() < kMaxSpareConnections)
+            spares.connections.push_back(move(db));
+    }
+
+
+    bool RESTListener::unregisterDatabase(string name) {
+        if (!Listener::unregisterDatabase(name))
+            return false;
+        // Close the idle connections, so the database can be closed or deleted:
+        lock_guard<mutex> lock(_mutex);
+        _spareConnections.erase(name);
+        return true;
+    }
+
+
+    RESTListener::DatabaseConnection::DatabaseConnection(RESTListener *listener, string name,
+                                                         c4::ref<C4Database> shared,
+                                                         c4::ref<C4Database> db)
+    :_listener(listener)
+    ,_name(move(name))
+    ,_shared(move(shared))
+    ,_db(move(db))
+    { }
+
+
+    RESTListener::DatabaseConnection::~DatabaseConnection() {
+        if (_db)
+            _listener->returnDatabaseConnection(_name, _shared, move(_db));
+    }
+
     
 
 } }
@@ -83,6 +83,8 @@ namespace litecore { namespace REST {
         /** The currently-running tasks. */
         std::vector<Retained<Task>> tasks();
 
+        bool unregisterDatabase(std::string name) override;
+
     protected:
         friend class Task;
 
@@ -91,8 +93,33 @@ namespace litecore { namespace REST {
         
         Server* server() const              {return _server.get();}
 
+        /** A connection to a database, separate from the shared one, that's borrowed from the
+            listener's pool and goes back to it when this object is destroyed. */
+        class DatabaseConnection {
+        public:
+            DatabaseConnection() =default;
+            DatabaseConnection(DatabaseConnection&&) =default;
+            ~DatabaseConnection();
+
+            operator C4Database* () const           {return _db;}
+
+        private:
+            friend class RESTListener;
+            DatabaseConnection(RESTListener*, std::string name,
+                               c4::ref<C4Database> shared, c4::ref<C4Database> db);
+
+            RESTListener* _listener {nullptr};
+            std::string _name;
+            c4::ref<C4Database> _shared;        // The registered database
+            c4::ref<C4Database> _db;            // The connection to it
+        };
+
         /** Returns the database for this request, or null on error. */
         c4::ref<C4Database> databaseFor(RequestResponse&);
+        /** Like databaseFor, but returns a different connection to the database, for handlers
+            that run a long time and shouldn't keep the shared connection locked. Connections
+            are pooled, so this only opens one when no idle one is available. */
+        DatabaseConnection newDatabaseConnectionFor(RequestResponse&);
         unsigned registerTask(Task*);
         void unregisterTask(Task*);
 
@@ -117,7 +144,8 @@ namespace litecore { namespace REST {
         void handleCreateDatabase(RequestResponse&);
         void handleDeleteDatabase(RequestResponse&, C4Database*);
 
-        void handleGetAllDocs(RequestResponse&, C4Database*);
+        void handleGetAllDocs(RequestResponse&);
+        void handleChanges(RequestResponse&);
         void handleGetDoc(RequestResponse&, C4Database*);
         void handleModifyDoc(RequestResponse&, C4Database*);
         void handleBulkDocs(RequestResponse&, C4Database*);
@@ -131,12 +159,22 @@ namespace litecore { namespace REST {
                        fleece::JSONEncoder& json,
                        C4Error *outError);
 
+        void returnDatabaseConnection(const std::string &name, C4Database *shared,
+                                      c4::ref<C4Database> &&db);
+
+        // Idle connections to a registered database, for newDatabaseConnectionFor:
+        struct SpareConnections {
+            c4::ref<C4Database> shared;                         // The registered database
+            std::vector<c4::ref<C4Database>> connections;
+        };
+
         std::unique_ptr<FilePath> _directory;
         const bool _allowCreateDB, _allowDeleteDB;
         Retained<crypto::Identity> _identity;
         Retained<Server> _server;
         std::mutex _mutex;
         std::set<Retained<Task>> _tasks;
+        std::map<std::string, SpareConnections> _spareConnections;
         unsigned _nextTaskID {1};
     };
 
@@ -54,6 +54,7 @@ namespace litecore { namespace REST {
         slice version = httpData.readToDelimiter("\r\n"_sl);
         if (method == Method::None || uri.size == 0 || !version.hasPrefix("HTTP/"_sl))
             return false;
+        _http11 = (version != "HTTP/1.0"_sl && version != "HTTP/0.9"_sl);
         
         const uint8_t *q = uri.findByte('?');
         if (q) {
@@ -113,6 +114,15 @@ namespace litecore { namespace REST {
     }
 
 
+    bool Request::wantsKeepAlive() const {
+        slice connection = header("Connection");
+        if (_http11)
+            return !connection.caseEquivalent("close"_sl);
+        else
+            return connection.caseEquivalent("keep-alive"_sl);
+    }
+
+
 
 #pragma mark - RESPONSE STATUS LINE:
 
@@ -123,17 +133,29 @@ namespace litecore { namespace REST {
     {
         auto request = _socket->readToDelimiter("\r\n\r\n"_sl);
         if (!request) {
-            handleSocketError();
+            C4Error err = _socket->error();
+            if (_socket->atReadEOF() || (err.domain == NetworkDomain
+                                            && err.code == kC4NetErrTimeout)) {
+                // Client closed or abandoned the connection instead of sending another request
+                Log("Connection closed by client");
+                _error = err;
+            } else {
+                handleSocketError();
+            }
             return;
         }
         if (!readFromHTTP(request))
             return;
-        if (_method == Method::POST || _method == Method::PUT) {
+        // Any request body has to be consumed, so the next request on the socket can be read:
+        if (_method == Method::POST || _method == Method::PUT
+                                    || _headers.getInt("Content-Length"_sl, 0) > 0
+                                    || _headers["Transfer-Encoding"_sl]) {
             if (!_socket->readHTTPBody(_headers, _body)) {
                 handleSocketError();
                 return;
             }
         }
+        _keepAlive = wantsKeepAlive() && !_socket->atReadEOF();
     }
 
 
@@ -154,7 +176,7 @@ namespace litecore { namespace REST {
             if (defaultMessage)
                 _statusMessage = defaultMessage;
         }
-        string statusLine = format("HTTP/1.0 %d %s\r\n", _status, _statusMessage.c_str());
+        string statusLine = format("HTTP/1.1 %d %s\r\n", _status, _statusMessage.c_str());
         _responseHeaderWriter.write(statusLine);
         _sentStatus = true;
 
@@ -262,6 +284,8 @@ namespace litecore { namespace REST {
 
     void RequestResponse::handleSocketError() {
         C4Error err = _socket->error();
+        _error = err;
+        _keepAlive = false;
         WarnError("Socket error sending response: %s", c4error_descriptionStr(err));
     }
 
@@ -299,6 +323,12 @@ namespace litecore { namespace REST {
     void RequestResponse::sendHeaders() {
         if (_jsonEncoder)
             setHeader("Content-Type", "application/json");
+        if (_status != HTTPStatus::Upgraded) {
+            if (!_keepAlive)
+                setHeader("Connection", "close");
+            else if (!_http11)
+                setHeader("Connection", "keep-alive");
+        }
         _responseHeaderWriter.write("\r\n"_sl);
         if (_socket->write_n(_responseHeaderWriter.finish()) < 0)
             handleSocketError();
@@ -316,9 +346,52 @@ namespace litecore { namespace REST {
     }
 
 
+    // Chunks of a streamed body are sent once this much data is buffered
+    static constexpr size_t kChunkSize = 16 * 1024;
+
+
+    void RequestResponse::setChunked() {
+        Assert(!_streaming && _contentLength < 0 && !_jsonEncoder);
+        sendStatus();
+        if (_http11)
+            setHeader("Transfer-Encoding", "chunked");
+        else
+            _keepAlive = false;         // HTTP/1.0 body ends at EOF
+        sendHeaders();
+        _streaming = true;
+    }
+
+
+    bool RequestResponse::flush() {
+        Assert(_streaming);
+        if (_error.code)
+            return false;
+        if (_responseWriter.length() == 0)
+            return true;
+        alloc_slice data = _responseWriter.finish();
+        if (_http11) {
+            // Prefix the chunk with its hex length, and suffix a CRLF:
+            char header[20];
+            snprintf(header, sizeof(header), "%zx\r\n", data.size);
+            Writer chunk;
+            chunk.write(slice(header));
+            chunk.write(data);
+            chunk.write("\r\n"_sl);
+            data = chunk.finish();
+        }
+        if (_socket->write_n(data) < 0) {
+            handleSocketError();
+            return false;
+        }
+        return true;
+    }
+
+
     void RequestResponse::write(slice content) {
         Assert(!_finished);
         _responseWriter.write(content);
+        if (_streaming && _responseWriter.length() >= kChunkSize)
+            flush();
     }
 
 
@@ -346,6 +419,14 @@ namespace litecore { namespace REST {
         if (_finished)
             return;
 
+        if (_streaming) {
+            // Send the remaining data, then the zero-length chunk that ends the body:
+            if (flush() && _http11 && _socket->write_n("0\r\n\r\n"_sl) < 0)
+                handleSocketError();
+            _finished = true;
+            return;
+        }
+
         if (_jsonEncoder) {
             alloc_slice json = _jsonEncoder->finish();
             write(json);
@@ -366,6 +447,15 @@ namespace litecore { namespace REST {
     }
 
 
+    void RequestResponse::abort() {
+        Log("Aborting response");
+        _keepAlive = false;
+        _finished = true;
+        if (_socket)
+            _socket->close();
+    }
+
+
     bool RequestResponse::isValidWebSocketRequest() {
         return header("Connection").caseEquivalent("upgrade"_sl)
             && header("Upgrade").caseEquivalent("websocket"_sl)
@@ -387,6 +477,11 @@ namespace litecore { namespace REST {
     }
 
 
+    bool RequestResponse::keepAlive() const {
+        return _keepAlive && _socket && _error.code == 0 && _status != HTTPStatus::Upgraded;
+    }
+
+
     unique_ptr<ResponderSocket> RequestResponse::extractSocket() {
         finish();
         return move(_socket);
@@ -397,4 +492,10 @@ namespace litecore { namespace REST {
         return _socket->peerAddress();
     }
 
+
+    void RequestResponse::leaveWorkerPool() {
+        if (_server->leaveWorkerPool())
+            Log("Connection now has its own thread");
+    }
+
 } }
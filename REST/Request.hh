@@ -45,10 +45,17 @@ namespace litecore { namespace REST {
         std::string path() const                {return _path;}
         std::string path(int i) const;
 
+        /// The i'th parameter matched by the handler's path pattern (URL-decoded), or "" if none.
+        std::string pathParam(size_t i) const   {return i < _pathParams.size() ? _pathParams[i] : "";}
+
         std::string query(const char *param) const;
         int64_t intQuery(const char *param, int64_t defaultValue =0) const;
         bool boolQuery(const char *param, bool defaultValue =false) const;
 
+        /// True if the client allows the connection to be reused for further requests.
+        /// That's the default in HTTP/1.1, unless it sent "Connection: close".
+        bool wantsKeepAlive() const;
+
     protected:
         friend class Server;
         
@@ -61,6 +68,8 @@ namespace litecore { namespace REST {
         Method _method {Method::None};
         std::string _path;
         std::string _queries;
+        std::vector<std::string> _pathParams;
+        bool _http11 {false};                       // Is the request HTTP/1.1 (or later)?
     };
 
 
@@ -93,6 +102,16 @@ namespace litecore { namespace REST {
         void setContentLength(uint64_t length);
         void uncacheable();
 
+        /// Streams the response body instead of buffering it: sends the status and headers
+        /// now, then sends body data using chunked transfer encoding as it accumulates.
+        /// (An HTTP/1.0 client instead gets the raw body, ended by closing the connection.)
+        /// Since writes block while the socket is full, a slow client throttles the handler.
+        void setChunked();
+
+        /// Sends any buffered body data of a chunked response.
+        /// Returns false if the connection has failed.
+        bool flush();
+
         void write(fleece::slice);
         void write(const char *content)                     {write(fleece::slice(content));}
         void printf(const char *format, ...) __printflike(2, 3);
@@ -105,6 +124,10 @@ namespace litecore { namespace REST {
         // Must be called after everything's written:
         void finish();
 
+        /// Closes the connection without finishing the response, so the client can tell it's
+        /// incomplete. For errors that occur after a chunked response has begun.
+        void abort();
+
         // WebSocket stuff:
 
         bool isValidWebSocketRequest();
@@ -115,8 +138,19 @@ namespace litecore { namespace REST {
 
         std::string peerAddress();
 
+        /// Call this from a handler that will run for a long time, such as a WebSocket or a
+        /// longpoll/continuous feed. The connection then gets a thread of its own instead of
+        /// occupying one of the Server's pool of workers; a new worker takes its place.
+        void leaveWorkerPool();
+
     protected:
         RequestResponse(Server *server, std::unique_ptr<net::ResponderSocket>);
+
+        /// Can the socket be reused for another request after this one is finished?
+        bool keepAlive() const;
+        /// Overrides keep-alive. Must be called before `finish`.
+        void setKeepAlive(bool keep)                        {_keepAlive = keep && _keepAlive;}
+
         void sendStatus();
         void sendHeaders();
         void handleSocketError();
@@ -137,12 +171,14 @@ namespace litecore { namespace REST {
         fleece::Writer _responseHeaderWriter;
         bool _endedHeaders {false};                 // True after headers are ended
         int64_t _contentLength {-1};                // Content-Length, once it's set
+        bool _streaming {false};                    // Sending the body as it's written?
 
         fleece::Writer _responseWriter;             // Output stream for response body
         std::unique_ptr<fleece::JSONEncoder> _jsonEncoder;  // Used for writing JSON to response
         fleece::alloc_slice _responseBody;          // Finished response body
         fleece::slice _unsentBody;                  // Unsent portion of _responseBody
         bool _finished {false};                     // Finished configuring the response?
+        bool _keepAlive {false};                    // Keep the connection open afterwards?
     };
 
 } }
@@ -28,6 +28,9 @@
 #include "c4ExceptionUtils.hh"
 #include "c4ListenerInternal.hh"
 #include "PlatformCompat.hh"
+#include "ThreadUtil.hh"
+#include "netUtils.hh"
+#include <algorithm>
 #include <mutex>
 
 // TODO: Remove these pragmas when doc-comments in sockpp are fixed
@@ -43,7 +46,182 @@ namespace litecore { namespace REST {
     using namespace litecore::net;
     using namespace sockpp;
 
+#pragma mark - ROUTE TREE:
+
+
+    // Kinds of path component a route can match, besides literal strings:
+    enum class Wildcard : uint8_t {
+        Any,                // `[^/]*`     (or `.*` as the final component)
+        NonEmpty,           // `[^/]+`
+        NoUnderscore,       // `[^_][^/]*` (or `[^_].*` as the final component)
+    };
+
+    static bool matchesWildcard(Wildcard w, slice component) {
+        switch (w) {
+            case Wildcard::Any:             return true;
+            case Wildcard::NonEmpty:        return component.size > 0;
+            case Wildcard::NoUnderscore:    return component.size > 0 && component[0] != '_';
+        }
+        return false;
+    }
+
+
+    /** A node of the route tree. Each level of the tree matches one '/'-delimited component
+        of the path. Rules are identified by their index in _rules, so that when several match,
+        the one registered first wins, just as with sequential regex matching. */
+    struct Server::RouteNode {
+        map<string, unique_ptr<RouteNode>, less<>> literals;   // Children matching exact strings
+        vector<pair<Wildcard, unique_ptr<RouteNode>>> params;  // Children matching a wildcard
+        vector<size_t> rules;                       // Rules whose pattern ends here
+        vector<pair<Wildcard, size_t>> restRules;   // Rules whose last param is the rest of path
+
+        RouteNode* literalChild(const string &component) {
+            auto &child = literals[component];
+            if (!child)
+                child = make_unique<RouteNode>();
+            return child.get();
+        }
+
+        RouteNode* paramChild(Wildcard w) {
+            for (auto &param : params) {
+                if (param.first == w)
+                    return param.second.get();
+            }
+            params.emplace_back(w, make_unique<RouteNode>());
+            return params.back().second.get();
+        }
+    };
+
+
+    // State of a route tree search:
+    struct Server::RouteSearch {
+        const vector<URIRule> &rules;
+        Method method;
+        slice path;
+        vector<slice> components;       // Path components (without the slashes)
+        vector<slice> captures;         // Params captured so far on the current branch
+        size_t bestRule = SIZE_MAX;     // First rule matching path & method
+        size_t bestPathRule = SIZE_MAX; // First rule matching path, with any method
+        vector<slice> bestCaptures;     // Captures of bestRule
+
+        void found(size_t ruleIndex) {
+            if (ruleIndex < bestRule && (rules[ruleIndex].methods & method)) {
+                bestRule = ruleIndex;
+                bestCaptures = captures;
+            }
+            bestPathRule = min(bestPathRule, ruleIndex);
+        }
+
+        void search(const RouteNode &node, size_t depth) {
+            if (depth == components.size()) {
+                for (size_t ruleIndex : node.rules)
+                    found(ruleIndex);
+                return;
+            }
+            slice component = components[depth];
+            if (!node.restRules.empty()) {
+                slice rest(component.buf, path.end());
+                slice afterFirst = rest;
+                if (afterFirst.size > 0)
+                    afterFirst.moveStart(1);
+                if (!afterFirst.findByte('\n') && !afterFirst.findByte('\r')) { // '.' won't match
+                    for (auto &restRule : node.restRules) {
+                        if (matchesWildcard(restRule.first, rest)) {
+                            captures.push_back(rest);
+                            found(restRule.second);
+                            captures.pop_back();
+                        }
+                    }
+                }
+            }
+            if (auto i = node.literals.find(string_view((const char*)component.buf, component.size));
+                    i != node.literals.end())
+                search(*i->second, depth + 1);
+            for (auto &param : node.params) {
+                if (matchesWildcard(param.first, component)) {
+                    captures.push_back(component);
+                    search(*param.second, depth + 1);
+                    captures.pop_back();
+                } else if (param.first == Wildcard::NoUnderscore && component.size == 0
+                                                        && depth + 1 < components.size()) {
+                    // `[^_]` also matches '/', so this can span an empty component and the next:
+                    captures.emplace_back(component.buf, components[depth + 1].end());
+                    search(*param.second, depth + 2);
+                    captures.pop_back();
+                }
+            }
+        }
+    };
+
+
+    // Splits a path or pattern into '/'-delimited components, after the leading '/'.
+    // Slashes inside "[...]" don't count. Returns false if there's no leading slash.
+    static bool splitPath(slice path, vector<slice> &components) {
+        if (path.size == 0 || path[0] != '/')
+            return false;
+        auto start = (const char*)path.buf + 1, end = (const char*)path.end();
+        bool inBrackets = false;
+        for (auto c = start; c < end; ++c) {
+            if (*c == '[')
+                inBrackets = true;
+            else if (*c == ']')
+                inBrackets = false;
+            else if (*c == '/' && !inBrackets) {
+                components.emplace_back(start, c);
+                start = c + 1;
+            }
+        }
+        components.emplace_back(start, end);
+        return true;
+    }
+
+
+    // Adds a rule's pattern to the route tree, if it's simple enough.
+    bool Server::addRoute(const string &pattern, size_t ruleIndex) {
+        vector<slice> components;
+        if (!splitPath(pattern, components))
+            return false;
+        // First check whether every component is something the tree can match:
+        static constexpr const char* kRegexChars = "\\^$.|?*+()[]{}";
+        for (size_t i = 0; i < components.size(); ++i) {
+            slice c = components[i];
+            bool last = (i == components.size() - 1);
+            if (c == "[^/]*"_sl || c == "[^/]+"_sl || c == "[^_][^/]*"_sl
+                    || (last && (c == ".*"_sl || c == "[^_].*"_sl)))
+                continue;
+            if (string(c).find_first_of(kRegexChars) != string::npos)
+                return false;
+        }
+
+        RouteNode *node = _routes.get();
+        for (size_t i = 0; i < components.size(); ++i) {
+            slice c = components[i];
+            if (c == ".*"_sl)
+                node->restRules.emplace_back(Wildcard::Any, ruleIndex);
+            else if (c == "[^_].*"_sl)
+                node->restRules.emplace_back(Wildcard::NoUnderscore, ruleIndex);
+            else {
+                if (c == "[^/]*"_sl)
+                    node = node->paramChild(Wildcard::Any);
+                else if (c == "[^/]+"_sl)
+                    node = node->paramChild(Wildcard::NonEmpty);
+                else if (c == "[^_][^/]*"_sl)
+                    node = node->paramChild(Wildcard::NoUnderscore);
+                else
+                    node = node->literalChild(string(c));
+                if (i == components.size() - 1)
+                    node->rules.push_back(ruleIndex);
+            }
+        }
+        return true;
+    }
+
+
+#pragma mark - SERVER:
+
+
     Server::Server()
+    :_routes(make_unique<RouteNode>())
     { }
 
     
@@ -52,6 +230,13 @@ namespace litecore { namespace REST {
     }
 
 
+    void Server::setWorkerThreads(unsigned count) {
+        lock_guard<mutex> lock(_workMutex);
+        Assert(_workers.empty(), "Can't change the worker count of a running Server");
+        _workerCount = max(count, 1u);
+    }
+
+
     void Server::start(uint16_t port,
                        const char *hostname,
                        TLSContext *tlsContext)
@@ -65,20 +250,83 @@ namespace litecore { namespace REST {
             error::_throw(error::POSIX, _acceptor->last_error());
         _acceptor->set_non_blocking();
         c4log(RESTLog, kC4LogInfo,"Server listening on port %d", _port);
+        {
+            lock_guard<mutex> lock(_workMutex);
+            _stopping = false;
+            for (unsigned i = 0; i < _workerCount; ++i)
+                _workers.emplace_back(&Server::runWorker, this);
+        }
         awaitConnection();
     }
 
     
     void Server::stop() {
-        lock_guard<mutex> lock(_mutex);
-        if (!_acceptor)
-            return;
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (!_acceptor)
+                return;
+
+            c4log(RESTLog, kC4LogInfo,"Stopping server");
+            Poller::instance().removeListeners(_acceptor->handle());
+            _acceptor->close();
+            _acceptor.reset();
+            _rules.clear();
+            _routes = make_unique<RouteNode>();
+        }
+        stopWorkers();
+    }
+
 
-        c4log(RESTLog, kC4LogInfo,"Stopping server");
-        Poller::instance().removeListeners(_acceptor->handle());
-        _acceptor->close();
-        _acceptor.reset();
-        _rules.clear();
+    bool Server::stopping() {
+        lock_guard<mutex> lock(_workMutex);
+        return _stopping;
+    }
+
+
+    void Server::stopWorkers() {
+        vector<thread> workers;
+        {
+            unique_lock<mutex> lock(_workMutex);
+            _stopping = true;
+            _pendingConnections.clear();
+            // Wake up workers blocked waiting for a client's next request:
+            for (auto socket : _readingSockets)
+                socket->close();
+            swap(workers, _workers);
+            // Long-running handlers are expected to notice `stopping()`. Wait for the threads
+            // serving them to exit; each one removes itself from _connectionThreads:
+            auto me = this_thread::get_id();
+            _workCond.notify_all();
+            _workCond.wait(lock, [&]{
+                return none_of(_connectionThreads.begin(), _connectionThreads.end(),
+                               [&](const thread &t) {return t.get_id() != me;});
+            });
+        }
+        _workCond.notify_all();
+        for (auto &worker : workers) {
+            if (worker.get_id() == this_thread::get_id())
+                worker.detach();        // stop() was called by a handler
+            else
+                worker.join();
+        }
+    }
+
+
+    // Takes the calling worker thread out of the pool, replacing it with a new worker, so that
+    // it can serve a long-running connection without holding up the rest. Returns false if
+    // the caller isn't a pool worker (e.g. it's already left.)
+    bool Server::leaveWorkerPool() {
+        lock_guard<mutex> lock(_workMutex);
+        if (_stopping)
+            return false;
+        auto me = find_if(_workers.begin(), _workers.end(), [](const thread &t) {
+            return t.get_id() == this_thread::get_id();
+        });
+        if (me == _workers.end())
+            return false;
+        _connectionThreads.push_back(move(*me));
+        *me = thread(&Server::runWorker, this);
+        return true;
     }
 
 
@@ -109,8 +357,17 @@ namespace litecore { namespace REST {
                 }
             }
             if (sock) {
+                // Hand the connection to a worker thread:
                 sock.set_non_blocking(false);
-                handleConnection(move(sock));
+                lock_guard<mutex> lock(_workMutex);
+                if (_stopping) {
+                    return;
+                } else if (_pendingConnections.size() >= kMaxPendingConnections) {
+                    c4log(RESTLog, kC4LogWarning, "Too many pending connections; dropping one");
+                } else {
+                    _pendingConnections.push_back(make_unique<stream_socket>(move(sock)));
+                    _workCond.notify_one();
+                }
             }
         } catch (const std::exception &x) {
             c4log(RESTLog, kC4LogWarning, "Caught C++ exception accepting connection: %s", x.what());
@@ -120,8 +377,62 @@ namespace litecore { namespace REST {
     }
 
 
-    void Server::handleConnection(sockpp::stream_socket &&sock) {
+    void Server::runWorker() {
+        SetThreadName("REST server worker (Couchbase Lite Core)");
+        unique_lock<mutex> lock(_workMutex);
+        while (true) {
+            _workCond.wait(lock, [&]{return _stopping || !_pendingConnections.empty();});
+            if (_stopping)
+                return;
+            auto sock = move(_pendingConnections.front());
+            _pendingConnections.pop_front();
+            lock.unlock();
+            try {
+                handleConnection(move(sock));
+            } catch (const std::exception &x) {
+                c4log(RESTLog, kC4LogWarning, "Caught C++ exception handling connection: %s",
+                      x.what());
+            }
+            lock.lock();
+
+            // If this thread left the pool to serve a long-running connection, it's done:
+            auto me = find_if(_connectionThreads.begin(), _connectionThreads.end(),
+                              [](const thread &t) {return t.get_id() == this_thread::get_id();});
+            if (me != _connectionThreads.end()) {
+                me->detach();
+                _connectionThreads.erase(me);
+                _workCond.notify_all();         // stopWorkers() may be waiting for this
+                return;
+            }
+        }
+    }
+
+
+    // Registers/unregisters a socket that's blocked reading a request, so stop() can close it.
+    // Returns false if the server is stopping.
+    bool Server::setReading(ResponderSocket *socket, bool reading) {
+        lock_guard<mutex> lock(_workMutex);
+        if (reading) {
+            if (_stopping)
+                return false;
+            _readingSockets.push_back(socket);
+        } else {
+            _readingSockets.erase(find(_readingSockets.begin(), _readingSockets.end(), socket));
+        }
+        return true;
+    }
+
+
+    // A connection is only kept open if no other connections are waiting for a worker.
+    bool Server::canKeepAlive() {
+        lock_guard<mutex> lock(_workMutex);
+        return !_stopping && _pendingConnections.empty();
+    }
+
+
+    void Server::handleConnection(unique_ptr<stream_socket> sock) {
         auto responder = make_unique<ResponderSocket>(_tlsContext);
+        responder->setTimeout(kKeepAliveTimeout);   // (Only while waiting for a request)
         if (!responder->acceptSocket(move(sock)) || (_tlsContext && !responder->wrapTLS())) {
             c4log(RESTLog, kC4LogError, "Error accepting incoming connection: %s",
                   c4error_descriptionStr(responder->error()));
@@ -136,10 +447,24 @@ namespace litecore { namespace REST {
                 c4log(RESTLog, kC4LogVerbose, "Accepted connection from %s",
                       responder->peerAddress().c_str());
         }
-        RequestResponse rq(this, move(responder));
-        if (rq.isValid()) {
+        // Handle requests until the client closes the connection or we decide not to keep it:
+        for (unsigned count = 1; responder; ++count) {
+            ResponderSocket *socket = responder.get();
+            if (!setReading(socket, true))
+                break;
+            socket->setTimeout(kKeepAliveTimeout);
+            RequestResponse rq(this, move(responder));
+            setReading(socket, false);
+            if (!rq.isValid())
+                break;
+            // The idle timeout mustn't apply to the handler, nor to a WebSocket it takes over:
+            socket->setTimeout(0);
             dispatchRequest(&rq);
+            if (count >= kMaxRequestsPerConnection || !canKeepAlive())
+                rq.setKeepAlive(false);
             rq.finish();
+            if (rq.keepAlive())
+                responder = rq.extractSocket();
         }
     }
 
@@ -150,22 +475,54 @@ namespace litecore { namespace REST {
     }
 
 
-    void Server::addHandler(Methods methods, const string &patterns, const Handler &handler) {
+    void Server::addHandler(Methods methods, const string &patterns, const Handler &handler,
+                            bool concurrent)
+    {
         lock_guard<mutex> lock(_mutex);
         split(patterns, "|", [&](const string &pattern) {
-            _rules.push_back({methods, pattern, regex(pattern.c_str()), handler});
+            bool inTree = addRoute(pattern, _rules.size());
+            _rules.push_back({methods, pattern, (inTree ? regex() : regex(pattern.c_str())),
+                              inTree, handler, concurrent});
         });
     }
 
 
-    Server::URIRule* Server::findRule(Method method, const string &path) {
-        //lock_guard<mutex> lock(_mutex);       // called from dispatchResponder which locks
-        for (auto &rule : _rules) {
-            if ((rule.methods & method)
-                    && regex_match(path.c_str(), rule.regex))
-                return &rule;
+    Server::RouteMatch Server::findRule(Method method, const string &path) {
+        //lock_guard<mutex> lock(_mutex);       // called from dispatchRequest which locks
+        RouteSearch search {_rules, method, slice(path)};
+        if (splitPath(search.path, search.components))
+            search.search(*_routes, 0);
+
+        // Rules not in the tree are matched by regex, but only if they precede the tree's matches:
+        RouteMatch match;
+        for (size_t i = 0; i < _rules.size(); ++i) {
+            bool wantRule = !match.rule && i < search.bestRule;
+            bool wantPathRule = !match.pathRule && i < search.bestPathRule;
+            if (!wantRule && !wantPathRule)
+                break;
+            URIRule &rule = _rules[i];
+            wantRule = wantRule && (rule.methods & method);
+            if (rule.inTree || !(wantRule || wantPathRule))
+                continue;
+            smatch m;
+            if (regex_match(path, m, rule.regex)) {
+                if (wantPathRule)
+                    match.pathRule = &rule;
+                if (wantRule) {
+                    match.rule = &rule;
+                    for (size_t g = 1; g < m.size(); ++g)
+                        match.params.push_back(URLDecode(slice(m.str(g))));
+                }
+            }
+        }
+        if (!match.rule && search.bestRule < _rules.size()) {
+            match.rule = &_rules[search.bestRule];
+            for (slice capture : search.bestCaptures)
+                match.params.push_back(URLDecode(capture));
         }
-        return nullptr;
+        if (!match.pathRule && search.bestPathRule < _rules.size())
+            match.pathRule = &_rules[search.bestPathRule];
+        return match;
     }
 
 
@@ -175,18 +532,39 @@ namespace litecore { namespace REST {
             method = Method::UPGRADE;
 
         c4log(RESTLog, kC4LogInfo, "%s %s", MethodName(method), rq->path().c_str());
-        lock_guard<mutex> lock(_mutex);
         try{
             string pathStr(rq->path());
-            auto rule = findRule(method, pathStr);
-            if (rule) {
-                c4log(RESTLog, kC4LogInfo, "Matched rule %s for path %s", rule->pattern.c_str(), pathStr.c_str());
-                rule->handler(*rq);
-            } else if (nullptr == (rule = findRule(Methods::ALL, pathStr))) {
+            // Look up the rule under the lock, but call the handler without it, so that
+            // requests on different connections can be handled concurrently:
+            Handler handler;
+            string pattern;
+            bool concurrent = false, pathMatched = false;
+            {
+                lock_guard<mutex> lock(_mutex);
+                RouteMatch match = findRule(method, pathStr);
+                if (match.rule) {
+                    handler = match.rule->handler;
+                    pattern = match.rule->pattern;
+                    concurrent = match.rule->concurrent;
+                    rq->_pathParams = move(match.params);
+                } else if (match.pathRule) {
+                    pathMatched = true;
+                    pattern = match.pathRule->pattern;
+                }
+            }
+            if (handler) {
+                c4log(RESTLog, kC4LogInfo, "Matched rule %s for path %s", pattern.c_str(), pathStr.c_str());
+                if (method == Method::UPGRADE)
+                    rq->leaveWorkerPool();      // A WebSocket connection is long-lived
+                unique_lock<mutex> handlerLock(_handlerMutex, defer_lock);
+                if (!concurrent)
+                    handlerLock.lock();
+                handler(*rq);
+            } else if (!pathMatched) {
                 c4log(RESTLog, kC4LogInfo, "No rule matched path %s", pathStr.c_str());
                 rq->respondWithStatus(HTTPStatus::NotFound, "Not found");
             } else {
-                c4log(RESTLog, kC4LogInfo, "Wrong method for rule %s for path %s", rule->pattern.c_str(), pathStr.c_str());
+                c4log(RESTLog, kC4LogInfo, "Wrong method for rule %s for path %s", pattern.c_str(), pathStr.c_str());
                 if (method == Method::UPGRADE)
                     rq->respondWithStatus(HTTPStatus::Forbidden, "No upgrade available");
                 else
@@ -21,6 +21,8 @@
 #include "InstanceCounted.hh"
 #include "Request.hh"
 #include "c4Base.h"
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <mutex>
 #include <functional>
@@ -37,14 +39,29 @@ namespace litecore { namespace crypto {
 } }
 namespace litecore::net {
     class TLSContext;
+    class ResponderSocket;
 }
 
 namespace litecore { namespace REST {
 
-    /** HTTP server with configurable URI handlers. */
+    /** HTTP server with configurable URI handlers.
+        Connections are served by a fixed-size pool of worker threads. A connection stays open
+        for further requests (HTTP/1.1 keep-alive, including pipelined requests) until the client
+        closes it, it goes idle for kKeepAliveTimeout between requests, or other connections are
+        waiting. A handler that will run for a long time, like a WebSocket or a continuous feed,
+        takes its connection out of the pool (see RequestResponse::leaveWorkerPool) so it doesn't
+        hold up other connections. */
     class Server : public fleece::RefCounted, public fleece::InstanceCountedIn<Server> {
     public:
+        static constexpr unsigned kDefaultWorkerThreads = 8;        // Default size of thread pool
+        static constexpr size_t   kMaxPendingConnections = 100;     // Beyond this, new ones drop
+        static constexpr double   kKeepAliveTimeout = 5.0;          // Idle timeout, in seconds
+        static constexpr unsigned kMaxRequestsPerConnection = 1000;
+
         Server();
+
+        /** Sets the number of worker threads. Must be called before `start`. */
+        void setWorkerThreads(unsigned count);
         
         void start(uint16_t port,
                    const char *hostname =nullptr,
@@ -52,6 +69,9 @@ namespace litecore { namespace REST {
 
         virtual void stop();
 
+        /** True after `stop` is called. Long-running handlers should check this. */
+        bool stopping();
+
         C4Address address() const;
 
         /** Extra HTTP headers to add to every response. */
@@ -61,36 +81,72 @@ namespace litecore { namespace REST {
         using Handler = std::function<void(RequestResponse&)>;
 
         /** Registers a handler function for a URI pattern.
-            Patterns use glob syntax: <http://man7.org/linux/man-pages/man7/glob.7.html>
+            Patterns are regular expressions matching the entire path.
             Multiple patterns can be joined with a "|".
-            Patterns are tested in the order the handlers are added, and the first match is used.*/
-        void addHandler(net::Methods, const std::string &pattern, const Handler&);
+            Patterns are tested in the order the handlers are added, and the first match is used.
+            A path component matching `[^/]*`, `[^/]+` or `[^_][^/]*`, or a final `.*` or `[^_].*`,
+            is a parameter, available to the handler as `Request::pathParam`. Patterns made only
+            of such components and literal ones are matched by a route tree instead of a regex.
+            Handlers are called one at a time, unless `concurrent` is true, in which case the
+            handler may be called on several threads at once and must do its own locking. */
+        void addHandler(net::Methods, const std::string &pattern, const Handler&,
+                        bool concurrent =false);
 
     protected:
         struct URIRule {
             net::Methods methods;
             std::string pattern;
-            std::regex  regex;
+            std::regex  regex;          // Only used if the pattern isn't in the route tree
+            bool        inTree;         // Is the pattern in the route tree?
             Handler     handler;
+            bool        concurrent;     // May the handler be called on multiple threads at once?
+        };
+
+        struct RouteMatch {
+            URIRule* rule {nullptr};            // First rule matching the method and path
+            URIRule* pathRule {nullptr};        // First rule matching the path, for any method
+            std::vector<std::string> params;    // Path parameters captured by `rule`
         };
 
-        URIRule* findRule(net::Method method, const std::string &path);
+        RouteMatch findRule(net::Method method, const std::string &path);
         ~Server();
 
         void dispatchRequest(RequestResponse*);
 
     private:
+        friend class RequestResponse;
+
         void awaitConnection();
         void acceptConnection();
-        void handleConnection(sockpp::stream_socket&&);
+        void runWorker();
+        bool leaveWorkerPool();
+        void stopWorkers();
+        void handleConnection(std::unique_ptr<sockpp::stream_socket>);
+        bool setReading(net::ResponderSocket*, bool reading);
+        bool canKeepAlive();
+
+        struct RouteNode;
+        struct RouteSearch;
+        bool addRoute(const std::string &pattern, size_t ruleIndex);
 
         fleece::Retained<crypto::Identity> _identity;
         fleece::Retained<net::TLSContext> _tlsContext;
         std::unique_ptr<sockpp::acceptor> _acceptor;
         std::mutex _mutex;
+        std::mutex _handlerMutex;                       // Serializes non-concurrent handlers
         std::vector<URIRule> _rules;
+        std::unique_ptr<RouteNode> _routes;             // Route tree indexing _rules
         std::map<std::string, std::string> _extraHeaders;
         uint16_t _port;
+
+        std::mutex _workMutex;                          // Guards the members below
+        std::condition_variable _workCond;
+        unsigned _workerCount {kDefaultWorkerThreads};
+        std::vector<std::thread> _workers;              // The pool
+        std::vector<std::thread> _connectionThreads;    // Former workers serving long connections
+        std::deque<std::unique_ptr<sockpp::stream_socket>> _pendingConnections;
+        std::vector<net::ResponderSocket*> _readingSockets; // Sockets awaiting a request
+        bool _stopping {false};
     };
 
 } }
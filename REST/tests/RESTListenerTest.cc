@@ -21,7 +21,15 @@
 #include "ListenerHarness.hh"
 #include "FilePath.hh"
 #include "Response.hh"
+#include "HTTPLogic.hh"
+#include "Server.hh"
+#include "TCPSocket.hh"
+#include "Benchmark.hh"
+#include "StringUtil.hh"
 #include "c4Internal.hh"
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 using namespace litecore::net;
 using namespace litecore::REST;
@@ -96,6 +104,32 @@ public:
         return request(method, uri, {}, nullslice, expectedStatus);
     }
 
+    // Opens a plain TCP connection to the listener, for sending requests by hand.
+    unique_ptr<ClientSocket> connectSocket() {
+        share(db, "db"_sl);
+        auto socket = make_unique<ClientSocket>();
+        socket->setTimeout(10.0);
+        if (!socket->connect(Address("http"_sl, "localhost"_sl, config.port, "/"_sl)))
+            return nullptr;
+        return socket;
+    }
+
+    // Reads one HTTP response from the socket. Returns the status, or 0 on error.
+    static int readResponse(ClientSocket &socket, websocket::Headers &headers, alloc_slice &body) {
+        alloc_slice response = socket.readToDelimiter("\r\n\r\n"_sl);
+        if (!response)
+            return 0;
+        slice data = response;
+        slice statusLine = data.readToDelimiter("\r\n"_sl);
+        if (!statusLine.readToDelimiter(" "_sl))
+            return 0;
+        int status = int(statusLine.readDecimal());
+        headers.clear();
+        if (!HTTPLogic::parseHeaders(data, headers) || !socket.readHTTPBody(headers, body))
+            return 0;
+        return status;
+    }
+
     void testRootLevel() {
         auto r = request("GET", "/", HTTPStatus::OK);
         auto body = r->bodyAsJSON().asDict();
@@ -172,6 +206,18 @@ TEST_CASE_METHOD(C4RESTTest, "REST DELETE database", "[REST][Listener][C]") {
         REQUIRE(remove(databasePathString().c_str()) != 0);
         REQUIRE(errno == ENOENT);
     }
+    SECTION("After _all_docs") {
+        // _all_docs leaves an idle connection in the listener's pool, which mustn't keep the
+        // database from being deleted:
+        config.allowDeleteDBs = true;
+        r = request("GET", "/db/_all_docs", HTTPStatus::OK);
+        r = request("GET", "/db/_all_docs", HTTPStatus::OK);
+        r = request("DELETE", "/db", HTTPStatus::OK);
+        r = request("GET", "/db", HTTPStatus::NotFound);
+        // This is the easiest cross-platform way to check that the db was deleted:
+        REQUIRE(remove(databasePathString().c_str()) != 0);
+        REQUIRE(errno == ENOENT);
+    }
 }
 
 
@@ -301,6 +347,62 @@ TEST_CASE_METHOD(C4RESTTest, "REST _all_docs", "[REST][Listener][C]") {
 }
 
 
+TEST_CASE_METHOD(C4RESTTest, "REST _changes", "[REST][Listener][C]") {
+    request("PUT", "/db/doc1",
+            {{"Content-Type", "application/json"}},
+            "{\"year\": 1964}"_sl, HTTPStatus::Created);
+    request("PUT", "/db/doc2",
+            {{"Content-Type", "application/json"}},
+            "{\"year\": 1977}"_sl, HTTPStatus::Created);
+
+    auto r = request("GET", "/db/_changes", HTTPStatus::OK);
+    Dict body = r->bodyAsJSON().asDict();
+    Array results = body["results"].asArray();
+    REQUIRE(results.count() == 2);
+    CHECK(results[0].asDict()["id"].asString() == "doc1"_sl);
+    CHECK(results[0].asDict()["seq"].asInt() == 1);
+    CHECK(results[1].asDict()["id"].asString() == "doc2"_sl);
+    CHECK(results[1].asDict()["changes"].asArray()[0].asDict()["rev"].asString().size > 0);
+    CHECK(body["last_seq"].asInt() == 2);
+
+    r = request("GET", "/db/_changes?since=1&include_docs=true", HTTPStatus::OK);
+    body = r->bodyAsJSON().asDict();
+    results = body["results"].asArray();
+    REQUIRE(results.count() == 1);
+    CHECK(results[0].asDict()["doc"].asDict()["year"].asInt() == 1977);
+
+    // A long-poll feed waits for the next change:
+    thread writer([&] {
+        this_thread::sleep_for(chrono::milliseconds(200));
+        websocket::Headers headers;
+        headers.add("Content-Type"_sl, "application/json"_sl);
+        Response("PUT", "localhost", config.port, "/db/doc3")
+            .setHeaders(headers).setBody("{}"_sl).run();
+    });
+    fleece::Stopwatch st;
+    r = request("GET", "/db/_changes?feed=longpoll&since=2", HTTPStatus::OK);
+    writer.join();
+    CHECK(st.elapsedMS() >= 100);
+    body = r->bodyAsJSON().asDict();
+    results = body["results"].asArray();
+    REQUIRE(results.count() == 1);
+    CHECK(results[0].asDict()["id"].asString() == "doc3"_sl);
+    CHECK(body["last_seq"].asInt() == 3);
+
+    // A continuous feed sends a line per change, until it's idle for `timeout` ms:
+    r = request("GET", "/db/_changes?feed=continuous&since=1&timeout=200", HTTPStatus::OK);
+    vector<string> lines;
+    litecore::split(r->body().asString(), "\n", [&](const string &line) {
+        if (!line.empty())
+            lines.push_back(line);
+    });
+    REQUIRE(lines.size() == 3);
+    CHECK(Doc::fromJSON(lines[0]).asDict()["seq"].asInt() == 2);
+    CHECK(Doc::fromJSON(lines[1]).asDict()["seq"].asInt() == 3);
+    CHECK(Doc::fromJSON(lines[2]).asDict()["last_seq"].asInt() == 3);
+}
+
+
 TEST_CASE_METHOD(C4RESTTest, "REST _bulk_docs", "[REST][Listener][C]") {
     unique_ptr<Response> r;
     r = request("POST", "/db/_bulk_docs",
@@ -334,6 +436,128 @@ TEST_CASE_METHOD(C4RESTTest, "REST _bulk_docs", "[REST][Listener][C]") {
 }
 
 
+TEST_CASE_METHOD(C4RESTTest, "REST routing", "[REST][Listener][C]") {
+    // Path parameters are URL-decoded, and a docID extends to the end of the path:
+    request("PUT", "/db/a%20doc",
+            {{"Content-Type", "application/json"}},
+            "{\"year\": 1964}"_sl, HTTPStatus::Created);
+    request("PUT", "/db/a/nested/doc",
+            {{"Content-Type", "application/json"}},
+            "{\"year\": 1977}"_sl, HTTPStatus::Created);
+    auto r = request("GET", "/db/a%20doc", HTTPStatus::OK);
+    CHECK(r->bodyAsJSON().asDict()["_id"].asString() == "a doc"_sl);
+    r = request("GET", "/db/a/nested/doc", HTTPStatus::OK);
+    CHECK(r->bodyAsJSON().asDict()["_id"].asString() == "a/nested/doc"_sl);
+
+    request("GET", "/db/_bulk_docs", HTTPStatus::MethodNotAllowed);
+    request("POST", "/db/_nope", HTTPStatus::NotFound);
+    request("GET", "/_all_dbs/x", HTTPStatus::NotFound);
+}
+
+
+#pragma mark - CONNECTIONS:
+
+
+TEST_CASE_METHOD(C4RESTTest, "REST keep-alive and pipelining", "[REST][Listener][C]") {
+    auto socket = connectSocket();
+    REQUIRE(socket);
+    // Send three requests at once, then read the three responses in order:
+    string requests = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                      "GET /db HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                      "GET /nope HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    REQUIRE(socket->write_n(slice(requests)) == ssize_t(requests.size()));
+    websocket::Headers headers;
+    alloc_slice body;
+    CHECK(readResponse(*socket, headers, body) == 200);
+    CHECK(headers["Connection"_sl] == nullslice);
+    CHECK(Doc::fromJSON(body).asDict()["couchdb"].asString() == "Welcome"_sl);
+    CHECK(readResponse(*socket, headers, body) == 200);
+    CHECK(Doc::fromJSON(body).asDict()["db_name"].asString() == "db"_sl);
+    CHECK(readResponse(*socket, headers, body) == 404);
+
+    // The connection is still usable, until the client asks to close it:
+    requests = "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    REQUIRE(socket->write_n(slice(requests)) == ssize_t(requests.size()));
+    CHECK(readResponse(*socket, headers, body) == 200);
+    CHECK(headers["Connection"_sl] == "close"_sl);
+    char c;
+    CHECK(socket->read(&c, 1) == 0);
+}
+
+
+TEST_CASE_METHOD(C4RESTTest, "REST HTTP/1.0 closes connection", "[REST][Listener][C]") {
+    auto socket = connectSocket();
+    REQUIRE(socket);
+    string request = "GET / HTTP/1.0\r\n\r\n";
+    REQUIRE(socket->write_n(slice(request)) == ssize_t(request.size()));
+    websocket::Headers headers;
+    alloc_slice body;
+    CHECK(readResponse(*socket, headers, body) == 200);
+    CHECK(headers["Connection"_sl] == "close"_sl);
+    char c;
+    CHECK(socket->read(&c, 1) == 0);
+}
+
+
+TEST_CASE_METHOD(C4RESTTest, "REST concurrent load", "[REST][Listener][Perf][C][.]") {
+    // Each client sends pipelined batches of requests over a single keep-alive connection.
+    // (No more clients than server worker threads, else the server closes idle connections.)
+    static constexpr unsigned kClients = Server::kDefaultWorkerThreads;
+    static constexpr unsigned kBatches = 500, kPipelineDepth = 4;
+    static constexpr unsigned kRequests = kClients * kBatches * kPipelineDepth;
+
+    string batch;
+    for (unsigned i = 0; i < kPipelineDepth; ++i)
+        batch += "GET /db HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    vector<unique_ptr<ClientSocket>> sockets;
+    for (unsigned c = 0; c < kClients; ++c) {
+        sockets.push_back(connectSocket());
+        REQUIRE(sockets.back());
+    }
+
+    vector<vector<double>> latencies(kClients);
+    atomic<unsigned> failures {0};
+    fleece::Stopwatch st;
+    vector<thread> clients;
+    for (unsigned c = 0; c < kClients; ++c) {
+        clients.emplace_back([&, c] {
+            ClientSocket &socket = *sockets[c];
+            websocket::Headers headers;
+            alloc_slice body;
+            for (unsigned b = 0; b < kBatches; ++b) {
+                fleece::Stopwatch requestTime;
+                if (socket.write_n(slice(batch)) != ssize_t(batch.size())) {
+                    ++failures;
+                    return;
+                }
+                for (unsigned i = 0; i < kPipelineDepth; ++i) {
+                    if (readResponse(socket, headers, body) != 200) {
+                        ++failures;
+                        return;
+                    }
+                    latencies[c].push_back(requestTime.elapsedMS());
+                }
+            }
+        });
+    }
+    for (auto &client : clients)
+        client.join();
+    double elapsed = st.elapsed();
+    REQUIRE(failures == 0);
+
+    vector<double> all;
+    for (auto &l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    REQUIRE(all.size() == kRequests);
+    sort(all.begin(), all.end());
+    fprintf(stderr, "******** %u clients sent %u requests: %.0f req/sec; "
+                    "latency median %.3fms, p99 %.3fms, max %.3fms\n",
+            kClients, kRequests, kRequests / elapsed,
+            all[all.size() / 2], all[all.size() * 99 / 100], all.back());
+}
+
+
 #pragma mark - TLS:
 
 
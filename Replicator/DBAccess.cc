@@ -305,6 +305,115 @@ namespace litecore { namespace repl {
     }
 
 
+    // Returns the highest SharedKeys index used as a dict key in `value`, or -1 if none.
+    static int maxSharedKey(Value value) {
+        int maxKey = -1;
+        switch (value.type()) {
+            case kFLArray:
+                for (Array::iterator i(value.asArray()); i; ++i)
+                    maxKey = max(maxKey, maxSharedKey(i.value()));
+                break;
+            case kFLDict:
+                for (Dict::iterator i(value.asDict()); i; ++i) {
+                    Value key = i.key();
+                    if (key.isInteger())
+                        maxKey = max(maxKey, (int)key.asInt());
+                    maxKey = max(maxKey, maxSharedKey(i.value()));
+                }
+                break;
+            default:
+                break;
+        }
+        return maxKey;
+    }
+
+
+    bool DBAccess::sharedKeysForPeer(Dict root, unsigned firstKey,
+                                     unsigned &outCount, string &outProperty)
+    {
+        outCount = unsigned(maxSharedKey(root) + 1);
+        outProperty.clear();
+        if (outCount <= firstKey)
+            return true;
+        return use<bool>([&](C4Database *db) {
+            FLSharedKeys sk = c4db_getFLSharedKeys(db);
+            outProperty = to_string(firstKey) + ':';
+            for (unsigned key = firstKey; key < outCount; ++key) {
+                // (Decoding a key this handle hasn't seen yet makes it reload the SharedKeys.)
+                slice str = FLSharedKeys_Decode(sk, int(key));
+                if (!str)
+                    return false;
+                if (key > firstKey)
+                    outProperty += ',';
+                outProperty.append((const char*)str.buf, str.size);
+            }
+            return true;
+        });
+    }
+
+
+    // Adds the keys in a "sharedKeys" property to _peerSharedKeys. Must hold the mutex.
+    bool DBAccess::addPeerSharedKeys(slice property) {
+        auto colon = (const char*)property.findByte(':');
+        if (!colon)
+            return false;
+        slice first(property.buf, colon);
+        if (first.size == 0 || first.size > 9)
+            return false;
+        unsigned key = 0;
+        for (size_t i = 0; i < first.size; ++i) {
+            if (first[i] < '0' || first[i] > '9')
+                return false;
+            key = 10 * key + (first[i] - '0');
+        }
+
+        slice keys(colon + 1, property.end());
+        while (keys.size > 0) {
+            auto comma = (const char*)keys.findByte(',');
+            slice keyStr = comma ? slice(keys.buf, comma) : keys;
+            unsigned count = FLSharedKeys_Count(_peerSharedKeys);
+            if (key < count) {
+                // Already known (sent with an earlier rev); it had better match:
+                if (slice(FLSharedKeys_Decode(_peerSharedKeys, int(key))) != keyStr)
+                    return false;
+            } else if (key > count
+                       || FLSharedKeys_Encode(_peerSharedKeys, keyStr, true) != int(key)) {
+                return false;
+            }
+            ++key;
+            keys.setStart(comma ? comma + 1 : keys.end());
+        }
+        return true;
+    }
+
+
+    Doc DBAccess::decodePeerFleece(alloc_slice body, slice sharedKeysProperty,
+                                   C4Error *outError)
+    {
+        SharedKeys sk;
+        {
+            lock_guard<mutex> lock(_peerSharedKeysMutex);
+            if (!_peerSharedKeys)
+                _peerSharedKeys = SharedKeys::create();
+            if (sharedKeysProperty && !addPeerSharedKeys(sharedKeysProperty)) {
+                *outError = c4error_make(WebSocketDomain, 400,
+                                         "invalid sharedKeys property in revision"_sl);
+                return {};
+            }
+            sk = _peerSharedKeys;
+        }
+
+        Doc doc(body, kFLUntrusted, sk);
+        Dict root = doc.root().asDict();
+        if (!root || maxSharedKey(root) >= int(sk.count())) {
+            *outError = c4error_make(LiteCoreDomain, kC4ErrorCorruptRevisionData,
+                                     "invalid Fleece revision body"_sl);
+            return {};
+        }
+        return doc;
+    }
+
+
     Doc DBAccess::applyDelta(const C4Revision *baseRevision,
                              slice deltaJSON,
                              bool useDBSharedKeys,
@@ -136,6 +136,27 @@ namespace litecore { namespace repl {
             inside a transaction. */
         alloc_slice reEncodeForDatabase(fleece::Doc);
 
+        //////// FLEECE BODIES:
+
+        // A peer that's also LiteCore can send revision bodies as Fleece instead of JSON, saving
+        // an encode and a parse. Its dict keys may be integers from the peer database's
+        // SharedKeys, so the key strings are sent too, as a "sharedKeys" property of the form
+        // "first:key,key,...", listing every key from index `first` that the body uses.
+        // `first` is the number of keys the peer knows for certain the receiver already has.
+
+        /** Gets the database's shared keys from index `firstKey` up to the highest one used by
+            `root`, as a "sharedKeys" property value (empty if none are needed.) Sets `outCount`
+            to the number of keys the peer needs to know to read `root`. */
+        bool sharedKeysForPeer(Dict root, unsigned firstKey,
+                               unsigned &outCount, std::string &outProperty);
+
+        /** Parses a Fleece revision body sent by the peer, first adding the keys in its
+            "sharedKeys" property to the SharedKeys that mirrors the peer database's.
+            Like the result of tempEncodeJSON, the Doc must be passed to reEncodeForDatabase
+            before it's saved. */
+        fleece::Doc decodePeerFleece(alloc_slice body, slice sharedKeysProperty,
+                                     C4Error *outError);
+
         /** Equivalent of "use()", but accesses the database handle used for insertion. */
         template <class LAMBDA>
         void useForInsert(LAMBDA callback) {
@@ -192,6 +213,7 @@ namespace litecore { namespace repl {
         void markRevsSyncedLater();
         fleece::SharedKeys tempSharedKeys();
         bool updateTempSharedKeys();
+        bool addPeerSharedKeys(slice sharedKeysProperty);
         bool beginTransaction(C4Error*);
         bool endTransaction(bool commit, C4Error*);
         access_lock<C4Database*>& insertionDB();
@@ -200,6 +222,8 @@ namespace litecore { namespace repl {
         fleece::SharedKeys _tempSharedKeys;                 // Keys used in tempEncodeJSON()
         std::mutex _tempSharedKeysMutex;                    // Mutex for replacing _tempSharedKeys
         unsigned _tempSharedKeysInitialCount {0};           // Count when copied from db's keys
+        fleece::SharedKeys _peerSharedKeys;                 // Mirror of peer db's SharedKeys
+        std::mutex _peerSharedKeysMutex;                    // Mutex for _peerSharedKeys
         C4RemoteID _remoteDBID {0};                         // ID # of remote DB in revision store
         bool const _disableBlobSupport;                     // Does replicator support blobs?
         actor::Batcher<ReplicatedRev> _revsToMarkSynced;    // Pending revs to be marked as synced
@@ -41,11 +41,23 @@ namespace litecore { namespace repl {
     :Worker(repl, "Insert")
     ,_revsToInsert(this, &Inserter::_insertRevisionsNow,
                    tuning::kInsertionDelay, tuning::kInsertionBatchSize)
+    ,_tuner(tuning::kInsertionBatchSize, tuning::kInsertionDelay)
     {
         _passive = _options.pull <= kC4Passive;
     }
 
 
+    Inserter::~Inserter() {
+        auto stats = _tuner.stats();
+        if (stats.batches > 0)
+            logInfo("Inserted %" PRIu64 " revs in %" PRIu64 " batches; batch size grew %u times "
+                    "and shrank %u times, ending at %zu revs / %.0fms; commits took %.0f%% of the time",
+                    stats.revs, stats.batches, stats.growths, stats.shrinks, stats.batchSize,
+                    chrono::duration<double, milli>(stats.delay).count(),
+                    _tuner.commitFraction() * 100);
+    }
+
+
     void Inserter::insertRevision(RevToInsert *rev) {
         _revsToInsert.push(rev);
     }
@@ -68,26 +80,26 @@ namespace litecore { namespace repl {
             // of them apply to the docs we're updating:
             _db->markRevsSyncedNow();
 
+            // Revisions are saved in batches by c4doc_putBatch, but a purge has to go through
+            // on its own, after any puts queued before it:
+            vector<RevToInsert*> puts;
             for (RevToInsert *rev : *revs) {
-                C4Error docErr;
-                bool docSaved = insertRevisionNow(rev, &docErr);
-                rev->trimBody();                // don't need body any more
-                if (docSaved) {
-                    rev->owner->revisionProvisionallyInserted();
+                if (rev->flags & kRevPurged) {
+                    insertRevisionsNow(puts);
+                    puts.clear();
+                    C4Error docErr;
+                    bool purged = purgeRevisionNow(rev, &docErr);
+                    revisionInsertionDone(rev, purged, docErr);
                 } else {
-                    // Notify owner of a rev that failed:
-                    alloc_slice desc = c4error_getDescription(docErr);
-                    warn("Failed to insert '%.*s' #%.*s : %.*s",
-                         SPLAT(rev->docID), SPLAT(rev->revID), SPLAT(desc));
-                    rev->error = docErr;
-                    rev->owner->revisionInserted();
+                    puts.push_back(rev);
                 }
             }
+            insertRevisionsNow(puts);
 
             Stopwatch stCommit;
             if (transaction.commit(&transactionErr))
                 transactionErr = {};
-            commitTime = st.elapsed();
+            commitTime = stCommit.elapsed();
         }
 
         if (transactionErr.code != 0)
@@ -107,38 +119,110 @@ namespace litecore { namespace repl {
             double t = st.elapsed();
             logInfo("Inserted %3zu revs in %6.2fms (%5.0f/sec) of which %4.1f%% was commit",
                     revs->size(), t*1000, revs->size()/t, commitTime/t*100);
+            if (_tuner.batchInserted(revs->size(), t, commitTime)) {
+                _revsToInsert.setCapacity(_tuner.batchSize());
+                _revsToInsert.setLatency(_tuner.delay());
+                logInfo("Insertion batch size is now %zu revs / %.0fms (commits take %.0f%% of %.2fms)",
+                        _tuner.batchSize(), chrono::duration<double, milli>(_tuner.delay()).count(),
+                        _tuner.commitFraction() * 100, t * 1000);
+            }
         }
     }
 
 
-    bool Inserter::insertRevisionNow(RevToInsert *rev, C4Error *outError) {
-        if (rev->flags & kRevPurged) {
-            // Server says the document is no longer accessible, i.e. it's been
-            // removed from all channels the client has access to. Purge it.
-            bool purged;
-            _db->useForInsert([&](C4Database *idb) {
-                purged = c4db_purgeDoc(idb, rev->docID, outError);
-            });
-            if (purged)
-                logVerbose("    {'%.*s' removed (purged)}", SPLAT(rev->docID));
-            else if (outError->domain == LiteCoreDomain && outError->code == kC4ErrorNotFound)
-                purged = true;
-            return purged;
+    // Adjusts the batch size and delay after a batch has been inserted. If commits dominate the
+    // insertion time, bigger batches amortize them better, but only if batches are actually
+    // filling up; if a transaction takes too long it's holding up other database users.
+    bool InsertionTuner::batchInserted(size_t revCount, double time, double commitTime) {
+        ++_batchCount;
+        _revCount += revCount;
+        double fraction = commitTime / time;
+        if (_commitFraction < 0)
+            _commitFraction = fraction;
+        else
+            _commitFraction += 0.25 * (fraction - _commitFraction);
+
+        size_t capacity = _batchSize;
+        duration delay = _delay;
+        size_t newCapacity = capacity;
+        duration newDelay = delay;
+        if (time > tuning::kMaxInsertionTransactionTime
+                || _commitFraction < tuning::kMinInsertionCommitFraction) {
+            newCapacity = max(capacity * 3 / 4, tuning::kMinInsertionBatchSize);
+            newDelay = max(delay * 3 / 4, tuning::kMinInsertionDelay);
+        } else if (_commitFraction > tuning::kMaxInsertionCommitFraction && revCount >= capacity) {
+            newCapacity = min(capacity * 2, tuning::kMaxInsertionBatchSize);
+            newDelay = min(delay * 3 / 2, tuning::kMaxInsertionDelay);
+        }
 
+        if (newCapacity == capacity && newDelay == delay)
+            return false;
+        if (newCapacity > capacity || newDelay > delay)
+            ++_growths;
+        else
+            ++_shrinks;
+        _batchSize = newCapacity;
+        _delay = newDelay;
+        return true;
+    }
+
+
+    // Called after a revision has been saved (or failed to be) in _insertRevisionsNow().
+    void Inserter::revisionInsertionDone(RevToInsert *rev, bool saved, C4Error docErr) {
+        rev->trimBody();                // don't need body any more
+        if (saved) {
+            rev->owner->revisionProvisionallyInserted();
         } else {
-            // Set up the parameter block for c4doc_put():
-            vector<C4String> history = rev->history();
-            C4DocPutRequest put = {};
+            // Notify owner of a rev that failed:
+            alloc_slice desc = c4error_getDescription(docErr);
+            warn("Failed to insert '%.*s' #%.*s : %.*s",
+                 SPLAT(rev->docID), SPLAT(rev->revID), SPLAT(desc));
+            rev->error = docErr;
+            rev->owner->revisionInserted();
+        }
+    }
+
+
+    bool Inserter::purgeRevisionNow(RevToInsert *rev, C4Error *outError) {
+        // Server says the document is no longer accessible, i.e. it's been
+        // removed from all channels the client has access to. Purge it.
+        bool purged;
+        _db->useForInsert([&](C4Database *idb) {
+            purged = c4db_purgeDoc(idb, rev->docID, outError);
+        });
+        if (purged)
+            logVerbose("    {'%.*s' removed (purged)}", SPLAT(rev->docID));
+        else if (outError->domain == LiteCoreDomain && outError->code == kC4ErrorNotFound)
+            purged = true;
+        return purged;
+    }
+
+
+    // Saves a run of (non-purged) revisions with a single call to c4doc_putBatch().
+    void Inserter::insertRevisionsNow(const vector<RevToInsert*> &revs) {
+        if (revs.empty())
+            return;
+        size_t n = revs.size();
+
+        // Set up the parameter blocks for c4doc_putBatch(). The histories and bodies they point
+        // to have to stay alive until it returns:
+        vector<vector<C4String>> histories(n);
+        vector<alloc_slice> bodies(n);
+        vector<C4DocPutRequest> puts(n);
+        for (size_t i = 0; i < n; ++i) {
+            RevToInsert *rev = revs[i];
+            histories[i] = rev->history();
+            C4DocPutRequest &put = puts[i];
             put.docID = rev->docID;
             put.revFlags = rev->flags;
             put.existingRevision = true;
             put.allowConflict = !rev->noConflicts;
-            put.history = history.data();
-            put.historyCount = history.size();
+            put.history = histories[i].data();
+            put.historyCount = histories[i].size();
             put.remoteDBID = _db->remoteDBID();
             put.save = true;
 
-            alloc_slice bodyForDB;
+            alloc_slice &bodyForDB = bodies[i];
             if (rev->deltaSrc) {
                 // If this is a delta, put the JSON delta in the put-request:
                 bodyForDB = move(rev->deltaSrc);
@@ -160,26 +244,34 @@ namespace litecore { namespace repl {
                     put.revFlags |= kRevKeepBody;
             }
             put.allocedBody = {(void*)bodyForDB.buf, bodyForDB.size};
+        }
 
-            // The save!!
-            return _db->useForInsert<bool>([&](C4Database *db) {
-                c4::ref<C4Document> doc = c4doc_put(db, &put, nullptr, outError);
-                if (!doc)
-                    return false;
+        // The save!!
+        vector<C4DocPutResult> results(n);
+        C4Error batchErr;
+        bool ok = _db->useForInsert<bool>([&](C4Database *db) {
+            return c4doc_putBatch(db, puts.data(), n, results.data(), &batchErr);
+        });
+
+        for (size_t i = 0; i < n; ++i) {
+            RevToInsert *rev = revs[i];
+            C4Error docErr = ok ? results[i].error : batchErr;
+            bool saved = (docErr.code == 0);
+            if (saved) {
                 logVerbose("    {'%.*s' #%.*s <- %.*s} seq %" PRIu64,
                            SPLAT(rev->docID), SPLAT(rev->revID), SPLAT(rev->historyBuf),
-                           doc->selectedRev.sequence);
-                rev->sequence = doc->selectedRev.sequence;
-                if (doc->selectedRev.flags & kRevIsConflict) {
+                           results[i].sequence);
+                rev->sequence = results[i].sequence;
+                if (results[i].revFlags & kRevIsConflict) {
                     // Note that rev was inserted but caused a conflict:
                     logInfo("Created conflict with '%.*s' #%.*s",
                             SPLAT(rev->docID), SPLAT(rev->revID));
                     rev->flags |= kRevIsConflict;
                     rev->isWarning = true;
-                    DebugAssert(put.allowConflict);
+                    DebugAssert(puts[i].allowConflict);
                 }
-                return true;
-            });
+            }
+            revisionInsertionDone(rev, saved, docErr);
         }
     }
 
@@ -19,11 +19,55 @@
 #pragma once
 #include "Worker.hh"
 #include "Batcher.hh"
+#include <atomic>
 
 namespace litecore { namespace repl {
     class Replicator;
     class RevToInsert;
 
+    /** Adapts the Inserter's batch size and delay to how long its transactions and commits
+        take. (See the tuning constants in ReplicatorTuning.hh.) */
+    class InsertionTuner {
+    public:
+        using duration = actor::Timer::duration;
+
+        struct Stats {
+            size_t   batchSize;         ///< Max number of revs inserted in one transaction
+            duration delay;             ///< Max time a rev waits before being inserted
+            uint64_t batches;           ///< Number of transactions committed
+            uint64_t revs;              ///< Number of revs inserted
+            unsigned growths;           ///< Number of times the batch size/delay were raised
+            unsigned shrinks;           ///< Number of times the batch size/delay were lowered
+        };
+
+        InsertionTuner(size_t batchSize, duration delay)
+        :_batchSize(batchSize), _delay(delay) { }
+
+        size_t batchSize() const                        {return _batchSize;}
+        duration delay() const                          {return _delay;}
+
+        /** Moving average of the fraction of the insertion time spent committing. */
+        double commitFraction() const                   {return _commitFraction;}
+
+        /** Call after a transaction inserting `revCount` revs has committed. `time` is the
+            total time it took, and `commitTime` the time the commit took, in seconds.
+            Returns true if the batch size or delay changed. */
+        bool batchInserted(size_t revCount, double time, double commitTime);
+
+        /** Returns the current parameters and statistics. Safe to call on any thread. */
+        Stats stats() const {
+            return {_batchSize, _delay, _batchCount, _revCount, _growths, _shrinks};
+        }
+
+    private:
+        std::atomic<size_t> _batchSize;
+        std::atomic<duration> _delay;
+        double _commitFraction {-1};
+        std::atomic<uint64_t> _batchCount {0}, _revCount {0};
+        std::atomic<unsigned> _growths {0}, _shrinks {0};
+    };
+
+
     /** Inserts revisions into the database in batches. */
     class Inserter : public Worker {
     public:
@@ -31,14 +75,24 @@ namespace litecore { namespace repl {
 
         void insertRevision(RevToInsert* NONNULL);
 
+        /** The current (adaptive) batching parameters, and how they've changed.
+            Safe to call on any thread. */
+        InsertionTuner::Stats stats() const             {return _tuner.stats();}
+
+    protected:
+        ~Inserter();
+
     private:
         void _insertRevisionsNow(int gen);
-        bool insertRevisionNow(RevToInsert* NONNULL, C4Error*);
+        void insertRevisionsNow(const std::vector<RevToInsert*>&);
+        bool purgeRevisionNow(RevToInsert* NONNULL, C4Error*);
+        void revisionInsertionDone(RevToInsert* NONNULL, bool saved, C4Error);
         C4SliceResult applyDeltaCallback(const C4Revision *baseRevision NONNULL,
                                          C4Slice deltaJSON,
                                          C4Error *outError);
 
         actor::ActorBatcher<Inserter,RevToInsert> _revsToInsert; // Pending revs to be added to db
+        InsertionTuner _tuner;                  // Adapts _revsToInsert's latency & capacity
     };
 
 } }
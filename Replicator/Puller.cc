@@ -352,6 +352,11 @@ namespace litecore { namespace repl {
     }
 
 
+    InsertionTuner::Stats Puller::insertionStats() const {
+        return _inserter->stats();
+    }
+
+
 #pragma mark - STATUS / PROGRESS:
 
 
@@ -47,6 +47,8 @@ namespace litecore { namespace repl {
 
         void insertRevision(RevToInsert *rev NONNULL);
 
+        InsertionTuner::Stats insertionStats() const;
+
     protected:
         virtual void _childChangedStatus(Worker *task NONNULL, Status) override;
         virtual ActivityLevel computeActivityLevel() const override;
@@ -315,11 +315,22 @@ namespace litecore { namespace repl {
             // Delta compression:
             alloc_slice delta = createRevisionDelta(doc, request, root, revisionBody.size,
                                                     sendLegacyAttachments);
+            string sharedKeys;
             if (delta) {
                 msg["deltaSrc"_sl] = doc->selectedRev.revID;
                 msg.jsonBody().writeRaw(delta);
             } else if (root.empty()) {
                 msg.write("{}"_sl);
+            } else if (request->fleeceOK && !sendLegacyAttachments
+                           && _db->sharedKeysForPeer(root, _peerSharedKeyCount,
+                                                     request->sharedKeyCount, sharedKeys)) {
+                // The peer is LiteCore, so send the stored Fleece body as-is, along with any
+                // shared keys it uses that the peer may not have yet:
+                msg["fleece"_sl] = "true"_sl;
+                if (!sharedKeys.empty())
+                    msg["sharedKeys"_sl] = slice(sharedKeys);
+                msg.write(revisionBody);
+                ++_revsSentAsFleece;
             } else {
                 auto &bodyEncoder = msg.jsonBody();
                 if (sendLegacyAttachments)
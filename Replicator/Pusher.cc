@@ -289,6 +289,8 @@ namespace litecore { namespace repl {
             if (!_deltasOK && reply->boolProperty("deltas"_sl)
                            && !_options.properties[kC4ReplicatorOptionDisableDeltas].asBool())
                 _deltasOK = true;
+            if (!_fleeceOK && reply->boolProperty("fleece"_sl) && !_options.disableFleeceBodies())
+                _fleeceOK = true;
 
             // The response body consists of an array that parallels the `changes` array I sent:
             auto requests = reply->JSONBody().asArray();
@@ -296,6 +298,7 @@ namespace litecore { namespace repl {
             for (RevToSend *change : *changes) {
                 bool queued = false, synced = false;
                 change->deltaOK = _deltasOK;
+                change->fleeceOK = _fleeceOK;
                 if (proposedChanges) {
                     // Entry in "proposeChanges" response is a status code, with 0 for OK:
                     int status = (int)requests[index].asInt();
@@ -397,6 +400,8 @@ namespace litecore { namespace repl {
                 if (synced) {
                     logVerbose("Completed rev %.*s #%.*s (seq #%" PRIu64 ")",
                                SPLAT(rev->docID), SPLAT(rev->revID), rev->sequence);
+                    // The peer has now added any shared keys that were sent with the rev:
+                    _peerSharedKeyCount = max(_peerSharedKeyCount, rev->sharedKeyCount);
                     finishedDocument(rev);
                     completed = true;
                 } else {
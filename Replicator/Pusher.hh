@@ -43,6 +43,9 @@ namespace litecore { namespace repl {
             _checkpointValid = false;
         }
 
+        /** The number of revisions whose bodies have been sent as Fleece instead of JSON. */
+        unsigned revsSentAsFleece() const   {return _revsSentAsFleece;}
+
     protected:
         virtual void afterEvent() override;
 
@@ -105,6 +108,9 @@ namespace litecore { namespace repl {
         bool _started {false};
         bool _caughtUp {false};                   // Received backlog of existing changes?
         bool _deltasOK {false};                   // OK to send revs in delta form?
+        bool _fleeceOK {false};                   // OK to send rev bodies as Fleece?
+        unsigned _peerSharedKeyCount {0};         // # of my db's shared keys the peer has
+        std::atomic<unsigned> _revsSentAsFleece {0}; // # revs sent with Fleece bodies
         unsigned _changeListsInFlight {0};        // # change lists being requested from db or sent to peer
         unsigned _revisionsInFlight {0};          // # 'rev' messages being sent
         MessageSize _revisionBytesAwaitingReply {0}; // # 'rev' message bytes sent but not replied
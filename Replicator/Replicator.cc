@@ -400,6 +400,14 @@ namespace litecore { namespace repl {
 
         _checkpointer.stopAutosave();
 
+        if (connected()) {
+            _flowStats = connection().flowStats();
+            logInfo("BLIP flow control ended with window %u bytes, frames %zu bytes, RTT %.1fms",
+                    _flowStats.window, _flowStats.frameSize, _flowStats.rtt * 1000);
+            if (_puller)
+                _insertionStats = _puller->insertionStats();
+        }
+
         // Clear connection() and notify the other agents to do the same:
         _connectionClosed();
         if (_pusher)
@@ -437,6 +445,21 @@ namespace litecore { namespace repl {
     }
 
 
+    blip::FlowControl::Stats Replicator::flowStats() const {
+        return connected() ? connection().flowStats() : _flowStats;
+    }
+
+
+    InsertionTuner::Stats Replicator::insertionStats() const {
+        return (connected() && _puller) ? _puller->insertionStats() : _insertionStats;
+    }
+
+
+    unsigned Replicator::revsSentAsFleece() const {
+        return _pusher ? _pusher->revsSentAsFleece() : 0;
+    }
+
+
     // This only gets called if none of the registered handlers were triggered.
     void Replicator::_onRequestReceived(Retained<MessageIn> msg) {
         warn("Received unrecognized BLIP request #%" PRIu64 " with Profile '%.*s', %zu bytes",
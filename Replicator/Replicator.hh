@@ -19,6 +19,7 @@
 #pragma once
 #include "Worker.hh"
 #include "Checkpointer.hh"
+#include "Inserter.hh"
 #include "ReplicatedRev.hh"
 #include "BLIPConnection.hh"
 #include "Batcher.hh"
@@ -100,8 +101,17 @@ namespace litecore { namespace repl {
         /** Checks if the document with the given ID has any pending revisions to push */
         bool isDocumentPending(slice docId, C4Error* outErr);
 
+        /** The BLIP connection's current flow-control window, frame size and round-trip time;
+            after the connection closes, their final values. */
+        blip::FlowControl::Stats flowStats() const;
+
+        /** The puller's current insertion batch size and delay, and how often they've been
+            adjusted; after the connection closes, their final values. */
+        InsertionTuner::Stats insertionStats() const;
+
         // exposed for unit tests:
         websocket::WebSocket* webSocket() const {return connection().webSocket();}
+        unsigned revsSentAsFleece() const;
         
         Checkpointer& checkpointer()            {return _checkpointer;}
 
@@ -166,6 +176,8 @@ namespace litecore { namespace repl {
         
         const websocket::URL _remoteURL;
         CloseStatus _closeStatus;
+        blip::FlowControl::Stats _flowStats {};
+        InsertionTuner::Stats _insertionStats {};
         Delegate* _delegate;
         Retained<Pusher> _pusher;
         Retained<Puller> _puller;
@@ -40,6 +40,20 @@ namespace litecore { namespace repl {
            if the queue size hasn't reached kInsertionBatchSize yet. */
         constexpr actor::Timer::duration kInsertionDelay = std::chrono::milliseconds(20);
 
+        /* The above two are only the starting values: the Inserter adapts them to the storage
+           it's running on. When commits take more than kMaxInsertionCommitFraction of the
+           insertion time, and batches fill up, it grows the batch size and delay; when a batch's
+           transaction takes longer than kMaxInsertionTransactionTime (blocking other writers
+           and checkpointing readers), or commits take less than kMinInsertionCommitFraction,
+           it shrinks them. They always stay within these bounds: */
+        constexpr size_t kMinInsertionBatchSize = 20;
+        constexpr size_t kMaxInsertionBatchSize = 2000;
+        constexpr actor::Timer::duration kMinInsertionDelay = std::chrono::milliseconds(5);
+        constexpr actor::Timer::duration kMaxInsertionDelay = std::chrono::milliseconds(250);
+        constexpr double kMinInsertionCommitFraction = 0.10;
+        constexpr double kMaxInsertionCommitFraction = 0.40;
+        constexpr double kMaxInsertionTransactionTime = 0.100; // seconds
+
         /* Minimum document body size that will be considered for delta compression.
             (This is the size of the Fleece encoding, which is usually smaller than the JSON.)
            This is not declared `constexpr`, so that the delta-sync unit tests can change it. */
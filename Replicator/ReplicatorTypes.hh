@@ -81,6 +81,8 @@ namespace litecore { namespace repl {
         bool            noConflicts {false};        // Server is in no-conflicts mode
         bool            legacyAttachments {false};  // Add _attachments property when sending
         bool            deltaOK {false};            // Can send a delta
+        bool            fleeceOK {false};           // Can send the body as Fleece
+        unsigned        sharedKeyCount {0};         // # of my shared keys the body needs
         int8_t          retryCount {0};             // Number of times this revision has been retried
         std::unique_ptr<std::set<alloc_slice>> ancestorRevIDs; // Known ancestor revIDs the peer already has
 
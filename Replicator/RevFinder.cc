@@ -76,6 +76,11 @@ namespace litecore { namespace repl {
             response["deltas"_sl] = "true"_sl;
             _announcedDeltaSupport = true;
         }
+        if ( !_announcedFleeceSupport && !_options.disableFleeceBodies()) {
+            // Tells a LiteCore peer it can send revision bodies as Fleece (other peers ignore it)
+            response["fleece"_sl] = "true"_sl;
+            _announcedFleeceSupport = true;
+        }
 
         Stopwatch st;
 
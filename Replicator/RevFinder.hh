@@ -49,6 +49,7 @@ namespace litecore { namespace repl {
         void updateRemoteRev(slice docID, slice revID);
 
         bool _announcedDeltaSupport {false};                // Did I send "deltas:true" yet?
+        bool _announcedFleeceSupport {false};               // Did I send "fleece:true" yet?
     };
 
 } }
@@ -42,6 +42,77 @@ TEST_CASE("Options password logging redaction") {
     CHECK(str.find(password) == string::npos);
 }
 
+
+TEST_CASE("Inserter batch tuning", "[Pull]") {
+    using namespace tuning;
+    InsertionTuner tuner(kInsertionBatchSize, kInsertionDelay);
+
+    // Commits dominate, and the batch filled up: grow.
+    CHECK(tuner.batchInserted(kInsertionBatchSize, 0.010, 0.008));
+    CHECK(tuner.batchSize() == 2 * kInsertionBatchSize);
+    CHECK(tuner.delay() == kInsertionDelay * 3 / 2);
+
+    // Commits dominate, but the batch didn't fill up: no change.
+    CHECK(!tuner.batchInserted(kInsertionBatchSize, 0.010, 0.008));
+    CHECK(tuner.batchSize() == 2 * kInsertionBatchSize);
+
+    // The transaction took too long: shrink.
+    CHECK(tuner.batchInserted(2 * kInsertionBatchSize, 0.200, 0.160));
+    CHECK(tuner.batchSize() == 2 * kInsertionBatchSize * 3 / 4);
+    CHECK(tuner.delay() == kInsertionDelay * 3 / 2 * 3 / 4);
+
+    auto stats = tuner.stats();
+    CHECK(stats.batches == 3);
+    CHECK(stats.revs == 4 * kInsertionBatchSize);
+    CHECK(stats.growths == 1);
+    CHECK(stats.shrinks == 1);
+
+    // Growth stops at the upper bounds:
+    for (int i = 0; i < 20; ++i)
+        tuner.batchInserted(tuner.batchSize(), 0.010, 0.008);
+    CHECK(tuner.batchSize() == kMaxInsertionBatchSize);
+    CHECK(tuner.delay() == kMaxInsertionDelay);
+
+    // Cheap commits make it shrink, down to the lower bounds:
+    for (int i = 0; i < 50; ++i)
+        tuner.batchInserted(tuner.batchSize(), 0.010, 0.0);
+    CHECK(tuner.commitFraction() < kMinInsertionCommitFraction);
+    CHECK(tuner.batchSize() == kMinInsertionBatchSize);
+    CHECK(tuner.delay() == kMinInsertionDelay);
+    CHECK(tuner.stats().shrinks > 1);
+}
+
+
+TEST_CASE("BLIP flow control minimum RTT", "[Push]") {
+    using namespace litecore::blip;
+    FlowControl flow;
+    auto now = FlowControl::clock::now();
+    auto ack = [&](int rttMs) {
+        now += chrono::milliseconds(10);
+        flow.receivedAck(50000, now - chrono::milliseconds(rttMs), now);
+    };
+
+    // An uncongested link with a 50ms round trip:
+    for (int i = 0; i < 100; ++i)
+        ack(50);
+    CHECK(flow.stats().minRTT == Approx(0.050));
+    CHECK(flow.window() > FlowControl::kMinWindow);
+
+    // A queue builds up, adding 450ms. When the minimum RTT expires, the inflated samples
+    // aren't adopted; instead the window shrinks so the queue can drain:
+    for (int i = 0; i < 1050; ++i)
+        ack(500);
+    CHECK(flow.stats().minRTT == Approx(0.050));
+    CHECK(flow.window() == FlowControl::kMinWindow);
+
+    // Once it's drained, the lowest RTT seen becomes the new minimum:
+    for (int i = 0; i < 200; ++i)
+        ack(60);
+    CHECK(flow.stats().minRTT == Approx(0.060));
+    CHECK(flow.window() > FlowControl::kMinWindow);
+}
+
+
 TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push replication from prebuilt database", "[Push]") {
     createRev("doc"_sl, kRevID, kEmptyFleeceBody);
     _expectedDocumentCount = 1;
@@ -235,6 +306,60 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push large database no-conflicts", "[P
 }
 
 
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push large database performance", "[Push][Perf][.]") {
+    importJSONLines(sFixturesDir + "iTunesMusicLibrary.json");
+    _expectedDocumentCount = 12189;
+    Stopwatch st;
+    runPushReplication();
+    double elapsed = st.elapsed();
+    Log("Pushed %lld docs in %.3f sec (%.0f docs/sec)",
+        (long long)_expectedDocumentCount, elapsed, _expectedDocumentCount / elapsed);
+    compareDatabases();
+}
+
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Fleece bodies", "[Push]") {
+    // Between LiteCore peers, revs are sent as Fleece by default:
+    importJSONLines(sFixturesDir + "names_100.json");
+    _expectedDocumentCount = 100;
+    runReplicators(Replicator::Options::pushing(kC4OneShot), Replicator::Options::passive());
+    compareDatabases();
+    validateCheckpoints(db, db2, "{\"local\":100}");
+    CHECK(_clientRevsSentAsFleece == 100);
+}
+
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push JSON bodies", "[Push]") {
+    // Revs are normally sent as Fleece between LiteCore peers; make sure JSON still works.
+    importJSONLines(sFixturesDir + "names_100.json");
+    _expectedDocumentCount = 100;
+    runReplicators(Replicator::Options::pushing(kC4OneShot),
+                   Replicator::Options::passive().setNoFleeceBodies());
+    compareDatabases();
+    validateCheckpoints(db, db2, "{\"local\":100}");
+    CHECK(_clientRevsSentAsFleece == 0);
+}
+
+
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Fleece vs JSON bodies performance", "[Push][Perf][.]") {
+    importJSONLines(sFixturesDir + "iTunesMusicLibrary.json");
+    _expectedDocumentCount = 12189;
+    auto serverOpts = Replicator::Options::passive();
+    const char *format = "Fleece";
+    SECTION("JSON") {
+        serverOpts.setNoFleeceBodies();
+        format = "JSON";
+    }
+    SECTION("Fleece") { }
+    Stopwatch st;
+    runReplicators(Replicator::Options::pushing(kC4OneShot), serverOpts);
+    double elapsed = st.elapsed();
+    Log("Pushed %lld revs as %s in %.3f sec (%.0f revs/sec)",
+        (long long)_expectedDocumentCount, format, elapsed, _expectedDocumentCount / elapsed);
+    compareDatabases();
+}
+
+
 TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull large database no-conflicts", "[Pull][NoConflicts]") {
     auto serverOpts = Replicator::Options::passive().setNoIncomingConflicts();
 
@@ -258,6 +383,13 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Pull Small Non-Empty DB", "[Pull]") {
     runPullReplication();
     compareDatabases();
     validateCheckpoints(db2, db, "{\"remote\":100}");
+
+    // The client's Inserter stats are surfaced through the Replicator:
+    auto stats = _clientInsertionStats;
+    CHECK(stats.revs == 100);
+    CHECK(stats.batches >= 1);
+    CHECK(stats.batchSize >= tuning::kMinInsertionBatchSize);
+    CHECK(stats.batchSize <= tuning::kMaxInsertionBatchSize);
 }
 
 
@@ -792,6 +924,34 @@ TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Uncompressible Blob", "[Push][blo
 }
 
 
+TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Large Blob Adapts Flow Control", "[Push][blob]") {
+    // The loopback WebSockets add kLatency each way, so the default BLIP window (128000 bytes
+    // per round trip) would limit throughput; it should grow to fit the link.
+    string blob(4 * 1024 * 1024, '\0');
+    for (auto &c : blob)
+        c = char(RandomNumber());
+    vector<string> attachments = {blob};
+    vector<C4BlobKey> blobKeys;
+    {
+        TransactionHelper t(db);
+        blobKeys = addDocWithAttachments("att1"_sl, attachments, "application/octet-stream");
+        _expectedDocumentCount = 1;
+    }
+    runPushReplication();
+    compareDatabases();
+    checkAttachments(db2, blobKeys, attachments);
+
+    auto flow = _clientFlowStats;
+    Log("Flow control: window %u, frame size %zu, RTT %.1fms (min %.1fms), rate %.0f KB/sec",
+        flow.window, flow.frameSize, flow.rtt * 1000, flow.minRTT * 1000, flow.deliveryRate / 1024);
+    CHECK(flow.minRTT >= chrono::duration<double>(kLatency).count());
+    CHECK(flow.window > blip::FlowControl::kMinWindow);
+    CHECK(flow.window <= blip::FlowControl::kMaxWindow);
+    CHECK(flow.frameSize >= blip::FlowControl::kMinFrameSize);
+    CHECK(flow.frameSize <= blip::FlowControl::kMaxFrameSize);
+}
+
+
 TEST_CASE_METHOD(ReplicatorLoopbackTest, "Push Blobs Legacy Mode", "[Push][blob]") {
     vector<string> attachments = {"Hey, this is an attachment!", "So is this", ""};
     vector<C4BlobKey> blobKeys;
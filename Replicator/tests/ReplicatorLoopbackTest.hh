@@ -269,6 +269,9 @@ public:
         if (repl == _replClient) {
             Log(">> Replicator closed with code=%d/%d, message=%.*s",
                 status.reason, status.code, SPLAT(status.message));
+            _clientFlowStats = repl->flowStats();
+            _clientInsertionStats = repl->insertionStats();
+            _clientRevsSentAsFleece = repl->revsSentAsFleece();
         }
     }
 
@@ -531,6 +534,9 @@ public:
     int64_t _expectedUnitsComplete {-1};
     C4Error _expectedError {};
     set<string> _docPushErrors, _docPullErrors;
+    blip::FlowControl::Stats _clientFlowStats {};
+    InsertionTuner::Stats _clientInsertionStats {};
+    unsigned _clientRevsSentAsFleece {0};
     set<string> _expectedDocPushErrors, _expectedDocPullErrors;
     bool _checkDocsFinished {true};
     multiset<string> _docsFinished, _expectedDocsFinished;
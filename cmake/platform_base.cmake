@@ -27,9 +27,11 @@ function(set_litecore_source_base)
         LiteCore/BlobStore/BlobStore.cc
         LiteCore/BlobStore/Stream.cc
         LiteCore/Database/BackgroundDB.cc
+        LiteCore/Database/BlobReferences.cc
         LiteCore/Database/Database.cc
         LiteCore/Database/Document.cc
         LiteCore/Database/Housekeeper.cc
+        LiteCore/Database/IndexBuilder.cc
         LiteCore/Database/LeafDocument.cc
         LiteCore/Database/LegacyAttachments.cc
         LiteCore/Database/LiveQuerier.cc
@@ -37,9 +39,11 @@ function(set_litecore_source_base)
         LiteCore/Database/SequenceTracker.cc
         LiteCore/Database/TreeDocument.cc
         LiteCore/Database/Upgrader.cc 
+        LiteCore/Query/DFARegex.cc
         LiteCore/Query/IndexSpec.cc
         LiteCore/Query/PredictiveModel.cc
         LiteCore/Query/Query.cc
+        LiteCore/Query/QueryCache.cc
         LiteCore/Query/QueryParser+Prediction.cc
         LiteCore/Query/QueryParser.cc
         LiteCore/Query/SQLiteDataFile+Indexes.cc